@@ -7,21 +7,59 @@ Generates plots for:
 - Exercise 1: Loop Unrolling Optimization
 - Exercise 3: Vector Operations with Amdahl's and Gustafson's Laws
 - Exercise 4: Matrix Operations with Amdahl's and Gustafson's Laws
+
+The plots use the latest structured results of the benchmarks (written
+when TP2_RESULTS is set, see common/results.h) and fall back to the
+numbers of results.md when a benchmark has not been run.
+
+Usage:
+  python3 analysis.py [plot]                     # regenerate the plots
+  python3 analysis.py ingest [--results F] [--history F] [--compiler CC]
+  python3 analysis.py check [--threshold PCT] [--baseline-runs K] [--alpha A]
+  python3 analysis.py variants [--input variants.csv] [--reference V] [--top K]
+  python3 analysis.py simulate [--calibration F] [--samples K] [--max-p P] [--plot]
+
+`ingest` files bench_results.csv into bench_history.csv under a run keyed
+by commit, host and compiler; `check` compares the latest run with the
+previous runs of the same host and compiler and exits with status 1 when
+a kernel regressed (`make bench-check` in the project root does both).
+`variants` ranks the build variants measured by variants.sh per kernel
+and per benchmark. `simulate` replays the exercise3 and exercise4 task
+graphs with the fork/join, per-task, bandwidth and imbalance costs
+measured by exercise4_calibrate and predicts their speedup curves, with
+error bars, against the measured multithreaded runs.
 """
 
-import matplotlib.pyplot as plt
-import numpy as np
+import argparse
+import csv
+import math
 import os
+import platform
+import re
+import subprocess
+import sys
+import time
+from collections import defaultdict
+
+# Plotting libraries are only needed by the plot command
+try:
+    import matplotlib
+    matplotlib.use('Agg')
+    import matplotlib.pyplot as plt
+    import numpy as np
+except ImportError:
+    plt = np = None
 
 # Set style for professional plots
-plt.style.use('seaborn-v0_8-whitegrid')
-plt.rcParams['figure.figsize'] = (10, 6)
-plt.rcParams['font.size'] = 11
-plt.rcParams['axes.titlesize'] = 14
-plt.rcParams['axes.labelsize'] = 12
-plt.rcParams['legend.fontsize'] = 10
-plt.rcParams['lines.linewidth'] = 2
-plt.rcParams['lines.markersize'] = 8
+if plt is not None:
+    plt.style.use('seaborn-v0_8-whitegrid')
+    plt.rcParams['figure.figsize'] = (10, 6)
+    plt.rcParams['font.size'] = 11
+    plt.rcParams['axes.titlesize'] = 14
+    plt.rcParams['axes.labelsize'] = 12
+    plt.rcParams['legend.fontsize'] = 10
+    plt.rcParams['lines.linewidth'] = 2
+    plt.rcParams['lines.markersize'] = 8
 
 # Color scheme
 COLORS = {
@@ -37,8 +75,611 @@ COLORS = {
     'max_line': '#7f8c8d' # Gray
 }
 
-# Output directory (project root)
-OUTPUT_DIR = '/Users/boussetayassir/Desktop/parralel computing/TP2'
+# Benchmark output (CSV files written by the exercise programs)
+DATA_DIR = os.path.dirname(os.path.abspath(__file__))
+
+# Output directory (project root, --output-dir to change)
+OUTPUT_DIR = DATA_DIR
+
+# Structured results (TP2_RESULTS) and the run history built from them
+RESULTS_FILE = os.path.join(DATA_DIR, 'bench_results.csv')
+VARIANTS_FILE = os.path.join(DATA_DIR, 'variants.csv')
+CALIBRATION_FILE = os.path.join(DATA_DIR, 'exercise4', 'calibration.csv')
+DEFAULT_REFERENCE = 'gcc-O2-generic-plain'
+HISTORY_FILE = os.path.join(DATA_DIR, 'bench_history.csv')
+RESULT_FIELDS = ['benchmark', 'kernel', 'param', 'metric', 'value', 'unit']
+RUN_FIELDS = ['run_id', 'timestamp', 'commit', 'host', 'compiler']
+
+# Regression check defaults
+DEFAULT_THRESHOLD = 5.0      # % slowdown that counts as a regression
+DEFAULT_BASELINE_RUNS = 5    # Previous runs the latest one is compared with
+DEFAULT_ALPHA = 0.05         # Welch t-test significance level
+MIN_TEST_SAMPLES = 3         # Fewer samples on a side: threshold alone decides
+
+# Speedup simulator defaults
+DEFAULT_SIM_SAMPLES = 40     # Parameter draws per thread count
+DEFAULT_SIM_MAX_P = 64       # Predict up to this many threads
+
+# Units by direction: times regress when they grow, rates when they shrink
+LOWER_IS_BETTER = {'ns', 'us', 'ms', 's'}
+HIGHER_IS_BETTER = {'GFLOP/s', 'GB/s', 'matrices/s'}
+
+
+# ---------------------------------------------------------------------------
+# Build-variant ranking (variants.sh)
+# ---------------------------------------------------------------------------
+
+def rank_variants(args):
+    """
+    Rank the variants of variants.sh per kernel, then per benchmark by the
+    geometric mean speedup over the reference variant across its kernels
+    """
+    rows = read_csv_rows(args.input)
+    if not rows:
+        print(f"No results in {args.input} (run ./variants.sh first)")
+        return 1
+
+    # {series: {variant: value}}
+    series = defaultdict(dict)
+    for row in rows:
+        if row['unit'] in LOWER_IS_BETTER | HIGHER_IS_BETTER:
+            key = (row['benchmark'], row['kernel'], row['param'], row['metric'], row['unit'])
+            series[key][row['variant']] = float(row['value'])
+    variants = sorted({row['variant'] for row in rows})
+    reference = args.reference if args.reference in variants else variants[0]
+
+    # Speedup over the reference, > 1 is better whatever the unit
+    def speedup(key, variant):
+        values, unit = series[key], key[4]
+        if reference not in values or values[variant] <= 0.0 or values[reference] <= 0.0:
+            return None
+        ratio = values[variant] / values[reference]
+        return ratio if unit in HIGHER_IS_BETTER else 1.0 / ratio
+
+    print(f"{len(variants)} variants, reference {reference} (speedup > 1 is faster)\n")
+    print(f"{'Benchmark':<18} {'Kernel':<24} {'Metric':<9} {'Rank':>4}  {'Variant':<32} "
+          f"{'Value':>12} {'Speedup':>8}")
+    print('-' * 116)
+    for key in sorted(series):
+        bench, kernel, param, metric, unit = key
+        values = series[key]
+        ranked = sorted(values, key=lambda v: values[v], reverse=unit in HIGHER_IS_BETTER)
+        for rank, variant in enumerate(ranked[:args.top], 1):
+            s = speedup(key, variant)
+            first = rank == 1
+            print(f"{bench if first else '':<18} {kernel[:24] if first else '':<24} "
+                  f"{metric[:9] if first else '':<9} {rank:>4}  {variant:<32} "
+                  f"{values[variant]:>12.4g} {'-' if s is None else f'{s:.2f}x':>8}")
+
+    # Per benchmark (hot path): geometric mean speedup over its kernels
+    print(f"\nVariant to ship per benchmark (geometric mean speedup over {reference}):")
+    print(f"{'Benchmark':<18} {'Best variant':<32} {'Speedup':>8}   {'Runner-up':<32} {'Speedup':>8}")
+    print('-' * 106)
+    for bench in sorted({key[0] for key in series}):
+        keys = [key for key in series if key[0] == bench]
+        scores = []
+        for variant in variants:
+            ups = [speedup(key, variant) for key in keys if variant in series[key]]
+            ups = [u for u in ups if u]
+            if ups and len(ups) == len(keys):
+                scores.append((math.exp(sum(math.log(u) for u in ups) / len(ups)), variant))
+        scores.sort(reverse=True)
+        if not scores:
+            continue
+        best = scores[0]
+        second = scores[1] if len(scores) > 1 else (float('nan'), '-')
+        print(f"{bench:<18} {best[1]:<32} {best[0]:>7.2f}x   {second[1]:<32} {second[0]:>7.2f}x")
+    return 0
+
+
+# ---------------------------------------------------------------------------
+# Structured results and run history
+# ---------------------------------------------------------------------------
+
+def read_csv_rows(path):
+    """All rows of a CSV file as dicts ([] if it does not exist)"""
+    if not os.path.exists(path):
+        return []
+    with open(path, newline='') as f:
+        return list(csv.DictReader(f))
+
+
+def load_live_results():
+    """
+    {benchmark: [rows]} holding the latest run of every benchmark:
+    the history first, then results not ingested yet (they are newer)
+    """
+    latest = {}
+    for row in read_csv_rows(HISTORY_FILE):
+        bench = row['benchmark']
+        if bench not in latest or row['run_id'] > latest[bench][0]:
+            latest[bench] = (row['run_id'], [])
+        if row['run_id'] == latest[bench][0]:
+            latest[bench][1].append(row)
+    live = {bench: rows for bench, (_, rows) in latest.items()}
+
+    pending = defaultdict(list)
+    for row in read_csv_rows(RESULTS_FILE):
+        pending[row['benchmark']].append(row)
+    live.update(pending)
+    return live
+
+
+def live_values(live, benchmark, metric):
+    """{kernel: mean value} of one benchmark metric, or {} if never run"""
+    samples = defaultdict(list)
+    for row in live.get(benchmark, []):
+        if row['metric'] == metric:
+            samples[row['kernel']].append(float(row['value']))
+    return {kernel: sum(v) / len(v) for kernel, v in samples.items()}
+
+
+def command_output(args):
+    """First line printed by a command, or None if it cannot run"""
+    try:
+        out = subprocess.run(args, capture_output=True, text=True, cwd=DATA_DIR, timeout=30)
+    except (OSError, subprocess.TimeoutExpired):
+        return None
+    lines = out.stdout.strip().splitlines()
+    return lines[0].strip() if out.returncode == 0 and lines else None
+
+
+def describe_compiler(cc):
+    """Compiler key: the first line of `cc --version` (e.g. "gcc (GCC) 13.2.0")"""
+    version = command_output([cc, '--version'])
+    return version.replace(',', ' ') if version else cc
+
+
+def ingest(args):
+    """Append the pending results to the history as one run"""
+    rows = read_csv_rows(args.results)
+    if not rows:
+        print(f"No results in {args.results} (run the benchmarks with TP2_RESULTS set)")
+        return 1
+
+    commit = command_output(['git', 'rev-parse', '--short', 'HEAD']) or 'unknown'
+    if command_output(['git', 'status', '--porcelain', '--untracked-files=no']):
+        commit += '-dirty'
+    # Microseconds and a random suffix keep run_id unique when two hosts or
+    # compilers ingest within the same second; it still sorts by time
+    now_s = time.time()
+    now = time.gmtime(now_s)
+    run = {
+        'run_id': (time.strftime('%Y%m%dT%H%M%S', now)
+                   + f".{int(now_s % 1 * 1e6):06d}Z-{os.urandom(2).hex()}"),
+        'timestamp': time.strftime('%Y-%m-%d %H:%M:%S UTC', now),
+        'commit': commit,
+        'host': platform.node() or 'unknown',
+        'compiler': describe_compiler(args.compiler),
+    }
+
+    new_file = not os.path.exists(args.history) or os.path.getsize(args.history) == 0
+    with open(args.history, 'a', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=RUN_FIELDS + RESULT_FIELDS)
+        if new_file:
+            writer.writeheader()
+        for row in rows:
+            writer.writerow({**run, **{key: row[key] for key in RESULT_FIELDS}})
+
+    print(f"Run {run['run_id']}: {len(rows)} results, commit {run['commit']}, "
+          f"host {run['host']}, compiler {run['compiler']}")
+    print(f"Appended to {args.history}")
+    return 0
+
+
+def incomplete_beta(a, b, x):
+    """Regularized incomplete beta function I_x(a, b) (continued fraction)"""
+    if x <= 0.0:
+        return 0.0
+    if x >= 1.0:
+        return 1.0
+    if x > (a + 1.0) / (a + b + 2.0):
+        return 1.0 - incomplete_beta(b, a, 1.0 - x)
+
+    front = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b)
+                     + a * math.log(x) + b * math.log(1.0 - x)) / a
+    # Lentz's method for the continued fraction
+    tiny = 1e-300
+    c, d = 1.0, 1.0 - (a + b) * x / (a + 1.0)
+    d = 1.0 / (d if abs(d) > tiny else tiny)
+    h = d
+    for m in range(1, 200):
+        for num in (m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m)),
+                    -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1))):
+            d = 1.0 + num * d
+            d = 1.0 / (d if abs(d) > tiny else tiny)
+            c = 1.0 + num / c
+            c = c if abs(c) > tiny else tiny
+            h *= c * d
+        if abs(c * d - 1.0) < 1e-12:
+            break
+    return front * h
+
+
+def welch_p_value(a, b):
+    """Two-sided p-value of Welch's t-test (unequal variances)"""
+    na, nb = len(a), len(b)
+    ma, mb = sum(a) / na, sum(b) / nb
+    va = sum((x - ma) ** 2 for x in a) / (na - 1)
+    vb = sum((x - mb) ** 2 for x in b) / (nb - 1)
+    se2 = va / na + vb / nb
+    if se2 == 0.0:
+        return 1.0 if ma == mb else 0.0
+    t = (ma - mb) / math.sqrt(se2)
+    df = se2 ** 2 / ((va / na) ** 2 / (na - 1) + (vb / nb) ** 2 / (nb - 1))
+    return incomplete_beta(df / 2.0, 0.5, df / (df + t * t))
+
+
+def check(args):
+    """
+    Compare the latest run with the previous runs of the same host and
+    compiler. A kernel regresses when its mean is more than --threshold %
+    worse and, with MIN_TEST_SAMPLES samples on each side, Welch's t-test
+    finds the difference significant at --alpha. Returns 1 on any regression.
+    """
+    history = read_csv_rows(args.history)
+    if not history:
+        print(f"No history in {args.history} (run `analysis.py ingest` first)")
+        return 1
+
+    runs = {}
+    for row in history:
+        runs.setdefault(row['run_id'], row)
+    latest = runs[max(runs)]
+    key = (latest['host'], latest['compiler'])
+    baseline_ids = sorted(run_id for run_id, run in runs.items()
+                          if run_id < latest['run_id'] and (run['host'], run['compiler']) == key)
+    baseline_ids = set(baseline_ids[-args.baseline_runs:])
+
+    print(f"Latest run {latest['run_id']} (commit {latest['commit']})")
+    print(f"Host {key[0]}, compiler {key[1]}")
+    if not baseline_ids:
+        print("No earlier run of this host and compiler: nothing to compare, recorded as baseline.")
+        return 0
+    print(f"Baseline: {len(baseline_ids)} previous run(s), threshold {args.threshold:.1f}%, "
+          f"alpha {args.alpha}\n")
+
+    current, baseline = defaultdict(list), defaultdict(list)
+    for row in history:
+        if row['unit'] not in LOWER_IS_BETTER | HIGHER_IS_BETTER:
+            continue
+        series = (row['benchmark'], row['kernel'], row['param'], row['metric'], row['unit'])
+        if row['run_id'] == latest['run_id']:
+            current[series].append(float(row['value']))
+        elif row['run_id'] in baseline_ids:
+            baseline[series].append(float(row['value']))
+
+    print(f"{'Benchmark':<20} {'Kernel':<24} {'Param':<10} {'Metric':<9} "
+          f"{'Baseline':>12} {'Latest':>12} {'Change':>8} {'p-value':>8}  Status")
+    print('-' * 120)
+    regressions = 0
+    for series in sorted(current):
+        if series not in baseline:
+            continue
+        bench, kernel, param, metric, unit = series
+        cur, base = current[series], baseline[series]
+        mean_cur, mean_base = sum(cur) / len(cur), sum(base) / len(base)
+        if mean_base == 0.0:
+            continue
+        change = 100.0 * (mean_cur - mean_base) / mean_base
+        worse = change if unit in LOWER_IS_BETTER else -change
+        enough = min(len(cur), len(base)) >= MIN_TEST_SAMPLES
+        p = welch_p_value(cur, base) if enough else None
+
+        status = 'ok'
+        if worse > args.threshold and (p is None or p < args.alpha):
+            status = 'REGRESSION'
+            regressions += 1
+        elif worse < -args.threshold and (p is None or p < args.alpha):
+            status = 'improved'
+        elif worse > args.threshold:
+            status = 'noise'
+        if status == 'ok' and not args.verbose:
+            continue
+        print(f"{bench:<20} {kernel[:24]:<24} {param[:10]:<10} {metric[:9]:<9} "
+              f"{mean_base:>12.4g} {mean_cur:>12.4g} {change:>+7.1f}% "
+              f"{'-' if p is None else f'{p:.3f}':>8}  {status} ({unit})")
+
+    compared = sum(1 for series in current if series in baseline)
+    print(f"\n{compared} series compared, {regressions} regression(s)")
+    return 1 if regressions else 0
+
+
+# ---------------------------------------------------------------------------
+# Discrete-event speedup simulator (exercise4_calibrate)
+# ---------------------------------------------------------------------------
+
+def load_calibration(path):
+    """{quantity: {threads: (mean, std)}} from exercise4_calibrate's CSV"""
+    cal = defaultdict(dict)
+    for row in read_csv_rows(path):
+        cal[row['quantity']][int(row['threads'])] = (float(row['mean']), float(row['std']))
+    return cal
+
+
+def fit_line(xs, ys):
+    """Least-squares a + b * x (b = 0 with a single point)"""
+    n = len(xs)
+    mx, my = sum(xs) / n, sum(ys) / n
+    sxx = sum((x - mx) ** 2 for x in xs)
+    if n < 2 or sxx == 0.0:
+        return my, 0.0
+    b = sum((x - mx) * (y - my) for x, y in zip(xs, ys)) / sxx
+    return my - b * mx, b
+
+
+def draw_parameters(cal, rng, perturb=True, cpus=None):
+    """
+    One set of model parameters: every calibrated quantity drawn from
+    N(mean, std) over its samples (perturb=False: the means). cpus
+    overrides the calibrated host's CPU count to predict a larger host.
+    """
+    def draw(mean_std):
+        mean, std = mean_std
+        return max(0.1 * mean, rng.gauss(mean, std)) if perturb else mean
+
+    def per_p(name):
+        return {p: draw(v) for p, v in cal[name].items()}
+
+    forkjoin = per_p('forkjoin')
+    bandwidth = per_p('bandwidth')
+    ps = sorted(forkjoin)
+    return {
+        'cpus': cpus or int(cal.get('config.cpus', {0: (1 << 30, 0)})[0][0]),
+        # Fork/join (barrier) cost grows with the workers woken and joined
+        'forkjoin': fit_line(ps, [forkjoin[p] for p in ps]),
+        'task_ns': sum(per_p('task').values()) / len(cal['task']),
+        'cv': sum(per_p('imbalance').values()) / len(cal['imbalance']),
+        'bw_ceiling': max(bandwidth.values()),            # GB/s = bytes/ns
+        'bw_core': bandwidth[min(bandwidth)],
+        'ns_per_flop': 1.0 / draw(cal['gemm.core'][1]),
+        'ex3': {phase: draw(cal['ex3.' + phase][1])
+                for phase in ('add_noise', 'init_b', 'compute_addition', 'reduction')},
+    }
+
+
+def run_tasks(tasks, workers, prm, rng):
+    """
+    Event-driven run of one batch of (compute_ns, bytes) tasks on a pool:
+    an idle worker takes the next task (the pool's stealing keeps every
+    worker busy while tasks remain); running tasks that move memory share
+    the bandwidth ceiling equally. A task advances at
+    1 / max(compute, bytes / share) of its work per ns. Workers beyond the
+    CPUs of the host time-share them, so at most prm['cpus'] run at once.
+    """
+    workers = min(workers, prm['cpus'])
+    queue = list(reversed(tasks))
+    running = []          # [remaining fraction, compute_ns, bytes]
+
+    def start():
+        while queue and len(running) < workers:
+            compute, nbytes = queue.pop()
+            factor = max(0.2, 1.0 + prm['cv'] * rng.gauss(0.0, 1.0))   # Load imbalance
+            running.append([1.0, compute * factor + prm['task_ns'], nbytes])
+
+    now = 0.0
+    start()
+    while running:
+        movers = sum(1 for r in running if r[2] > 0)
+        share = prm['bw_ceiling'] / movers if movers else 0.0
+        rates = [1.0 / max(r[1], r[2] / share if r[2] > 0 else 0.0, 1e-9) for r in running]
+        dt = min(r[0] / rate for r, rate in zip(running, rates))
+        now += dt
+        for r, rate in zip(running, rates):
+            r[0] -= rate * dt
+        running = [r for r in running if r[0] > 1e-9]
+        start()
+    return now
+
+
+def simulate_dag(phases, workers, prm, rng):
+    """Wall time of a list of (serial, tasks) phases; parallel ones pay a fork/join"""
+    a, b = prm['forkjoin']
+    total = 0.0
+    for serial, tasks in phases:
+        if serial:
+            total += run_tasks(tasks, 1, prm, rng)
+        else:
+            total += max(0.0, a + b * workers) + run_tasks(tasks, workers, prm, rng)
+    return total
+
+
+def exercise3_dag(cal, workers, prm):
+    """add_noise on the caller, then init_b / addition / reduction in chunks"""
+    n = cal['config.ex3_n'][0][0]
+    chunks = min(4096, workers * int(cal['config.chunks_per_thread'][0][0]))
+    elems = n / chunks
+    ns = prm['ex3']
+    return [
+        (True, [(n * ns['add_noise'], 0)]),      # A recurrence: latency, not bandwidth
+        (False, [(elems * ns['init_b'], 8 * elems)] * chunks),
+        (False, [(elems * ns['compute_addition'], 24 * elems)] * chunks),
+        (False, [(elems * ns['reduction'], 8 * elems)] * chunks),
+    ]
+
+
+def exercise4_dag(cal, workers, prm):
+    """
+    matmul_parallel(): the tiles of choose_decomposition() in
+    matmul_parallel.c, each moving its packed A block, B panel and C tile
+    through memory; k-split shapes add the reduction pass
+    """
+    def ceil_div(a, b):
+        return -(-a // b)
+
+    n = int(cal['config.ex4_n'][0][0])
+    mc, kc, nc = (int(cal['config.' + t][0][0]) for t in ('mc', 'kc', 'nc'))
+    target = workers * 4                                   # TASKS_PER_WORKER
+    tm, tn = min(mc, n), min(nc, n)
+    while ceil_div(n, tm) * ceil_div(n, tn) < target:
+        if tn >= tm and tn > 64:                           # MIN_TILE
+            tn = ceil_div(ceil_div(tn, 2), 16) * 16
+        elif tm > 64:
+            tm = ceil_div(ceil_div(tm, 2), 16) * 16
+        else:
+            break
+    tiles_m, tiles_n = ceil_div(n, tm), ceil_div(n, tn)
+    splits, tk = 1, n
+    if workers > 1 and tiles_m * tiles_n < workers:
+        s = min(ceil_div(target, tiles_m * tiles_n), n // kc)
+        if s > 1:
+            tk = ceil_div(ceil_div(n, s), kc) * kc
+            splits = ceil_div(n, tk)
+
+    tasks = []
+    for i in range(tiles_m):
+        mb = min(tm, n - i * tm)
+        for j in range(tiles_n):
+            nb = min(tn, n - j * tn)
+            for s in range(splits):
+                kb = min(tk, n - s * tk)
+                tasks.append((2.0 * mb * nb * kb * prm['ns_per_flop'],
+                              8 * (mb * kb + kb * nb + 2 * mb * nb)))
+    phases = [(False, tasks)]
+    if splits > 1:
+        rows = 16                                          # REDUCE_ROWS
+        nbytes = 8 * rows * n * (splits + 1)
+        phases.append((False, [(nbytes / prm['bw_core'], nbytes)] * ceil_div(n, rows)))
+    return phases
+
+
+SIM_EXERCISES = (('exercise3', 'ex3', exercise3_dag), ('exercise4', 'ex4', exercise4_dag))
+
+
+def simulate_speedups(cal, ps, samples, seed, cpus=None):
+    """
+    {exercise: {p: (simulated mean, std, measured mean, std)}}: speedup
+    T(1) / T(p) over `samples` parameter draws, against the measured runs
+    of the calibration (None where p was not measured)
+    """
+    import random
+    rng = random.Random(seed)
+    draws = [draw_parameters(cal, rng, perturb=i > 0, cpus=cpus) for i in range(samples)]
+    out = {}
+    for name, key, dag in SIM_EXERCISES:
+        measured = cal.get('measured.' + key, {})
+        out[name] = {}
+        for p in ps:
+            speedups = []
+            for prm in draws:
+                t1 = simulate_dag(dag(cal, 1, prm), 1, prm, rng)
+                speedups.append(t1 / simulate_dag(dag(cal, p, prm), p, prm, rng))
+            mean = sum(speedups) / len(speedups)
+            std = math.sqrt(sum((s - mean) ** 2 for s in speedups) / max(1, len(speedups) - 1))
+            meas = meas_std = None
+            if p in measured and 1 in measured:
+                (m1, s1), (mp, sp) = measured[1], measured[p]
+                meas = m1 / mp
+                meas_std = meas * math.sqrt((s1 / m1) ** 2 + (sp / mp) ** 2)
+            out[name][p] = (mean, std, meas, meas_std)
+    return out
+
+
+def simulation_thread_counts(cal, max_p):
+    """Measured thread counts, then powers of two up to max_p"""
+    ps = set(cal['forkjoin'])
+    p = 1
+    while p <= max_p:
+        ps.add(p)
+        p *= 2
+    return sorted(ps)
+
+
+def simulate(args):
+    """
+    Predict the exercise3 / exercise4 speedup curves from the calibrated
+    overheads and compare them with the measured multithreaded runs
+    """
+    global OUTPUT_DIR
+    if not os.path.exists(args.calibration):
+        print(f"No calibration in {args.calibration} (run exercise4/exercise4_calibrate)")
+        return 1
+    cal = load_calibration(args.calibration)
+    ps = simulation_thread_counts(cal, args.max_p)
+    results = simulate_speedups(cal, ps, args.samples, args.seed, args.cpus)
+    calibrated = max(cal['bandwidth'])
+    host_cpus = args.cpus or int(cal.get('config.cpus', {0: (0, 0)})[0][0])
+    fs_amdahl = {'exercise3': measured_fs('exercise3_phases', 0.263),
+                 'exercise4': measured_fs('exercise4_phases', 0.0000027)}
+
+    print(f"Simulated speedup ({args.samples} parameter draws, error = 1 std) "
+          f"vs measured (error propagated from the calibration samples)")
+    print(f"Host: {host_cpus} CPU(s); bandwidth calibrated up to P={calibrated}, "
+          f"* = beyond it (the ceiling seen so far is kept)")
+    for name, series in results.items():
+        print(f"\n{name} (Amdahl fs = {fs_amdahl[name] * 100:.4g}%)")
+        print(f"{'P':>5} {'Amdahl':>9} {'Simulated':>17} {'Measured':>17} {'Error':>8}  Within")
+        print('-' * 68)
+        errors = []
+        for p, (mean, std, meas, meas_std) in series.items():
+            amdahl = 1.0 / (fs_amdahl[name] + (1.0 - fs_amdahl[name]) / p)
+            line = f"{p:>4}{'*' if p > calibrated else ' '} {amdahl:>8.2f}x {mean:>9.2f} +/- {std:<5.2f}"
+            if meas is None:
+                print(line.rstrip())
+                continue
+            error = (mean - meas) / meas * 100.0
+            errors.append(abs(error))
+            within = 'yes' if abs(mean - meas) <= std + meas_std else 'no'
+            print(f"{line} {meas:>9.2f} +/- {meas_std:<5.2f} {error:>+7.1f}%  {within}")
+        if errors:
+            print(f"Mean absolute error over the measured points: {sum(errors) / len(errors):.1f}%")
+
+    if args.plot:
+        if plt is None:
+            print("The plot needs matplotlib and numpy")
+            return 1
+        OUTPUT_DIR = args.output_dir
+        os.makedirs(OUTPUT_DIR, exist_ok=True)
+        plot_simulated_speedup(results, fs_amdahl)
+    return 0
+
+
+def plot_simulated_speedup(results=None, fs_amdahl=None):
+    """
+    Simulated vs measured speedup of exercises 3 and 4 with error bars,
+    next to the overhead-free Amdahl curve
+    Data from exercise4/calibration.csv (run ./exercise4_calibrate)
+    """
+    if results is None:
+        if not os.path.exists(CALIBRATION_FILE):
+            print(f"Skipped: {CALIBRATION_FILE} not found (run exercise4/exercise4_calibrate)")
+            return
+        cal = load_calibration(CALIBRATION_FILE)
+        results = simulate_speedups(cal, simulation_thread_counts(cal, DEFAULT_SIM_MAX_P),
+                                    DEFAULT_SIM_SAMPLES, 1)
+        fs_amdahl = {'exercise3': measured_fs('exercise3_phases', 0.263),
+                     'exercise4': measured_fs('exercise4_phases', 0.0000027)}
+
+    fig, axes = plt.subplots(1, 2, figsize=(15, 6.5))
+    for ax, (name, series), color in zip(axes, results.items(), (COLORS['ex3'], COLORS['ex4'])):
+        ps = np.array(list(series))
+        sim = np.array([v[0] for v in series.values()])
+        sim_err = np.array([v[1] for v in series.values()])
+        fs = fs_amdahl[name]
+        ax.plot(ps, 1 / (fs + (1 - fs) / ps), '--', color=COLORS['amdahl'],
+                label=f"Amdahl, free overheads (fs = {fs * 100:.3g}%)")
+        ax.errorbar(ps, sim, yerr=sim_err, fmt='o-', color=color, capsize=4,
+                    label='Simulated (fork/join, bandwidth, imbalance)')
+        measured = [(p, v[2], v[3]) for p, v in series.items() if v[2] is not None]
+        if measured:
+            mp, ms, me = zip(*measured)
+            ax.errorbar(mp, ms, yerr=me, fmt='s', color=COLORS['gustafson'], capsize=4,
+                        label='Measured')
+        ax.plot(ps, ps, ':', color='gray', alpha=0.5, label='Ideal Linear Scaling')
+        ax.set_xscale('log', base=2)
+        ax.set_yscale('log', base=2)
+        ax.set_xlabel('Number of Threads (p)')
+        ax.set_ylabel('Speedup T(1) / T(p)')
+        ax.set_title(f'{name.capitalize()}: Simulated vs Measured Speedup')
+        ax.legend(loc='upper left', framealpha=0.9)
+        ax.grid(True, which='both', alpha=0.3)
+
+    plt.tight_layout()
+    filepath = os.path.join(OUTPUT_DIR, 'simulated_speedup.png')
+    plt.savefig(filepath, dpi=150, bbox_inches='tight')
+    plt.close()
+    print(f"Created: {filepath}")
+
 
 def plot_exercise1_unrolling():
     """
@@ -59,6 +700,27 @@ def plot_exercise1_unrolling():
     times_ILP_O2 = [176005.42, 76088.33]
     times_ILP_O3 = [164072.08, 76588.75]
 
+    # Measured average times replace them level by level
+    live = load_live_results()
+    series = {'O0': (times_O0, times_ILP_O0), 'O2': (times_O2, times_ILP_O2),
+              'O3': (times_O3, times_ILP_O3)}
+    source = 'results.md'
+    for level, (standard, ilp) in series.items():
+        values = live_values(live, f'exercise1_{level}', 'avg_time')
+        unrolled, accumulated = {}, {}
+        for kernel, value in values.items():
+            match = re.match(r'U=(\d+)', kernel)
+            if match:
+                (accumulated if 'ILP' in kernel else unrolled)[int(match.group(1))] = value
+        if all(u in unrolled for u in U_values) and all(u in accumulated for u in U_ILP):
+            standard[:] = [unrolled[u] for u in U_values]
+            ilp[:] = [accumulated[u] for u in U_ILP]
+            source = 'measured'
+
+    # Fastest point for the annotation
+    best_time, best_u, best_level = min(
+        (t, u, level) for level, (_, ilp) in series.items() for u, t in zip(U_ILP, ilp))
+
     fig, ax = plt.subplots(figsize=(12, 7))
 
     # Plot standard unrolling
@@ -76,15 +738,16 @@ def plot_exercise1_unrolling():
 
     ax.set_xlabel('Unrolling Factor (U)')
     ax.set_ylabel('Execution Time (ns)')
-    ax.set_title('Exercise 1: Loop Unrolling vs Execution Time (double type)\nArray Size: 1,000,000 elements')
+    ax.set_title('Exercise 1: Loop Unrolling vs Execution Time (double type)\n'
+                 f'Array Size: 1,000,000 elements ({source})')
     ax.set_xticks(U_values)
     ax.set_xticklabels(['1', '2', '4', '8', '16', '32'])
     ax.legend(loc='upper left', framealpha=0.9)
     ax.set_yscale('log')
 
     # Add annotation for best result
-    ax.annotate('Best: 76,088 ns\n(U=8 ILP, -O2)',
-                xy=(8, 76088.33), xytext=(12, 150000),
+    ax.annotate(f'Best: {best_time:,.0f} ns\n(U={best_u} ILP, -{best_level})',
+                xy=(best_u, best_time), xytext=(12, best_time * 2),
                 arrowprops=dict(arrowstyle='->', color='black'),
                 fontsize=10, ha='center')
 
@@ -110,6 +773,18 @@ def plot_exercise1_types():
     baseline_O0 = [719338, 633134, 596690, 606154]
     best_O0 = [414410, 427034, 418937, 446730]
 
+    # Measured: U=1 and the U=8 ILP kernel at -O0, the fastest kernel at -O2
+    live = load_live_results()
+    for level, baseline, best in (('O0', baseline_O0, best_O0), ('O2', baseline_O2, best_O2)):
+        values = live_values(live, f'exercise1_types_{level}', 'avg_time')
+        if not all(f'{t} U=1' in values for t in types):
+            continue
+        baseline[:] = [values[f'{t} U=1'] for t in types]
+        if level == 'O0':
+            best[:] = [values.get(f'{t} U=8 (ILP)', values[f'{t} U=1']) for t in types]
+        else:
+            best[:] = [min(v for k, v in values.items() if k.startswith(t + ' ')) for t in types]
+
     x = np.arange(len(types))
     width = 0.2
 
@@ -167,12 +842,18 @@ def plot_exercise1_types():
     print(f"Created: {filepath}")
 
 
+def measured_fs(benchmark, default):
+    """Latest wall-clock fs written by a phase-profiled build, else default"""
+    fs = live_values(load_live_results(), benchmark, 'fs').get('total')
+    return fs if fs and fs > 0.0 else default
+
+
 def plot_exercise3_amdahl():
     """
     Exercise 3: Amdahl Speedup Curve
-    fs = 26.3%
+    fs = 26.3% (Callgrind), or the wall-clock fs of exercise3_phases
     """
-    fs = 0.263
+    fs = measured_fs('exercise3_phases', 0.263)
 
     # Processors
     p = np.array([1, 2, 4, 8, 16, 32, 64])
@@ -210,7 +891,8 @@ def plot_exercise3_amdahl():
 
     ax.set_xlabel('Number of Processors (p)')
     ax.set_ylabel('Speedup S(p)')
-    ax.set_title("Exercise 3: Amdahl's Law Speedup for Vector Operations\n(Sequential Fraction fs = 26.3%)")
+    ax.set_title("Exercise 3: Amdahl's Law Speedup for Vector Operations\n"
+                 f"(Sequential Fraction fs = {fs*100:.1f}%)")
     ax.legend(loc='upper left', framealpha=0.9)
     ax.set_xlim(0, 68)
     ax.set_ylim(0, max_speedup * 1.3)
@@ -231,9 +913,9 @@ def plot_exercise3_amdahl():
 def plot_exercise3_gustafson():
     """
     Exercise 3: Gustafson Speedup Curve
-    fs = 26.3%
+    fs = 26.3% (Callgrind), or the wall-clock fs of exercise3_phases
     """
-    fs = 0.263
+    fs = measured_fs('exercise3_phases', 0.263)
 
     # Processors
     p = np.array([1, 2, 4, 8, 16, 32, 64])
@@ -266,10 +948,11 @@ def plot_exercise3_gustafson():
 
     ax.set_xlabel('Number of Processors (p)')
     ax.set_ylabel('Scaled Speedup S(p)')
-    ax.set_title("Exercise 3: Gustafson's Law Scaled Speedup for Vector Operations\n(Sequential Fraction fs = 26.3%)")
+    ax.set_title("Exercise 3: Gustafson's Law Scaled Speedup for Vector Operations\n"
+                 f"(Sequential Fraction fs = {fs*100:.1f}%)")
     ax.legend(loc='upper left', framealpha=0.9)
     ax.set_xlim(0, 68)
-    ax.set_ylim(0, 52)
+    ax.set_ylim(0, gustafson(64, fs) * 1.1)
     ax.grid(True, alpha=0.3)
 
     # Show near-linear scaling with annotation
@@ -286,63 +969,185 @@ def plot_exercise3_gustafson():
     print(f"Created: {filepath}")
 
 
-def plot_exercise4_scaling():
+def load_scaling_csv(path):
     """
-    Exercise 4: Amdahl + Gustafson Combined
-    fs = 0.00027%
+    Read the CSV written by exercise4/exercise4_scaling into
+    {experiment: {column: np.array}} sorted by thread count
     """
-    fs = 0.00000271
+    rows = {}
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            rows.setdefault(row['experiment'], []).append(row)
 
-    # Processors (extended range for matrix ops)
-    p = np.array([1, 2, 4, 8, 16, 32, 64, 128, 256, 512])
-    p_continuous = np.linspace(1, 512, 200)
+    data = {}
+    for name, items in rows.items():
+        items.sort(key=lambda r: int(r['threads']))
+        data[name] = {key: np.array([float(r[key]) for r in items])
+                      for key in ('threads', 'm', 'n', 'k', 'seconds',
+                                  'gflops', 'speedup', 'efficiency')}
+    return data
 
-    # Amdahl's Law
-    def amdahl(p, fs):
-        return 1 / (fs + (1 - fs) / p)
 
-    # Gustafson's Law
-    def gustafson(p, fs):
-        return fs + p * (1 - fs)
-
-    speedup_amdahl = amdahl(p, fs)
-    speedup_gustafson = gustafson(p, fs)
-    speedup_amdahl_cont = amdahl(p_continuous, fs)
-    speedup_gustafson_cont = gustafson(p_continuous, fs)
-
-    fig, ax = plt.subplots(figsize=(12, 7))
-
-    # Amdahl curve
-    ax.plot(p_continuous, speedup_amdahl_cont, '-', color=COLORS['amdahl'],
-            label=f"Amdahl's Law (fs = {fs*100:.5f}%)", linewidth=2.5)
-    ax.plot(p, speedup_amdahl, 'o', color=COLORS['amdahl'], markersize=8)
-
-    # Gustafson curve (will overlap significantly)
-    ax.plot(p_continuous, speedup_gustafson_cont, '--', color=COLORS['gustafson'],
-            label=f"Gustafson's Law (fs = {fs*100:.5f}%)", linewidth=2.5)
-    ax.plot(p, speedup_gustafson, 's', color=COLORS['gustafson'], markersize=8)
+def plot_exercise4_scaling():
+    """
+    Exercise 4: measured strong and weak scaling of the parallel GEMM
+    Data from exercise4/scaling.csv (run ./exercise4_scaling)
+    """
+    csv_path = os.path.join(DATA_DIR, 'exercise4', 'scaling.csv')
+    if not os.path.exists(csv_path):
+        print(f"Skipped: {csv_path} not found (run exercise4/exercise4_scaling)")
+        return
+    data = load_scaling_csv(csv_path)
+
+    fig, (ax_strong, ax_weak) = plt.subplots(1, 2, figsize=(15, 6.5))
+    p_max = max(d['threads'].max() for d in data.values())
+    p_line = np.linspace(1, p_max, 100)
+
+    # Strong scaling: fixed problem (square and skinny k-split shapes)
+    for name, color, marker in (('strong', COLORS['ex4'], 'o'),
+                                ('skinny', COLORS['ex3'], '^')):
+        if name not in data:
+            continue
+        d = data[name]
+        shape = f"{int(d['m'][0])}x{int(d['n'][0])}x{int(d['k'][0])}"
+        ax_strong.plot(d['threads'], d['speedup'], marker + '-', color=color,
+                       label=f'Measured {name} ({shape})')
+
+    # Amdahl fit of the square strong-scaling run: 1/S = fs + (1-fs)/p,
+    # i.e. (1 - 1/S) = (1 - fs) * (1 - 1/p), least squares through 0
+    if 'strong' in data and len(data['strong']['threads']) > 1:
+        d = data['strong']
+        x = 1.0 - 1.0 / d['threads']
+        y = 1.0 - 1.0 / d['speedup']
+        slope = float(np.sum(x * y) / np.sum(x * x))
+        fs_fit = min(1.0, max(0.0, 1.0 - slope))
+        ax_strong.plot(p_line, 1 / (fs_fit + (1 - fs_fit) / p_line), '--',
+                       color=COLORS['amdahl'],
+                       label=f"Amdahl fit (effective fs = {fs_fit*100:.2f}%)")
+
+    ax_strong.plot(p_line, p_line, ':', color='gray', alpha=0.5,
+                   label='Ideal Linear Scaling', linewidth=1.5)
+    ax_strong.set_xlabel('Number of Threads (p)')
+    ax_strong.set_ylabel('Speedup T(1) / T(p)')
+    ax_strong.set_title('Strong Scaling (fixed problem size)')
+    ax_strong.legend(loc='upper left', framealpha=0.9)
+    ax_strong.grid(True, alpha=0.3)
+
+    # Weak scaling: N grows as N0 * p^(1/3)
+    if 'weak' in data:
+        d = data['weak']
+        ax_weak.plot(d['threads'], d['speedup'], 's-', color=COLORS['gustafson'],
+                     label=f"Measured scaled speedup (N0 = {int(d['n'][0])})")
+        for p, s, n in zip(d['threads'], d['speedup'], d['n']):
+            ax_weak.annotate(f'N={int(n)}', xy=(p, s), xytext=(4, -12),
+                             textcoords='offset points', fontsize=8)
+    ax_weak.plot(p_line, p_line, ':', color='gray', alpha=0.5,
+                 label='Ideal (Gustafson, fs -> 0)', linewidth=1.5)
+    ax_weak.set_xlabel('Number of Threads (p)')
+    ax_weak.set_ylabel('Scaled Speedup (GFLOP/s at p / GFLOP/s at 1)')
+    ax_weak.set_title('Weak Scaling (constant flops per thread)')
+    ax_weak.legend(loc='upper left', framealpha=0.9)
+    ax_weak.grid(True, alpha=0.3)
+
+    fig.suptitle('Exercise 4: Measured Scaling of the Work-Stealing Parallel GEMM')
+    plt.tight_layout()
+    filepath = os.path.join(OUTPUT_DIR, 'exercise4_scaling.png')
+    plt.savefig(filepath, dpi=150, bbox_inches='tight')
+    plt.close()
+    print(f"Created: {filepath}")
 
-    # Linear scaling reference
-    ax.plot(p_continuous, p_continuous, ':', color='gray', alpha=0.5,
-            label='Ideal Linear Scaling', linewidth=1.5)
 
-    ax.set_xlabel('Number of Processors (p)')
-    ax.set_ylabel('Speedup S(p)')
-    ax.set_title("Exercise 4: Amdahl's and Gustafson's Laws for Matrix Multiplication\n(Sequential Fraction fs = 0.00027% - Near-perfect parallelism)")
+def plot_exercise4_roofline():
+    """
+    Roofline: peak FLOPs and DRAM / LLC bandwidth of one core with the
+    exercise kernels placed by arithmetic intensity
+    Data from exercise4/roofline.csv (run ./exercise4_roofline)
+    """
+    csv_path = os.path.join(DATA_DIR, 'exercise4', 'roofline.csv')
+    if not os.path.exists(csv_path):
+        print(f"Skipped: {csv_path} not found (run exercise4/exercise4_roofline)")
+        return
+    roofs, kernels = {}, []
+    for row in read_csv_rows(csv_path):
+        if row['type'] == 'roof':
+            roofs[row['name']] = float(row['gflops'] or row['gbs'])
+        else:
+            kernels.append(row)
+
+    peak = roofs['peak']
+    fig, ax = plt.subplots(figsize=(12, 7.5))
+    ai = np.logspace(-2.5, 3, 200)
+    for name, style, label in (('dram', '-', 'DRAM'), ('llc', '--', 'LLC')):
+        bw = roofs[name]
+        ax.plot(ai, np.minimum(peak, ai * bw), style, color=COLORS['amdahl'],
+                label=f'{label} roof ({bw:.1f} GB/s, ridge {peak / bw:.2f} flop/B)')
+    ax.axhline(y=peak, color=COLORS['max_line'], linestyle=':', linewidth=1.5,
+               label=f'Peak FP ({peak:.1f} GFLOP/s)')
+
+    colors = {'exercise1': COLORS['O2'], 'exercise3': COLORS['ex3'], 'exercise4': COLORS['gustafson']}
+    markers = {'exercise1': 's', 'exercise3': 'o', 'exercise4': '^'}
+    labelled = set()
+    for k in kernels:
+        intensity, gflops = float(k['intensity']), float(k['gflops'])
+        if intensity <= 0.0:
+            continue  # No flops (init_b): rated against bandwidth only
+        ex = k['exercise']
+        ax.plot(intensity, gflops, markers[ex], color=colors[ex], markersize=10,
+                label=ex if ex not in labelled else None)
+        labelled.add(ex)
+        ax.annotate(f"{k['name']}\n{float(k['fraction'])*100:.0f}% of roof",
+                    xy=(intensity, gflops), xytext=(6, -4), textcoords='offset points',
+                    fontsize=8)
+
+    ax.set_xscale('log')
+    ax.set_yscale('log')
+    ax.set_xlabel('Arithmetic Intensity (flop / byte, compulsory traffic)')
+    ax.set_ylabel('Performance (GFLOP/s)')
+    ax.set_title('Roofline of the TP2 Kernels (one core, measured roofs)')
     ax.legend(loc='upper left', framealpha=0.9)
-    ax.set_xlim(0, 540)
-    ax.set_ylim(0, 550)
-    ax.grid(True, alpha=0.3)
+    ax.grid(True, which='both', alpha=0.3)
 
-    # Annotation
-    ax.annotate('Both laws show\nnear-linear scaling\ndue to tiny fs',
-                xy=(256, 256), xytext=(350, 150),
-                arrowprops=dict(arrowstyle='->', color='black'),
-                fontsize=10, ha='left',
-                bbox=dict(boxstyle='round,pad=0.3', facecolor='white', alpha=0.8))
+    plt.tight_layout()
+    filepath = os.path.join(OUTPUT_DIR, 'exercise4_roofline.png')
+    plt.savefig(filepath, dpi=150, bbox_inches='tight')
+    plt.close()
+    print(f"Created: {filepath}")
 
+
+def plot_exercise4_placement():
+    """
+    Exercise 3 streaming stages and the parallel GEMM per thread placement
+    Data from exercise4/placement.csv (run ./exercise4_placement)
+    """
+    csv_path = os.path.join(DATA_DIR, 'exercise4', 'placement.csv')
+    if not os.path.exists(csv_path):
+        print(f"Skipped: {csv_path} not found (run exercise4/exercise4_placement)")
+        return
+    series, units = {}, {}
+    for row in read_csv_rows(csv_path):
+        points = series.setdefault(row['kernel'], {}).setdefault(row['policy'], [])
+        points.append((int(row['threads']), float(row['value'])))
+        units[row['kernel']] = row['unit']
+
+    kernels = list(series)
+    fig, axes = plt.subplots(1, len(kernels), figsize=(5 * len(kernels), 5.5), squeeze=False)
+    markers = {'none': 'o', 'compact': 's', 'scatter': '^', 'one-per-core': 'D', 'one-per-l3': 'v'}
+    for ax, kernel in zip(axes[0], kernels):
+        for policy, points in series[kernel].items():
+            points.sort()
+            threads, values = zip(*points)
+            ax.plot(threads, values, markers.get(policy, 'o') + ('--' if policy == 'none' else '-'),
+                    label=policy)
+        ax.set_xscale('log', base=2)
+        ax.set_xlabel('Threads')
+        ax.set_ylabel(units[kernel])
+        ax.set_title(kernel)
+        ax.legend(loc='upper left', framealpha=0.9, fontsize=8)
+        ax.grid(True, alpha=0.3)
+
+    fig.suptitle('Thread Placement: exercise3 Stages (bandwidth) and Parallel GEMM (compute)')
     plt.tight_layout()
-    filepath = os.path.join(OUTPUT_DIR, 'exercise4_scaling.png')
+    filepath = os.path.join(OUTPUT_DIR, 'exercise4_placement.png')
     plt.savefig(filepath, dpi=150, bbox_inches='tight')
     plt.close()
     print(f"Created: {filepath}")
@@ -353,8 +1158,8 @@ def plot_comparison_scaling():
     Comparison: Exercise 3 vs 4
     Overlay Amdahl curves for both exercises
     """
-    fs_ex3 = 0.263
-    fs_ex4 = 0.00000271
+    fs_ex3 = measured_fs('exercise3_phases', 0.263)
+    fs_ex4 = measured_fs('exercise4_phases', 0.00000271)
 
     p = np.array([1, 2, 4, 8, 16, 32, 64])
     p_continuous = np.linspace(1, 64, 100)
@@ -420,8 +1225,15 @@ def plot_comparison_scaling():
     print(f"Created: {filepath}")
 
 
-def main():
+def plot_all(args):
     """Generate all plots"""
+    global OUTPUT_DIR
+    if plt is None:
+        print("The plot command needs matplotlib and numpy")
+        return 1
+    OUTPUT_DIR = args.output_dir
+    os.makedirs(OUTPUT_DIR, exist_ok=True)
+
     print("=" * 60)
     print("TP2 Analysis - Generating Plots")
     print("=" * 60)
@@ -440,10 +1252,13 @@ def main():
     # Exercise 4 plots
     print("\nGenerating Exercise 4 plots...")
     plot_exercise4_scaling()
+    plot_exercise4_roofline()
+    plot_exercise4_placement()
 
-    # Comparison plot
-    print("\nGenerating comparison plot...")
+    # Comparison plots
+    print("\nGenerating comparison plots...")
     plot_comparison_scaling()
+    plot_simulated_speedup()
 
     print()
     print("=" * 60)
@@ -452,11 +1267,59 @@ def main():
     print("\nGenerated files:")
     for fname in ['exercise1_unrolling.png', 'exercise1_types.png',
                   'exercise3_amdahl.png', 'exercise3_gustafson.png',
-                  'exercise4_scaling.png', 'comparison_scaling.png']:
+                  'exercise4_scaling.png', 'exercise4_roofline.png',
+                  'exercise4_placement.png',
+                  'comparison_scaling.png', 'simulated_speedup.png']:
         fpath = os.path.join(OUTPUT_DIR, fname)
         if os.path.exists(fpath):
             print(f"  - {fname}")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='TP2 plots and benchmark regression checks')
+    sub = parser.add_subparsers(dest='command')
+
+    p = sub.add_parser('plot', help='regenerate the plots (default)')
+    p.add_argument('--output-dir', default=OUTPUT_DIR)
+    p.set_defaults(func=plot_all)
+
+    p = sub.add_parser('ingest', help='file bench_results.csv into the run history')
+    p.add_argument('--results', default=RESULTS_FILE)
+    p.add_argument('--history', default=HISTORY_FILE)
+    p.add_argument('--compiler', default=os.environ.get('CC', 'cc'))
+    p.set_defaults(func=ingest)
+
+    p = sub.add_parser('check', help='flag regressions of the latest run, exit 1 if any')
+    p.add_argument('--history', default=HISTORY_FILE)
+    p.add_argument('--threshold', type=float, default=DEFAULT_THRESHOLD,
+                   help='percent change that counts (default %(default)s)')
+    p.add_argument('--baseline-runs', type=int, default=DEFAULT_BASELINE_RUNS)
+    p.add_argument('--alpha', type=float, default=DEFAULT_ALPHA)
+    p.add_argument('--verbose', action='store_true', help='also list unchanged kernels')
+    p.set_defaults(func=check)
+
+    p = sub.add_parser('variants', help='rank the build variants of variants.sh')
+    p.add_argument('--input', default=VARIANTS_FILE)
+    p.add_argument('--reference', default=DEFAULT_REFERENCE)
+    p.add_argument('--top', type=int, default=3, help='variants listed per kernel')
+    p.set_defaults(func=rank_variants)
+
+    p = sub.add_parser('simulate', help='simulated vs measured speedup of exercises 3 and 4')
+    p.add_argument('--calibration', default=CALIBRATION_FILE)
+    p.add_argument('--samples', type=int, default=DEFAULT_SIM_SAMPLES)
+    p.add_argument('--max-p', type=int, default=DEFAULT_SIM_MAX_P)
+    p.add_argument('--seed', type=int, default=1)
+    p.add_argument('--cpus', type=int, help='predict for a host with this many CPUs')
+    p.add_argument('--plot', action='store_true', help='also write simulated_speedup.png')
+    p.add_argument('--output-dir', default=OUTPUT_DIR)
+    p.set_defaults(func=simulate)
+
+    args = parser.parse_args()
+    if args.command is None:
+        args = parser.parse_args(['plot'])
+    return args.func(args)
 
 
 if __name__ == "__main__":
-    main()
+    sys.exit(main())
@@ -0,0 +1,115 @@
+/*
+ * Adaptive thread count for the TP2 parallel benchmarks.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "timing.h"
+#include "tuning.h"
+#include "concurrency.h"
+
+// Marginal gain of the p-th worker: its added rate over the mean rate of
+// a worker in the team of p - 1
+static double gain(const concurrency_t *c, int p) {
+    const double below = c->rate[p - 1];
+    if (below <= 0.0) return 1.0;
+    return (c->rate[p] - below) * (p - 1) / below;
+}
+
+static void set_knee(concurrency_t *c, int knee) {
+    if (c->knee > 0 && knee != c->knee) c->changes++;
+    c->knee = knee;
+    c->threads = knee;
+    if (c->key[0]) tuning_store(c->key, knee);
+}
+
+int concurrency_init(concurrency_t *c, threadpool_t *pool, const char *kernel, long size,
+                     double min_gain) {
+    memset(c, 0, sizeof(*c));
+    if (!pool) return -1;
+    c->pool = pool;
+    c->max_threads = threadpool_size(pool);
+    if (c->max_threads > TOPOLOGY_MAX_CPUS) c->max_threads = TOPOLOGY_MAX_CPUS;
+    c->min_gain = (min_gain > 0.0) ? min_gain : CONCURRENCY_MIN_GAIN;
+    c->threads = 1;
+    c->last_good = 1;
+    c->next_probe = -1;
+    if (kernel) {
+        snprintf(c->key, sizeof(c->key), "concurrency.%s.%ld", kernel, size);
+        int knee;
+        if (tuning_get(c->key, &knee) == 0 && knee >= 1) {
+            c->knee = (knee < c->max_threads) ? knee : c->max_threads;
+            c->threads = c->knee;
+            c->remembered = 1;
+        }
+    }
+    return 0;
+}
+
+int concurrency_begin(concurrency_t *c) {
+    threadpool_set_active(c->pool, c->threads);
+    c->start = get_time_ns();
+    return c->threads;
+}
+
+// Count one timed batch at `threads`; 1 once CONCURRENCY_SAMPLES are in
+static int sample(concurrency_t *c, double rate) {
+    if (rate > c->best) c->best = rate;
+    if (++c->samples < CONCURRENCY_SAMPLES) return 0;
+    c->rate[c->threads] = c->best;
+    c->samples = 0;
+    c->best = 0.0;
+    return 1;
+}
+
+void concurrency_end(concurrency_t *c, double work) {
+    const double elapsed = get_time_ns() - c->start;
+    const double rate = work / (elapsed > 1.0 ? elapsed : 1.0);
+    c->batches++;
+
+    if (c->knee == 0) {
+        // Ramp: one more worker per CONCURRENCY_SAMPLES batches
+        c->ramp_batches++;
+        if (!sample(c, rate)) return;
+        const int p = c->threads;
+        if (p > 1) {
+            if (gain(c, p) >= c->min_gain) {
+                c->last_good = p;
+                c->weak = 0;
+            } else {
+                c->weak++;
+            }
+        }
+        if (c->weak >= CONCURRENCY_PATIENCE || p == c->max_threads) set_knee(c, c->last_good);
+        else c->threads = p + 1;
+        return;
+    }
+
+    if (c->probe == 0) {
+        // Settled: remeasure the knee over the last batches before a probe
+        c->since_probe++;
+        if (c->since_probe <= CONCURRENCY_PROBE_EVERY - CONCURRENCY_SAMPLES) return;
+        if (!sample(c, rate)) return;
+        c->since_probe = 0;
+        int dir = c->next_probe;
+        c->next_probe = -dir;
+        if (c->knee + dir < 1 || c->knee + dir > c->max_threads) dir = -dir;
+        if (c->knee + dir < 1 || c->knee + dir > c->max_threads) return;
+        c->probe = dir;
+        c->threads = c->knee + dir;
+        return;
+    }
+
+    // Probing one worker less (shed it unless it paid off) or one more
+    // (keep it if it pays off)
+    if (!sample(c, rate)) return;
+    const int knee = c->knee, dir = c->probe;
+    c->probe = 0;
+    c->threads = knee;
+    if (dir < 0 && gain(c, knee) < c->min_gain) set_knee(c, knee - 1);
+    else if (dir > 0 && gain(c, knee + 1) >= c->min_gain) set_knee(c, knee + 1);
+}
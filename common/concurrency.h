@@ -0,0 +1,83 @@
+/*
+ * Adaptive thread count for the TP2 parallel benchmarks.
+ *
+ * A bandwidth-bound stage stops speeding up once a few cores saturate the
+ * memory controllers; every further thread only occupies a core. The
+ * controller wraps a thread pool whose size is the most the caller will
+ * spend and picks, online, how many of its workers run each batch
+ * (threadpool_set_active(); the others sleep):
+ *   ramp     start at 1 worker and add one at a time, timing
+ *            CONCURRENCY_SAMPLES batches (best of) per count. The marginal
+ *            gain of the p-th worker is (rate(p) - rate(p-1)) divided by
+ *            the mean per-worker rate at p - 1 (1 = perfect scaling, 0 =
+ *            saturated). After CONCURRENCY_PATIENCE workers in a row gain
+ *            less than min_gain, settle on the last one that did not.
+ *   settled  every CONCURRENCY_PROBE_EVERY batches, remeasure the knee and
+ *            try one worker less (shed it if it was not worth min_gain)
+ *            or, alternately, one more (keep it if it is), so the knee
+ *            follows interference from other jobs.
+ * The knee is remembered per kernel and size in the tuning cache
+ * (common/tuning.h, parameter "concurrency.<kernel>.<size>"), so a later
+ * run starts settled and skips the ramp.
+ *
+ * Usage, once per batch:
+ *   concurrency_begin(&c);
+ *   threadpool_run(pool, ...);
+ *   concurrency_end(&c, bytes_or_flops_of_the_batch);
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_CONCURRENCY_H
+#define TP2_CONCURRENCY_H
+
+#include "threadpool.h"
+#include "topology.h"
+
+#define CONCURRENCY_MIN_GAIN    0.2   // A worker must add 20% of an average worker's rate
+#define CONCURRENCY_SAMPLES     3     // Batches timed per worker count (best of)
+#define CONCURRENCY_PATIENCE    2     // Weak workers in a row that end the ramp
+#define CONCURRENCY_PROBE_EVERY 64    // Settled batches between probes
+
+typedef struct {
+    threadpool_t *pool;
+    char key[96];              // Tuning-cache parameter, "" when not remembered
+    int max_threads;           // Pool size
+    double min_gain;
+    int threads;               // Workers of the current / next batch
+    int knee;                  // Settled worker count, 0 while ramping
+    int remembered;            // Knee loaded from the tuning cache
+    int last_good;             // Ramp: last count whose worker paid off
+    int weak;                  // Ramp: weak workers in a row
+    int probe;                 // Settled: -1 / +1 while probing, else 0
+    int next_probe;            // Direction of the next probe
+    int samples;               // Batches timed at `threads` so far
+    double best;               // Their best rate (work / ns)
+    double rate[TOPOLOGY_MAX_CPUS + 1];   // Best rate per worker count
+    long batches, ramp_batches, since_probe;
+    int changes;               // Knee moves after settling
+    double start;
+} concurrency_t;
+
+// Control pool for one kernel at one size (kernel NULL: do not remember).
+// min_gain <= 0 picks CONCURRENCY_MIN_GAIN. Returns 0, or -1 on invalid
+// arguments.
+int concurrency_init(concurrency_t *c, threadpool_t *pool, const char *kernel, long size,
+                     double min_gain);
+
+// Activate the workers of the next batch and start its timer; returns
+// their count
+int concurrency_begin(concurrency_t *c);
+
+// Stop the timer; `work` is what the batch did (bytes, FLOPs, ...)
+void concurrency_end(concurrency_t *c, double work);
+
+static inline int concurrency_settled(const concurrency_t *c) { return c->knee > 0; }
+
+// Best rate (work / ns) measured with `threads` workers, 0 if never run
+static inline double concurrency_rate(const concurrency_t *c, int threads) {
+    return (threads >= 1 && threads <= c->max_threads) ? c->rate[threads] : 0.0;
+}
+
+#endif // TP2_CONCURRENCY_H
@@ -0,0 +1,294 @@
+/*
+ * NUMA placement for the TP2 parallel benchmarks.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "numa.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#define NUMA_LINUX 1
+#endif
+
+#define PAGE_BATCH 1024   // Pages per move_pages() query
+
+static const char *policy_names[NUMA_NUM_POLICIES] = {
+    "serial", "first-touch", "interleave", "bind"
+};
+
+const char *numa_policy_name(numa_policy_t policy) {
+    if (policy < 0 || policy >= NUMA_NUM_POLICIES) return "?";
+    return policy_names[policy];
+}
+
+int numa_parse_policy(const char *name, numa_policy_t *policy) {
+    for (int p = 0; p < NUMA_NUM_POLICIES; p++) {
+        if (strcmp(name, policy_names[p]) == 0) {
+            *policy = (numa_policy_t)p;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// ============================================================================
+// Topology
+// ============================================================================
+
+static struct {
+    int nodes;
+    int id[NUMA_MAX_NODES];          // Kernel node id of each logical node
+    int ncpus[NUMA_MAX_NODES];
+#ifdef NUMA_LINUX
+    cpu_set_t cpus[NUMA_MAX_NODES];
+#endif
+} topo;
+
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+#ifdef NUMA_LINUX
+// Parse a cpulist such as "0-3,8-11" into set; returns the CPU count
+static int parse_cpulist(const char *s, cpu_set_t *set) {
+    int count = 0;
+    CPU_ZERO(set);
+    while (*s && *s != '\n') {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s) break;
+        if (*end == '-') hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi && c < CPU_SETSIZE; c++) {
+            CPU_SET((int)c, set);
+            count++;
+        }
+        s = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+#endif
+
+static void topo_init(void) {
+    topo.nodes = 0;
+#ifdef NUMA_LINUX
+    for (int id = 0; id < NUMA_MAX_NODES; id++) {
+        char path[64], line[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        const int ok = fgets(line, sizeof(line), f) != NULL;
+        fclose(f);
+        cpu_set_t set;
+        const int n = ok ? parse_cpulist(line, &set) : 0;
+        if (n == 0) continue;    // Memory-only node
+        topo.id[topo.nodes] = id;
+        topo.ncpus[topo.nodes] = n;
+        topo.cpus[topo.nodes] = set;
+        topo.nodes++;
+    }
+#endif
+    if (topo.nodes == 0) {
+        topo.nodes = 1;
+        topo.id[0] = 0;
+        topo.ncpus[0] = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+}
+
+int numa_num_nodes(void) {
+    pthread_once(&topo_once, topo_init);
+    return topo.nodes;
+}
+
+int numa_node_cpus(int node) {
+    pthread_once(&topo_once, topo_init);
+    return (node >= 0 && node < topo.nodes) ? topo.ncpus[node] : 0;
+}
+
+int numa_run_on_node(int node) {
+    if (numa_num_nodes() == 1) return 0;
+#ifdef NUMA_LINUX
+    if (node < 0 || node >= topo.nodes) return -1;
+    return sched_setaffinity(0, sizeof(cpu_set_t), &topo.cpus[node]) == 0 ? 0 : -1;
+#else
+    (void)node;
+    return 0;
+#endif
+}
+
+// ============================================================================
+// Pinned chunk execution
+// ============================================================================
+
+typedef struct {
+    tp_task_fn fn;
+    void *arg;
+    int chunks;
+} pinned_job_t;
+
+// Narrow the worker to its CPUs on the chunk's node (a worker pinned by
+// threadpool_create_pinned stays where it is when it already is on that
+// node) and restore its own affinity afterwards
+static void pinned_task(void *arg, int chunk, int worker) {
+    const pinned_job_t *job = arg;
+#ifdef NUMA_LINUX
+    cpu_set_t saved, target;
+    const int node = numa_chunk_node(chunk, job->chunks);
+    const int pin = numa_num_nodes() > 1 && sched_getaffinity(0, sizeof(saved), &saved) == 0;
+    if (pin) {
+        CPU_AND(&target, &saved, &topo.cpus[node]);
+        if (CPU_COUNT(&target) == 0) target = topo.cpus[node];
+        sched_setaffinity(0, sizeof(target), &target);
+    }
+    job->fn(job->arg, chunk, worker);
+    if (pin) sched_setaffinity(0, sizeof(saved), &saved);
+#else
+    job->fn(job->arg, chunk, worker);
+#endif
+}
+
+void numa_run_chunks(threadpool_t *pool, int chunks, tp_task_fn fn, void *arg) {
+    if (!pool) {
+        for (int c = 0; c < chunks; c++) fn(arg, c, 0);
+        return;
+    }
+    pinned_job_t job = {fn, arg, chunks};
+    threadpool_run(pool, chunks, pinned_task, &job);
+}
+
+// ============================================================================
+// Allocation and placement
+// ============================================================================
+
+typedef struct {
+    numa_fill_fn fill;
+    void *arg, *buf;
+    long count;
+    int chunks;
+} fill_job_t;
+
+static void fill_task(void *arg, int chunk, int worker) {
+    const fill_job_t *job = arg;
+    long begin, end;
+    (void)worker;
+    numa_chunk_range(job->count, job->chunks, chunk, &begin, &end);
+    if (end > begin) job->fill(job->arg, job->buf, begin, end);
+}
+
+static size_t mapping_bytes(long count, size_t elem_size) {
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t bytes = (size_t)count * elem_size;
+    return (bytes + page - 1) / page * page;
+}
+
+#ifdef NUMA_LINUX
+static int bind_range(void *addr, size_t len, int mode, const unsigned long *mask) {
+    if (len == 0) return 0;
+    return syscall(SYS_mbind, addr, len, mode, mask, (unsigned long)NUMA_MAX_NODES + 1, 0) == 0 ? 0 : -1;
+}
+
+// Apply interleave / bind before anything touches the pages
+static int apply_policy(char *buf, long count, size_t elem_size, int chunks, numa_policy_t policy) {
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long)) + 1];
+    if (policy == NUMA_INTERLEAVE) {
+        memset(mask, 0, sizeof(mask));
+        for (int n = 0; n < numa_num_nodes(); n++)
+            mask[topo.id[n] / (8 * sizeof(unsigned long))] |= 1ul << (topo.id[n] % (8 * sizeof(unsigned long)));
+        return bind_range(buf, mapping_bytes(count, elem_size), MPOL_INTERLEAVE, mask);
+    }
+    // bind: whole pages of each chunk, a shared boundary page goes to the later chunk
+    for (int c = 0; c < chunks; c++) {
+        long begin, end;
+        numa_chunk_range(count, chunks, c, &begin, &end);
+        const size_t p0 = (size_t)begin * elem_size / page * page;
+        const size_t p1 = (c == chunks - 1) ? mapping_bytes(count, elem_size)
+                                            : (size_t)end * elem_size / page * page;
+        if (p1 <= p0) continue;
+        const int id = topo.id[numa_chunk_node(c, chunks)];
+        memset(mask, 0, sizeof(mask));
+        mask[id / (8 * sizeof(unsigned long))] |= 1ul << (id % (8 * sizeof(unsigned long)));
+        if (bind_range(buf + p0, p1 - p0, MPOL_BIND, mask) != 0) return -1;
+    }
+    return 0;
+}
+#endif
+
+void *numa_alloc_init(long count, size_t elem_size, int chunks, numa_policy_t policy,
+                      threadpool_t *pool, numa_fill_fn fill, void *arg, int *applied) {
+    if (applied) *applied = 1;
+    if (count < 1 || chunks < 1) return NULL;
+    // Fresh anonymous pages, so nothing has been touched yet
+    void *buf = mmap(NULL, mapping_bytes(count, elem_size), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) return NULL;
+
+    fill_job_t job = {fill, arg, buf, count, chunks};
+    if (policy == NUMA_SERIAL) {
+        fill(arg, buf, 0, count);
+        return buf;
+    }
+    if (policy == NUMA_INTERLEAVE || policy == NUMA_BIND) {
+#ifdef NUMA_LINUX
+        const int ok = apply_policy(buf, count, elem_size, chunks, policy) == 0;
+#else
+        const int ok = 0;
+#endif
+        if (!ok && applied) *applied = 0;
+    }
+    numa_run_chunks(pool, chunks, fill_task, &job);
+    return buf;
+}
+
+void numa_free(void *buf, long count, size_t elem_size) {
+    if (buf) munmap(buf, mapping_bytes(count, elem_size));
+}
+
+int numa_page_report(const void *buf, long count, size_t elem_size, int chunks,
+                     long *pages, double *remote_ratio) {
+    memset(pages, 0, sizeof(long) * NUMA_MAX_NODES);
+    *remote_ratio = -1.0;
+#ifdef NUMA_LINUX
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const long npages = (long)(mapping_bytes(count, elem_size) / page);
+    const long per_chunk_elems = count / chunks > 0 ? count / chunks : 1;
+    void *addr[PAGE_BATCH];
+    int status[PAGE_BATCH];
+    long known = 0, remote = 0;
+    for (long p0 = 0; p0 < npages; p0 += PAGE_BATCH) {
+        const long batch = (npages - p0 < PAGE_BATCH) ? npages - p0 : PAGE_BATCH;
+        for (long p = 0; p < batch; p++) addr[p] = (char *)buf + (p0 + p) * page;
+        if (syscall(SYS_move_pages, 0, batch, addr, NULL, status, 0) != 0) return -1;
+        for (long p = 0; p < batch; p++) {
+            if (status[p] < 0) continue;    // Not present
+            int node = 0;
+            while (node < topo.nodes - 1 && topo.id[node] != status[p]) node++;
+            pages[node]++;
+            // Chunk of the page's first element; the formula inverts numa_chunk_range
+            const long elem = (long)((p0 + p) * page / elem_size);
+            long chunk = elem / per_chunk_elems;
+            while (chunk > 0 && count * chunk / chunks > elem) chunk--;
+            while (chunk < chunks - 1 && count * (chunk + 1) / chunks <= elem) chunk++;
+            remote += node != numa_chunk_node((int)chunk, chunks);
+            known++;
+        }
+    }
+    if (known > 0) *remote_ratio = (double)remote / known;
+    return 0;
+#else
+    (void)buf; (void)count; (void)elem_size; (void)chunks;
+    return -1;
+#endif
+}
@@ -0,0 +1,85 @@
+/*
+ * NUMA placement for the TP2 parallel benchmarks.
+ *
+ * Linux places a page on the node of the thread that first writes it, so
+ * data initialized by one thread ends up behind one memory controller no
+ * matter how the work is split later. Here a buffer is cut into chunks,
+ * chunk c belongs to node numa_chunk_node(c), and the same mapping drives
+ * both initialization and the compute phase (numa_run_chunks), so the
+ * pages a thread touches are the pages local to it. Policies:
+ *   serial       the calling thread touches everything (the old behaviour)
+ *   first-touch  each chunk is written by a pool task pinned to its node
+ *   interleave   pages round-robin over all nodes (mbind MPOL_INTERLEAVE)
+ *   bind         each chunk mbind()-ed to its node, independent of who
+ *                touches it first
+ * Topology comes from /sys/devices/system/node and placement from the
+ * raw mbind / move_pages system calls, so no libnuma is needed. Elsewhere,
+ * or on a single node, everything degrades to one node and no pinning.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_NUMA_H
+#define TP2_NUMA_H
+
+#include <stddef.h>
+
+#include "threadpool.h"
+
+#define NUMA_MAX_NODES 64
+
+typedef enum {
+    NUMA_SERIAL,
+    NUMA_FIRST_TOUCH,
+    NUMA_INTERLEAVE,
+    NUMA_BIND,
+    NUMA_NUM_POLICIES
+} numa_policy_t;
+
+const char *numa_policy_name(numa_policy_t policy);
+
+// Policy from its name; returns -1 for an unknown name
+int numa_parse_policy(const char *name, numa_policy_t *policy);
+
+// Nodes with CPUs (at least 1), and the CPUs of one node
+int numa_num_nodes(void);
+int numa_node_cpus(int node);
+
+// Node owning chunk c of `chunks`: consecutive chunks share a node
+static inline int numa_chunk_node(int chunk, int chunks) {
+    return (int)((long)chunk * numa_num_nodes() / chunks);
+}
+
+// Restrict the calling thread to the CPUs of node (no-op on one node).
+// Returns 0 on success, -1 if the affinity could not be set.
+int numa_run_on_node(int node);
+
+// fn(arg, chunk, worker) for every chunk, each on a thread pinned to the
+// chunk's node; pool may be NULL (runs on the caller, unpinned)
+void numa_run_chunks(threadpool_t *pool, int chunks, tp_task_fn fn, void *arg);
+
+// Writes elements [begin, end) of buf, the buffer being initialized
+typedef void (*numa_fill_fn)(void *arg, void *buf, long begin, long end);
+
+// Allocate count elements of elem_size bytes (page aligned), apply policy
+// over `chunks` equal chunks and initialize them with fill. Returns NULL
+// on allocation failure; a policy the kernel refuses (no mbind) falls back
+// to first-touch and *applied (may be NULL) is set to 0.
+void *numa_alloc_init(long count, size_t elem_size, int chunks, numa_policy_t policy,
+                      threadpool_t *pool, numa_fill_fn fill, void *arg, int *applied);
+void numa_free(void *buf, long count, size_t elem_size);
+
+// Element range of chunk c when count elements are split into chunks
+static inline void numa_chunk_range(long count, int chunks, int c, long *begin, long *end) {
+    *begin = count * c / chunks;
+    *end = count * (c + 1) / chunks;
+}
+
+// Pages of the buffer per node (pages[NUMA_MAX_NODES]) and the fraction
+// of pages whose node differs from the node of the chunk they belong to.
+// Returns -1 when the kernel cannot report page locations.
+int numa_page_report(const void *buf, long count, size_t elem_size, int chunks,
+                     long *pages, double *remote_ratio);
+
+#endif // TP2_NUMA_H
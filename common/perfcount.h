@@ -0,0 +1,102 @@
+/*
+ * Hardware cache-miss counters for the TP2 benchmarks.
+ *
+ * Linux perf_event_open() on the calling thread, user space only (works
+ * with perf_event_paranoid <= 2). L1D read misses and last-level cache
+ * misses are counted together. Elsewhere, or when the kernel/VM exposes no
+ * hardware counters, perf_open() fails and callers print "n/a".
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_PERFCOUNT_H
+#define TP2_PERFCOUNT_H
+
+enum { PERF_L1D_MISS, PERF_LLC_MISS, PERF_NUM_EVENTS };
+
+typedef struct {
+    int fd[PERF_NUM_EVENTS];
+} perf_counters_t;
+
+#ifdef __linux__
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static inline int perf_open_event(unsigned type, unsigned long long config) {
+    struct perf_event_attr pe;
+    memset(&pe, 0, sizeof(pe));
+    pe.size = sizeof(pe);
+    pe.type = type;
+    pe.config = config;
+    pe.disabled = 1;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+static inline void perf_close(perf_counters_t *pc) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (pc->fd[e] >= 0) close(pc->fd[e]);
+        pc->fd[e] = -1;
+    }
+}
+
+// Returns 0 when every counter could be opened, -1 otherwise
+static inline int perf_open(perf_counters_t *pc) {
+    pc->fd[PERF_L1D_MISS] = perf_open_event(PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    pc->fd[PERF_LLC_MISS] = perf_open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (pc->fd[e] < 0) {
+            perf_close(pc);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline void perf_start(perf_counters_t *pc) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        ioctl(pc->fd[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static inline void perf_stop(perf_counters_t *pc, long long counts[PERF_NUM_EVENTS]) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        ioctl(pc->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(pc->fd[e], &counts[e], sizeof(long long)) != sizeof(long long)) counts[e] = -1;
+    }
+}
+
+// Current counts of running counters, without stopping or resetting them
+static inline void perf_read(perf_counters_t *pc, long long counts[PERF_NUM_EVENTS]) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++)
+        if (read(pc->fd[e], &counts[e], sizeof(long long)) != sizeof(long long)) counts[e] = -1;
+}
+#else
+static inline int perf_open(perf_counters_t *pc) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) pc->fd[e] = -1;
+    return -1;
+}
+
+static inline void perf_close(perf_counters_t *pc) { (void)pc; }
+static inline void perf_start(perf_counters_t *pc) { (void)pc; }
+
+static inline void perf_stop(perf_counters_t *pc, long long counts[PERF_NUM_EVENTS]) {
+    (void)pc;
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) counts[e] = -1;
+}
+
+static inline void perf_read(perf_counters_t *pc, long long counts[PERF_NUM_EVENTS]) {
+    perf_stop(pc, counts);
+}
+#endif
+
+#endif // TP2_PERFCOUNT_H
@@ -0,0 +1,219 @@
+/*
+ * Scoped phase profiler for the TP2 benchmarks.
+ *
+ * The Amdahl fractions in results.txt are Callgrind instruction counts:
+ * they ignore memory stalls and need a 10-25x memory blow-up, which ruled
+ * out N = 10^8. This measures the same split natively, in time:
+ *
+ *   void add_noise() {
+ *       PHASE_SCOPE("add_noise", PHASE_SERIAL);
+ *       ...
+ *   }
+ *
+ * PHASE_SCOPE reads the time-stamp counter when the scope is entered and
+ * again when it is left (a cleanup attribute, the C form of an RAII
+ * guard), including on an early return. At exit a table gives the time of
+ * each phase, the part of the run outside every phase, and the
+ * wall-clock sequential fraction fs = serial time / total time with the
+ * Amdahl and Gustafson speedups it implies. PHASE_PERF=1 in the
+ * environment adds per-phase L1D / LLC misses (common/perfcount.h), and
+ * with TP2_RESULTS set every phase time and fs are also appended as
+ * structured results (common/results.h), tagged with the PHASE_PARAM
+ * string (e.g. "N=512").
+ *
+ * Everything compiles away unless PHASE_PROFILE is defined, so the
+ * Callgrind builds of the same source are unchanged. One scope costs two
+ * counter reads (tens of ns, plus two read() calls with PHASE_PERF); the
+ * report states the measured overhead.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_PHASE_H
+#define TP2_PHASE_H
+
+typedef enum { PHASE_SERIAL, PHASE_PARALLEL } phase_kind_t;
+
+#ifndef PHASE_PROFILE
+
+#define PHASE_SCOPE(name, kind) ((void)0)
+#define PHASE_PARAM(...) ((void)0)
+
+#else
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "timing.h"
+#include "perfcount.h"
+#include "results.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t phase_ticks(void) { return __rdtsc(); }
+#define PHASE_CLOCK "TSC"
+#elif defined(__aarch64__)
+static inline uint64_t phase_ticks(void) {
+    uint64_t v;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+}
+#define PHASE_CLOCK "CNTVCT"
+#else
+static inline uint64_t phase_ticks(void) { return (uint64_t)get_time_ns(); }
+#define PHASE_CLOCK "monotonic clock"
+#endif
+
+#define PHASE_MAX           32
+#define PHASE_OVERHEAD_RUNS 10000
+
+typedef struct {
+    const char *name;
+    phase_kind_t kind;
+    long calls;
+    uint64_t ticks;
+    long long events[PERF_NUM_EVENTS];
+} phase_stat_t;
+
+static struct {
+    phase_stat_t stat[PHASE_MAX];
+    int count;
+    long scopes;             // Scopes entered, for the overhead estimate
+    uint64_t tick0;
+    double ns0;
+    int perf;                // Counters open
+    perf_counters_t pc;
+    char param[64];          // Problem description for the results file
+} phase_state;
+
+typedef struct {
+    int id;                  // -1: not recorded (overhead calibration)
+    uint64_t start;
+    long long events[PERF_NUM_EVENTS];
+} phase_scope_t;
+
+static inline int phase_register(const char *name, phase_kind_t kind) {
+    for (int i = 0; i < phase_state.count; i++)
+        if (strcmp(phase_state.stat[i].name, name) == 0) return i;
+    if (phase_state.count == PHASE_MAX) return -1;
+    phase_stat_t *st = &phase_state.stat[phase_state.count];
+    memset(st, 0, sizeof(*st));
+    st->name = name;
+    st->kind = kind;
+    return phase_state.count++;
+}
+
+static inline phase_scope_t phase_begin(int id) {
+    phase_scope_t s;
+    s.id = id;
+    phase_state.scopes++;
+    if (phase_state.perf) perf_read(&phase_state.pc, s.events);
+    s.start = phase_ticks();
+    return s;
+}
+
+static inline void phase_end(phase_scope_t *s) {
+    const uint64_t end = phase_ticks();
+    long long events[PERF_NUM_EVENTS];
+    if (phase_state.perf) perf_read(&phase_state.pc, events);
+    if (s->id < 0) return;
+    phase_stat_t *st = &phase_state.stat[s->id];
+    st->calls++;
+    st->ticks += end - s->start;
+    if (phase_state.perf)
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) st->events[e] += events[e] - s->events[e];
+}
+
+// Describe the problem (printf format), e.g. PHASE_PARAM("N=%d", N)
+#define PHASE_PARAM(...) snprintf(phase_state.param, sizeof(phase_state.param), __VA_ARGS__)
+
+#define PHASE_CONCAT_(a, b) a##b
+#define PHASE_CONCAT(a, b) PHASE_CONCAT_(a, b)
+
+// Time the rest of the enclosing block as phase `name`
+#define PHASE_SCOPE(name, kind)                                                           \
+    static int PHASE_CONCAT(phase_id_, __LINE__) = -2;                                    \
+    if (PHASE_CONCAT(phase_id_, __LINE__) == -2)                                          \
+        PHASE_CONCAT(phase_id_, __LINE__) = phase_register(name, kind);                   \
+    phase_scope_t PHASE_CONCAT(phase_scope_, __LINE__) __attribute__((cleanup(phase_end))) \
+        = phase_begin(PHASE_CONCAT(phase_id_, __LINE__))
+
+static void phase_report(void) {
+    const uint64_t tick1 = phase_ticks();
+    const double ns1 = get_time_ns();
+    const double total_ns = ns1 - phase_state.ns0;
+    const double ticks_per_ns = (double)(tick1 - phase_state.tick0) / total_ns;
+
+    // Cost of one empty scope, measured the way the phases use it
+    const long scopes = phase_state.scopes;
+    const uint64_t o0 = phase_ticks();
+    for (int i = 0; i < PHASE_OVERHEAD_RUNS; i++) {
+        phase_scope_t s __attribute__((cleanup(phase_end))) = phase_begin(-1);
+        (void)s;
+    }
+    const double scope_ns = (double)(phase_ticks() - o0) / ticks_per_ns / PHASE_OVERHEAD_RUNS;
+
+    // Results name: the main source file ("exercise3.c" -> "exercise3_phases")
+    char bench[64];
+    snprintf(bench, sizeof(bench), "%s", results_program(__BASE_FILE__));
+    bench[strcspn(bench, ".")] = '\0';
+    strncat(bench, "_phases", sizeof(bench) - strlen(bench) - 1);
+
+    double serial_ns = 0.0, phases_ns = 0.0;
+    printf("\nPhase profile (%s at %.3f GHz, %s):\n", PHASE_CLOCK, ticks_per_ns,
+           phase_state.perf ? "with cache counters" : "PHASE_PERF=1 adds cache counters");
+    printf("%-20s %-9s %7s %12s %8s %14s %14s\n", "Phase", "Kind", "Calls", "Time (ms)", "Share",
+           "L1D misses", "LLC misses");
+    printf("------------------------------------------------------------------------------------------\n");
+    for (int i = 0; i < phase_state.count; i++) {
+        const phase_stat_t *st = &phase_state.stat[i];
+        const double ns = st->ticks / ticks_per_ns;
+        phases_ns += ns;
+        if (st->kind == PHASE_SERIAL) serial_ns += ns;
+        results_record(bench, st->name, phase_state.param, "time", ns / 1e6, "ms");
+        printf("%-20s %-9s %7ld %12.3f %7.2f%%", st->name, st->kind == PHASE_SERIAL ? "serial" : "parallel",
+               st->calls, ns / 1e6, 100.0 * ns / total_ns);
+        if (phase_state.perf) printf(" %14lld %14lld\n", st->events[PERF_L1D_MISS], st->events[PERF_LLC_MISS]);
+        else printf(" %14s %14s\n", "n/a", "n/a");
+    }
+    printf("%-20s %-9s %7s %12.3f %7.2f%%\n", "(outside phases)", "-", "-",
+           (total_ns - phases_ns) / 1e6, 100.0 * (total_ns - phases_ns) / total_ns);
+    printf("------------------------------------------------------------------------------------------\n");
+    printf("%-20s %-9s %7s %12.3f %7.2f%%\n\n", "Total", "", "", total_ns / 1e6, 100.0);
+
+    const double fs = serial_ns / total_ns;
+    results_record(bench, "total", phase_state.param, "time", total_ns / 1e6, "ms");
+    results_record(bench, "total", phase_state.param, "fs", fs, "fraction");
+    printf("Sequential fraction (wall clock): fs = %.6f (%.4f%%)\n", fs, 100.0 * fs);
+    if (fs > 0.0) printf("  Amdahl limit 1/fs:  %.1fx\n", 1.0 / fs);
+    printf("  S(p) at p = 8 / 64: Amdahl %.2fx / %.2fx, Gustafson %.2fx / %.2fx\n",
+           1.0 / (fs + (1.0 - fs) / 8), 1.0 / (fs + (1.0 - fs) / 64), fs + 8 * (1.0 - fs),
+           fs + 64 * (1.0 - fs));
+    printf("  Profiler overhead:  %ld scopes x %.1f ns = %.4f%% of the run\n", scopes, scope_ns,
+           100.0 * scopes * scope_ns / total_ns);
+    if (phase_state.perf) perf_close(&phase_state.pc);
+}
+
+__attribute__((constructor))
+static void phase_init(void) {
+    init_timing();
+    phase_state.ns0 = get_time_ns();
+    phase_state.tick0 = phase_ticks();
+    const char *env = getenv("PHASE_PERF");
+    if (env && atoi(env) > 0) {
+        if (perf_open(&phase_state.pc) == 0) {
+            perf_start(&phase_state.pc);
+            phase_state.perf = 1;
+        } else {
+            fprintf(stderr, "PHASE_PERF: hardware counters unavailable, timing only\n");
+        }
+    }
+    atexit(phase_report);
+}
+
+#endif // PHASE_PROFILE
+
+#endif // TP2_PHASE_H
@@ -0,0 +1,61 @@
+/*
+ * Structured benchmark results for the TP2 benchmarks.
+ *
+ * When TP2_RESULTS names a file, results_record() appends one CSV row per
+ * measurement:
+ *
+ *   benchmark,kernel,param,metric,value,unit
+ *
+ * e.g. "exercise1_O2,U=8 (8 accum ILP),N=1000000,avg_time,76088.3,ns".
+ * The console tables are unchanged; `python3 analysis.py ingest` files the
+ * rows into the run history (keyed by commit, host and compiler) and
+ * `analysis.py check` flags regressions against it. Units decide the
+ * direction: times (ns, ms, s) regress upwards, rates (GFLOP/s, GB/s)
+ * downwards, anything else is only recorded.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_RESULTS_H
+#define TP2_RESULTS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Copy s into out with commas (the CSV separator) and runs of spaces removed
+static inline void results_field(char *out, size_t size, const char *s) {
+    size_t o = 0;
+    for (; *s && o + 1 < size; s++) {
+        if (*s == ',' || *s == '\n') continue;
+        if (*s == ' ' && (o == 0 || out[o - 1] == ' ')) continue;
+        out[o++] = *s;
+    }
+    while (o > 0 && out[o - 1] == ' ') o--;
+    out[o] = '\0';
+}
+
+// Program name without directories ("./exercise1_O2" -> "exercise1_O2")
+static inline const char *results_program(const char *argv0) {
+    const char *slash = strrchr(argv0, '/');
+    return slash ? slash + 1 : argv0;
+}
+
+static inline void results_record(const char *benchmark, const char *kernel, const char *param,
+                                  const char *metric, double value, const char *unit) {
+    const char *path = getenv("TP2_RESULTS");
+    if (!path || !*path) return;
+    FILE *f = fopen(path, "a");
+    if (!f) return;
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0) fprintf(f, "benchmark,kernel,param,metric,value,unit\n");
+    char b[128], k[128], p[128];
+    results_field(b, sizeof(b), benchmark);
+    results_field(k, sizeof(k), kernel);
+    results_field(p, sizeof(p), param);
+    fprintf(f, "%s,%s,%s,%s,%.9g,%s\n", b, k, p, metric, value, unit);
+    fclose(f);
+}
+
+#endif // TP2_RESULTS_H
@@ -0,0 +1,139 @@
+/*
+ * Incrementally maintained sum of a double array.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sumtree.h"
+
+#define B SUMTREE_FANOUT
+
+// Fixed-order sum of one block: 8 lanes, then a pairwise combine
+static double block_sum(const double *x, long len) {
+    double acc[B] = {0};
+    long i = 0;
+    for (; i + B <= len; i += B)
+        for (int l = 0; l < B; l++) acc[l] += x[i + l];
+    for (int l = 0; i < len; i++, l++) acc[l] += x[i];
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+// The B children of a node: one cache line
+static double line_sum(const double *c) {
+    return ((c[0] + c[1]) + (c[2] + c[3])) + ((c[4] + c[5]) + (c[6] + c[7]));
+}
+
+static void recompute_block(sumtree_t *t, long b) {
+    const long begin = b * t->block;
+    const long len = (t->n - begin < t->block) ? t->n - begin : t->block;
+    t->nodes[b] = block_sum(t->data + begin, len);
+}
+
+static void mark_block(sumtree_t *t, long b) {
+    if (t->dirty[b]) return;
+    t->dirty[b] = 1;
+    t->queue[t->queued++] = b;
+}
+
+int sumtree_init(sumtree_t *t, double *data, long n, int block) {
+    memset(t, 0, sizeof(*t));
+    if (block == 0) block = SUMTREE_DEFAULT_BLOCK;
+    if (!data || n < 1 || block < B || block % B != 0) return -1;
+    t->data = data;
+    t->n = n;
+    t->block = block;
+
+    // Level sizes, each padded to whole cache lines of nodes
+    long total = 0;
+    t->count[0] = (n + block - 1) / block;
+    for (int l = 0;; l++) {
+        t->offset[l] = total;
+        total += (t->count[l] + B - 1) / B * B;
+        t->levels = l + 1;
+        if (t->count[l] == 1) break;
+        if (l + 1 == SUMTREE_MAX_LEVELS) return -1;
+        t->count[l + 1] = (t->count[l] + B - 1) / B;
+    }
+    t->nodes = aligned_alloc(64, total * sizeof(double));
+    t->dirty = calloc(total, 1);
+    t->queue = malloc(t->count[0] * sizeof(long));
+    t->next = malloc(t->count[0] * sizeof(long));
+    if (!t->nodes || !t->dirty || !t->queue || !t->next) {
+        sumtree_free(t);
+        return -1;
+    }
+    memset(t->nodes, 0, total * sizeof(double));
+
+    for (long b = 0; b < t->count[0]; b++) recompute_block(t, b);
+    for (int l = 1; l < t->levels; l++)
+        for (long i = 0; i < t->count[l]; i++)
+            t->nodes[t->offset[l] + i] = line_sum(t->nodes + t->offset[l - 1] + i * B);
+    return 0;
+}
+
+void sumtree_free(sumtree_t *t) {
+    free(t->nodes);
+    free(t->dirty);
+    free(t->queue);
+    free(t->next);
+    memset(t, 0, sizeof(*t));
+}
+
+void sumtree_set(sumtree_t *t, long i, double value) {
+    t->data[i] = value;
+    mark_block(t, i / t->block);
+}
+
+void sumtree_write(sumtree_t *t, long begin, const double *values, long count) {
+    if (count < 1) return;
+    memcpy(t->data + begin, values, count * sizeof(double));
+    sumtree_touch(t, begin, begin + count);
+}
+
+void sumtree_touch(sumtree_t *t, long begin, long end) {
+    if (end <= begin) return;
+    for (long b = begin / t->block; b <= (end - 1) / t->block; b++) mark_block(t, b);
+}
+
+double sumtree_total(sumtree_t *t) {
+    long pending = t->queued;
+    // Many dirty blocks: visit them in address order so the prefetcher
+    // streams the data instead of jumping between random blocks
+    if (pending > t->count[0] / B) {
+        pending = 0;
+        for (long b = 0; b < t->count[0]; b++)
+            if (t->dirty[b]) t->queue[pending++] = b;
+    }
+    for (long q = 0; q < pending; q++) {
+        recompute_block(t, t->queue[q]);
+        t->dirty[t->queue[q]] = 0;
+    }
+    // Each level: the distinct parents of the nodes just recomputed
+    for (int l = 1; l < t->levels; l++) {
+        unsigned char *dirty = t->dirty + t->offset[l];
+        double *level = t->nodes + t->offset[l];
+        const double *below = t->nodes + t->offset[l - 1];
+        long parents = 0;
+        for (long q = 0; q < pending; q++) {
+            const long p = t->queue[q] / B;
+            if (dirty[p]) continue;
+            dirty[p] = 1;
+            t->next[parents++] = p;
+        }
+        for (long q = 0; q < parents; q++) {
+            const long p = t->next[q];
+            level[p] = line_sum(below + p * B);
+            dirty[p] = 0;
+        }
+        long *swap = t->queue;
+        t->queue = t->next;
+        t->next = swap;
+        pending = parents;
+    }
+    t->queued = 0;
+    return t->nodes[t->offset[t->levels - 1]];
+}
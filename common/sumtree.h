@@ -0,0 +1,64 @@
+/*
+ * Incrementally maintained sum of a double array.
+ *
+ * reduction() rescans all N elements on every query even when only a few
+ * changed. A sumtree keeps partial sums over fixed blocks of the caller's
+ * array (SUMTREE_DEFAULT_BLOCK elements) in a B-ary tree with
+ * B = SUMTREE_FANOUT = 8: the 8 children of a node are one 64-byte cache
+ * line, so a node is recomputed with one aligned 8-wide sum. Updates only
+ * mark blocks dirty; sumtree_total() recomputes the dirty blocks and then
+ * the dirty nodes level by level, each once per query however many of its
+ * children changed. k scattered changes therefore cost
+ * O(k (block + B log_B(N / block))) instead of O(N).
+ *
+ * Every sum is recomputed from the data in a fixed order, never adjusted
+ * by deltas, so the total is bit-identical to that of a tree freshly built
+ * over the current contents (no drift over many updates). It differs from
+ * a sequential left-to-right sum only in rounding.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_SUMTREE_H
+#define TP2_SUMTREE_H
+
+#define SUMTREE_FANOUT        8      // Children per node: one cache line
+#define SUMTREE_DEFAULT_BLOCK 256    // Elements per leaf block
+#define SUMTREE_MAX_LEVELS    24
+
+typedef struct {
+    double *data;            // Caller's array (not owned)
+    long n;
+    int block;               // Elements per leaf
+    int levels;              // Level 0: block sums ... levels - 1: the root
+    long count[SUMTREE_MAX_LEVELS];    // Nodes per level
+    long offset[SUMTREE_MAX_LEVELS];   // First node of each level in nodes[]
+    double *nodes;           // Every level, each padded with zeros to whole lines
+    unsigned char *dirty;    // Per node: queued for recomputation
+    long *queue, *next;      // Dirty nodes of the level being flushed / the next
+    long queued;             // Dirty leaf blocks waiting in queue
+} sumtree_t;
+
+// Build the tree over data[0 .. n); block = 0 picks SUMTREE_DEFAULT_BLOCK
+// (otherwise a positive multiple of SUMTREE_FANOUT). Returns 0, or -1 on
+// invalid arguments or allocation failure.
+int sumtree_init(sumtree_t *t, double *data, long n, int block);
+void sumtree_free(sumtree_t *t);
+
+// Point update: data[i] = value
+void sumtree_set(sumtree_t *t, long i, double value);
+
+// Range update: data[begin .. begin + count) = values[0 .. count)
+void sumtree_write(sumtree_t *t, long begin, const double *values, long count);
+
+// data[begin .. end) was modified in place by the caller
+void sumtree_touch(sumtree_t *t, long begin, long end);
+
+// Sum of the array: recomputes the dirty blocks and their ancestors
+double sumtree_total(sumtree_t *t);
+
+// Leaf blocks that the next sumtree_total() will recompute
+static inline long sumtree_pending(const sumtree_t *t) { return t->queued; }
+
+#endif // TP2_SUMTREE_H
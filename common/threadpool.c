@@ -0,0 +1,316 @@
+/*
+ * Work-stealing thread pool for the TP2 parallel benchmarks.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+
+// Task deque: the owner works at `bottom`, thieves take from `top`
+typedef struct {
+    pthread_mutex_t lock;
+    int *items;
+    int capacity;
+    int top, bottom;
+    long executed, stolen;
+} tp_deque_t;
+
+typedef struct {
+    threadpool_t *pool;
+    int id;
+} tp_worker_arg_t;
+
+struct threadpool {
+    int nthreads;
+    int active;                // Workers taking part in batches (the rest sleep)
+    pthread_t *threads;
+    tp_worker_arg_t *args;
+    tp_deque_t *deques;
+    int *cpus;                 // CPU of each worker, NULL when unpinned
+    topology_affinity_t caller_affinity;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;       // New batch or shutdown
+    pthread_cond_t done;       // Batch finished
+    unsigned long generation;
+    int shutdown;
+
+    tp_task_fn fn;
+    void *arg;
+    int remaining;             // Tasks of the current batch not yet finished
+};
+
+// ============================================================================
+// Deque operations
+// ============================================================================
+
+static int deque_pop_bottom(tp_deque_t *d, int *task) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) {
+        *task = d->items[--d->bottom];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static int deque_steal_top(tp_deque_t *d, int *task) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) {
+        *task = d->items[d->top++];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+// ============================================================================
+// Workers
+// ============================================================================
+
+static void finish_task(threadpool_t *pool) {
+    if (__atomic_sub_fetch(&pool->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Drain own deque, then steal until every deque is empty
+static void work_until_empty(threadpool_t *pool, int id, unsigned *seed) {
+    tp_deque_t *own = &pool->deques[id];
+    const int P = __atomic_load_n(&pool->active, __ATOMIC_RELAXED);
+    int task;
+
+    for (;;) {
+        while (deque_pop_bottom(own, &task)) {
+            pool->fn(pool->arg, task, id);
+            own->executed++;
+            finish_task(pool);
+        }
+
+        // xorshift victim selection, then scan every other worker once
+        *seed ^= *seed << 13; *seed ^= *seed >> 17; *seed ^= *seed << 5;
+        int start = (int)(*seed % (unsigned)P), found = 0;
+        for (int v = 0; v < P && !found; v++) {
+            int victim = (start + v) % P;
+            if (victim == id) continue;
+            if (deque_steal_top(&pool->deques[victim], &task)) {
+                pool->fn(pool->arg, task, id);
+                own->executed++;
+                own->stolen++;
+                finish_task(pool);
+                found = 1;
+            }
+        }
+        if (!found) return;
+    }
+}
+
+static void *worker_main(void *p) {
+    tp_worker_arg_t *wa = p;
+    threadpool_t *pool = wa->pool;
+    unsigned seed = 2463534242u + 977u * (unsigned)wa->id;
+    unsigned long seen = 0;
+
+    if (pool->cpus) topology_pin(pool->cpus[wa->id]);
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shutdown && (pool->generation == seen || wa->id >= pool->active))
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work_until_empty(pool, wa->id, &seed);
+    }
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+// Stop and join workers 1..started-1
+static void pool_join(threadpool_t *pool, int started) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i < started; i++)
+        pthread_join(pool->threads[i], NULL);
+}
+
+static void pool_free(threadpool_t *pool) {
+    if (pool->cpus) topology_set_affinity(&pool->caller_affinity);
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].items);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->args);
+    free(pool->deques);
+    free(pool->cpus);
+    free(pool);
+}
+
+threadpool_t *threadpool_create(int nthreads) {
+    return threadpool_create_pinned(nthreads, NULL);
+}
+
+threadpool_t *threadpool_create_pinned(int nthreads, const int *cpus) {
+    if (nthreads < 1) nthreads = 1;
+    threadpool_t *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+
+    pool->nthreads = nthreads;
+    pool->active = nthreads;
+    pool->threads = calloc(nthreads, sizeof(pthread_t));
+    pool->args = calloc(nthreads, sizeof(tp_worker_arg_t));
+    pool->deques = calloc(nthreads, sizeof(tp_deque_t));
+    if (!pool->threads || !pool->args || !pool->deques) {
+        free(pool->threads); free(pool->args); free(pool->deques); free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (int i = 0; i < nthreads; i++)
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+    if (cpus) {
+        pool->cpus = malloc(sizeof(int) * nthreads);
+        if (pool->cpus) {
+            for (int i = 0; i < nthreads; i++) pool->cpus[i] = cpus[i];
+            topology_get_affinity(&pool->caller_affinity);
+            topology_pin(cpus[0]);
+        }
+    }
+
+    // Worker 0 is the thread calling threadpool_run()
+    for (int i = 1; i < nthreads; i++) {
+        pool->args[i].pool = pool;
+        pool->args[i].id = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->args[i]) != 0) {
+            // Only workers 1..i-1 exist: join those, never the rest
+            pool_join(pool, i);
+            pool_free(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+threadpool_t *threadpool_create_placed(int nthreads, topology_policy_t policy) {
+    if (policy == TOPOLOGY_NONE) return threadpool_create(nthreads);
+    int cpus[TOPOLOGY_MAX_CPUS];
+    if (nthreads < 1 || nthreads > TOPOLOGY_MAX_CPUS ||
+        topology_place(policy, nthreads, cpus) < nthreads) return NULL;
+    return threadpool_create_pinned(nthreads, cpus);
+}
+
+void threadpool_destroy(threadpool_t *pool) {
+    if (!pool) return;
+    pool_join(pool, pool->nthreads);
+    pool_free(pool);
+}
+
+int threadpool_size(const threadpool_t *pool) {
+    return pool->nthreads;
+}
+
+void threadpool_set_active(threadpool_t *pool, int active) {
+    if (active < 1) active = 1;
+    if (active > pool->nthreads) active = pool->nthreads;
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->active, active, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int threadpool_active(const threadpool_t *pool) {
+    return pool->active;
+}
+
+void threadpool_run(threadpool_t *pool, int count, tp_task_fn fn, void *arg) {
+    const int P = pool->active;
+    if (count <= 0) return;
+
+    // Grow the deques before dealing. Out of memory, the caller runs the
+    // whole batch itself rather than dealing into a missing array.
+    for (int w = 0; w < P; w++) {
+        tp_deque_t *d = &pool->deques[w];
+        const int need = (int)((long)count * (w + 1) / P) - (int)((long)count * w / P);
+        if (d->capacity >= need) continue;
+        int *items = malloc(sizeof(int) * need);
+        if (!items) {
+            for (int t = 0; t < count; t++) fn(arg, t, 0);
+            for (int v = 0; v < pool->nthreads; v++)
+                pool->deques[v].executed = pool->deques[v].stolen = 0;
+            pool->deques[0].executed = count;
+            return;
+        }
+        pthread_mutex_lock(&d->lock);
+        free(d->items);
+        d->items = items;
+        d->capacity = need;
+        pthread_mutex_unlock(&d->lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    __atomic_store_n(&pool->remaining, count, __ATOMIC_RELEASE);
+
+    // Deal contiguous chunks; the owner pops from the bottom, so push the
+    // chunk in reverse to run it in ascending order. Parked workers keep
+    // empty deques.
+    for (int w = 0; w < pool->nthreads; w++) {
+        tp_deque_t *d = &pool->deques[w];
+        const int lo = (w < P) ? (int)((long)count * w / P) : 0;
+        const int hi = (w < P) ? (int)((long)count * (w + 1) / P) : 0;
+        pthread_mutex_lock(&d->lock);
+        d->top = 0;
+        d->bottom = 0;
+        for (int t = hi - 1; t >= lo; t--) d->items[d->bottom++] = t;
+        d->executed = 0;
+        d->stolen = 0;
+        pthread_mutex_unlock(&d->lock);
+    }
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    unsigned seed = 88172645u;
+    work_until_empty(pool, 0, &seed);
+
+    pthread_mutex_lock(&pool->lock);
+    while (__atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE) > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void threadpool_stats(const threadpool_t *pool, tp_stats_t *stats) {
+    stats->executed = 0;
+    stats->stolen = 0;
+    for (int i = 0; i < pool->nthreads; i++) {
+        stats->executed += pool->deques[i].executed;
+        stats->stolen += pool->deques[i].stolen;
+    }
+}
+
+int threadpool_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
@@ -0,0 +1,62 @@
+/*
+ * Work-stealing thread pool for the TP2 parallel benchmarks.
+ *
+ * A batch of independent tasks (numbered 0 .. count-1) is dealt out in
+ * contiguous chunks to per-worker deques. A worker pops from the bottom
+ * of its own deque (most recently dealt, best locality) and, once it runs
+ * dry, steals from the top of a random victim's deque. The calling thread
+ * takes part as worker 0, so a pool of P threads uses P cores.
+ *
+ * threadpool_create_pinned() fixes worker i on cpus[i] (see topology.h
+ * for the placement policies); the caller is pinned as worker 0 until
+ * threadpool_destroy() restores its previous affinity.
+ *
+ * threadpool_set_active() parks workers [active, size) between batches:
+ * they sleep, get no tasks and are never stolen from, so their cores are
+ * free for other work until the count is raised again.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_THREADPOOL_H
+#define TP2_THREADPOOL_H
+
+#include "topology.h"
+
+typedef struct threadpool threadpool_t;
+
+// fn(arg, task, worker): worker is in [0, threadpool_size) and is stable
+// for the duration of the task, so it can index per-thread scratch space.
+typedef void (*tp_task_fn)(void *arg, int task, int worker);
+
+// Per-batch statistics, reset by every threadpool_run()
+typedef struct {
+    long executed;   // Tasks run by each worker, summed
+    long stolen;     // Of which were taken from another worker's deque
+} tp_stats_t;
+
+threadpool_t *threadpool_create(int nthreads);
+threadpool_t *threadpool_create_pinned(int nthreads, const int *cpus);
+
+// Pool pinned by a placement policy (TOPOLOGY_NONE: unpinned); NULL when
+// the policy cannot place nthreads threads
+threadpool_t *threadpool_create_placed(int nthreads, topology_policy_t policy);
+void threadpool_destroy(threadpool_t *pool);
+int threadpool_size(const threadpool_t *pool);
+
+// Workers taking part in the next batches, clamped to [1, size]. Only call
+// between threadpool_run() calls.
+void threadpool_set_active(threadpool_t *pool, int active);
+int threadpool_active(const threadpool_t *pool);
+
+// Run fn for every task in [0, count) and wait until all have finished.
+// Out of memory for the task deques, the caller runs them all as worker 0.
+void threadpool_run(threadpool_t *pool, int count, tp_task_fn fn, void *arg);
+
+void threadpool_stats(const threadpool_t *pool, tp_stats_t *stats);
+
+// Number of online CPUs (at least 1)
+int threadpool_cpu_count(void);
+
+#endif // TP2_THREADPOOL_H
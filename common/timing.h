@@ -0,0 +1,62 @@
+/*
+ * Shared timing and resource helpers for the TP2 benchmarks.
+ *
+ * Same clock selection as exercise1 (mach_absolute_time on macOS,
+ * CLOCK_MONOTONIC elsewhere), plus a peak-RSS query so benchmarks can
+ * report memory footprint next to runtime.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_TIMING_H
+#define TP2_TIMING_H
+
+#include <stdint.h>
+#include <sys/resource.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+// High-resolution timing functions
+#ifdef __APPLE__
+static mach_timebase_info_data_t timebase_info;
+
+static inline void init_timing(void) {
+    mach_timebase_info(&timebase_info);
+}
+
+static inline double get_time_ns(void) {
+    uint64_t time = mach_absolute_time();
+    return (double)time * timebase_info.numer / timebase_info.denom;
+}
+#else
+static inline void init_timing(void) {}
+
+static inline double get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+#endif
+
+// ru_maxrss is reported in bytes on macOS and in kilobytes on Linux
+static inline double rusage_maxrss_mb(const struct rusage *ru) {
+#ifdef __APPLE__
+    return (double)ru->ru_maxrss / (1024.0 * 1024.0);
+#else
+    return (double)ru->ru_maxrss / 1024.0;
+#endif
+}
+
+// Peak resident set size of the calling process, in MB
+static inline double peak_rss_mb(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return rusage_maxrss_mb(&ru);
+}
+
+#endif // TP2_TIMING_H
@@ -0,0 +1,335 @@
+/*
+ * CPU topology and thread placement for the TP2 parallel benchmarks.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "topology.h"
+
+#ifdef __linux__
+#include <sched.h>
+#define TOPOLOGY_LINUX 1
+#endif
+
+#define SYS_CPU "/sys/devices/system/cpu"
+
+static const char *policy_names[TOPOLOGY_NUM_POLICIES] = {
+    "compact", "scatter", "one-per-core", "one-per-l3"
+};
+
+const char *topology_policy_name(topology_policy_t policy) {
+    if (policy == TOPOLOGY_NONE) return "none";
+    if (policy < 0 || policy >= TOPOLOGY_NUM_POLICIES) return "?";
+    return policy_names[policy];
+}
+
+int topology_parse_policy(const char *name, topology_policy_t *policy) {
+    if (strcmp(name, "none") == 0) {
+        *policy = TOPOLOGY_NONE;
+        return 0;
+    }
+    for (int p = 0; p < TOPOLOGY_NUM_POLICIES; p++) {
+        if (strcmp(name, policy_names[p]) == 0) {
+            *policy = (topology_policy_t)p;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// ============================================================================
+// Discovery
+// ============================================================================
+
+static struct {
+    int ncpus;
+    topology_cpu_t cpu[TOPOLOGY_MAX_CPUS];
+    int cores, l3s, packages, efficiency;
+    int core_rank[TOPOLOGY_MAX_CPUS];   // Rank of the CPU's core within its L3
+    int l3_rank[TOPOLOGY_MAX_CPUS];     // Rank of the CPU's L3 within its package
+} topo;
+
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+// First line of a sysfs file into buf; returns 0 on success
+static int read_line(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    const int ok = fgets(buf, (int)size, f) != NULL;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+static int read_int(const char *path, int fallback) {
+    char line[64];
+    return read_line(path, line, sizeof(line)) == 0 ? atoi(line) : fallback;
+}
+
+// Parse a cpulist such as "0-3,8-11" into mask[TOPOLOGY_MAX_CPUS];
+// returns the CPU count (0 if the file is missing)
+static int read_cpulist(const char *path, unsigned char *mask) {
+    char line[8192];
+    memset(mask, 0, TOPOLOGY_MAX_CPUS);
+    if (read_line(path, line, sizeof(line)) != 0) return 0;
+    int count = 0;
+    const char *s = line;
+    while (*s && *s != '\n') {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s) break;
+        if (*end == '-') hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi && c < TOPOLOGY_MAX_CPUS; c++) {
+            if (!mask[c]) count++;
+            mask[c] = 1;
+        }
+        s = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+static int lowest(const unsigned char *mask, int fallback) {
+    for (int c = 0; c < TOPOLOGY_MAX_CPUS; c++)
+        if (mask[c]) return c;
+    return fallback;
+}
+
+// Lowest CPU sharing the last-level cache of cpu (-1 if unknown)
+static int llc_domain(int cpu) {
+    int best_level = 0, domain = -1;
+    unsigned char mask[TOPOLOGY_MAX_CPUS];
+    for (int index = 0; index < 8; index++) {
+        char path[128];
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/level", cpu, index);
+        const int level = read_int(path, -1);
+        if (level < 0) break;
+        if (level <= best_level) continue;
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+        if (read_cpulist(path, mask) == 0) continue;
+        best_level = level;
+        domain = lowest(mask, cpu);
+    }
+    return domain;
+}
+
+static void topo_init(void) {
+    unsigned char online[TOPOLOGY_MAX_CPUS], mask[TOPOLOGY_MAX_CPUS];
+    char path[128];
+
+    topo.ncpus = 0;
+#ifdef TOPOLOGY_LINUX
+    if (read_cpulist(SYS_CPU "/online", online) > 0) {
+        // Hybrid x86: the efficiency cores are listed by the cpu_atom PMU
+        unsigned char atom[TOPOLOGY_MAX_CPUS];
+        const int have_atom = read_cpulist("/sys/devices/cpu_atom/cpus", atom) > 0;
+        int max_capacity = 0;
+
+        for (int c = 0; c < TOPOLOGY_MAX_CPUS; c++) {
+            if (!online[c]) continue;
+            topology_cpu_t *t = &topo.cpu[topo.ncpus++];
+            t->cpu = c;
+            snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/physical_package_id", c);
+            t->package = read_int(path, 0);
+
+            snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/thread_siblings_list", c);
+            if (read_cpulist(path, mask) > 0) {
+                t->core = lowest(mask, c);
+                t->smt = 0;
+                for (int s = 0; s < c; s++) t->smt += mask[s];
+            } else {
+                t->core = c;
+                t->smt = 0;
+            }
+
+            t->l3 = llc_domain(c);
+            if (t->l3 < 0) {
+                snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/core_siblings_list", c);
+                t->l3 = read_cpulist(path, mask) > 0 ? lowest(mask, c) : 0;
+            }
+
+            // big.LITTLE: capacity below the maximum marks an efficiency core
+            snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cpu_capacity", c);
+            t->type = have_atom ? atom[c] : read_int(path, 0);
+            if (!have_atom && t->type > max_capacity) max_capacity = t->type;
+        }
+        if (!have_atom)
+            for (int i = 0; i < topo.ncpus; i++)
+                topo.cpu[i].type = (topo.cpu[i].type > 0 && topo.cpu[i].type < max_capacity);
+    }
+#endif
+    if (topo.ncpus == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n < 1) n = 1;
+        if (n > TOPOLOGY_MAX_CPUS) n = TOPOLOGY_MAX_CPUS;
+        for (int c = 0; c < n; c++)
+            topo.cpu[topo.ncpus++] = (topology_cpu_t){c, 0, 0, c, 0, 0};
+    }
+
+    // Counts and ranks (sysfs lists are small, quadratic scans are fine)
+    topo.cores = topo.l3s = topo.packages = topo.efficiency = 0;
+    for (int i = 0; i < topo.ncpus; i++) {
+        const topology_cpu_t *t = &topo.cpu[i];
+        int new_l3 = 1, new_package = 1;
+        topo.core_rank[i] = topo.l3_rank[i] = 0;
+        for (int j = 0; j < topo.ncpus; j++) {
+            const topology_cpu_t *u = &topo.cpu[j];
+            if (j < i && u->l3 == t->l3) new_l3 = 0;
+            if (j < i && u->package == t->package) new_package = 0;
+            if (u->smt == 0 && u->l3 == t->l3 && u->core < t->core) topo.core_rank[i]++;
+        }
+        for (int j = 0; j < topo.ncpus; j++) {
+            const topology_cpu_t *u = &topo.cpu[j];
+            if (u->package != t->package || u->l3 >= t->l3) continue;
+            int first = 1;  // Count each smaller L3 of the package once
+            for (int k = 0; k < j; k++)
+                if (topo.cpu[k].l3 == u->l3) first = 0;
+            topo.l3_rank[i] += first;
+        }
+        topo.cores += (t->smt == 0);
+        topo.l3s += new_l3;
+        topo.packages += new_package;
+        topo.efficiency += (t->type != 0 && t->smt == 0);
+    }
+}
+
+int topology_num_cpus(void) {
+    pthread_once(&topo_once, topo_init);
+    return topo.ncpus;
+}
+
+const topology_cpu_t *topology_cpu(int i) {
+    pthread_once(&topo_once, topo_init);
+    return (i >= 0 && i < topo.ncpus) ? &topo.cpu[i] : NULL;
+}
+
+int topology_num_cores(void)      { pthread_once(&topo_once, topo_init); return topo.cores; }
+int topology_num_l3(void)         { pthread_once(&topo_once, topo_init); return topo.l3s; }
+int topology_num_packages(void)   { pthread_once(&topo_once, topo_init); return topo.packages; }
+int topology_num_efficiency(void) { pthread_once(&topo_once, topo_init); return topo.efficiency; }
+
+int topology_max_threads(topology_policy_t policy) {
+    pthread_once(&topo_once, topo_init);
+    switch (policy) {
+        case TOPOLOGY_NONE:         return TOPOLOGY_MAX_CPUS;
+        case TOPOLOGY_ONE_PER_CORE: return topo.cores;
+        case TOPOLOGY_ONE_PER_L3:   return topo.l3s;
+        default:                    return topo.ncpus;
+    }
+}
+
+// ============================================================================
+// Placement
+// ============================================================================
+
+// Sort key of CPU i under a policy, most significant first
+#define KEY_LEN 6
+static void placement_key(topology_policy_t policy, int i, int *key) {
+    const topology_cpu_t *t = &topo.cpu[i];
+    if (policy == TOPOLOGY_SCATTER) {
+        const int k[KEY_LEN] = {t->type, t->smt, topo.core_rank[i], topo.l3_rank[i], t->package, t->cpu};
+        memcpy(key, k, sizeof(k));
+    } else {
+        const int k[KEY_LEN] = {t->type, t->package, t->l3, t->core, t->smt, t->cpu};
+        memcpy(key, k, sizeof(k));
+    }
+}
+
+static topology_policy_t sort_policy;
+
+static int compare_cpus(const void *pa, const void *pb) {
+    int ka[KEY_LEN], kb[KEY_LEN];
+    placement_key(sort_policy, *(const int *)pa, ka);
+    placement_key(sort_policy, *(const int *)pb, kb);
+    for (int k = 0; k < KEY_LEN; k++)
+        if (ka[k] != kb[k]) return ka[k] < kb[k] ? -1 : 1;
+    return 0;
+}
+
+int topology_place(topology_policy_t policy, int threads, int *cpus) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    int order[TOPOLOGY_MAX_CPUS];
+    pthread_once(&topo_once, topo_init);
+    if (policy == TOPOLOGY_NONE) return 0;
+
+    for (int i = 0; i < topo.ncpus; i++) order[i] = i;
+    pthread_mutex_lock(&lock);
+    sort_policy = policy;
+    qsort(order, topo.ncpus, sizeof(int), compare_cpus);
+    pthread_mutex_unlock(&lock);
+
+    int placed = 0;
+    for (int o = 0; o < topo.ncpus && placed < threads; o++) {
+        const topology_cpu_t *t = &topo.cpu[order[o]];
+        if (policy == TOPOLOGY_ONE_PER_CORE && t->smt != 0) continue;
+        if (policy == TOPOLOGY_ONE_PER_L3) {
+            int taken = 0;
+            for (int p = 0; p < placed; p++)
+                for (int i = 0; i < topo.ncpus; i++)
+                    if (topo.cpu[i].cpu == cpus[p] && topo.cpu[i].l3 == t->l3) taken = 1;
+            if (taken || t->smt != 0) continue;
+        }
+        cpus[placed++] = t->cpu;
+    }
+    return placed;
+}
+
+int topology_pin(int cpu) {
+#ifdef TOPOLOGY_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpu >= 0) {
+        if (cpu >= CPU_SETSIZE) return -1;
+        CPU_SET(cpu, &set);
+    } else {
+        for (int i = 0; i < topology_num_cpus(); i++)
+            if (topo.cpu[i].cpu < CPU_SETSIZE) CPU_SET(topo.cpu[i].cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    (void)cpu;
+    return 0;
+#endif
+}
+
+int topology_get_affinity(topology_affinity_t *saved) {
+    memset(saved, 0, sizeof(*saved));
+#ifdef TOPOLOGY_LINUX
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+    for (int c = 0; c < TOPOLOGY_MAX_CPUS && c < CPU_SETSIZE; c++)
+        saved->cpu[c] = CPU_ISSET(c, &set) != 0;
+    saved->valid = 1;
+#endif
+    return 0;
+}
+
+int topology_set_affinity(const topology_affinity_t *saved) {
+#ifdef TOPOLOGY_LINUX
+    if (!saved->valid) return 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < TOPOLOGY_MAX_CPUS && c < CPU_SETSIZE; c++)
+        if (saved->cpu[c]) CPU_SET(c, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    (void)saved;
+    return 0;
+#endif
+}
+
+void topology_describe(FILE *out) {
+    pthread_once(&topo_once, topo_init);
+    fprintf(out, "%d package(s), %d L3 domain(s), %d core(s)", topo.packages, topo.l3s, topo.cores);
+    if (topo.efficiency) fprintf(out, " (%d efficiency)", topo.efficiency);
+    fprintf(out, ", %d CPU(s)", topo.ncpus);
+}
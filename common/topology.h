@@ -0,0 +1,93 @@
+/*
+ * CPU topology and thread placement for the TP2 parallel benchmarks.
+ *
+ * Whether two threads share a physical core (SMT siblings), a last-level
+ * cache or a socket changes what a parallel kernel measures: a
+ * bandwidth-bound loop gains from spreading over L3 slices and sockets,
+ * a compute-bound one loses little from sharing an L3 but a lot from
+ * sharing a core. Every online CPU is described by its package, L3
+ * domain, physical core, SMT rank and core type, read from
+ * /sys/devices/system/cpu (topology/ and cache/index*), and a placement
+ * policy turns a thread count into an ordered CPU list:
+ *   compact       fill a core's SMT siblings, then the next core of the
+ *                 same L3, then the next L3 and package
+ *   scatter       round-robin over packages, then L3 domains, then cores;
+ *                 SMT siblings only once every core has a thread
+ *   one-per-core  one thread per physical core, compact order, at most
+ *                 as many threads as cores
+ *   one-per-l3    one thread per L3 domain, at most as many threads as
+ *                 domains
+ * Performance cores come before efficiency cores in every policy (hybrid
+ * x86 from /sys/devices/cpu_atom/cpus, big.LITTLE from
+ * cpu_capacity). The list feeds threadpool_create_pinned(). Elsewhere,
+ * every CPU is its own core in one domain and pinning is a no-op.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_TOPOLOGY_H
+#define TP2_TOPOLOGY_H
+
+#include <stdio.h>
+
+#define TOPOLOGY_MAX_CPUS 1024
+
+typedef enum {
+    TOPOLOGY_NONE = -1,      // No pinning: the scheduler places the threads
+    TOPOLOGY_COMPACT,
+    TOPOLOGY_SCATTER,
+    TOPOLOGY_ONE_PER_CORE,
+    TOPOLOGY_ONE_PER_L3,
+    TOPOLOGY_NUM_POLICIES
+} topology_policy_t;
+
+typedef struct {
+    int cpu;         // Kernel CPU number
+    int package;     // Physical package (socket)
+    int l3;          // L3 domain: lowest CPU sharing the last-level cache
+    int core;        // Physical core: lowest CPU among the SMT siblings
+    int smt;         // Rank among the SMT siblings of the core (0 = first)
+    int type;        // 0 = performance core, 1 = efficiency core
+} topology_cpu_t;
+
+const char *topology_policy_name(topology_policy_t policy);
+
+// Policy from its name ("none" included); returns -1 for an unknown name
+int topology_parse_policy(const char *name, topology_policy_t *policy);
+
+// Online CPUs (at least 1) and the description of the i-th one
+int topology_num_cpus(void);
+const topology_cpu_t *topology_cpu(int i);
+
+// Distinct physical cores, L3 domains, packages and efficiency cores
+int topology_num_cores(void);
+int topology_num_l3(void);
+int topology_num_packages(void);
+int topology_num_efficiency(void);
+
+// Threads a policy can place at most (every CPU, every core, every L3;
+// TOPOLOGY_MAX_CPUS for TOPOLOGY_NONE, which may oversubscribe)
+int topology_max_threads(topology_policy_t policy);
+
+// CPUs of the first `threads` threads under policy into cpus[]; returns
+// the number placed, which is below `threads` when the policy runs out
+int topology_place(topology_policy_t policy, int threads, int *cpus);
+
+// Restrict the calling thread to one CPU (-1: every online CPU).
+// Returns 0 on success, -1 if the affinity could not be set.
+int topology_pin(int cpu);
+
+// Affinity mask of a thread, saved before pinning and restored after
+typedef struct {
+    unsigned char cpu[TOPOLOGY_MAX_CPUS];
+    int valid;
+} topology_affinity_t;
+
+int topology_get_affinity(topology_affinity_t *saved);
+int topology_set_affinity(const topology_affinity_t *saved);
+
+// One-line summary, e.g. "2 packages, 4 L3 domains, 32 cores, 64 CPUs"
+void topology_describe(FILE *out);
+
+#endif // TP2_TOPOLOGY_H
@@ -0,0 +1,218 @@
+/*
+ * Per-host tuning cache for the TP2 benchmarks.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#include "tuning.h"
+
+#define MAX_LINE  512
+
+// ============================================================================
+// Host key and file location
+// ============================================================================
+
+static void cpu_model(char *model, size_t size) {
+    snprintf(model, size, "unknown cpu");
+#ifdef __APPLE__
+    size_t len = size;
+    if (sysctlbyname("machdep.cpu.brand_string", model, &len, NULL, 0) != 0)
+        snprintf(model, size, "unknown cpu");
+#else
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (!f) return;
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "model name", 10) != 0) continue;
+        const char *v = strchr(line, ':');
+        if (!v) continue;
+        v++;
+        while (*v == ' ') v++;
+        snprintf(model, size, "%s", v);
+        model[strcspn(model, "\n")] = '\0';
+        break;
+    }
+    fclose(f);
+#endif
+}
+
+static long cache_kb(int level) {
+    long v = 0;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    switch (level) {
+        case 1: v = sysconf(_SC_LEVEL1_DCACHE_SIZE); break;
+        case 2: v = sysconf(_SC_LEVEL2_CACHE_SIZE); break;
+        default: v = sysconf(_SC_LEVEL3_CACHE_SIZE); break;
+    }
+#else
+    (void)level;
+#endif
+    return v > 0 ? v / 1024 : 0;
+}
+
+void tuning_host_key(char *key, size_t size) {
+    char model[TUNING_MAX_KEY];
+    cpu_model(model, sizeof(model));
+    for (char *c = model; *c; c++)
+        if (*c == '\t') *c = ' ';    // Tabs separate the fields
+    snprintf(key, size, "%s | L1d %ldK L2 %ldK L3 %ldK", model, cache_kb(1), cache_kb(2), cache_kb(3));
+}
+
+const char *tuning_file_path(void) {
+    static char path[1024];
+    const char *env = getenv("TP2_TUNING_FILE");
+    if (env && *env) return strcmp(env, "none") == 0 ? NULL : env;
+    const char *home = getenv("HOME");
+    if (home && *home) {
+        snprintf(path, sizeof(path), "%s/.tp2_tuning", home);
+        return path;
+    }
+    return "tp2_tuning.txt";
+}
+
+// ============================================================================
+// Lookup and update
+// ============================================================================
+
+// Split "key\tparam\tvalue" in place; returns 0 for a well-formed line
+static int split_line(char *line, char **key, char **param, char **value) {
+    if (line[0] == '#' || line[0] == '\n') return -1;
+    line[strcspn(line, "\n")] = '\0';
+    *key = line;
+    if (!(*param = strchr(*key, '\t'))) return -1;
+    *(*param)++ = '\0';
+    if (!(*value = strchr(*param, '\t'))) return -1;
+    *(*value)++ = '\0';
+    return 0;
+}
+
+int tuning_get(const char *param, int *value) {
+    const char *path = tuning_file_path();
+    if (!path) return -1;
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char host[TUNING_MAX_KEY], line[MAX_LINE];
+    tuning_host_key(host, sizeof(host));
+    int found = -1;
+    while (fgets(line, sizeof(line), f)) {
+        char *k, *p, *v;
+        if (split_line(line, &k, &p, &v) != 0) continue;
+        if (strcmp(k, host) == 0 && strcmp(p, param) == 0) {
+            *value = atoi(v);
+            found = 0;    // Keep going: the last entry wins
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+int tuning_store(const char *param, int value) {
+    const char *path = tuning_file_path();
+    if (!path) return -1;
+    char host[TUNING_MAX_KEY];
+    tuning_host_key(host, sizeof(host));
+
+    // Serialize writers (the file itself is replaced, so lock a side file)
+    char lock_path[1100], tmp[1100];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    const int lock = open(lock_path, O_RDWR | O_CREAT, 0644);
+    if (lock < 0) return -1;
+    if (flock(lock, LOCK_EX) != 0) {
+        close(lock);
+        return -1;
+    }
+
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        close(lock);    // Releases the lock
+        return -1;
+    }
+
+    // Copy every line except an older entry for (host, param)
+    int copied = 0;
+    FILE *f = fopen(path, "r");
+    if (f) {
+        char *line = NULL, *copy = NULL;
+        size_t line_cap = 0, copy_cap = 0;
+        ssize_t len;
+        while ((len = getline(&line, &line_cap, f)) > 0) {
+            if (copy_cap < (size_t)len + 1) {
+                char *grown = realloc(copy, len + 1);
+                if (!grown) break;
+                copy = grown;
+                copy_cap = len + 1;
+            }
+            memcpy(copy, line, len + 1);
+            char *k, *p, *v;
+            if (split_line(copy, &k, &p, &v) == 0 && strcmp(k, host) == 0 && strcmp(p, param) == 0)
+                continue;
+            fputs(line, out);
+            if (line[len - 1] != '\n') fputc('\n', out);
+            copied = 1;
+        }
+        const int failed = ferror(f) || !feof(f);
+        free(line);
+        free(copy);
+        fclose(f);
+        if (failed) {
+            // Never replace the file with a truncated copy
+            fclose(out);
+            remove(tmp);
+            close(lock);
+            return -1;
+        }
+    }
+
+    if (!copied) fprintf(out, "# TP2 tuning cache: host key <TAB> parameter <TAB> value\n");
+    fprintf(out, "%s\t%s\t%d\n", host, param, value);
+    int rc = 0;
+    if (fclose(out) != 0 || rename(tmp, path) != 0) {
+        remove(tmp);
+        rc = -1;
+    }
+    close(lock);
+    return rc;
+}
+
+// ============================================================================
+// Tunable reduction
+// ============================================================================
+
+#define SUM_KERNEL(ACC)                                              \
+    static double sum_##ACC(const double *x, long n) {               \
+        double s[ACC] = {0.0};                                       \
+        long i = 0;                                                  \
+        for (; i + (ACC) <= n; i += (ACC))                           \
+            for (int j = 0; j < (ACC); j++) s[j] += x[i + j];        \
+        for (; i < n; i++) s[0] += x[i];                             \
+        for (int w = (ACC) / 2; w > 0; w /= 2)                       \
+            for (int j = 0; j < w; j++) s[j] += s[j + w];            \
+        return s[0];                                                 \
+    }
+
+SUM_KERNEL(1)
+SUM_KERNEL(2)
+SUM_KERNEL(4)
+SUM_KERNEL(8)
+SUM_KERNEL(16)
+
+double tuning_sum(const double *x, long n, int accumulators) {
+    if (accumulators >= 16) return sum_16(x, n);
+    if (accumulators >= 8)  return sum_8(x, n);
+    if (accumulators >= 4)  return sum_4(x, n);
+    if (accumulators >= 2)  return sum_2(x, n);
+    return sum_1(x, n);
+}
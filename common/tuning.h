@@ -0,0 +1,47 @@
+/*
+ * Per-host tuning cache for the TP2 benchmarks.
+ *
+ * Tuned kernel parameters (tile sizes, accumulator counts, ...) depend on
+ * the CPU and its caches, so they are stored in a plain-text file keyed by
+ * the CPU model and the cache sizes. One line per parameter:
+ *
+ *   <host key> <TAB> <parameter> <TAB> <value>
+ *
+ * Lines starting with '#' are comments. Several hosts can share one file
+ * (e.g. a fleet-wide file on a network share): each only sees its own
+ * lines. The file is $TP2_TUNING_FILE if set (the value "none" disables
+ * tuning), else $HOME/.tp2_tuning, else ./tp2_tuning.txt. Benchmarks read
+ * it at startup and fall back to built-in defaults for anything missing.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_TUNING_H
+#define TP2_TUNING_H
+
+#include <stddef.h>
+
+#define TUNING_MAX_KEY 256
+
+// "<cpu model> | L1d <n>K L2 <n>K L3 <n>K" of the calling host
+void tuning_host_key(char *key, size_t size);
+
+// Path of the tuning file, NULL when tuning is disabled
+const char *tuning_file_path(void);
+
+// Value of param for this host; returns 0 if found, -1 otherwise
+int tuning_get(const char *param, int *value);
+
+// Insert or replace param for this host. The file is rewritten atomically
+// under an exclusive lock on <file>.lock, so concurrent benchmarks do not
+// lose each other's entries.
+// Returns 0 on success, -1 if the file cannot be written.
+int tuning_store(const char *param, int value);
+
+// Reduction kernel with a tunable number of independent accumulators
+// (1, 2, 4, 8 or 16; others are rounded down). More accumulators hide the
+// add latency but cost registers; the best count is host specific.
+double tuning_sum(const double *x, long n, int accumulators);
+
+#endif // TP2_TUNING_H
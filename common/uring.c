@@ -0,0 +1,172 @@
+/*
+ * Minimal io_uring wrapper for the TP2 benchmarks.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "uring.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define URING_LINUX 1
+#endif
+#endif
+
+#ifdef URING_LINUX
+
+int uring_init(uring_t *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+
+    r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    const int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (r->cq_map_size > r->sq_map_size) r->sq_map_size = r->cq_map_size;
+        r->cq_map_size = r->sq_map_size;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        close(r->fd);
+        return -1;
+    }
+    r->cq_map = single ? r->sq_map
+                       : mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        if (r->cq_map != MAP_FAILED && !single) munmap(r->cq_map, r->cq_map_size);
+        if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_size);
+        munmap(r->sq_map, r->sq_map_size);
+        close(r->fd);
+        return -1;
+    }
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = cq + p.cq_off.cqes;
+    r->entries = p.sq_entries;
+    return 0;
+}
+
+void uring_exit(uring_t *r) {
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_size);
+    munmap(r->sq_map, r->sq_map_size);
+    close(r->fd);
+}
+
+int uring_register_buffers(uring_t *r, void *const *bufs, size_t size, int count) {
+    struct iovec iov[count];
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = size;
+    }
+    return syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, count) == 0 ? 0 : -1;
+}
+
+int uring_prep_read(uring_t *r, int fd, void *buf, unsigned len, off_t offset, int buf_index,
+                    uint64_t user_data) {
+    const unsigned tail = *r->sq_tail;
+    if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->entries) return -1;
+    const unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)r->sqes + idx;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = buf_index >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = (uint64_t)offset;
+    sqe->buf_index = buf_index >= 0 ? (uint16_t)buf_index : 0;
+    sqe->user_data = user_data;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->pending++;
+    return 0;
+}
+
+int uring_submit(uring_t *r) {
+    int submitted = 0;
+    while (r->pending > 0) {
+        long ret = syscall(__NR_io_uring_enter, r->fd, r->pending, 0, 0, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return -1;
+        }
+        if (ret == 0) {
+            // Nothing consumed (e.g. CQ overflow backpressure): retrying spins
+            errno = EBUSY;
+            return -1;
+        }
+        r->pending -= (unsigned)ret;
+        submitted += (int)ret;
+    }
+    return submitted;
+}
+
+int uring_wait(uring_t *r, uint64_t *user_data, int *res) {
+    for (;;) {
+        const unsigned head = *r->cq_head;
+        if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            const struct io_uring_cqe *cqe = (const struct io_uring_cqe *)r->cqes + (head & *r->cq_mask);
+            *user_data = cqe->user_data;
+            *res = cqe->res;
+            __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+            return 0;
+        }
+        if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR) return -1;
+    }
+}
+
+#else
+
+int uring_init(uring_t *r, unsigned entries) {
+    (void)entries;
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    return -1;
+}
+
+void uring_exit(uring_t *r) { (void)r; }
+
+int uring_register_buffers(uring_t *r, void *const *bufs, size_t size, int count) {
+    (void)r; (void)bufs; (void)size; (void)count;
+    return -1;
+}
+
+int uring_prep_read(uring_t *r, int fd, void *buf, unsigned len, off_t offset, int buf_index,
+                    uint64_t user_data) {
+    (void)r; (void)fd; (void)buf; (void)len; (void)offset; (void)buf_index; (void)user_data;
+    return -1;
+}
+
+int uring_submit(uring_t *r) { (void)r; return -1; }
+
+int uring_wait(uring_t *r, uint64_t *user_data, int *res) {
+    (void)r; (void)user_data; (void)res;
+    return -1;
+}
+
+#endif
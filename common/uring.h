@@ -0,0 +1,59 @@
+/*
+ * Minimal io_uring wrapper for the TP2 benchmarks.
+ *
+ * Just enough of io_uring to stream a file into registered buffers:
+ * ring setup, buffer registration, READ / READ_FIXED submissions and
+ * one-at-a-time completions. It talks to the kernel through the raw
+ * io_uring_setup / io_uring_enter / io_uring_register system calls and
+ * the shared rings, so no liburing is needed. Elsewhere (or when the
+ * kernel refuses io_uring) uring_init() fails and callers fall back.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef TP2_URING_H
+#define TP2_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned pending;                // Prepared, not yet submitted
+    // Submission ring
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    void *sqes;
+    // Completion ring
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+    // Mappings, for uring_exit()
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size, sqes_size;
+} uring_t;
+
+// Ring with room for `entries` submissions in flight. Returns 0, or -1 if
+// io_uring is unavailable (not Linux, too old, or disabled).
+int uring_init(uring_t *r, unsigned entries);
+void uring_exit(uring_t *r);
+
+// Register count buffers of size bytes each (for uring_prep_read with
+// buf_index >= 0). Returns 0 on success, -1 otherwise.
+int uring_register_buffers(uring_t *r, void *const *bufs, size_t size, int count);
+
+// Queue a read of len bytes at offset into buf; buf_index >= 0 reads into
+// registered buffer buf_index (buf must lie inside it). Returns -1 if the
+// submission ring is full.
+int uring_prep_read(uring_t *r, int fd, void *buf, unsigned len, off_t offset, int buf_index,
+                    uint64_t user_data);
+
+// Hand every queued read to the kernel; returns the number submitted or -1
+int uring_submit(uring_t *r);
+
+// Block for the next completion: its user_data and result (bytes read or
+// -errno). Returns 0, or -1 if waiting failed.
+int uring_wait(uring_t *r, uint64_t *user_data, int *res);
+
+#endif // TP2_URING_H
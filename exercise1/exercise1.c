@@ -14,6 +14,8 @@
 #include <stdint.h>
 #include <math.h>
 
+#include "results.h"
+
 #ifdef __APPLE__
 #include <mach/mach_time.h>
 #else
@@ -335,6 +337,9 @@ int main(int argc, char *argv[]) {
            "Method", "Avg (ns)", "Min (ns)", "Max (ns)", "Speedup", "BW (GB/s)");
     printf("--------------------------------------------------------------------------------\n");
 
+    const char *program = argc > 0 ? results_program(argv[0]) : "exercise1";
+    char param[32];
+    snprintf(param, sizeof(param), "N=%d", N);
     double baseline_time = 0.0;
     double best_time = 1e18;
     const char *best_method = "";
@@ -357,6 +362,8 @@ int main(int argc, char *argv[]) {
 
         printf("%-25s %12.2f %12.2f %12.2f %9.2fx %11.2f\n",
                benchmarks[i].name, avg_time, min_time, max_time, speedup, bandwidth);
+        results_record(program, benchmarks[i].name, param, "avg_time", avg_time, "ns");
+        results_record(program, benchmarks[i].name, param, "min_time", min_time, "ns");
 
         if (avg_time < best_time) {
             best_time = avg_time;
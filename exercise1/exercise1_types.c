@@ -14,6 +14,8 @@
 #include <stdint.h>
 #include <math.h>
 
+#include "results.h"
+
 #ifdef __APPLE__
 #include <mach/mach_time.h>
 #else
@@ -423,7 +425,12 @@ typedef struct {
     double speedup;
 } result_t;
 
+// Benchmark (program) name and type of the table being printed, for results_record()
+static const char *program_name = "exercise1_types";
+static const char *current_type = "";
+
 void print_header(const char *type_name, int type_size) {
+    current_type = type_name;
     printf("\n");
     printf("================================================================================\n");
     printf("Data Type: %s (%d bytes)\n", type_name, type_size);
@@ -438,6 +445,10 @@ void print_result(const char *name, double avg, double min, double max,
                   double speedup, double bandwidth) {
     printf("%-20s %12.2f %12.2f %12.2f %9.2fx %11.2f\n",
            name, avg, min, max, speedup, bandwidth);
+    char kernel[64], param[32];
+    snprintf(kernel, sizeof(kernel), "%s %s", current_type, name);
+    snprintf(param, sizeof(param), "N=%d", N);
+    results_record(program_name, kernel, param, "avg_time", avg, "ns");
 }
 
 // ============================================================================
@@ -648,6 +659,7 @@ void benchmark_short(double *results_baseline, double *results_best) {
 
 int main(int argc, char *argv[]) {
     init_timing();
+    if (argc > 0) program_name = results_program(argv[0]);
 
     printf("================================================================================\n");
     printf("Exercise 1: Loop Unrolling Analysis for Different Data Types\n");
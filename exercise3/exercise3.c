@@ -2,12 +2,17 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include "phase.h"  // PHASE_SCOPE is a no-op unless built with -DPHASE_PROFILE
+
+#ifndef N
 #define N 100000000
+#endif
 
 double a[N], b[N], c[N];
 
 // SEQUENTIAL - each element depends on previous
 void add_noise() {
+    PHASE_SCOPE("add_noise", PHASE_SERIAL);
     a[0] = 1.0;
     for (int i = 1; i < N; i++) {
         a[i] = a[i-1] * 1.0000001;
@@ -16,6 +21,7 @@ void add_noise() {
 
 // PARALLEL - no dependencies
 void init_b() {
+    PHASE_SCOPE("init_b", PHASE_PARALLEL);
     for (int i = 0; i < N; i++) {
         b[i] = 2.0;
     }
@@ -23,6 +29,7 @@ void init_b() {
 
 // PARALLEL - no dependencies
 void compute_addition() {
+    PHASE_SCOPE("compute_addition", PHASE_PARALLEL);
     for (int i = 0; i < N; i++) {
         c[i] = a[i] + b[i];
     }
@@ -30,6 +37,7 @@ void compute_addition() {
 
 // PARALLEL - reduction pattern
 double reduction() {
+    PHASE_SCOPE("reduction", PHASE_PARALLEL);
     double sum = 0.0;
     for (int i = 0; i < N; i++) {
         sum += c[i];
@@ -38,6 +46,7 @@ double reduction() {
 }
 
 int main() {
+    PHASE_PARAM("N=%d", N);
     add_noise();
     init_b();
     compute_addition();
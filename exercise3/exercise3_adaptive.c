@@ -0,0 +1,306 @@
+/*
+ * Exercise 3: Adaptive Thread Count for Bandwidth-Bound Stages
+ *
+ * The exercise3 stages and exercise1's large-N sum move 8 - 24 bytes per
+ * FLOP: once a few cores saturate the memory controllers, more threads
+ * add nothing but occupied cores. For each kernel this runs
+ *   all cores  every worker of the pool, best of FULL_BATCHES batches
+ *   adaptive   common/concurrency.h: ramp one worker at a time while
+ *              timing each batch, settle on the knee where another worker
+ *              adds less than --min-gain of an average worker's rate,
+ *              then keep probing knee - 1 / knee + 1
+ * and reports the knee, the cores it leaves free and the throughput lost
+ * against all cores, with the ramp curve (GB/s per worker count). Knees
+ * are stored per kernel and N in the tuning cache (common/tuning.h), so a
+ * second run starts at the knee and skips the ramp (--remember 0 ignores
+ * and keeps the cache).
+ *
+ * Kernels (GB/s of compulsory traffic, one pool task per chunk):
+ *   init_b            b[i] = 2.0                          8 B/element
+ *   compute_addition  c[i] = a[i] + b[i]                 24 B/element
+ *   reduction         sum of c, exercise3.c's loop        8 B/element
+ *   sum (exercise1)   sum of a, 8 accumulators            8 B/element
+ *
+ * Usage: ./exercise3_adaptive [--n N] [--threads P] [--batches B]
+ *                             [--min-gain G] [--remember 0|1]
+ *                             [--placement none|compact|scatter|one-per-core|one-per-l3]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+#include "results.h"
+#include "threadpool.h"
+#include "topology.h"
+#include "tuning.h"
+#include "concurrency.h"
+
+// Configuration
+#define DEFAULT_N         (1L << 24)  // Elements (128 MB per array)
+#define DEFAULT_BATCHES   100         // Controlled batches per kernel
+#define B_VALUE           2.0
+#define CHUNKS_PER_THREAD 4
+#define MAX_CHUNKS        4096
+#define FULL_BATCHES      5           // All-cores and knee reference runs (best of)
+
+typedef enum { K_INIT_B, K_ADDITION, K_REDUCE, K_SUM, NUM_KERNELS } kernel_id_t;
+
+static const struct {
+    const char *name, *key;           // Key: tuning-cache name
+    double bytes_per_elem;
+} kernel_info[NUM_KERNELS] = {
+    {"init_b",           "init_b",   8.0},
+    {"compute_addition", "addition", 24.0},
+    {"reduction",        "reduction", 8.0},
+    {"sum (exercise1)",  "sum8",     8.0},
+};
+
+typedef struct {
+    double *a, *b, *c;
+    long n;
+    int chunks;
+    double partial[MAX_CHUNKS];
+} vectors_t;
+
+typedef struct {
+    double full, at_knee;             // GB/s
+    int knee, remembered, changes;
+    long ramp_batches;
+    double curve[TOPOLOGY_MAX_CPUS + 1];
+} kernel_report_t;
+
+static double *alloc_doubles(long count) {
+    return aligned_alloc(64, (sizeof(double) * count + 63) / 64 * 64);
+}
+
+// ============================================================================
+// Kernels, one task per chunk
+// ============================================================================
+
+static void chunk_range(const vectors_t *v, int chunk, long *begin, long *end) {
+    *begin = v->n * chunk / v->chunks;
+    *end = v->n * (chunk + 1) / v->chunks;
+}
+
+static void fill_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    for (long i = begin; i < end; i++) {
+        v->a[i] = 1.0 + i * 1e-9;
+        v->b[i] = 0.0;
+        v->c[i] = 0.0;
+    }
+}
+
+static void init_b_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    double *restrict b = v->b;
+    for (long i = begin; i < end; i++) b[i] = B_VALUE;
+}
+
+static void add_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    double *restrict c = v->c;
+    const double *restrict a = v->a, *restrict b = v->b;
+    for (long i = begin; i < end; i++) c[i] = a[i] + b[i];
+}
+
+static void reduce_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    double sum = 0.0;
+    for (long i = begin; i < end; i++) sum += v->c[i];
+    v->partial[chunk] = sum;
+}
+
+static void sum_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    v->partial[chunk] = tuning_sum(v->a + begin, end - begin, 8);
+}
+
+static const tp_task_fn kernel_fn[NUM_KERNELS] = {init_b_task, add_task, reduce_task, sum_task};
+
+// Best GB/s of FULL_BATCHES batches with `threads` workers
+static double measure(threadpool_t *pool, vectors_t *v, kernel_id_t k, int threads) {
+    double best = 1e300;
+    threadpool_set_active(pool, threads);
+    for (int r = 0; r < FULL_BATCHES; r++) {
+        const double start = get_time_ns();
+        threadpool_run(pool, v->chunks, kernel_fn[k], v);
+        const double elapsed = get_time_ns() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return kernel_info[k].bytes_per_elem * v->n / best;
+}
+
+static int run_kernel(threadpool_t *pool, vectors_t *v, kernel_id_t k, int batches, double min_gain,
+                      int remember, kernel_report_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->full = measure(pool, v, k, threadpool_size(pool));
+
+    concurrency_t ctl;
+    if (concurrency_init(&ctl, pool, remember ? kernel_info[k].key : NULL, v->n, min_gain) != 0)
+        return -1;
+    const double work = kernel_info[k].bytes_per_elem * v->n;
+    for (int b = 0; b < batches; b++) {
+        concurrency_begin(&ctl);
+        threadpool_run(pool, v->chunks, kernel_fn[k], v);
+        concurrency_end(&ctl, work);
+    }
+    r->remembered = ctl.remembered;
+    r->ramp_batches = ctl.ramp_batches;
+    r->changes = ctl.changes;
+    for (int p = 1; p <= ctl.max_threads; p++) r->curve[p] = concurrency_rate(&ctl, p);
+    if (!concurrency_settled(&ctl)) return 0;   // Too few batches to finish the ramp
+    r->knee = ctl.knee;
+    r->at_knee = measure(pool, v, k, r->knee);
+    threadpool_set_active(pool, threadpool_size(pool));
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long n = DEFAULT_N;
+    int threads = threadpool_cpu_count();
+    int batches = DEFAULT_BATCHES, remember = 1;
+    double min_gain = CONCURRENCY_MIN_GAIN;
+    topology_policy_t placement = TOPOLOGY_NONE;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--n") == 0)              n = (long)strtod(val, NULL);
+        else if (strcmp(opt, "--threads") == 0)   threads = atoi(val);
+        else if (strcmp(opt, "--batches") == 0)   batches = atoi(val);
+        else if (strcmp(opt, "--min-gain") == 0)  min_gain = atof(val);
+        else if (strcmp(opt, "--remember") == 0)  remember = atoi(val);
+        else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &placement) != 0) {
+                fprintf(stderr, "Unknown placement %s\n", val);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (n < 1024 || threads < 1 || threads > TOPOLOGY_MAX_CPUS || batches < 1 || min_gain <= 0.0) {
+        fprintf(stderr, "N must be at least 1024, threads in [1, %d], batches and min gain positive\n",
+                TOPOLOGY_MAX_CPUS);
+        return 1;
+    }
+
+    init_timing();
+    threadpool_t *pool = threadpool_create_placed(threads, placement);
+    vectors_t *v = calloc(1, sizeof(vectors_t));
+    if (!pool || !v) {
+        fprintf(stderr, "Cannot place %d threads with %s\n", threads, topology_policy_name(placement));
+        return 1;
+    }
+    v->n = n;
+    v->chunks = threads * CHUNKS_PER_THREAD;
+    if (v->chunks > MAX_CHUNKS) v->chunks = MAX_CHUNKS;
+    v->a = alloc_doubles(n);
+    v->b = alloc_doubles(n);
+    v->c = alloc_doubles(n);
+    if (!v->a || !v->b || !v->c) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return 1;
+    }
+    threadpool_run(pool, v->chunks, fill_task, v);   // First touch by the workers
+    threadpool_run(pool, v->chunks, init_b_task, v);
+
+    const char *tuning = tuning_file_path();
+    printf("=============================================================\n");
+    printf("Exercise 3: Adaptive Thread Count for Bandwidth-Bound Stages\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Vector size N:       %ld elements (%.0f MB per array)\n", n, n * 8.0 / 1048576.0);
+    printf("  Pool:                %d threads, placement %s\n", threads, topology_policy_name(placement));
+    printf("  Controller:          min gain %.2f, %d batches per count, patience %d, probe every %d\n",
+           min_gain, CONCURRENCY_SAMPLES, CONCURRENCY_PATIENCE, CONCURRENCY_PROBE_EVERY);
+    printf("  Batches per kernel:  %d\n", batches);
+    printf("  Knee memory:         %s\n\n",
+           !remember ? "off" : tuning ? tuning : "off (tuning disabled)");
+
+    kernel_report_t reports[NUM_KERNELS];
+    printf("%-18s %11s %5s %11s %7s %8s %6s %-10s\n", "Kernel", "All GB/s", "Knee", "Knee GB/s",
+           "Saved", "Lost", "Ramp", "Knee from");
+    printf("-------------------------------------------------------------------------------------\n");
+    int saved_total = 0, settled = 0;
+    double lost_total = 0.0;
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        kernel_report_t *r = &reports[k];
+        if (run_kernel(pool, v, (kernel_id_t)k, batches, min_gain, remember, r) != 0) {
+            fprintf(stderr, "Cannot start the controller\n");
+            return 1;
+        }
+        if (r->knee == 0) {
+            printf("%-18s %11.2f   not settled after %d batches (raise --batches)\n",
+                   kernel_info[k].name, r->full, batches);
+            continue;
+        }
+        const double lost = 1.0 - r->at_knee / r->full;
+        printf("%-18s %11.2f %5d %11.2f %7d %7.1f%% %6ld %-10s\n", kernel_info[k].name, r->full, r->knee,
+               r->at_knee, threads - r->knee, 100.0 * lost, r->ramp_batches,
+               r->remembered ? "cache" : "ramp");
+        fflush(stdout);
+        saved_total += threads - r->knee;
+        lost_total += lost;
+        settled++;
+
+        char param[64];
+        snprintf(param, sizeof(param), "N=%ld P=%d", n, threads);
+        results_record("exercise3_adaptive", kernel_info[k].name, param, "knee", r->knee, "threads");
+        results_record("exercise3_adaptive", kernel_info[k].name, param, "bandwidth", r->at_knee, "GB/s");
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    if (settled > 0)
+        printf("Cores saved: %d of %d worker slots (%.0f%%) for %.1f%% mean throughput lost vs all cores\n"
+               "(negative: the knee is faster than all cores)\n\n",
+               saved_total, settled * threads, 100.0 * saved_total / (settled * threads),
+               100.0 * lost_total / settled);
+
+    printf("Ramp curves (GB/s per worker count, measured while ramping or probing):\n");
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        printf("  %-18s", kernel_info[k].name);
+        int shown = 0;
+        for (int p = 1; p <= threads; p++) {
+            if (reports[k].curve[p] <= 0.0) continue;
+            printf(" %d:%.1f%s", p, reports[k].curve[p], p == reports[k].knee ? "*" : "");
+            shown++;
+        }
+        printf("%s\n", shown ? "" : " (knee from the cache, no probe yet)");
+    }
+    printf("  * knee; knee moves after settling:");
+    for (int k = 0; k < NUM_KERNELS; k++) printf(" %s %d%s", kernel_info[k].key, reports[k].changes,
+                                                 k + 1 < NUM_KERNELS ? "," : "\n");
+
+    double check = 0.0;
+    for (int c = 0; c < v->chunks; c++) check += v->partial[c];
+    printf("Checksum: %.6e\n", check);
+
+    free(v->a); free(v->b); free(v->c); free(v);
+    threadpool_destroy(pool);
+    return 0;
+}
@@ -0,0 +1,541 @@
+/*
+ * Exercise 3: Streaming the Vectors from Disk
+ *
+ * exercise3.c builds a and b in memory with add_noise() and init_b(). Here
+ * they come from a file (a[0..N) followed by b[0..N), written on the first
+ * run) and the pipeline consumes them chunk by chunk: compute_addition()
+ * then reduction() on each chunk, partial sums added in chunk order, so
+ * every input path returns the same result. Paths compared:
+ *   storage   io_uring reads only, no compute: the device time T_io
+ *   compute   chunks already in memory, no I/O: the compute time T_comp
+ *   read()    pread() a chunk, compute it, pread() the next
+ *   mmap      compute straight out of a MAP_SHARED mapping (MADV_SEQUENTIAL)
+ *   io_uring  --depth registered buffers; reads of chunks k+1..k+depth-1 are
+ *             in flight while chunk k is computed (depth 2: double buffering)
+ * Reads use O_DIRECT when the file system accepts it (--direct 0 goes
+ * through the page cache), and the page cache is dropped for the file
+ * before every run. A run that overlaps perfectly takes max(T_io, T_comp);
+ * "hidden" is the share of the shorter of the two that disappeared:
+ *   hidden = (T_io + T_comp - total) / min(T_io, T_comp)
+ * and the I/O wait column is the time the compute loop sat waiting for
+ * data (time in pread(), in io_uring completions, or the mmap run's excess
+ * over T_comp, which is mostly page-fault time).
+ *
+ * io_uring is driven through common/uring.h (raw system calls, no
+ * liburing); without it the io_uring row is skipped and the storage row
+ * falls back to pread(), reported as "storage-pread".
+ *
+ * Usage: ./exercise3_ingest [--n N] [--chunk ELEMS] [--depth D]
+ *                           [--file PATH] [--direct 0|1] [--keep 0|1]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "timing.h"
+#include "results.h"
+#include "uring.h"
+
+// Configuration
+#define DEFAULT_N       (1L << 24)
+#define DEFAULT_CHUNK   (1L << 20)
+#define DEFAULT_DEPTH   2
+#define DEFAULT_FILE    "ingest.dat"
+#define ALIGN_ELEMS     512            // 4 KiB of doubles: O_DIRECT offsets and sizes
+#define ALIGN_BYTES     4096
+#define B_VALUE         2.0
+#define NOISE           1.0000001
+#define NOISE_BLOCK     4096
+#define REPEATS         3
+#define HIDDEN_FULLY    0.95           // Overlap that counts as "fully hidden"
+
+enum { PATH_STORAGE, PATH_COMPUTE, PATH_READ, PATH_MMAP, PATH_URING, NUM_PATHS };
+
+static const char *path_names[NUM_PATHS] = {"storage", "compute", "read()", "mmap", "io_uring"};
+
+typedef struct {
+    double total, wait, compute;    // ns
+    double result;
+    int ran;
+    int fallback;                   // Storage row timed with pread(): io_uring failed
+} run_t;
+
+typedef struct {
+    const char *file;
+    int fd_io;                      // O_DIRECT when available
+    int fd_cached;                  // Page-cache reads, mmap, cache dropping
+    int direct;
+    long n, chunk, nchunks;
+    int depth;
+    double *c;                      // compute_addition() output, one chunk
+} ingest_t;
+
+static long chunk_len(const ingest_t *in, long k) {
+    const long begin = k * in->chunk;
+    return (in->n - begin < in->chunk) ? in->n - begin : in->chunk;
+}
+
+static void *aligned_buffer(size_t bytes) {
+    void *p = NULL;
+    return posix_memalign(&p, ALIGN_BYTES, bytes) == 0 ? p : NULL;
+}
+
+static void drop_cache(const ingest_t *in) {
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(in->fd_cached, 0, 0, POSIX_FADV_DONTNEED);
+#else
+    (void)in;
+#endif
+}
+
+// ============================================================================
+// Input file
+// ============================================================================
+
+static int write_all(int fd, const void *buf, size_t bytes, off_t offset) {
+    const char *p = buf;
+    while (bytes > 0) {
+        const ssize_t w = pwrite(fd, p, bytes, offset);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        p += w;
+        offset += w;
+        bytes -= (size_t)w;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t bytes, off_t offset) {
+    char *p = buf;
+    while (bytes > 0) {
+        const ssize_t r = pread(fd, p, bytes, offset);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p += r;
+        offset += r;
+        bytes -= (size_t)r;
+    }
+    return 0;
+}
+
+// a = add_noise() (restarted every NOISE_BLOCK like exercise3_numa), b = init_b()
+static int create_input(const char *file, long n, long chunk) {
+    const int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    double *buf = malloc(chunk * sizeof(double));
+    if (fd < 0 || !buf) {
+        if (fd >= 0) close(fd);
+        free(buf);
+        return -1;
+    }
+    int ok = 1;
+    for (long begin = 0; ok && begin < n; begin += chunk) {
+        const long len = (n - begin < chunk) ? n - begin : chunk;
+        for (long i = 0; i < len; i++) {
+            const long g = begin + i;
+            buf[i] = (g % NOISE_BLOCK == 0 || i == 0) ? pow(NOISE, (double)g) : buf[i - 1] * NOISE;
+        }
+        ok = write_all(fd, buf, len * sizeof(double), (off_t)begin * sizeof(double)) == 0;
+    }
+    for (long i = 0; i < chunk; i++) buf[i] = B_VALUE;
+    for (long begin = 0; ok && begin < n; begin += chunk) {
+        const long len = (n - begin < chunk) ? n - begin : chunk;
+        ok = write_all(fd, buf, len * sizeof(double), (off_t)(n + begin) * sizeof(double)) == 0;
+    }
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+    free(buf);
+    return ok ? 0 : -1;
+}
+
+// ============================================================================
+// Pipeline on one chunk
+// ============================================================================
+
+static double compute_chunk(const double *restrict a, const double *restrict b,
+                            double *restrict c, long len) {
+    for (long i = 0; i < len; i++) c[i] = a[i] + b[i];     // compute_addition()
+    double sum = 0.0;
+    for (long i = 0; i < len; i++) sum += c[i];             // reduction()
+    return sum;
+}
+
+// ============================================================================
+// Input paths
+// ============================================================================
+
+// Everything in memory first (untimed), then the chunked pipeline alone
+static int run_compute(const ingest_t *in, run_t *r) {
+    double *a = aligned_buffer(in->n * sizeof(double));
+    double *b = aligned_buffer(in->n * sizeof(double));
+    if (!a || !b || read_all(in->fd_cached, a, in->n * sizeof(double), 0) != 0 ||
+        read_all(in->fd_cached, b, in->n * sizeof(double), (off_t)in->n * sizeof(double)) != 0) {
+        free(a);
+        free(b);
+        return -1;
+    }
+    const double t0 = get_time_ns();
+    double sum = 0.0;
+    for (long k = 0; k < in->nchunks; k++) {
+        const long begin = k * in->chunk;
+        sum += compute_chunk(a + begin, b + begin, in->c, chunk_len(in, k));
+    }
+    r->total = r->compute = get_time_ns() - t0;
+    r->wait = 0.0;
+    r->result = sum;
+    free(a);
+    free(b);
+    return 0;
+}
+
+// pread() into one buffer; compute == 0 measures the device alone
+static int run_read(const ingest_t *in, int compute, run_t *r) {
+    double *buf = aligned_buffer(2 * in->chunk * sizeof(double));
+    if (!buf) return -1;
+    double sum = 0.0, wait = 0.0;
+    const double t0 = get_time_ns();
+    for (long k = 0; k < in->nchunks; k++) {
+        const long begin = k * in->chunk, len = chunk_len(in, k);
+        const double tw = get_time_ns();
+        if (read_all(in->fd_io, buf, len * sizeof(double), (off_t)begin * sizeof(double)) != 0 ||
+            read_all(in->fd_io, buf + in->chunk, len * sizeof(double),
+                     (off_t)(in->n + begin) * sizeof(double)) != 0) {
+            free(buf);
+            return -1;
+        }
+        wait += get_time_ns() - tw;
+        if (compute) sum += compute_chunk(buf, buf + in->chunk, in->c, len);
+    }
+    r->total = get_time_ns() - t0;
+    r->wait = wait;
+    r->compute = r->total - wait;
+    r->result = sum;
+    free(buf);
+    return 0;
+}
+
+static int run_mmap(const ingest_t *in, run_t *r) {
+    const size_t bytes = 2 * (size_t)in->n * sizeof(double);
+    const double t0 = get_time_ns();
+    double *map = mmap(NULL, bytes, PROT_READ, MAP_SHARED, in->fd_cached, 0);
+    if (map == MAP_FAILED) return -1;
+    madvise(map, bytes, MADV_SEQUENTIAL);
+    double sum = 0.0;
+    for (long k = 0; k < in->nchunks; k++) {
+        const long begin = k * in->chunk;
+        sum += compute_chunk(map + begin, map + in->n + begin, in->c, chunk_len(in, k));
+    }
+    munmap(map, bytes);
+    r->total = get_time_ns() - t0;
+    r->result = sum;
+    r->wait = r->compute = 0.0;     // Filled in from T_comp by the caller
+    return 0;
+}
+
+// Queue both halves of chunk k into buffer k % depth
+static int uring_queue_chunk(uring_t *ring, const ingest_t *in, double *const *bufs,
+                             int registered, long k) {
+    const int d = (int)(k % in->depth);
+    const long begin = k * in->chunk;
+    const unsigned len = (unsigned)(chunk_len(in, k) * sizeof(double));
+    const int index = registered ? d : -1;
+    if (uring_prep_read(ring, in->fd_io, bufs[d], len, (off_t)begin * sizeof(double), index,
+                        (uint64_t)k * 2) != 0 ||
+        uring_prep_read(ring, in->fd_io, bufs[d] + in->chunk, len,
+                        (off_t)(in->n + begin) * sizeof(double), index, (uint64_t)k * 2 + 1) != 0)
+        return -1;
+    return 0;
+}
+
+// depth chunks in flight; compute == 0 measures the device alone
+static int run_uring(const ingest_t *in, int compute, run_t *r, int *registered) {
+    uring_t ring;
+    const int depth = in->depth;
+    double *bufs[depth];
+    int outstanding[depth];
+    if (uring_init(&ring, (unsigned)(2 * depth)) != 0) return -1;
+    int ok = 1;
+    for (int d = 0; d < depth; d++) {
+        bufs[d] = aligned_buffer(2 * in->chunk * sizeof(double));
+        outstanding[d] = 0;
+        ok = ok && bufs[d];
+    }
+    // Registered buffers skip the per-read page pinning; fall back to plain reads
+    *registered = ok && uring_register_buffers(&ring, (void *const *)bufs,
+                                               2 * in->chunk * sizeof(double), depth) == 0;
+
+    double sum = 0.0, wait = 0.0;
+    long queued = 0, completed = 0;     // Reads prepared / reaped
+    const double t0 = get_time_ns();
+    for (long k = 0; ok && k < depth && k < in->nchunks; k++) {
+        ok = uring_queue_chunk(&ring, in, bufs, *registered, k) == 0;
+        if (ok) queued += 2;
+        outstanding[k % depth] = 2;
+    }
+    ok = ok && uring_submit(&ring) >= 0;
+    for (long k = 0; ok && k < in->nchunks; k++) {
+        const int d = (int)(k % depth);
+        const double tw = get_time_ns();
+        while (ok && outstanding[d] > 0) {
+            uint64_t tag;
+            int res;
+            if (uring_wait(&ring, &tag, &res) != 0) {
+                ok = 0;
+                break;
+            }
+            completed++;
+            const long done = (long)(tag / 2);
+            if (done < 0 || done >= in->nchunks) {
+                ok = 0;
+                break;
+            }
+            ok = res == (int)(chunk_len(in, done) * sizeof(double));
+            outstanding[done % depth]--;
+        }
+        wait += get_time_ns() - tw;
+        if (!ok) break;
+        if (compute) sum += compute_chunk(bufs[d], bufs[d] + in->chunk, in->c, chunk_len(in, k));
+        // Buffer d is free again: refill it with chunk k + depth
+        if (k + depth < in->nchunks) {
+            ok = uring_queue_chunk(&ring, in, bufs, *registered, k + depth) == 0;
+            if (ok) queued += 2;
+            ok = ok && uring_submit(&ring) >= 0;
+            outstanding[d] = 2;
+        }
+    }
+    r->total = get_time_ns() - t0;
+    r->wait = wait;
+    r->compute = r->total - wait;
+    r->result = sum;
+
+    // After a failure, reap every read the kernel accepted before the
+    // buffers go away (queued but never submitted ones die with the ring)
+    long inflight = queued - (long)ring.pending - completed;
+    while (inflight > 0) {
+        uint64_t tag;
+        int res;
+        if (uring_wait(&ring, &tag, &res) != 0) break;
+        inflight--;
+    }
+    uring_exit(&ring);
+    // Reads the kernel may still complete: leak their buffers rather than free them
+    if (inflight == 0)
+        for (int d = 0; d < depth; d++) free(bufs[d]);
+    return ok ? 0 : -1;
+}
+
+// Best of REPEATS, cold page cache every time
+static int run_path(int path, const ingest_t *in, run_t *best, int *registered) {
+    best->ran = 0;
+    int fallback = 0;
+    for (int rep = 0; rep < REPEATS; rep++) {
+        run_t r;
+        int rc;
+        drop_cache(in);
+        switch (path) {
+        case PATH_STORAGE:
+            if (fallback) {
+                rc = run_read(in, 0, &r);
+            } else if ((rc = run_uring(in, 0, &r, registered)) != 0) {
+                // io_uring failed: time every repeat with pread() instead
+                fallback = 1;
+                best->ran = 0;
+                rep = -1;
+                continue;
+            }
+            break;
+        case PATH_COMPUTE: rc = run_compute(in, &r); break;
+        case PATH_READ:    rc = run_read(in, 1, &r); break;
+        case PATH_MMAP:    rc = run_mmap(in, &r); break;
+        default:           rc = run_uring(in, 1, &r, registered); break;
+        }
+        if (rc != 0) return -1;
+        r.fallback = fallback;
+        if (!best->ran || r.total < best->total) *best = r;
+        best->ran = 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long n = DEFAULT_N, chunk = DEFAULT_CHUNK;
+    int depth = DEFAULT_DEPTH, direct = 1, keep = 0;
+    const char *file = DEFAULT_FILE;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--n") == 0)           n = (long)strtod(val, NULL);
+        else if (strcmp(opt, "--chunk") == 0)  chunk = (long)strtod(val, NULL);
+        else if (strcmp(opt, "--depth") == 0)  depth = atoi(val);
+        else if (strcmp(opt, "--file") == 0)   file = val;
+        else if (strcmp(opt, "--direct") == 0) direct = atoi(val);
+        else if (strcmp(opt, "--keep") == 0)   keep = atoi(val);
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    // O_DIRECT wants 4 KiB-aligned offsets and lengths
+    n = (n + ALIGN_ELEMS - 1) / ALIGN_ELEMS * ALIGN_ELEMS;
+    chunk = (chunk + ALIGN_ELEMS - 1) / ALIGN_ELEMS * ALIGN_ELEMS;
+    if (n < ALIGN_ELEMS || chunk < ALIGN_ELEMS || depth < 1 || depth > 64) {
+        fprintf(stderr, "N and the chunk must be positive and the depth in 1..64\n");
+        return 1;
+    }
+    if (chunk > n) chunk = n;
+    if (chunk * (long)sizeof(double) > (1L << 30)) {
+        fprintf(stderr, "A chunk may be at most 1 GiB (one io_uring read)\n");
+        return 1;
+    }
+
+    init_timing();
+    struct stat st;
+    const off_t file_bytes = 2 * (off_t)n * sizeof(double);
+    int created = 0;
+    if (stat(file, &st) != 0 || st.st_size != file_bytes) {
+        if (create_input(file, n, chunk) != 0) {
+            fprintf(stderr, "Failed to write %s\n", file);
+            return 1;
+        }
+        created = 1;
+    }
+
+    ingest_t in = {file, -1, -1, 0, n, chunk, (n + chunk - 1) / chunk, depth, NULL};
+    in.fd_cached = open(file, O_RDONLY);
+#ifdef O_DIRECT
+    if (direct) in.fd_io = open(file, O_RDONLY | O_DIRECT);
+    in.direct = in.fd_io >= 0;
+#endif
+    if (in.fd_io < 0) in.fd_io = open(file, O_RDONLY);
+    in.c = aligned_buffer(chunk * sizeof(double));
+    if (in.fd_cached < 0 || in.fd_io < 0 || !in.c) {
+        fprintf(stderr, "Failed to open %s\n", file);
+        if (in.fd_io >= 0) close(in.fd_io);
+        if (in.fd_cached >= 0) close(in.fd_cached);
+        free(in.c);
+        if (created && !keep) unlink(file);
+        return 1;
+    }
+    uring_t probe;
+    const int have_uring = uring_init(&probe, 2) == 0;
+    if (have_uring) uring_exit(&probe);
+
+    printf("=============================================================\n");
+    printf("Exercise 3: Streaming the Vectors from Disk\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Vector size N:       %ld elements (%.2f MB per array)\n", n, n * 8.0 / 1048576.0);
+    printf("  Input file:          %s (%.2f MB%s)\n", file, file_bytes / 1048576.0,
+           created ? ", written now" : "");
+    printf("  Chunk:               %ld elements (%.2f MB of a + b), %ld chunks\n", chunk,
+           2.0 * chunk * 8.0 / 1048576.0, in.nchunks);
+    printf("  Queue depth:         %d buffer(s)\n", depth);
+    printf("  Reads:               %s\n", in.direct ? "O_DIRECT" :
+           direct ? "page cache (O_DIRECT refused)" : "page cache");
+    printf("  io_uring:            %s\n", have_uring ? "available" : "unavailable");
+    printf("  Repeats:             best of %d, cold page cache\n\n", REPEATS);
+
+    run_t runs[NUM_PATHS];
+    int registered = 0;
+    printf("%-10s %11s %13s %12s %9s %9s\n", "Path", "total(ms)", "compute(ms)", "I/O wait(ms)",
+           "GB/s", "hidden %");
+    printf("------------------------------------------------------------------------\n");
+    for (int path = 0; path < NUM_PATHS; path++) {
+        run_t *r = &runs[path];
+        if (path == PATH_URING && !have_uring) {
+            r->ran = 0;
+            printf("%-10s   skipped (io_uring unavailable)\n", path_names[path]);
+            continue;
+        }
+        if (run_path(path, &in, r, &registered) != 0) {
+            r->ran = 0;
+            printf("%-10s   FAILED (%s)\n", path_names[path], strerror(errno));
+            continue;
+        }
+        if (path == PATH_STORAGE) {
+            r->wait = r->total;      // Nothing but I/O
+            r->compute = 0.0;
+        }
+        if (path == PATH_MMAP && runs[PATH_COMPUTE].ran) {
+            r->compute = runs[PATH_COMPUTE].total;
+            r->wait = fmax(0.0, r->total - r->compute);
+        }
+        const double gbs = file_bytes / r->total;
+        char hidden[16] = "";
+        if (path >= PATH_READ && runs[PATH_STORAGE].ran && runs[PATH_COMPUTE].ran) {
+            const double t_io = runs[PATH_STORAGE].total, t_comp = runs[PATH_COMPUTE].total;
+            const double h = fmin(1.0, fmax(0.0, (t_io + t_comp - r->total) / fmin(t_io, t_comp)));
+            snprintf(hidden, sizeof(hidden), "%.1f", 100.0 * h);
+        }
+        // A storage row timed with pread() is a different kernel: never file it as io_uring's
+        const char *name = r->fallback ? "storage-pread" : path_names[path];
+        printf("%-10s %11.2f %13.2f %12.2f %9.2f %9s\n", r->fallback ? "storage*" : path_names[path],
+               r->total / 1e6, r->compute / 1e6, r->wait / 1e6, gbs, hidden);
+        if (r->fallback)
+            printf("%-10s   * timed with pread(): %s\n", "",
+                   have_uring ? "io_uring reads failed" : "io_uring unavailable");
+        fflush(stdout);
+
+        char param[96];
+        snprintf(param, sizeof(param), "N=%ld chunk=%ld depth=%d", n, chunk, depth);
+        results_record("exercise3_ingest", name, param, "total_time", r->total / 1e6, "ms");
+        results_record("exercise3_ingest", name, param, "io_wait", r->wait / 1e6, "ms");
+        results_record("exercise3_ingest", name, param, "bandwidth", gbs, "GB/s");
+    }
+    printf("------------------------------------------------------------------------\n\n");
+
+    if (runs[PATH_STORAGE].ran && runs[PATH_COMPUTE].ran) {
+        const double t_io = runs[PATH_STORAGE].total, t_comp = runs[PATH_COMPUTE].total;
+        printf("Analysis:\n");
+        printf("  Storage alone:       %.2f ms (%.2f GB/s)\n", t_io / 1e6, file_bytes / t_io);
+        printf("  Compute alone:       %.2f ms (%.2f GB/s of input)\n", t_comp / 1e6, file_bytes / t_comp);
+        printf("  Bound:               %s (ideal overlap: %.2f ms)\n",
+               t_io > t_comp ? "I/O-bound" : "compute-bound", fmax(t_io, t_comp) / 1e6);
+        for (int path = PATH_READ; path < NUM_PATHS; path++) {
+            if (!runs[path].ran) continue;
+            const double h = fmin(1.0, fmax(0.0, (t_io + t_comp - runs[path].total) / fmin(t_io, t_comp)));
+            printf("  %-9s            %.2fx the ideal, %s is %s\n", path_names[path],
+                   runs[path].total / fmax(t_io, t_comp), t_io > t_comp ? "compute" : "storage",
+                   h >= HIDDEN_FULLY ? "fully hidden" : h > 0.05 ? "partly hidden" : "not hidden");
+        }
+        if (runs[PATH_URING].ran)
+            printf("  io_uring buffers:    %s\n", registered ? "registered (READ_FIXED)" : "not registered (plain READ)");
+        printf("\n");
+    }
+
+    printf("Results:\n");
+    int first = -1;
+    for (int path = PATH_COMPUTE; path < NUM_PATHS; path++) {
+        if (!runs[path].ran) continue;
+        printf("  %-10s Result: %f", path_names[path], runs[path].result);
+        if (first < 0) first = path;
+        else printf("   (%s)", runs[path].result == runs[first].result ? "identical" : "DIFFERS");
+        printf("\n");
+    }
+    printf("\nThe storage row reads without computing and the compute row computes\n");
+    printf("from memory; an input path hides the I/O when its total approaches the\n");
+    printf("larger of the two. mmap always goes through the page cache.\n");
+
+    free(in.c);
+    close(in.fd_io);
+    close(in.fd_cached);
+    if (created && !keep) unlink(file);
+    return 0;
+}
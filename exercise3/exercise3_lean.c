@@ -0,0 +1,355 @@
+/*
+ * Exercise 3: Memory-Lean Execution of the Vector Pipeline
+ *
+ * exercise3.c keeps three full double arrays (a, b, c): 3 x N x 8 bytes,
+ * i.e. 2.4 GB at N = 10^8. Two of them are not needed:
+ *   - b is the constant 2.0, so it can be a "virtual" array that is never
+ *     materialized (lazy constant source).
+ *   - c is read exactly once by reduction(), so compute_addition() can
+ *     overwrite a in place.
+ * Optionally, a can be stored as float32 while every sum is still
+ * accumulated in double.
+ *
+ * Each mode runs in its own child process so that peak RSS (ru_maxrss)
+ * is measured per layout rather than for the whole benchmark.
+ *
+ * Usage: ./exercise3_lean [N] [--mode baseline|lean|lean-f32]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "timing.h"
+
+// Configuration
+#define DEFAULT_N 100000000
+#define B_VALUE   2.0
+#define NOISE     1.0000001
+
+typedef enum {
+    MODE_BASELINE,   // a, b, c all materialized as double (exercise3.c)
+    MODE_LEAN,       // b virtual, c aliased onto a
+    MODE_LEAN_F32,   // as MODE_LEAN, a stored as float, double accumulation
+    NUM_MODES
+} lean_mode_t;
+
+static const char *mode_names[NUM_MODES] = {"baseline", "lean", "lean-f32"};
+
+// Per-stage timings and result, sent from the child back to the parent
+typedef struct {
+    double t_noise, t_init_b, t_add, t_reduce;
+    double result;
+    double arrays_mb;  // Bytes of array storage actually allocated
+    int ok;
+} lean_report_t;
+
+// ============================================================================
+// Virtual (lazy) vector source
+// ============================================================================
+
+// A read-only double vector that is either backed by storage or is a
+// constant. A constant source costs no memory and no memory traffic.
+typedef struct {
+    const double *data;  // NULL => every element equals `value`
+    double value;
+} dvec_src_t;
+
+static dvec_src_t dvec_constant(double value) {
+    dvec_src_t v = {NULL, value};
+    return v;
+}
+
+static dvec_src_t dvec_array(const double *data) {
+    dvec_src_t v = {data, 0.0};
+    return v;
+}
+
+// ============================================================================
+// Pipeline stages (double storage)
+// ============================================================================
+
+// SEQUENTIAL - each element depends on previous
+__attribute__((noinline))
+static void add_noise(double *a, size_t n) {
+    a[0] = 1.0;
+    for (size_t i = 1; i < n; i++) {
+        a[i] = a[i-1] * NOISE;
+    }
+}
+
+// PARALLEL - only needed when b is materialized
+__attribute__((noinline))
+static void init_b(double *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        b[i] = B_VALUE;
+    }
+}
+
+// PARALLEL - dst may alias a (in-place overwrite)
+__attribute__((noinline))
+static void compute_addition(double *dst, const double *a, dvec_src_t b, size_t n) {
+    if (b.data) {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = a[i] + b.data[i];
+        }
+    } else {
+        const double bv = b.value;
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = a[i] + bv;
+        }
+    }
+}
+
+// PARALLEL - reduction pattern
+__attribute__((noinline))
+static double reduction(const double *c, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += c[i];
+    }
+    return sum;
+}
+
+// ============================================================================
+// Pipeline stages (float32 storage, double arithmetic)
+// ============================================================================
+
+// The recurrence itself is carried in double so the stored values are
+// the correctly rounded float32 images of the double sequence.
+__attribute__((noinline))
+static void add_noise_f32(float *a, size_t n) {
+    double x = 1.0;
+    a[0] = (float)x;
+    for (size_t i = 1; i < n; i++) {
+        x *= NOISE;
+        a[i] = (float)x;
+    }
+}
+
+__attribute__((noinline))
+static void compute_addition_f32(float *dst, const float *a, dvec_src_t b, size_t n) {
+    if (b.data) {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = (float)((double)a[i] + b.data[i]);
+        }
+    } else {
+        const double bv = b.value;
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = (float)((double)a[i] + bv);
+        }
+    }
+}
+
+__attribute__((noinline))
+static double reduction_f32(const float *c, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += (double)c[i];
+    }
+    return sum;
+}
+
+// ============================================================================
+// Mode runners (executed inside a child process)
+// ============================================================================
+
+static void run_baseline(size_t n, lean_report_t *r) {
+    double *a = malloc(n * sizeof(double));
+    double *b = malloc(n * sizeof(double));
+    double *c = malloc(n * sizeof(double));
+    if (!a || !b || !c) return;
+    r->arrays_mb = 3.0 * n * sizeof(double) / (1024.0 * 1024.0);
+
+    double t0 = get_time_ns();
+    add_noise(a, n);
+    double t1 = get_time_ns();
+    init_b(b, n);
+    double t2 = get_time_ns();
+    compute_addition(c, a, dvec_array(b), n);
+    double t3 = get_time_ns();
+    r->result = reduction(c, n);
+    double t4 = get_time_ns();
+
+    r->t_noise = t1 - t0; r->t_init_b = t2 - t1;
+    r->t_add = t3 - t2;   r->t_reduce = t4 - t3;
+    r->ok = 1;
+    free(a); free(b); free(c);
+}
+
+static void run_lean(size_t n, lean_report_t *r) {
+    double *a = malloc(n * sizeof(double));
+    if (!a) return;
+    r->arrays_mb = (double)n * sizeof(double) / (1024.0 * 1024.0);
+
+    double t0 = get_time_ns();
+    add_noise(a, n);
+    double t1 = get_time_ns();
+    dvec_src_t b = dvec_constant(B_VALUE);  // init_b() becomes free
+    double t2 = get_time_ns();
+    compute_addition(a, a, b, n);           // c aliases a
+    double t3 = get_time_ns();
+    r->result = reduction(a, n);
+    double t4 = get_time_ns();
+
+    r->t_noise = t1 - t0; r->t_init_b = t2 - t1;
+    r->t_add = t3 - t2;   r->t_reduce = t4 - t3;
+    r->ok = 1;
+    free(a);
+}
+
+static void run_lean_f32(size_t n, lean_report_t *r) {
+    float *a = malloc(n * sizeof(float));
+    if (!a) return;
+    r->arrays_mb = (double)n * sizeof(float) / (1024.0 * 1024.0);
+
+    double t0 = get_time_ns();
+    add_noise_f32(a, n);
+    double t1 = get_time_ns();
+    dvec_src_t b = dvec_constant(B_VALUE);
+    double t2 = get_time_ns();
+    compute_addition_f32(a, a, b, n);
+    double t3 = get_time_ns();
+    r->result = reduction_f32(a, n);
+    double t4 = get_time_ns();
+
+    r->t_noise = t1 - t0; r->t_init_b = t2 - t1;
+    r->t_add = t3 - t2;   r->t_reduce = t4 - t3;
+    r->ok = 1;
+    free(a);
+}
+
+// Run one mode in a fresh child; returns its peak RSS in MB (or -1)
+static double run_mode_isolated(lean_mode_t mode, size_t n, lean_report_t *r) {
+    int fds[2];
+    memset(r, 0, sizeof(*r));       // ok = 0 until the child reports
+    if (pipe(fds) != 0) return -1.0;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1.0;
+    }
+    if (pid == 0) {
+        lean_report_t rep;
+        memset(&rep, 0, sizeof(rep));
+        close(fds[0]);
+        switch (mode) {
+            case MODE_BASELINE: run_baseline(n, &rep); break;
+            case MODE_LEAN:     run_lean(n, &rep);     break;
+            case MODE_LEAN_F32: run_lean_f32(n, &rep); break;
+            default: break;
+        }
+        ssize_t w = write(fds[1], &rep, sizeof(rep));
+        _exit(w == (ssize_t)sizeof(rep) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], r, sizeof(*r));
+    close(fds[0]);
+
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        r->ok = 0;
+        return -1.0;
+    }
+    if (got != (ssize_t)sizeof(*r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        r->ok = 0;
+    return rusage_maxrss_mb(&ru);
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = DEFAULT_N;
+    int only = -1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            const char *m = argv[++i];
+            for (int k = 0; k < NUM_MODES; k++)
+                if (strcmp(m, mode_names[k]) == 0) only = k;
+            if (only < 0) {
+                fprintf(stderr, "Unknown mode '%s'\n", m);
+                return 1;
+            }
+        } else {
+            n = strtoull(argv[i], NULL, 10);
+        }
+    }
+    if (n < 2) {
+        fprintf(stderr, "N must be at least 2\n");
+        return 1;
+    }
+
+    init_timing();
+
+    printf("=============================================================\n");
+    printf("Exercise 3: Memory-Lean Vector Pipeline\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Vector size N:       %zu elements\n", n);
+    printf("  Baseline footprint:  %.2f MB (a, b, c as double)\n\n",
+           3.0 * n * sizeof(double) / (1024.0 * 1024.0));
+
+    lean_report_t reports[NUM_MODES];
+    double rss[NUM_MODES];
+    int ran[NUM_MODES] = {0};
+
+    for (int m = 0; m < NUM_MODES; m++) {
+        if (only >= 0 && m != only) continue;
+        rss[m] = run_mode_isolated((lean_mode_t)m, n, &reports[m]);
+        ran[m] = 1;
+    }
+
+    printf("%-10s %10s %10s %10s %10s %10s %11s %11s\n",
+           "Mode", "noise(ms)", "init_b(ms)", "add(ms)", "reduce(ms)",
+           "total(ms)", "arrays(MB)", "peakRSS(MB)");
+    printf("------------------------------------------------------------------------------------------\n");
+    for (int m = 0; m < NUM_MODES; m++) {
+        if (!ran[m]) continue;
+        lean_report_t *r = &reports[m];
+        if (!r->ok) {
+            printf("%-10s   FAILED (allocation or child error)\n", mode_names[m]);
+            continue;
+        }
+        double total = r->t_noise + r->t_init_b + r->t_add + r->t_reduce;
+        printf("%-10s %10.2f %10.2f %10.2f %10.2f %10.2f %11.1f %11.1f\n",
+               mode_names[m], r->t_noise / 1e6, r->t_init_b / 1e6, r->t_add / 1e6,
+               r->t_reduce / 1e6, total / 1e6, r->arrays_mb, rss[m]);
+    }
+    printf("------------------------------------------------------------------------------------------\n\n");
+
+    printf("Results:\n");
+    for (int m = 0; m < NUM_MODES; m++) {
+        if (!ran[m] || !reports[m].ok) continue;
+        printf("  %-10s Result: %f", mode_names[m], reports[m].result);
+        if (ran[MODE_BASELINE] && reports[MODE_BASELINE].ok && m != MODE_BASELINE) {
+            double ref = reports[MODE_BASELINE].result;
+            printf("   (rel. error vs baseline: %.3e)", fabs(reports[m].result - ref) / fabs(ref));
+        }
+        printf("\n");
+    }
+
+    if (ran[MODE_BASELINE] && reports[MODE_BASELINE].ok) {
+        lean_report_t *b = &reports[MODE_BASELINE];
+        double tb = b->t_noise + b->t_init_b + b->t_add + b->t_reduce;
+        printf("\nVersus baseline:\n");
+        for (int m = MODE_LEAN; m < NUM_MODES; m++) {
+            if (!ran[m] || !reports[m].ok) continue;
+            lean_report_t *r = &reports[m];
+            double t = r->t_noise + r->t_init_b + r->t_add + r->t_reduce;
+            printf("  %-10s footprint %.2fx smaller (peak RSS %.2fx), runtime %.2fx faster\n",
+                   mode_names[m], b->arrays_mb / r->arrays_mb, rss[MODE_BASELINE] / rss[m], tb / t);
+        }
+    }
+
+    return 0;
+}
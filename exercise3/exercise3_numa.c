@@ -0,0 +1,327 @@
+/*
+ * Exercise 3: NUMA Placement of the Vector Pipeline
+ *
+ * exercise3.c initializes a, b and c from one thread, so on a multi-socket
+ * machine every page lands on that thread's node and a parallel
+ * compute_addition() / reduction() pulls half (or more) of its traffic
+ * across the interconnect. This benchmark runs the whole pipeline on a
+ * thread pool with the buffers placed by common/numa.h:
+ *   serial       one thread writes everything (exercise3.c behaviour)
+ *   first-touch  chunk c is written by a thread pinned to its node
+ *   interleave   pages round-robin over all nodes
+ *   bind         chunk c is mbind()-ed to its node before it is written
+ * Initialization and compute use the same chunks and the same chunk ->
+ * node mapping, so with first-touch / bind every chunk is processed on the
+ * node holding its pages. For each policy it reports the init time, the
+ * add / reduce bandwidth overall and per node (bytes of that node's chunks
+ * over the span its chunks ran), the pages per node and the fraction of
+ * pages remote to the node that processes them.
+ *
+ * The per-chunk reduction is tuning_sum() with the accumulator count
+ * stored for this host by exercise4_tune (one accumulator, exercise3.c's
+ * loop, when the host is untuned).
+ *
+ * add_noise() restarts its recurrence every NOISE_BLOCK elements (from
+ * pow(NOISE, i)), so every policy and thread count computes bit-identical
+ * data; the result differs from exercise3.c only in the last digits.
+ *
+ * --placement pins the pool workers by a common/topology.h policy; the
+ * node pinning of each chunk then keeps a worker on its own CPU whenever
+ * that CPU belongs to the chunk's node.
+ *
+ * Usage: ./exercise3_numa [--n N] [--threads P]
+ *                         [--numa all|serial|first-touch|interleave|bind]
+ *                         [--placement none|compact|scatter|one-per-core|one-per-l3]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "timing.h"
+#include "threadpool.h"
+#include "numa.h"
+#include "tuning.h"
+
+// Configuration
+#define DEFAULT_N        100000000
+#define B_VALUE          2.0
+#define NOISE            1.0000001
+#define NOISE_BLOCK      4096
+#define CHUNKS_PER_THREAD 4
+#define MAX_CHUNKS       4096
+
+typedef struct {
+    double start, end;   // ns since the phase started
+    double sum;          // Partial reduction
+} chunk_stat_t;
+
+typedef struct {
+    double *a, *b, *c;
+    long n;
+    int chunks;
+    int accumulators;    // tuning_sum() accumulators
+    double t0;
+    chunk_stat_t stat[MAX_CHUNKS];
+} pipeline_t;
+
+typedef struct {
+    double t_init, t_add, t_reduce, result;
+    double add_node[NUMA_MAX_NODES], reduce_node[NUMA_MAX_NODES];  // GB/s
+    long pages[NUMA_MAX_NODES];
+    double remote;       // < 0: unknown
+    int applied;
+} numa_report_t;
+
+// ============================================================================
+// Initialization (fill callbacks)
+// ============================================================================
+
+static void fill_noise(void *arg, void *buf, long begin, long end) {
+    double *a = buf;
+    (void)arg;
+    for (long i = begin; i < end; i++) {
+        if (i % NOISE_BLOCK == 0 || i == begin) a[i] = pow(NOISE, (double)i);
+        else a[i] = a[i - 1] * NOISE;
+    }
+}
+
+static void fill_b(void *arg, void *buf, long begin, long end) {
+    double *b = buf;
+    (void)arg;
+    for (long i = begin; i < end; i++) b[i] = B_VALUE;
+}
+
+static void fill_zero(void *arg, void *buf, long begin, long end) {
+    double *c = buf;
+    (void)arg;
+    for (long i = begin; i < end; i++) c[i] = 0.0;
+}
+
+// ============================================================================
+// Compute phases, one task per chunk
+// ============================================================================
+
+static void add_task(void *arg, int chunk, int worker) {
+    pipeline_t *p = arg;
+    long begin, end;
+    (void)worker;
+    numa_chunk_range(p->n, p->chunks, chunk, &begin, &end);
+    p->stat[chunk].start = get_time_ns() - p->t0;
+    double *restrict c = p->c;
+    const double *restrict a = p->a, *restrict b = p->b;
+    for (long i = begin; i < end; i++) c[i] = a[i] + b[i];
+    p->stat[chunk].end = get_time_ns() - p->t0;
+}
+
+static void reduce_task(void *arg, int chunk, int worker) {
+    pipeline_t *p = arg;
+    long begin, end;
+    (void)worker;
+    numa_chunk_range(p->n, p->chunks, chunk, &begin, &end);
+    p->stat[chunk].start = get_time_ns() - p->t0;
+    p->stat[chunk].sum = tuning_sum(p->c + begin, end - begin, p->accumulators);
+    p->stat[chunk].end = get_time_ns() - p->t0;
+}
+
+// Bandwidth of each node: bytes of its chunks over the span they ran
+static void node_bandwidth(const pipeline_t *p, double bytes_per_elem, double *gbs) {
+    const int nodes = numa_num_nodes();
+    for (int node = 0; node < nodes; node++) {
+        double first = 1e300, last = 0.0, bytes = 0.0;
+        for (int c = 0; c < p->chunks; c++) {
+            if (numa_chunk_node(c, p->chunks) != node) continue;
+            long begin, end;
+            numa_chunk_range(p->n, p->chunks, c, &begin, &end);
+            bytes += (end - begin) * bytes_per_elem;
+            first = fmin(first, p->stat[c].start);
+            last = fmax(last, p->stat[c].end);
+        }
+        gbs[node] = last > first ? bytes / (last - first) : 0.0;
+    }
+}
+
+static int run_policy(numa_policy_t policy, long n, threadpool_t *pool, pipeline_t *p,
+                      numa_report_t *r) {
+    const int chunks = p->chunks;
+    int ok_a, ok_b, ok_c;
+    memset(r, 0, sizeof(*r));
+
+    double t0 = get_time_ns();
+    p->a = numa_alloc_init(n, sizeof(double), chunks, policy, pool, fill_noise, NULL, &ok_a);
+    p->b = numa_alloc_init(n, sizeof(double), chunks, policy, pool, fill_b, NULL, &ok_b);
+    p->c = numa_alloc_init(n, sizeof(double), chunks, policy, pool, fill_zero, NULL, &ok_c);
+    r->t_init = get_time_ns() - t0;
+    r->applied = ok_a && ok_b && ok_c;
+    if (!p->a || !p->b || !p->c) {
+        numa_free(p->a, n, sizeof(double));
+        numa_free(p->b, n, sizeof(double));
+        numa_free(p->c, n, sizeof(double));
+        return -1;
+    }
+
+    p->t0 = get_time_ns();
+    numa_run_chunks(pool, chunks, add_task, p);
+    r->t_add = get_time_ns() - p->t0;
+    node_bandwidth(p, 3.0 * sizeof(double), r->add_node);
+
+    p->t0 = get_time_ns();
+    numa_run_chunks(pool, chunks, reduce_task, p);
+    double sum = 0.0;
+    for (int c = 0; c < chunks; c++) sum += p->stat[c].sum;   // Fixed order
+    r->t_reduce = get_time_ns() - p->t0;
+    r->result = sum;
+    node_bandwidth(p, sizeof(double), r->reduce_node);
+
+    // Placement of all three arrays relative to the compute partitioning
+    long pages[NUMA_MAX_NODES];
+    double remote, remote_sum = 0.0;
+    int known = 1;
+    double *arrays[3] = {p->a, p->b, p->c};
+    for (int k = 0; k < 3; k++) {
+        if (numa_page_report(arrays[k], n, sizeof(double), chunks, pages, &remote) != 0 || remote < 0.0) {
+            known = 0;
+            break;
+        }
+        remote_sum += remote;
+        for (int node = 0; node < NUMA_MAX_NODES; node++) r->pages[node] += pages[node];
+    }
+    r->remote = known ? remote_sum / 3.0 : -1.0;
+
+    numa_free(p->a, n, sizeof(double));
+    numa_free(p->b, n, sizeof(double));
+    numa_free(p->c, n, sizeof(double));
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long n = DEFAULT_N;
+    int threads = threadpool_cpu_count();
+    int only = -1;
+    topology_policy_t placement = TOPOLOGY_NONE;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--n") == 0)            n = (long)strtod(val, NULL);
+        else if (strcmp(opt, "--threads") == 0) threads = atoi(val);
+        else if (strcmp(opt, "--numa") == 0) {
+            numa_policy_t policy;
+            if (strcmp(val, "all") == 0) only = -1;
+            else if (numa_parse_policy(val, &policy) == 0) only = policy;
+            else {
+                fprintf(stderr, "Unknown NUMA policy '%s'\n", val);
+                return 1;
+            }
+        } else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &placement) != 0) {
+                fprintf(stderr, "Unknown placement policy '%s'\n", val);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (n < 2 || threads < 1) {
+        fprintf(stderr, "N must be at least 2 and P positive\n");
+        return 1;
+    }
+
+    init_timing();
+    const int nodes = numa_num_nodes();
+    int chunks = threads * CHUNKS_PER_THREAD;
+    if (chunks < nodes) chunks = nodes;
+    if (chunks > MAX_CHUNKS) chunks = MAX_CHUNKS;
+    if (threads > topology_max_threads(placement)) {
+        fprintf(stderr, "Placement %s fits at most %d threads\n", topology_policy_name(placement),
+                topology_max_threads(placement));
+        return 1;
+    }
+    threadpool_t *pool = threadpool_create_placed(threads, placement);
+    pipeline_t *p = calloc(1, sizeof(pipeline_t));
+    if (!pool || !p) {
+        fprintf(stderr, "Failed to create the thread pool\n");
+        return 1;
+    }
+    p->n = n;
+    p->chunks = chunks;
+    const int tuned = tuning_get("reduce.accumulators", &p->accumulators) == 0;
+    if (!tuned) p->accumulators = 1;
+
+    printf("=============================================================\n");
+    printf("Exercise 3: NUMA Placement of the Vector Pipeline\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Vector size N:       %ld elements (%.2f MB per array)\n", n, n * 8.0 / 1048576.0);
+    printf("  Threads:             %d (%d chunks)\n", threads, chunks);
+    printf("  Placement:           %s (", topology_policy_name(placement));
+    topology_describe(stdout);
+    printf(")\n");
+    printf("  NUMA nodes:          %d (", nodes);
+    for (int node = 0; node < nodes; node++)
+        printf("%snode %d: %d CPUs", node ? ", " : "", node, numa_node_cpus(node));
+    printf(")\n");
+    printf("  Reduction:           %d accumulator(s)%s\n\n", p->accumulators,
+           tuned ? " (tuned for this host)" : "");
+
+    numa_report_t reports[NUMA_NUM_POLICIES];
+    int ran[NUMA_NUM_POLICIES] = {0};
+
+    printf("%-12s %10s %10s %10s %11s %10s %9s\n", "Policy", "init(ms)", "add(ms)", "add GB/s",
+           "reduce(ms)", "red. GB/s", "remote %");
+    printf("------------------------------------------------------------------------------\n");
+    for (int pol = 0; pol < NUMA_NUM_POLICIES; pol++) {
+        if (only >= 0 && pol != only) continue;
+        numa_report_t *r = &reports[pol];
+        if (run_policy((numa_policy_t)pol, n, pool, p, r) != 0) {
+            printf("%-12s   FAILED (allocation)\n", numa_policy_name((numa_policy_t)pol));
+            continue;
+        }
+        ran[pol] = 1;
+        char remote[16];
+        if (r->remote < 0.0) snprintf(remote, sizeof(remote), "n/a");
+        else snprintf(remote, sizeof(remote), "%.1f", 100.0 * r->remote);
+        printf("%-12s %10.2f %10.2f %10.2f %11.2f %10.2f %9s%s\n", numa_policy_name((numa_policy_t)pol),
+               r->t_init / 1e6, r->t_add / 1e6, 3.0 * n * sizeof(double) / r->t_add,
+               r->t_reduce / 1e6, n * sizeof(double) / r->t_reduce, remote,
+               r->applied ? "" : "  (mbind refused, first-touch used)");
+        fflush(stdout);
+    }
+    printf("------------------------------------------------------------------------------\n\n");
+
+    printf("Per node (pages of a, b, c; bandwidth over the node's own chunks):\n");
+    printf("%-12s %5s %6s %12s %10s %10s\n", "Policy", "Node", "CPUs", "Pages", "add GB/s", "red. GB/s");
+    for (int pol = 0; pol < NUMA_NUM_POLICIES; pol++) {
+        if (!ran[pol]) continue;
+        for (int node = 0; node < nodes; node++) {
+            printf("%-12s %5d %6d %12ld %10.2f %10.2f\n", node ? "" : numa_policy_name((numa_policy_t)pol),
+                   node, numa_node_cpus(node), reports[pol].pages[node],
+                   reports[pol].add_node[node], reports[pol].reduce_node[node]);
+        }
+    }
+
+    printf("\nResults:\n");
+    int first = -1;
+    for (int pol = 0; pol < NUMA_NUM_POLICIES; pol++) {
+        if (!ran[pol]) continue;
+        printf("  %-12s Result: %f", numa_policy_name((numa_policy_t)pol), reports[pol].result);
+        if (first < 0) first = pol;
+        else printf("   (%s)", reports[pol].result == reports[first].result ? "identical" : "DIFFERS");
+        printf("\n");
+    }
+    printf("\nRemote %% is the share of pages whose node is not the node of the chunk\n");
+    printf("that processes them (n/a: move_pages unavailable). On a single node every\n");
+    printf("policy places everything locally and the bandwidths should match.\n");
+
+    free(p);
+    threadpool_destroy(pool);
+    return 0;
+}
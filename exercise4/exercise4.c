@@ -2,13 +2,18 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include "phase.h"  // PHASE_SCOPE is a no-op unless built with -DPHASE_PROFILE
+
+#ifndef N
 #define N 512  // Matrix size (N x N)
+#endif
 
 double A[N][N], B[N][N], C[N][N];
 double noise[N];
 
 // SEQUENTIAL - each element depends on previous (O(N))
 void generate_noise() {
+    PHASE_SCOPE("generate_noise", PHASE_SERIAL);
     noise[0] = 1.0;
     for (int i = 1; i < N; i++) {
         noise[i] = noise[i-1] * 1.0000001;
@@ -17,6 +22,7 @@ void generate_noise() {
 
 // PARALLEL - no dependencies (O(N^2))
 void init_matrix() {
+    PHASE_SCOPE("init_matrix", PHASE_PARALLEL);
     for (int i = 0; i < N; i++) {
         for (int j = 0; j < N; j++) {
             A[i][j] = noise[i % N] + i + j;
@@ -27,6 +33,7 @@ void init_matrix() {
 
 // PARALLEL - no dependencies (O(N^3))
 void matmul() {
+    PHASE_SCOPE("matmul", PHASE_PARALLEL);
     for (int i = 0; i < N; i++) {
         for (int j = 0; j < N; j++) {
             C[i][j] = 0.0;
@@ -38,6 +45,7 @@ void matmul() {
 }
 
 int main() {
+    PHASE_PARAM("N=%d", N);
     generate_noise();
     init_matrix();
     matmul();
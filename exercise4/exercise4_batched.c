@@ -0,0 +1,237 @@
+/*
+ * Exercise 4: Batched Small-Matrix GEMM Benchmark
+ *
+ * Multiplies many independent n x n matrices (n = 4 .. 32) and reports
+ * matrices per second for:
+ *   loop naive    the exercise4.c triple loop called once per matrix
+ *   loop packed   the general packed engine called once per matrix
+ *   batched       matmul_batched() on the AoS and interleaved layouts,
+ *                 on one thread and on the whole pool
+ * Sizes without a compile-time specialization run the runtime-n kernels.
+ * The AoS <-> interleaved conversion is timed separately.
+ *
+ * Usage: ./exercise4_batched [--sizes 4,8,...] [--elems E] [--count C]
+ *                            [--threads P]
+ *                            [--placement none|compact|scatter|one-per-core|one-per-l3]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "timing.h"
+#include "threadpool.h"
+#include "matmul.h"
+
+// Configuration
+#define MAX_SIZES     16
+#define DEFAULT_ELEMS (1L << 22)   // Doubles per operand (32 MB), sets the batch count
+#define MIN_REPEATS   3
+#define MIN_TIME_NS   3e8
+
+static const int default_sizes[] = {4, 7, 8, 16, 32};
+
+typedef enum {
+    METHOD_LOOP_NAIVE,
+    METHOD_LOOP_PACKED,
+    METHOD_AOS,
+    METHOD_INTERLEAVED,
+    METHOD_AOS_POOL,
+    METHOD_INTERLEAVED_POOL,
+    NUM_METHODS
+} method_t;
+
+static const char *method_names[NUM_METHODS] = {
+    "loop naive", "loop packed", "batched aos", "batched lanes",
+    "aos, pool", "lanes, pool"
+};
+
+typedef struct {
+    int n, count;
+    const double *A, *B, *Al, *Bl;   // AoS and interleaved operands
+    double *C, *Cl;
+    const matmul_tiles_t *t;
+    threadpool_t *pool;
+} batch_bench_t;
+
+static double *alloc_doubles(long count) {
+    return aligned_alloc(64, ((sizeof(double) * count + 63) / 64) * 64);
+}
+
+static void run_method(method_t m, batch_bench_t *bb) {
+    const int n = bb->n;
+    const long nn = (long)n * n;
+    switch (m) {
+        case METHOD_LOOP_NAIVE:
+            for (int b = 0; b < bb->count; b++)
+                matmul_naive(n, n, n, bb->A + b * nn, n, bb->B + b * nn, n, bb->C + b * nn, n);
+            break;
+        case METHOD_LOOP_PACKED:
+            for (int b = 0; b < bb->count; b++)
+                matmul_packed(n, n, n, bb->A + b * nn, n, bb->B + b * nn, n, bb->C + b * nn, n, bb->t);
+            break;
+        case METHOD_AOS:
+            matmul_batched(n, bb->count, bb->A, bb->B, bb->C, MATMUL_BATCH_AOS, NULL);
+            break;
+        case METHOD_INTERLEAVED:
+            matmul_batched(n, bb->count, bb->Al, bb->Bl, bb->Cl, MATMUL_BATCH_INTERLEAVED, NULL);
+            break;
+        case METHOD_AOS_POOL:
+            matmul_batched(n, bb->count, bb->A, bb->B, bb->C, MATMUL_BATCH_AOS, bb->pool);
+            break;
+        case METHOD_INTERLEAVED_POOL:
+            matmul_batched(n, bb->count, bb->Al, bb->Bl, bb->Cl, MATMUL_BATCH_INTERLEAVED, bb->pool);
+            break;
+        default:
+            break;
+    }
+}
+
+// Best-of-repeats seconds for one pass over the batch
+static double time_method(method_t m, batch_bench_t *bb) {
+    double best = 1e30, spent = 0.0;
+    for (int r = 0; r < MIN_REPEATS || spent < MIN_TIME_NS; r++) {
+        double start = get_time_ns();
+        run_method(m, bb);
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best / 1e9;
+}
+
+static int parse_sizes(const char *s, int *sizes) {
+    int count = 0;
+    while (*s && count < MAX_SIZES) {
+        sizes[count++] = (int)strtol(s, (char **)&s, 10);
+        if (*s == ',') s++;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    int sizes[MAX_SIZES];
+    int num_sizes = (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    memcpy(sizes, default_sizes, sizeof(default_sizes));
+    long elems = DEFAULT_ELEMS;
+    int fixed_count = 0;
+    int threads = threadpool_cpu_count();
+    topology_policy_t placement = TOPOLOGY_NONE;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--sizes") == 0)        num_sizes = parse_sizes(val, sizes);
+        else if (strcmp(opt, "--elems") == 0)   elems = atol(val);
+        else if (strcmp(opt, "--count") == 0)   fixed_count = atoi(val);
+        else if (strcmp(opt, "--threads") == 0) threads = atoi(val);
+        else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &placement) != 0) {
+                fprintf(stderr, "Unknown placement policy '%s'\n", val);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    threadpool_t *pool = threadpool_create_placed(threads, placement);
+    if (!pool) {
+        fprintf(stderr, "Placement %s cannot place %d threads\n", topology_policy_name(placement), threads);
+        return 1;
+    }
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Batched Small-Matrix GEMM\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Threads (pool):      %d\n", threadpool_size(pool));
+    printf("  Placement:           %s\n", topology_policy_name(placement));
+    printf("  Interleave lanes:    %d matrices\n", MATMUL_BATCH_LANES);
+    printf("  Batch count:         %s\n\n", fixed_count ? "fixed (--count)" : "--elems / n^2 per operand");
+
+    printf("%4s %5s %8s %-14s %10s %12s %10s %9s %6s\n", "n", "Spec.", "Count", "Method",
+           "Time (ms)", "Mmatrices/s", "GFLOP/s", "Speedup", "Check");
+    printf("-------------------------------------------------------------------------------------\n");
+
+    for (int s = 0; s < num_sizes; s++) {
+        const int n = sizes[s];
+        if (n < 1) continue;
+        const int count = fixed_count > 0 ? fixed_count : (int)fmax(64.0, (double)elems / ((long)n * n));
+        const long aos_elems = matmul_batch_elems(n, count, MATMUL_BATCH_AOS);
+        const long lane_elems = matmul_batch_elems(n, count, MATMUL_BATCH_INTERLEAVED);
+
+        double *A = alloc_doubles(aos_elems), *B = alloc_doubles(aos_elems);
+        double *C = alloc_doubles(aos_elems), *Ref = alloc_doubles(aos_elems);
+        double *Al = alloc_doubles(lane_elems), *Bl = alloc_doubles(lane_elems);
+        double *Cl = alloc_doubles(lane_elems);
+        if (!A || !B || !C || !Ref || !Al || !Bl || !Cl) {
+            fprintf(stderr, "Failed to allocate n=%d x %d\n", n, count);
+            return 1;
+        }
+        unsigned seed = 12345u;
+        for (long e = 0; e < aos_elems; e++) {
+            seed = seed * 1103515245u + 12345u;
+            A[e] = (double)(seed >> 8 & 0xffffff) / 16777216.0 - 0.5;
+            seed = seed * 1103515245u + 12345u;
+            B[e] = (double)(seed >> 8 & 0xffffff) / 16777216.0 - 0.5;
+        }
+        // Touch the interleaved buffers so the conversion timing excludes page faults
+        memset(Al, 0, sizeof(double) * lane_elems);
+        memset(Bl, 0, sizeof(double) * lane_elems);
+        memset(Cl, 0, sizeof(double) * lane_elems);
+
+        double start = get_time_ns();
+        matmul_batch_interleave(n, count, A, Al);
+        matmul_batch_interleave(n, count, B, Bl);
+        const double interleave_ms = (get_time_ns() - start) / 1e6;
+
+        batch_bench_t bb = {n, count, A, B, Al, Bl, Ref, Cl, &tiles, pool};
+        const double flops = 2.0 * n * n * (double)n * count;
+        double base = 0.0;
+
+        for (int m = 0; m < NUM_METHODS; m++) {
+            const double secs = time_method((method_t)m, &bb);
+            if (m == METHOD_LOOP_NAIVE) {
+                base = secs;
+                bb.C = C;         // Ref holds the naive result from here on
+            }
+            const double *out = C;
+            if (m == METHOD_INTERLEAVED || m == METHOD_INTERLEAVED_POOL) {
+                matmul_batch_deinterleave(n, count, Cl, C);
+            }
+            double err = 0.0;
+            if (m != METHOD_LOOP_NAIVE) {
+                for (long e = 0; e < aos_elems; e++) err = fmax(err, fabs(out[e] - Ref[e]));
+                err /= n * 0.25;  // max|A| max|B| <= 1/4
+            }
+            printf("%4d %5s %8d %-14s %10.3f %12.2f %10.2f %8.2fx %6s\n", n,
+                   matmul_batch_specialized(n) ? "yes" : "no", count, method_names[m],
+                   secs * 1e3, count / secs / 1e6, flops / secs / 1e9, base / secs,
+                   err <= 2.0 * n * DBL_EPSILON ? "OK" : "FAIL");
+            fflush(stdout);
+        }
+        printf("%4d %5s %8d %-14s %10.3f  (A and B, AoS -> interleaved)\n\n", n, "", count,
+               "interleave", interleave_ms);
+
+        free(A); free(B); free(C); free(Ref); free(Al); free(Bl); free(Cl);
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    printf("Speedup is relative to calling the naive kernel once per matrix.\n");
+
+    threadpool_destroy(pool);
+    return 0;
+}
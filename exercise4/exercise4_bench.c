@@ -0,0 +1,272 @@
+/*
+ * Exercise 4: Matrix Multiplication Kernel Benchmark
+ *
+ * Compares the textbook i-j-k kernel of exercise4.c against the loop
+ * interchanged (i-k-j), multi-level cache-blocked and packed SIMD
+ * kernels, reporting GFLOP/s (2*N^3 flops per product) for N = 64 .. 8192.
+ * Every kernel is checked against the naive result while it is run, and
+ * at every size by Freivalds' O(N^2) check (matmul_verify), whose cost is
+ * reported as a fraction of the packed kernel's time (both best of the same
+ * repeats), along with the size from which that fraction stays below
+ * VERIFY_CHEAP. The exit status is 1 when any check fails.
+ * With TP2_RESULTS set, each GFLOP/s figure is also appended there
+ * (common/results.h) for `analysis.py check`.
+ *
+ * Usage: ./exercise4_bench [--sizes 64,128,...] [--naive-max N]
+ *                          [--mc X] [--kc X] [--nc X] [--nr X]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "timing.h"
+#include "results.h"
+#include "matmul.h"
+
+// Configuration
+#define MAX_SIZES      32
+#define MIN_REPEATS    3      // Timed runs per kernel at least ...
+#define MIN_TIME_NS    5e8    // ... and until this much time was spent
+#define NAIVE_MAX      2048   // The i-j-k kernel takes minutes beyond this
+#define VERIFY_CHEAP   0.10   // Freivalds is "cheap" below this fraction of a product
+
+static const int default_sizes[] = {64, 128, 256, 512, 1024, 2048, 4096, 8192};
+
+typedef enum { KERNEL_NAIVE, KERNEL_IKJ, KERNEL_BLOCKED, KERNEL_PACKED, NUM_KERNELS } kernel_id_t;
+
+static const char *kernel_names[NUM_KERNELS] = {"naive", "ikj", "blocked", "packed"};
+
+// Same initialization as init_matrix() in exercise4.c
+static void init_matrices(int n, double *A, double *B) {
+    double *noise = malloc(n * sizeof(double));
+    noise[0] = 1.0;
+    for (int i = 1; i < n; i++) noise[i] = noise[i-1] * 1.0000001;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            A[(long)i * n + j] = noise[i] + i + j;
+            B[(long)i * n + j] = noise[j] + i - j;
+        }
+    }
+    free(noise);
+}
+
+static void run_kernel(kernel_id_t id, int n, const double *A, const double *B,
+                       double *C, const matmul_tiles_t *t) {
+    switch (id) {
+        case KERNEL_NAIVE:   matmul_naive(n, n, n, A, n, B, n, C, n); break;
+        case KERNEL_IKJ:     matmul_ikj(n, n, n, A, n, B, n, C, n); break;
+        case KERNEL_BLOCKED: matmul_blocked(n, n, n, A, n, B, n, C, n, t); break;
+        case KERNEL_PACKED:  matmul_packed(n, n, n, A, n, B, n, C, n, t); break;
+        default: break;
+    }
+}
+
+// Best-of-repeats wall time in ns
+static double time_kernel(kernel_id_t id, int n, const double *A, const double *B,
+                          double *C, const matmul_tiles_t *t) {
+    double best = 1e30, spent = 0.0;
+    for (int r = 0; r < MIN_REPEATS || spent < MIN_TIME_NS; r++) {
+        double start = get_time_ns();
+        run_kernel(id, n, A, B, C, t);
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// Best-of-repeats wall time of one Freivalds check of C, in ns, timed as
+// the kernels are so the two compare like for like
+static double time_verify(int n, const double *A, const double *B, const double *C) {
+    double best = 1e30, spent = 0.0;
+    for (int r = 0; r < MIN_REPEATS || spent < MIN_TIME_NS; r++) {
+        matmul_verify_t check;
+        double start = get_time_ns();
+        matmul_verify(n, n, n, A, n, 1, B, n, 1, C, n, MATMUL_VERIFY_VECTORS, (unsigned)n, NULL, &check);
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+static double max_abs(long count, const double *X) {
+    double m = 0.0;
+    for (long i = 0; i < count; i++)
+        if (fabs(X[i]) > m) m = fabs(X[i]);
+    return m;
+}
+
+// max |C - Ref| / (n * max|A| * max|B|): the classical bound for either
+// product is |C - C_exact| <= gamma_n |A||B| with gamma_n ~ n * eps, so a
+// correct kernel stays below 2 * n * eps on this scale.
+static double rel_error(int n, const double *C, const double *Ref, double scale) {
+    const long count = (long)n * n;
+    double err = 0.0;
+    for (long i = 0; i < count; i++) {
+        double d = fabs(C[i] - Ref[i]);
+        if (d > err) err = d;
+    }
+    return err / (n * scale);
+}
+
+static int parse_sizes(const char *s, int *sizes) {
+    int count = 0;
+    while (*s && count < MAX_SIZES) {
+        sizes[count++] = (int)strtol(s, (char **)&s, 10);
+        if (*s == ',') s++;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    int sizes[MAX_SIZES];
+    int num_sizes = (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    memcpy(sizes, default_sizes, sizeof(default_sizes));
+    int naive_max = NAIVE_MAX;
+
+    matmul_tiles_t tiles;
+    matmul_cache_tiles(&tiles);
+    const int tuned = matmul_load_tuned_tiles(&tiles);
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--sizes") == 0)          num_sizes = parse_sizes(val, sizes);
+        else if (strcmp(opt, "--naive-max") == 0) naive_max = atoi(val);
+        else if (strcmp(opt, "--mc") == 0)        tiles.mc = atoi(val);
+        else if (strcmp(opt, "--kc") == 0)        tiles.kc = atoi(val);
+        else if (strcmp(opt, "--nc") == 0)        tiles.nc = atoi(val);
+        else if (strcmp(opt, "--nr") == 0)        tiles.nr = atoi(val);
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (tiles.mc <= 0 || tiles.kc <= 0 || tiles.nc <= 0 || tiles.nr <= 0) {
+        fprintf(stderr, "Tile sizes must be positive\n");
+        return 1;
+    }
+
+    init_timing();
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Matrix Multiplication Kernels\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Tiles:               mc=%d kc=%d nc=%d nr=%d (%s)\n",
+           tiles.mc, tiles.kc, tiles.nc, tiles.nr,
+           tuned ? "tuned for this host" : "from cache sizes, run exercise4_tune");
+    int mr, nr;
+    const char *isa = matmul_packed_isa(&mr, &nr);
+    const double peak = matmul_peak_gflops();
+    printf("  Micro-kernel:        %s (%d x %d)\n", isa, mr, nr);
+    printf("  Single-core peak:    %.2f GFLOP/s (measured FMA throughput)\n", peak);
+    printf("  Naive kernel up to:  N=%d\n", naive_max);
+    printf("  Timing:              best of >= %d runs / %.1f s\n\n",
+           MIN_REPEATS, MIN_TIME_NS / 1e9);
+
+    printf("%6s %12s %12s %12s %12s %8s %10s %11s %6s %9s\n",
+           "N", "naive GF/s", "ikj GF/s", "blocked GF/s", "packed GF/s",
+           "% peak", "Speedup", "Rel. error", "Check", "Freivalds");
+    printf("--------------------------------------------------------------------------------------------------------\n");
+
+    int failed = 0;
+    double verify_frac[MAX_SIZES];
+    for (int s = 0; s < num_sizes; s++) {
+        const int n = sizes[s];
+        const long count = (long)n * n;
+        double *A = aligned_alloc(64, count * sizeof(double));
+        double *B = aligned_alloc(64, count * sizeof(double));
+        double *C = aligned_alloc(64, count * sizeof(double));
+        double *Ref = aligned_alloc(64, count * sizeof(double));
+        if (!A || !B || !C || !Ref) {
+            fprintf(stderr, "Failed to allocate memory for N=%d\n", n);
+            return 1;
+        }
+        init_matrices(n, A, B);
+
+        const double flops = 2.0 * n * n * (double)n;
+        const double scale = max_abs(count, A) * max_abs(count, B);
+        const int have_ref = (n <= naive_max);
+        double gflops[NUM_KERNELS] = {0};
+        double err = 0.0, verify_ns = 0.0;
+        int verified = 1;
+
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            if (k == KERNEL_NAIVE && !have_ref) continue;
+            double t = time_kernel((kernel_id_t)k, n, A, B, C, &tiles);
+            gflops[k] = flops / t;
+            matmul_verify_t check;
+            const int ok = matmul_verify(n, n, n, A, n, 1, B, n, 1, C, n, MATMUL_VERIFY_VECTORS,
+                                         (unsigned)n, NULL, &check);
+            if (k == KERNEL_PACKED) verify_ns = time_verify(n, A, B, C);
+            if (ok == 0) {
+                fprintf(stderr, "N=%d %s: ", n, kernel_names[k]);
+                matmul_verify_print(stderr, &check);
+            }
+            verified = verified && ok == 1;
+            if (k == KERNEL_NAIVE) {
+                memcpy(Ref, C, count * sizeof(double));
+            } else if (have_ref) {
+                double e = rel_error(n, C, Ref, scale);
+                if (e > err) err = e;
+            }
+        }
+
+        char param[32];
+        snprintf(param, sizeof(param), "N=%d", n);
+        for (int k = 0; k < NUM_KERNELS; k++)
+            if (gflops[k] > 0.0) results_record("exercise4_bench", kernel_names[k], param, "gflops", gflops[k], "GFLOP/s");
+        results_record("exercise4_bench", "freivalds", param, "time", verify_ns / 1e6, "ms");
+
+        printf("%6d ", n);
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            if (gflops[k] > 0.0) printf("%12.2f ", gflops[k]);
+            else                 printf("%12s ", "skipped");
+        }
+        printf("%7.1f%% ", 100.0 * gflops[KERNEL_PACKED] / peak);
+        const int close = !have_ref || err <= 2.0 * n * DBL_EPSILON;
+        if (!verified || !close) failed = 1;
+        if (have_ref)
+            printf("%9.2fx %11.2e %6s ", gflops[KERNEL_PACKED] / gflops[KERNEL_NAIVE], err,
+                   close ? "OK" : "FAIL");
+        else
+            printf("%10s %11s %6s ", "-", "-", "-");
+        verify_frac[s] = verify_ns / (flops / gflops[KERNEL_PACKED]);
+        printf("%4s %3.0f%%\n", verified ? "OK" : "FAIL", 100.0 * verify_frac[s]);
+        fflush(stdout);
+
+        free(A); free(B); free(C); free(Ref);
+    }
+    printf("--------------------------------------------------------------------------------------------------------\n");
+    printf("Speedup = packed / naive. Rel. error = max over kernels of\n");
+    printf("max|C - C_naive| / (N max|A| max|B|); Check passes below 2 N eps.\n");
+    printf("Freivalds checks every kernel's C against %d random vectors (the time is\n", MATMUL_VERIFY_VECTORS);
+    printf("that of one check relative to one packed product, both best of the same\n");
+    printf("repeats); failures go to stderr. Its O(N^2) cost only amortizes with N:\n");
+    // Smallest N from which every larger measured size stays under the mark
+    int cheap_from = 0;
+    for (int s = 0; s < num_sizes; s++) {
+        int cheap = verify_frac[s] < VERIFY_CHEAP;
+        for (int o = 0; cheap && o < num_sizes; o++)
+            if (sizes[o] > sizes[s] && verify_frac[o] >= VERIFY_CHEAP) cheap = 0;
+        if (cheap && (cheap_from == 0 || sizes[s] < cheap_from)) cheap_from = sizes[s];
+    }
+    if (cheap_from > 0)
+        printf("it costs under %.0f%% of a product from N=%d on this host.\n", 100.0 * VERIFY_CHEAP, cheap_from);
+    else
+        printf("it never fell under %.0f%% of a product at the sizes measured.\n", 100.0 * VERIFY_CHEAP);
+    if (failed) fprintf(stderr, "Result check FAILED\n");
+
+    return failed;
+}
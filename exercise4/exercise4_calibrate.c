@@ -0,0 +1,356 @@
+/*
+ * Exercise 4: Overhead Calibration for the Speedup Simulator
+ *
+ * amdahl(p, fs) and gustafson(p, fs) in analysis.py treat a fork, a
+ * barrier and a byte of DRAM traffic as free, which is how exercise4's
+ * 0.00027% sequential fraction turns into a 369,004x speedup. The
+ * discrete-event simulator (`python3 analysis.py simulate`) replays the
+ * real task graphs of exercise3 and matmul_parallel() with those costs
+ * put back; this measures them on the host, SAMPLES times each so the
+ * simulator can carry their spread into error bars:
+ *   forkjoin   ns of one threadpool_run() of P empty tasks (dispatch, the
+ *              join and the wake-up of every worker: the barrier cost)
+ *   task       ns per additional empty task of a batch (deque traffic)
+ *   bandwidth  GB/s of c = a + b over the pool at P threads; the largest
+ *              is the shared memory-bandwidth ceiling
+ *   imbalance  coefficient of variation of equal-sized chunk durations
+ *   ex3.*      single-thread ns per element of the four exercise3 phases
+ *   gemm.core  single-thread GFLOP/s of the packed kernel
+ * and, for validation, the measured wall time of the exercise3 pipeline
+ * (add_noise serial, the other phases on the pool) and of
+ * matmul_parallel() at every thread count.
+ *
+ * Results are written as CSV (quantity,threads,mean,std,unit) for
+ * `analysis.py simulate`.
+ *
+ * Usage: ./exercise4_calibrate [--threads P] [--vector N] [--n N]
+ *                              [--placement none|compact|scatter|one-per-core|one-per-l3]
+ *                              [--csv FILE]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "timing.h"
+#include "threadpool.h"
+#include "topology.h"
+#include "matmul.h"
+
+// Configuration
+#define DEFAULT_VECTOR    (1L << 24)  // exercise3 elements (128 MB per array)
+#define DEFAULT_N         1024
+#define SAMPLES           7
+#define FORKJOIN_ITERS    2000
+#define TASKS_PER_BATCH   64          // Empty tasks per worker for the per-task cost
+#define CHUNKS_PER_THREAD 4           // As exercise3_numa and exercise4_placement
+#define MAX_CHUNKS        4096
+#define B_VALUE           2.0
+#define NOISE             1.0000001
+
+typedef struct {
+    double *a, *b, *c;
+    long n;
+    int chunks;
+    double partial[MAX_CHUNKS];
+    double start[MAX_CHUNKS], end[MAX_CHUNKS];
+    double t0;
+} vectors_t;
+
+static FILE *csv;
+
+static void record(const char *quantity, int threads, const double *samples, int count,
+                   const char *unit) {
+    double mean = 0.0, var = 0.0;
+    for (int i = 0; i < count; i++) mean += samples[i];
+    mean /= count;
+    for (int i = 0; i < count; i++) var += (samples[i] - mean) * (samples[i] - mean);
+    const double sd = count > 1 ? sqrt(var / (count - 1)) : 0.0;
+    fprintf(csv, "%s,%d,%.6g,%.6g,%s\n", quantity, threads, mean, sd, unit);
+    printf("  %-22s P=%-4d %14.4g %s  (+/- %.2g)\n", quantity, threads, mean, unit, sd);
+}
+
+static void record_value(const char *quantity, double value, const char *unit) {
+    record(quantity, 0, &value, 1, unit);
+}
+
+static double *alloc_doubles(long count) {
+    return aligned_alloc(64, (sizeof(double) * count + 63) / 64 * 64);
+}
+
+// ============================================================================
+// Pool tasks
+// ============================================================================
+
+static void empty_task(void *arg, int task, int worker) {
+    (void)arg; (void)task; (void)worker;
+    __asm__ volatile("" ::: "memory");
+}
+
+static void chunk_range(const vectors_t *v, int chunk, long *begin, long *end) {
+    *begin = v->n * chunk / v->chunks;
+    *end = v->n * (chunk + 1) / v->chunks;
+}
+
+static void init_b_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    for (long i = begin; i < end; i++) v->b[i] = B_VALUE;
+}
+
+static void add_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    v->start[chunk] = get_time_ns() - v->t0;
+    double *restrict c = v->c;
+    const double *restrict a = v->a, *restrict b = v->b;
+    for (long i = begin; i < end; i++) c[i] = a[i] + b[i];
+    v->end[chunk] = get_time_ns() - v->t0;
+}
+
+static void reduce_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    double sum = 0.0;
+    for (long i = begin; i < end; i++) sum += v->c[i];
+    v->partial[chunk] = sum;
+}
+
+// exercise3.c's add_noise(), the serial phase of the pipeline
+static void add_noise(double *a, long n) {
+    a[0] = 1.0;
+    for (long i = 1; i < n; i++) a[i] = a[i - 1] * NOISE;
+}
+
+static double sink;
+
+// ============================================================================
+// Measurements
+// ============================================================================
+
+static void measure_pool(threadpool_t *pool, int p) {
+    double fj[SAMPLES], task[SAMPLES];
+    threadpool_run(pool, p, empty_task, NULL);
+    for (int s = 0; s < SAMPLES; s++) {
+        double start = get_time_ns();
+        for (int it = 0; it < FORKJOIN_ITERS; it++) threadpool_run(pool, p, empty_task, NULL);
+        fj[s] = (get_time_ns() - start) / FORKJOIN_ITERS;
+
+        const int tasks = p * TASKS_PER_BATCH;
+        start = get_time_ns();
+        for (int it = 0; it < FORKJOIN_ITERS / 10; it++) threadpool_run(pool, tasks, empty_task, NULL);
+        const double batch = (get_time_ns() - start) / (FORKJOIN_ITERS / 10);
+        task[s] = fmax(0.0, (batch - fj[s]) / (tasks - p) * p);
+    }
+    record("forkjoin", p, fj, SAMPLES, "ns");
+    record("task", p, task, SAMPLES, "ns");
+}
+
+// Stream bandwidth and chunk imbalance at p threads
+static void measure_stream(threadpool_t *pool, int p, vectors_t *v) {
+    double gbs[SAMPLES], cv[SAMPLES];
+    v->chunks = p * CHUNKS_PER_THREAD;
+    if (v->chunks > MAX_CHUNKS) v->chunks = MAX_CHUNKS;
+    threadpool_run(pool, v->chunks, add_task, v);
+    for (int s = 0; s < SAMPLES; s++) {
+        v->t0 = get_time_ns();
+        threadpool_run(pool, v->chunks, add_task, v);
+        gbs[s] = 24.0 * v->n / (get_time_ns() - v->t0);
+
+        double mean = 0.0, var = 0.0;
+        for (int c = 0; c < v->chunks; c++) mean += v->end[c] - v->start[c];
+        mean /= v->chunks;
+        for (int c = 0; c < v->chunks; c++) {
+            const double d = v->end[c] - v->start[c] - mean;
+            var += d * d;
+        }
+        cv[s] = v->chunks > 1 ? sqrt(var / (v->chunks - 1)) / mean : 0.0;
+    }
+    record("bandwidth", p, gbs, SAMPLES, "GB/s");
+    record("imbalance", p, cv, SAMPLES, "cv");
+}
+
+// Single-thread ns per element of each exercise3 phase
+static void measure_phases(vectors_t *v) {
+    double t[4][SAMPLES];
+    const long n = v->n;
+    for (int s = 0; s < SAMPLES; s++) {
+        double start = get_time_ns();
+        add_noise(v->a, n);
+        t[0][s] = (get_time_ns() - start) / n;
+
+        start = get_time_ns();
+        for (long i = 0; i < n; i++) v->b[i] = B_VALUE;
+        t[1][s] = (get_time_ns() - start) / n;
+
+        start = get_time_ns();
+        for (long i = 0; i < n; i++) v->c[i] = v->a[i] + v->b[i];
+        t[2][s] = (get_time_ns() - start) / n;
+
+        start = get_time_ns();
+        double sum = 0.0;
+        for (long i = 0; i < n; i++) sum += v->c[i];
+        t[3][s] = (get_time_ns() - start) / n;
+        sink += sum;
+    }
+    record("ex3.add_noise", 1, t[0], SAMPLES, "ns/elem");
+    record("ex3.init_b", 1, t[1], SAMPLES, "ns/elem");
+    record("ex3.compute_addition", 1, t[2], SAMPLES, "ns/elem");
+    record("ex3.reduction", 1, t[3], SAMPLES, "ns/elem");
+}
+
+// Wall time of the exercise3 pipeline and of matmul_parallel at p threads
+static void measure_runs(threadpool_t *pool, int p, vectors_t *v, int mn, const double *A,
+                         const double *B, double *C, const matmul_tiles_t *tiles) {
+    double ex3[SAMPLES], ex4[SAMPLES];
+    v->chunks = p * CHUNKS_PER_THREAD;
+    if (v->chunks > MAX_CHUNKS) v->chunks = MAX_CHUNKS;
+    matmul_parallel(mn, mn, mn, A, mn, 1, B, mn, 1, C, mn, tiles, pool);
+    for (int s = 0; s < SAMPLES; s++) {
+        double start = get_time_ns();
+        add_noise(v->a, v->n);
+        threadpool_run(pool, v->chunks, init_b_task, v);
+        threadpool_run(pool, v->chunks, add_task, v);
+        threadpool_run(pool, v->chunks, reduce_task, v);
+        double sum = 0.0;
+        for (int c = 0; c < v->chunks; c++) sum += v->partial[c];
+        ex3[s] = get_time_ns() - start;
+        sink += sum;
+
+        start = get_time_ns();
+        matmul_parallel(mn, mn, mn, A, mn, 1, B, mn, 1, C, mn, tiles, pool);
+        ex4[s] = get_time_ns() - start;
+    }
+    record("measured.ex3", p, ex3, SAMPLES, "ns");
+    record("measured.ex4", p, ex4, SAMPLES, "ns");
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = threadpool_cpu_count();
+    long n = DEFAULT_VECTOR;
+    int mn = DEFAULT_N;
+    topology_policy_t placement = TOPOLOGY_NONE;
+    const char *csv_path = "calibration.csv";
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--threads") == 0)     max_threads = atoi(val);
+        else if (strcmp(opt, "--vector") == 0) n = (long)strtod(val, NULL);
+        else if (strcmp(opt, "--n") == 0)      mn = atoi(val);
+        else if (strcmp(opt, "--csv") == 0)    csv_path = val;
+        else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &placement) != 0) {
+                fprintf(stderr, "Unknown placement policy '%s'\n", val);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (max_threads < 1 || n < MAX_CHUNKS || mn < 1) {
+        fprintf(stderr, "Thread count and N must be positive, the vector at least %d\n", MAX_CHUNKS);
+        return 1;
+    }
+    if (max_threads > topology_max_threads(placement)) max_threads = topology_max_threads(placement);
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    vectors_t *v = calloc(1, sizeof(vectors_t));
+    double *A = alloc_doubles((long)mn * mn), *B = alloc_doubles((long)mn * mn);
+    double *C = alloc_doubles((long)mn * mn);
+    if (!v || !A || !B || !C) {
+        fprintf(stderr, "Failed to allocate N=%d\n", mn);
+        return 1;
+    }
+    v->n = n;
+    v->a = alloc_doubles(n);
+    v->b = alloc_doubles(n);
+    v->c = alloc_doubles(n);
+    if (!v->a || !v->b || !v->c) {
+        fprintf(stderr, "Failed to allocate vectors of %ld elements\n", n);
+        return 1;
+    }
+    for (long e = 0; e < (long)mn * mn; e++) {
+        A[e] = (double)(e % 7) - 3.0;
+        B[e] = (double)(e % 5) * 0.5;
+    }
+    csv = fopen(csv_path, "w");
+    if (!csv) {
+        fprintf(stderr, "Cannot write %s\n", csv_path);
+        return 1;
+    }
+    fprintf(csv, "quantity,threads,mean,std,unit\n");
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Overhead Calibration for the Speedup Simulator\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Topology:            ");
+    topology_describe(stdout);
+    printf("\n");
+    printf("  Max threads:         %d (placement %s)\n", max_threads, topology_policy_name(placement));
+    printf("  exercise3 vectors:   %ld elements (%.0f MB per array)\n", n, n * 8.0 / 1048576.0);
+    printf("  exercise4 GEMM:      N=%d, mc=%d kc=%d nc=%d\n", mn, tiles.mc, tiles.kc, tiles.nc);
+    printf("  Samples:             %d per quantity\n\n", SAMPLES);
+
+    record_value("config.cpus", topology_num_cpus(), "cpus");
+    record_value("config.ex3_n", (double)n, "elements");
+    record_value("config.ex4_n", mn, "elements");
+    record_value("config.chunks_per_thread", CHUNKS_PER_THREAD, "chunks");
+    record_value("config.mc", tiles.mc, "elements");
+    record_value("config.kc", tiles.kc, "elements");
+    record_value("config.nc", tiles.nc, "elements");
+
+    // Serial costs
+    add_noise(v->a, n);
+    measure_phases(v);
+    double gemm[SAMPLES];
+    for (int s = 0; s < SAMPLES; s++) {
+        double start = get_time_ns();
+        matmul_packed(mn, mn, mn, A, mn, B, mn, C, mn, &tiles);
+        gemm[s] = 2.0 * mn * mn * (double)mn / (get_time_ns() - start);
+    }
+    record("gemm.core", 1, gemm, SAMPLES, "GFLOP/s");
+
+    // Pool overheads, bandwidth and the validation runs at 1, 2, 4, ... P
+    for (int p = 1, last = 0; !last; p *= 2) {
+        if (p >= max_threads) {
+            p = max_threads;
+            last = 1;
+        }
+        threadpool_t *pool = threadpool_create_placed(p, placement);
+        if (!pool) {
+            fprintf(stderr, "Failed to create a pool of %d threads\n", p);
+            return 1;
+        }
+        printf("\n");
+        measure_pool(pool, p);
+        measure_stream(pool, p, v);
+        measure_runs(pool, p, v, mn, A, B, C, &tiles);
+        threadpool_destroy(pool);
+        fflush(csv);
+    }
+
+    fclose(csv);
+    printf("\nCSV written to %s (checksum %.3e)\n", csv_path, sink);
+    printf("Simulate: python3 ../analysis.py simulate --calibration %s\n", csv_path);
+    free(v->a); free(v->b); free(v->c); free(v);
+    free(A); free(B); free(C);
+    return 0;
+}
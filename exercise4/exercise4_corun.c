@@ -0,0 +1,429 @@
+/*
+ * Exercise 4: Co-Scheduling Interference
+ *
+ * exercise4_placement measures each kernel alone on the machine. In
+ * production a memory-streaming job (the exercise3 stages) often shares a
+ * socket with a compute-bound one (the exercise4 GEMM): they compete for
+ * L3 capacity, memory bandwidth and, on SMT siblings, for the core itself.
+ * This splits P threads into m streaming threads and P - m GEMM threads on
+ * disjoint CPUs of one placement policy (streaming side first) and, for a
+ * sweep of splits, runs
+ *   - the streaming side alone on its CPUs, repeating compute_addition +
+ *     reduction over the vectors (GB/s of compulsory traffic)
+ *   - the GEMM side alone on its CPUs, repeating matmul_parallel() (GFLOP/s)
+ *   - both at once for the same time window
+ * Each side runs in its own thread with its own pinned pool. Iterations
+ * still running when the window closes are discarded, so every reported
+ * iteration overlapped the other side. The report gives each side's
+ * throughput slowdown (solo / co-run) and the inflation of its p95
+ * iteration latency, and lists the splits where both stay within --slo.
+ * When the policy cannot place P threads (or with --placement none) both
+ * sides run unpinned and the scheduler shares the CPUs between them.
+ *
+ * Usage: ./exercise4_corun [--threads P] [--splits S] [--vector N] [--n N]
+ *                          [--seconds T] [--slo X] [--placement POLICY]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "timing.h"
+#include "results.h"
+#include "threadpool.h"
+#include "topology.h"
+#include "matmul.h"
+
+// Configuration
+#define DEFAULT_VECTOR    (1L << 24)  // exercise3 elements (128 MB per array)
+#define DEFAULT_N         1024
+#define DEFAULT_SPLITS    8           // Streaming shares 1/S, 2/S, ... of the threads
+#define DEFAULT_SECONDS   2.0         // Measurement window per run
+#define DEFAULT_SLO       1.25        // Tolerated slowdown of either side
+#define B_VALUE           2.0
+#define CHUNKS_PER_THREAD 4
+#define MAX_CHUNKS        4096
+#define MAX_SAMPLES       4096        // Iteration latencies kept per side
+#define MAX_POINTS        64
+
+typedef enum { SIDE_STREAM, SIDE_GEMM, NUM_SIDES } side_id_t;
+
+static const struct {
+    const char *name, *unit, *metric;
+} side_info[NUM_SIDES] = {
+    {"stream (add+reduce)", "GB/s",    "bandwidth"},
+    {"matmul parallel",     "GFLOP/s", "gflops"},
+};
+
+typedef struct {
+    double throughput;    // GB/s or GFLOP/s over the completed iterations
+    double p95;           // ns per iteration
+    long iterations;
+} side_result_t;
+
+typedef struct {
+    int stream_threads, gemm_threads;
+    side_result_t solo[NUM_SIDES], corun[NUM_SIDES];
+} corun_point_t;
+
+// Shared by the side threads of one run
+typedef struct {
+    pthread_barrier_t start;
+    int stop;
+} window_t;
+
+typedef struct {
+    side_id_t id;
+    int threads;
+    const int *cpus;              // NULL: unpinned pool
+    window_t *window;
+    // Streaming side
+    long n;
+    int chunks;
+    double *a, *b, *c;
+    double partial[MAX_CHUNKS];
+    // GEMM side
+    int mn;
+    const double *A, *B;
+    double *C;
+    const matmul_tiles_t *tiles;
+    // Results
+    double lat[MAX_SAMPLES];
+    int failed;
+    side_result_t result;
+} side_t;
+
+static double *alloc_doubles(long count) {
+    return aligned_alloc(64, (sizeof(double) * count + 63) / 64 * 64);
+}
+
+// ============================================================================
+// exercise3 stages, one task per chunk
+// ============================================================================
+
+static void chunk_range(const side_t *s, int chunk, long *begin, long *end) {
+    *begin = s->n * chunk / s->chunks;
+    *end = s->n * (chunk + 1) / s->chunks;
+}
+
+static void fill_task(void *arg, int chunk, int worker) {
+    side_t *s = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(s, chunk, &begin, &end);
+    for (long i = begin; i < end; i++) {
+        s->a[i] = 1.0 + i * 1e-9;
+        s->b[i] = B_VALUE;
+        s->c[i] = 0.0;
+    }
+}
+
+static void add_task(void *arg, int chunk, int worker) {
+    side_t *s = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(s, chunk, &begin, &end);
+    double *restrict c = s->c;
+    const double *restrict a = s->a, *restrict b = s->b;
+    for (long i = begin; i < end; i++) c[i] = a[i] + b[i];
+}
+
+static void reduce_task(void *arg, int chunk, int worker) {
+    side_t *s = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(s, chunk, &begin, &end);
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    long i = begin;
+    for (; i + 4 <= end; i += 4) {
+        s0 += s->c[i]; s1 += s->c[i + 1]; s2 += s->c[i + 2]; s3 += s->c[i + 3];
+    }
+    for (; i < end; i++) s0 += s->c[i];
+    s->partial[chunk] = (s0 + s1) + (s2 + s3);
+}
+
+// ============================================================================
+// One side: its own pool, iterations until the window closes
+// ============================================================================
+
+static void iterate(side_t *s, threadpool_t *pool) {
+    if (s->id == SIDE_STREAM) {
+        threadpool_run(pool, s->chunks, add_task, s);
+        threadpool_run(pool, s->chunks, reduce_task, s);
+    } else {
+        matmul_parallel(s->mn, s->mn, s->mn, s->A, s->mn, 1, s->B, s->mn, 1, s->C, s->mn, s->tiles,
+                        pool);
+    }
+}
+
+static int compare_double(const void *x, const void *y) {
+    const double a = *(const double *)x, b = *(const double *)y;
+    return (a > b) - (a < b);
+}
+
+static void *side_main(void *arg) {
+    side_t *s = arg;
+    threadpool_t *pool = s->cpus ? threadpool_create_pinned(s->threads, s->cpus)
+                                 : threadpool_create(s->threads);
+    if (!pool) s->failed = 1;
+    else if (s->id == SIDE_STREAM) {
+        // First touch by the side's own workers, then one warm-up pass
+        s->chunks = s->threads * CHUNKS_PER_THREAD;
+        if (s->chunks > MAX_CHUNKS) s->chunks = MAX_CHUNKS;
+        s->a = alloc_doubles(s->n);
+        s->b = alloc_doubles(s->n);
+        s->c = alloc_doubles(s->n);
+        if (!s->a || !s->b || !s->c) s->failed = 1;
+        else threadpool_run(pool, s->chunks, fill_task, s);
+    }
+    if (!s->failed) iterate(s, pool);
+
+    pthread_barrier_wait(&s->window->start);
+    double busy = 0.0;
+    long done = 0;
+    while (!s->failed && !__atomic_load_n(&s->window->stop, __ATOMIC_ACQUIRE)) {
+        const double t0 = get_time_ns();
+        iterate(s, pool);
+        const double elapsed = get_time_ns() - t0;
+        if (__atomic_load_n(&s->window->stop, __ATOMIC_ACQUIRE)) break;   // Ran past the window
+        if (done < MAX_SAMPLES) s->lat[done] = elapsed;
+        busy += elapsed;
+        done++;
+    }
+
+    memset(&s->result, 0, sizeof(s->result));
+    s->result.iterations = done;
+    if (done > 0) {
+        const double work = (s->id == SIDE_STREAM) ? 32.0 * s->n : 2.0 * s->mn * s->mn * (double)s->mn;
+        const int samples = done < MAX_SAMPLES ? (int)done : MAX_SAMPLES;
+        qsort(s->lat, samples, sizeof(double), compare_double);
+        s->result.throughput = work * done / busy;
+        s->result.p95 = s->lat[(int)(0.95 * (samples - 1) + 0.5)];
+    }
+    free(s->a); free(s->b); free(s->c);
+    s->a = s->b = s->c = NULL;
+    threadpool_destroy(pool);
+    return NULL;
+}
+
+// Run the given sides together for `seconds`; 0 on success
+static int run_window(side_t **sides, int count, double seconds) {
+    window_t window;
+    pthread_t threads[NUM_SIDES];
+    window.stop = 0;
+    if (pthread_barrier_init(&window.start, NULL, count + 1) != 0) return -1;
+    for (int i = 0; i < count; i++) {
+        sides[i]->window = &window;
+        sides[i]->failed = 0;
+        if (pthread_create(&threads[i], NULL, side_main, sides[i]) != 0) {
+            fprintf(stderr, "Cannot start a side thread\n");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&window.start);
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+    __atomic_store_n(&window.stop, 1, __ATOMIC_RELEASE);
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+        if (sides[i]->failed || sides[i]->result.iterations == 0) failed = 1;
+    }
+    pthread_barrier_destroy(&window.start);
+    return failed ? -1 : 0;
+}
+
+static double slowdown(const side_result_t *solo, const side_result_t *corun) {
+    return solo->throughput / corun->throughput;
+}
+
+static double inflation(const side_result_t *solo, const side_result_t *corun) {
+    return corun->p95 / solo->p95;
+}
+
+int main(int argc, char *argv[]) {
+    int threads = threadpool_cpu_count();
+    int splits = DEFAULT_SPLITS;
+    long n = DEFAULT_VECTOR;
+    int mn = DEFAULT_N;
+    double seconds = DEFAULT_SECONDS, slo = DEFAULT_SLO;
+    topology_policy_t policy = TOPOLOGY_COMPACT;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--threads") == 0)      threads = atoi(val);
+        else if (strcmp(opt, "--splits") == 0)  splits = atoi(val);
+        else if (strcmp(opt, "--vector") == 0)  n = (long)strtod(val, NULL);
+        else if (strcmp(opt, "--n") == 0)       mn = atoi(val);
+        else if (strcmp(opt, "--seconds") == 0) seconds = atof(val);
+        else if (strcmp(opt, "--slo") == 0)     slo = atof(val);
+        else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &policy) != 0) {
+                fprintf(stderr, "Unknown placement %s\n", val);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    // Two sides need two threads even on a single CPU (they then time-share)
+    if (threads < 2) threads = 2;
+    if (threads > TOPOLOGY_MAX_CPUS) threads = TOPOLOGY_MAX_CPUS;
+    if (splits < 2 || n < 1024 || mn < 1 || seconds <= 0.0 || slo < 1.0) {
+        fprintf(stderr, "Splits must be at least 2, sizes and the window positive, the SLO >= 1\n");
+        return 1;
+    }
+
+    // Streaming threads take the first CPUs of the placement, GEMM the rest
+    int cpus[TOPOLOGY_MAX_CPUS];
+    int pinned = policy != TOPOLOGY_NONE && topology_place(policy, threads, cpus) == threads;
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    double *A = alloc_doubles((long)mn * mn);
+    double *B = alloc_doubles((long)mn * mn);
+    double *C = alloc_doubles((long)mn * mn);
+    if (!A || !B || !C) {
+        fprintf(stderr, "Failed to allocate N=%d\n", mn);
+        return 1;
+    }
+    for (long e = 0; e < (long)mn * mn; e++) {
+        A[e] = (double)(e % 7) - 3.0;
+        B[e] = (double)(e % 5) * 0.5;
+    }
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Co-Scheduling Interference\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Topology:            ");
+    topology_describe(stdout);
+    printf("\n");
+    printf("  Threads:             %d, %s\n", threads,
+           pinned ? topology_policy_name(policy) : "unpinned (the scheduler shares the CPUs)");
+    printf("  Streaming side:      compute_addition + reduction, %ld elements (%.0f MB per array)\n",
+           n, n * 8.0 / 1048576.0);
+    printf("  GEMM side:           matmul_parallel N=%d, %s\n", mn, matmul_packed_isa(NULL, NULL));
+    printf("  Window:              %.1f s per run, SLO: slowdown <= %.2fx\n\n", seconds, slo);
+
+    // Streaming thread counts: round(P * i / S), deduplicated, both sides non-empty
+    corun_point_t points[MAX_POINTS];
+    int count = 0;
+    for (int i = 1; i < splits && count < MAX_POINTS; i++) {
+        int m = (int)((long)threads * i / splits);
+        if (m < 1) m = 1;
+        if (m > threads - 1) m = threads - 1;
+        if (count > 0 && points[count - 1].stream_threads == m) continue;
+        points[count].stream_threads = m;
+        points[count].gemm_threads = threads - m;
+        count++;
+    }
+
+    static side_t stream_side, gemm_side;
+    stream_side.id = SIDE_STREAM;
+    stream_side.n = n;
+    gemm_side.id = SIDE_GEMM;
+    gemm_side.mn = mn;
+    gemm_side.A = A;
+    gemm_side.B = B;
+    gemm_side.C = C;
+    gemm_side.tiles = &tiles;
+
+    printf("%-11s %11s %11s %11s %11s %9s %9s %9s %9s\n", "Split", "Stream solo", "Stream co",
+           "GEMM solo", "GEMM co", "Stream", "GEMM", "Str. p95", "GEMM p95");
+    printf("%-11s %11s %11s %11s %11s %9s %9s %9s %9s\n", "(str:gemm)", "GB/s", "GB/s", "GFLOP/s",
+           "GFLOP/s", "slowdown", "slowdown", "x solo", "x solo");
+    printf("-----------------------------------------------------------------------------------------------------\n");
+    int measured = 0;
+    for (int i = 0; i < count; i++) {
+        corun_point_t *pt = &points[i];
+        stream_side.threads = pt->stream_threads;
+        stream_side.cpus = pinned ? cpus : NULL;
+        gemm_side.threads = pt->gemm_threads;
+        gemm_side.cpus = pinned ? cpus + pt->stream_threads : NULL;
+
+        side_t *stream_only[] = {&stream_side}, *gemm_only[] = {&gemm_side};
+        side_t *both[] = {&stream_side, &gemm_side};
+        int failed = run_window(stream_only, 1, seconds) != 0;
+        pt->solo[SIDE_STREAM] = stream_side.result;
+        failed |= run_window(gemm_only, 1, seconds) != 0;
+        pt->solo[SIDE_GEMM] = gemm_side.result;
+        failed |= run_window(both, 2, seconds) != 0;
+        pt->corun[SIDE_STREAM] = stream_side.result;
+        pt->corun[SIDE_GEMM] = gemm_side.result;
+
+        char split[16];
+        snprintf(split, sizeof(split), "%d:%d", pt->stream_threads, pt->gemm_threads);
+        if (failed) {
+            printf("%-11s   FAILED (allocation, or no iteration completed: raise --seconds)\n", split);
+            pt->stream_threads = 0;
+            continue;
+        }
+        measured++;
+        printf("%-11s %11.2f %11.2f %11.2f %11.2f %8.2fx %8.2fx %8.2fx %8.2fx\n", split,
+               pt->solo[SIDE_STREAM].throughput, pt->corun[SIDE_STREAM].throughput,
+               pt->solo[SIDE_GEMM].throughput, pt->corun[SIDE_GEMM].throughput,
+               slowdown(&pt->solo[SIDE_STREAM], &pt->corun[SIDE_STREAM]),
+               slowdown(&pt->solo[SIDE_GEMM], &pt->corun[SIDE_GEMM]),
+               inflation(&pt->solo[SIDE_STREAM], &pt->corun[SIDE_STREAM]),
+               inflation(&pt->solo[SIDE_GEMM], &pt->corun[SIDE_GEMM]));
+        fflush(stdout);
+
+        for (int s = 0; s < NUM_SIDES; s++) {
+            char param[64];
+            snprintf(param, sizeof(param), "split=%s %s", split,
+                     pinned ? topology_policy_name(policy) : "none");
+            results_record("exercise4_corun", side_info[s].name, param, "slowdown",
+                           slowdown(&pt->solo[s], &pt->corun[s]), "x");
+            results_record("exercise4_corun", side_info[s].name, param, side_info[s].metric,
+                           pt->corun[s].throughput, side_info[s].unit);
+        }
+    }
+    printf("-----------------------------------------------------------------------------------------------------\n\n");
+    if (measured == 0) {
+        fprintf(stderr, "No split could be measured\n");
+        return 1;
+    }
+
+    // Packing guidance: splits where neither side is slowed beyond the SLO
+    printf("Splits within the SLO (both sides <= %.2fx slower than solo):\n", slo);
+    const corun_point_t *best = NULL;
+    double best_worst = 0.0;
+    int within = 0;
+    for (int i = 0; i < count; i++) {
+        const corun_point_t *pt = &points[i];
+        if (pt->stream_threads == 0) continue;
+        double worst = 0.0;
+        for (int s = 0; s < NUM_SIDES; s++) {
+            const double d = slowdown(&pt->solo[s], &pt->corun[s]);
+            if (d > worst) worst = d;
+        }
+        if (!best || worst < best_worst) {
+            best = pt;
+            best_worst = worst;
+        }
+        if (worst <= slo) {
+            printf("  %d:%d (worst slowdown %.2fx)\n", pt->stream_threads, pt->gemm_threads, worst);
+            within++;
+        }
+    }
+    if (within == 0) printf("  none\n");
+    printf("Least interference: %d:%d, worst side %.2fx slower than solo\n", best->stream_threads,
+           best->gemm_threads, best_worst);
+
+    free(A); free(B); free(C);
+    return 0;
+}
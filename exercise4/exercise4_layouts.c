@@ -0,0 +1,219 @@
+/*
+ * Exercise 4: Storage Layout Benchmark
+ *
+ * Runs the GEMM engine directly on row-major, column-major, block-major
+ * (tiled) and Morton (Z-order tiled) operands. Inputs start row-major, as
+ * in exercise4.c, so every layout pays a conversion of A and B on the way
+ * in and of C on the way out; both are timed and folded into an
+ * end-to-end rate next to the kernel-only GFLOP/s. L1D and last-level
+ * cache misses per 1000 flops come from hardware counters when the host
+ * exposes them (single-threaded kernels only).
+ *
+ * Usage: ./exercise4_layouts [--n N] [--naive-n N] [--tile T] [--threads P]
+ *                            [--placement none|compact|scatter|one-per-core|one-per-l3]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "timing.h"
+#include "perfcount.h"
+#include "threadpool.h"
+#include "matmul.h"
+
+// Configuration
+#define DEFAULT_N       2048
+#define DEFAULT_NAIVE_N 512     // The i-j-k kernel is timed on a smaller problem
+#define MIN_REPEATS     2
+#define MIN_TIME_NS     3e8
+
+typedef struct {
+    matmul_algo_t algo;
+    int use_naive_n;
+} kernel_t;
+
+static const kernel_t kernels[] = {
+    {MATMUL_NAIVE, 1},
+    {MATMUL_PACKED, 0},
+    {MATMUL_PARALLEL, 0},
+};
+
+#define NUM_KERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+typedef struct {
+    double conv_in, gemm, conv_out;   // Seconds
+    long long misses[PERF_NUM_EVENTS];
+    double err;
+} layout_result_t;
+
+// max |C - Ref| / (n * max|A| * max|B|), all row-major
+static double rel_error(const matrix_t *C, const matrix_t *Ref, const matrix_t *A,
+                        const matrix_t *B) {
+    double ma = 0.0, mb = 0.0, d = 0.0;
+    const long count = (long)C->rows * C->cols;
+    for (long i = 0; i < (long)A->rows * A->cols; i++) ma = fmax(ma, fabs(A->data[i]));
+    for (long i = 0; i < (long)B->rows * B->cols; i++) mb = fmax(mb, fabs(B->data[i]));
+    for (long i = 0; i < count; i++) d = fmax(d, fabs(C->data[i] - Ref->data[i]));
+    return d / (A->cols * ma * mb);
+}
+
+static int run_layout(const kernel_t *kn, matrix_layout_t layout, int tile,
+                      const matrix_t *A, const matrix_t *B, const matrix_t *Ref,
+                      const matmul_tiles_t *t, threadpool_t *pool, perf_counters_t *pc,
+                      int have_perf, layout_result_t *res) {
+    const int n = A->rows;
+    const int ld = (layout == MATRIX_TILED || layout == MATRIX_MORTON) ? tile : 0;
+    matrix_t Al, Bl, Cl, Cr;
+    int rc = -1;
+    memset(&Al, 0, sizeof(Al)); Bl = Cl = Cr = Al;
+
+    if (matrix_alloc(&Al, n, n, layout, ld) || matrix_alloc(&Bl, n, n, layout, ld) ||
+        matrix_alloc(&Cl, n, n, layout, ld) || matrix_alloc(&Cr, n, n, MATRIX_ROW_MAJOR, 0))
+        goto out;
+    // Fault the pages in first: tiled storage is zeroed at allocation
+    matrix_fill_zero(&Al); matrix_fill_zero(&Bl); matrix_fill_zero(&Cl); matrix_fill_zero(&Cr);
+
+    double start = get_time_ns();
+    matrix_convert(&Al, A);
+    matrix_convert(&Bl, B);
+    res->conv_in = (get_time_ns() - start) / 1e9;
+
+    double best = 1e30, spent = 0.0;
+    for (int r = 0; r < MIN_REPEATS || spent < MIN_TIME_NS; r++) {
+        start = get_time_ns();
+        if (matmul_gemm(kn->algo, &Al, &Bl, &Cl, t, pool) != 0) goto out;
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    res->gemm = best / 1e9;
+
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) res->misses[e] = -1;
+    if (have_perf && kn->algo != MATMUL_PARALLEL) {
+        perf_start(pc);
+        matmul_gemm(kn->algo, &Al, &Bl, &Cl, t, pool);
+        perf_stop(pc, res->misses);
+    }
+
+    start = get_time_ns();
+    matrix_convert(&Cr, &Cl);
+    res->conv_out = (get_time_ns() - start) / 1e9;
+    res->err = rel_error(&Cr, Ref, A, B);
+    rc = 0;
+
+out:
+    matrix_free(&Al); matrix_free(&Bl); matrix_free(&Cl); matrix_free(&Cr);
+    return rc;
+}
+
+static void print_misses(long long count, double flops) {
+    if (count < 0) printf(" %9s", "n/a");
+    else           printf(" %9.2f", count / (flops / 1000.0));
+}
+
+int main(int argc, char *argv[]) {
+    int n_big = DEFAULT_N, n_naive = DEFAULT_NAIVE_N, tile = MATRIX_DEFAULT_TILE;
+    int threads = threadpool_cpu_count();
+    topology_policy_t placement = TOPOLOGY_NONE;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--n") == 0)            n_big = atoi(val);
+        else if (strcmp(opt, "--naive-n") == 0) n_naive = atoi(val);
+        else if (strcmp(opt, "--tile") == 0)    tile = atoi(val);
+        else if (strcmp(opt, "--threads") == 0) threads = atoi(val);
+        else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &placement) != 0) {
+                fprintf(stderr, "Unknown placement policy '%s'\n", val);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (n_big < 1 || n_naive < 1 || tile < 8 || tile % 8 != 0) {
+        fprintf(stderr, "Sizes must be positive and the tile a multiple of 8\n");
+        return 1;
+    }
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    perf_counters_t pc;
+    const int have_perf = perf_open(&pc) == 0;
+    threadpool_t *pool = threadpool_create_placed(threads, placement);
+    if (!pool) {
+        fprintf(stderr, "Placement %s cannot place %d threads\n", topology_policy_name(placement), threads);
+        return 1;
+    }
+
+    printf("=============================================================\n");
+    printf("Exercise 4: GEMM on Row / Column / Tiled / Morton Storage\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Threads (parallel):  %d\n", threadpool_size(pool));
+    printf("  Placement:           %s\n", topology_policy_name(placement));
+    printf("  Micro-kernel:        %s\n", matmul_packed_isa(NULL, NULL));
+    printf("  Storage tile:        %d x %d (tiled, morton)\n", tile, tile);
+    printf("  Cache counters:      %s\n\n", have_perf ? "perf_event (L1D read, LLC)" : "unavailable");
+
+    printf("%-9s %5s %-7s %9s %9s %9s %9s %9s %9s %9s %6s\n", "Kernel", "N", "Layout",
+           "Conv in", "GEMM", "GFLOP/s", "Conv out", "End2end", "L1D miss", "LLC miss", "Check");
+    printf("%-9s %5s %-7s %9s %9s %9s %9s %9s %9s %9s\n", "", "", "",
+           "(ms)", "(s)", "", "(ms)", "GFLOP/s", "/kflop", "/kflop");
+    printf("------------------------------------------------------------------------------------------------------\n");
+
+    for (int kk = 0; kk < NUM_KERNELS; kk++) {
+        const kernel_t *kn = &kernels[kk];
+        const int n = kn->use_naive_n ? n_naive : n_big;
+        const double flops = 2.0 * n * n * (double)n;
+
+        matrix_t A, B, Ref;
+        if (matrix_alloc(&A, n, n, MATRIX_ROW_MAJOR, 0) || matrix_alloc(&B, n, n, MATRIX_ROW_MAJOR, 0) ||
+            matrix_alloc(&Ref, n, n, MATRIX_ROW_MAJOR, 0)) {
+            fprintf(stderr, "Failed to allocate N=%d\n", n);
+            return 1;
+        }
+        matrix_fill_random(&A, 1u);
+        matrix_fill_random(&B, 2u);
+        matmul_gemm(MATMUL_PACKED, &A, &B, &Ref, &tiles, pool);
+
+        for (int l = 0; l < MATRIX_NUM_LAYOUTS; l++) {
+            layout_result_t res;
+            printf("%-9s %5d %-7s", matmul_algo_name(kn->algo), n,
+                   matrix_layout_name((matrix_layout_t)l));
+            if (run_layout(kn, (matrix_layout_t)l, tile, &A, &B, &Ref, &tiles, pool, &pc,
+                           have_perf, &res) != 0) {
+                printf(" %9s\n", "failed");
+                continue;
+            }
+            printf(" %9.2f %9.3f %9.2f %9.2f %9.2f", res.conv_in * 1e3, res.gemm,
+                   flops / res.gemm / 1e9, res.conv_out * 1e3,
+                   flops / (res.conv_in + res.gemm + res.conv_out) / 1e9);
+            print_misses(res.misses[PERF_L1D_MISS], flops);
+            print_misses(res.misses[PERF_LLC_MISS], flops);
+            printf(" %6s\n", res.err <= 2.0 * n * DBL_EPSILON ? "OK" : "FAIL");
+            fflush(stdout);
+        }
+        matrix_free(&A); matrix_free(&B); matrix_free(&Ref);
+    }
+    printf("------------------------------------------------------------------------------------------------------\n");
+    printf("Conv in converts A and B from row-major, conv out converts C back.\n");
+    printf("End2end = 2*N^3 / (conv in + GEMM + conv out). Parallel runs are not counted.\n");
+
+    if (have_perf) perf_close(&pc);
+    threadpool_destroy(pool);
+    return 0;
+}
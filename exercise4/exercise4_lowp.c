@@ -0,0 +1,283 @@
+/*
+ * Exercise 4: Reduced-Precision GEMM Benchmark
+ *
+ * Square n x n products in float32, bf16 and int8 next to the double
+ * packed kernel, all single-threaded. Each row reports the micro-kernel
+ * that ran (avx512-bf16 / avx512-vnni when the CPU has them), the rate
+ * and the speedup over double, and two errors against double results:
+ *   arith   the low-precision GEMM vs a double GEMM of the same rounded
+ *           inputs, i.e. the cost of the narrower accumulation alone
+ *           (bound 2k * FLT_EPSILON; int32 accumulation must be exact)
+ *   total   vs the double GEMM of the original inputs, i.e. including
+ *           the input rounding (bf16: 2^-8 relative per input, int8:
+ *           symmetric per-tensor quantization with step max|x| / 127)
+ * Errors are max|C - Ref| / (k * max|A| * max|B|).
+ *
+ * Usage: ./exercise4_lowp [--sizes 256,512,...]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "timing.h"
+#include "matmul.h"
+
+// Configuration
+#define MAX_SIZES   16
+#define MIN_REPEATS 2
+#define MIN_TIME_NS 3e8
+
+static const int default_sizes[] = {256, 512, 1024, 2048};
+
+typedef enum {
+    PREC_F64,
+    PREC_F32,
+    PREC_BF16,
+    PREC_I8,
+    NUM_PRECS
+} prec_t;
+
+static const char *prec_names[NUM_PRECS] = {"double", "float32", "bf16", "int8"};
+
+typedef struct {
+    int n;
+    const double *A, *B;          // Original inputs
+    double *C;                    // Double result
+    float *Af, *Bf, *Cf;          // float32, and the float result of bf16
+    matmul_bf16_t *Ah, *Bh;
+    int8_t *Aq, *Bq;
+    int32_t *Cq;
+    const matmul_pack_buf_t *buf;        // Workspaces reused by every call
+    const matmul_lowp_buf_t *lowp_buf;
+} lowp_bench_t;
+
+static void *alloc_bytes(size_t bytes) {
+    return aligned_alloc(64, ((bytes + 63) / 64) * 64);
+}
+
+static int run_prec(prec_t p, lowp_bench_t *lb) {
+    const int n = lb->n;
+    switch (p) {
+        case PREC_F64:
+            // matmul_packed() without its per-call allocation, like the others
+            memset(lb->C, 0, sizeof(double) * n * n);
+            matmul_packed_acc(n, n, n, lb->A, n, 1, lb->B, n, 1, lb->C, n, lb->buf);
+            return 0;
+        case PREC_F32:  return matmul_f32(n, n, n, lb->Af, n, lb->Bf, n, lb->Cf, n, lb->lowp_buf);
+        case PREC_BF16: return matmul_bf16(n, n, n, lb->Ah, n, lb->Bh, n, lb->Cf, n, lb->lowp_buf);
+        case PREC_I8:   return matmul_i8(n, n, n, lb->Aq, n, lb->Bq, n, lb->Cq, n, lb->lowp_buf);
+        default:        return -1;
+    }
+}
+
+// Best time in seconds, or -1 if the kernel failed
+static double time_prec(prec_t p, lowp_bench_t *lb) {
+    double best = 1e30, spent = 0.0;
+    for (int r = 0; r < MIN_REPEATS || spent < MIN_TIME_NS; r++) {
+        double start = get_time_ns();
+        if (run_prec(p, lb) != 0) return -1.0;
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best / 1e9;
+}
+
+static double max_abs(const double *x, long count) {
+    double m = 0.0;
+    for (long i = 0; i < count; i++) m = fmax(m, fabs(x[i]));
+    return m;
+}
+
+static int parse_sizes(const char *s, int *sizes) {
+    int count = 0;
+    while (*s && count < MAX_SIZES) {
+        sizes[count++] = (int)strtol(s, (char **)&s, 10);
+        if (*s == ',') s++;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    int sizes[MAX_SIZES];
+    int num_sizes = (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    memcpy(sizes, default_sizes, sizeof(default_sizes));
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--sizes") == 0) num_sizes = parse_sizes(val, sizes);
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Reduced-Precision GEMM (float32 / bf16 / int8)\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Threads:             1\n");
+    printf("  double kernel:       %s\n", matmul_packed_isa(NULL, NULL));
+    printf("  float32 kernel:      %s\n", matmul_lowp_isa(MATMUL_LOWP_F32));
+    printf("  bf16 kernel:         %s\n", matmul_lowp_isa(MATMUL_LOWP_BF16));
+    printf("  int8 kernel:         %s\n\n", matmul_lowp_isa(MATMUL_LOWP_I8));
+
+    printf("%5s %-8s %-14s %9s %9s %9s %10s %6s %10s %6s\n", "N", "Type", "Kernel",
+           "Time (s)", "G(FL)OP/s", "Speedup", "Arith err", "Check", "Total err", "Check");
+    printf("-----------------------------------------------------------------------------------------------\n");
+
+    for (int s = 0; s < num_sizes; s++) {
+        const int n = sizes[s];
+        if (n < 1) continue;
+        const long nn = (long)n * n;
+        const double flops = 2.0 * n * n * (double)n;
+
+        double *A = alloc_bytes(sizeof(double) * nn), *B = alloc_bytes(sizeof(double) * nn);
+        double *C = alloc_bytes(sizeof(double) * nn), *Ref = alloc_bytes(sizeof(double) * nn);
+        double *Ar = alloc_bytes(sizeof(double) * nn), *Br = alloc_bytes(sizeof(double) * nn);
+        double *Rr = alloc_bytes(sizeof(double) * nn);
+        float *Af = alloc_bytes(sizeof(float) * nn), *Bf = alloc_bytes(sizeof(float) * nn);
+        float *Cf = alloc_bytes(sizeof(float) * nn);
+        matmul_bf16_t *Ah = alloc_bytes(sizeof(matmul_bf16_t) * nn);
+        matmul_bf16_t *Bh = alloc_bytes(sizeof(matmul_bf16_t) * nn);
+        int8_t *Aq = alloc_bytes(nn), *Bq = alloc_bytes(nn);
+        int32_t *Cq = alloc_bytes(sizeof(int32_t) * nn);
+        if (!A || !B || !C || !Ref || !Ar || !Br || !Rr || !Af || !Bf || !Cf || !Ah || !Bh ||
+            !Aq || !Bq || !Cq) {
+            fprintf(stderr, "Failed to allocate N=%d\n", n);
+            return 1;
+        }
+
+        unsigned long long seed = 12345ull;
+        for (long e = 0; e < nn; e++) {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            A[e] = (double)(seed >> 11) / 9007199254740992.0 * 2.0 - 1.0;
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            B[e] = (double)(seed >> 11) / 9007199254740992.0 * 2.0 - 1.0;
+        }
+        const double ma = max_abs(A, nn), mb = max_abs(B, nn);
+        const double sa = ma / 127.0, sb = mb / 127.0;   // int8 quantization steps
+        for (long e = 0; e < nn; e++) {
+            Af[e] = (float)A[e];
+            Bf[e] = (float)B[e];
+            Ah[e] = matmul_to_bf16(Af[e]);
+            Bh[e] = matmul_to_bf16(Bf[e]);
+            Aq[e] = (int8_t)lrint(A[e] / sa);
+            Bq[e] = (int8_t)lrint(B[e] / sb);
+        }
+
+        matmul_tiles_t fit = tiles;
+        fit.mc = fit.mc < n ? fit.mc : n;
+        fit.kc = fit.kc < n ? fit.kc : n;
+        fit.nc = fit.nc < n ? fit.nc : n;
+        matmul_pack_buf_t buf;
+        matmul_lowp_buf_t lowp_buf;
+        if (matmul_pack_buf_alloc(&buf, &fit) != 0) {
+            fprintf(stderr, "Failed to allocate N=%d\n", n);
+            return 1;
+        }
+        if (matmul_lowp_buf_alloc(&lowp_buf) != 0) {
+            fprintf(stderr, "Failed to allocate N=%d\n", n);
+            matmul_pack_buf_free(&buf);
+            return 1;
+        }
+        lowp_bench_t lb = {n, A, B, Ref, Af, Bf, Cf, Ah, Bh, Aq, Bq, Cq, &buf, &lowp_buf};
+        const double scale = n * ma * mb;
+        double base = 0.0;
+
+        for (int p = 0; p < NUM_PRECS; p++) {
+            const double secs = time_prec((prec_t)p, &lb);
+            if (secs < 0) {
+                printf("%5d %-8s   FAILED (out of memory)\n", n, prec_names[p]);
+                continue;
+            }
+            if (p == PREC_F64) base = secs;
+
+            // Inputs as the low-precision kernel saw them, and its result, in double
+            double bound_arith = 0.0, bound_total = 0.0, out_scale = 1.0;
+            const char *isa = matmul_packed_isa(NULL, NULL);
+            for (long e = 0; e < nn; e++) {
+                switch (p) {
+                    case PREC_F32:
+                        Ar[e] = Af[e]; Br[e] = Bf[e]; C[e] = Cf[e];
+                        break;
+                    case PREC_BF16:
+                        Ar[e] = matmul_from_bf16(Ah[e]); Br[e] = matmul_from_bf16(Bh[e]); C[e] = Cf[e];
+                        break;
+                    case PREC_I8:
+                        Ar[e] = Aq[e] * sa; Br[e] = Bq[e] * sb; C[e] = Cq[e];
+                        break;
+                    default:
+                        break;
+                }
+            }
+            switch (p) {
+                case PREC_F32:
+                    isa = matmul_lowp_isa(MATMUL_LOWP_F32);
+                    bound_arith = 2.0 * n * FLT_EPSILON;
+                    bound_total = bound_arith + 2.0 * FLT_EPSILON;
+                    break;
+                case PREC_BF16:
+                    isa = matmul_lowp_isa(MATMUL_LOWP_BF16);
+                    bound_arith = 2.0 * n * FLT_EPSILON;
+                    bound_total = bound_arith + 2.0 * 0x1p-8 + 0x1p-16;
+                    break;
+                case PREC_I8:
+                    // Exact in int32, so only the double reference rounds; the
+                    // total error is half a quantization step on each input
+                    isa = matmul_lowp_isa(MATMUL_LOWP_I8);
+                    out_scale = sa * sb;
+                    bound_arith = 2.0 * n * DBL_EPSILON;
+                    bound_total = 1.0 / 127.0 + 1.0 / (254.0 * 254.0);
+                    break;
+                default:
+                    bound_total = 2.0 * n * DBL_EPSILON;
+                    break;
+            }
+
+            double arith = 0.0, total = 0.0;
+            if (p != PREC_F64) {
+                matmul_packed(n, n, n, Ar, n, Br, n, Rr, n, &tiles);
+                for (long e = 0; e < nn; e++) {
+                    arith = fmax(arith, fabs(C[e] * out_scale - Rr[e]));
+                    total = fmax(total, fabs(C[e] * out_scale - Ref[e]));
+                }
+                arith /= scale;
+                total /= scale;
+            }
+
+            printf("%5d %-8s %-14s %9.3f %9.2f %8.2fx", n, prec_names[p], isa, secs,
+                   flops / secs / 1e9, base / secs);
+            if (p == PREC_F64) printf(" %10s %6s %10s %6s\n", "-", "ref", "-", "ref");
+            else printf(" %10.2e %6s %10.2e %6s\n", arith, arith <= bound_arith ? "OK" : "FAIL",
+                        total, total <= bound_total ? "OK" : "FAIL");
+            fflush(stdout);
+        }
+        printf("\n");
+
+        matmul_pack_buf_free(&buf);
+        matmul_lowp_buf_free(&lowp_buf);
+        free(A); free(B); free(C); free(Ref); free(Ar); free(Br); free(Rr);
+        free(Af); free(Bf); free(Cf); free(Ah); free(Bh); free(Aq); free(Bq); free(Cq);
+    }
+    printf("-----------------------------------------------------------------------------------------------\n");
+    printf("Arith err: vs double GEMM of the rounded inputs; bound 2N*FLT_EPSILON (int8: exact,\n");
+    printf("           checked to 2N*DBL_EPSILON).\n");
+    printf("Total err: vs double GEMM of the original inputs; adds the input rounding\n");
+    printf("           (bf16 ~2^-7, int8 ~1/127 with per-tensor scale max|x|/127).\n");
+    return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Exercise 4: Padded Leading Dimensions
+ *
+ * exercise4.c multiplies N = 512 matrices: every row of B is exactly 4 KB,
+ * so the column walk B[k][j], k = 0 .. N-1, of its inner loop hits the
+ * same L1 set (and a handful of L2 sets) on every step and misses even
+ * though the column would fit in L1 many times over. This sweeps N around
+ * powers of two (N0 - r .. N0 + r) and runs each kernel twice: with
+ * tightly packed rows (ld = N) and with the leading dimension chosen by
+ * matmul_padded_ld() from the detected L1 / L2 associativity. Kernels:
+ *   naive    exercise4.c's i-j-k loop (column walk over all of B)
+ *   ikj      loop interchange (unit-stride rows)
+ *   blocked  cache-blocked i-k-j (column walks within the tiles)
+ *   packed   packed panels (contiguous copies: immune by construction)
+ * The report gives GFLOP/s both ways, the padding gain and, where perf
+ * counters are available, L1D misses per 1000 FLOPs, and checks that the
+ * padded products match the ld = N ones bit for bit.
+ *
+ * Usage: ./exercise4_padding [--sizes N1,N2,...] [--radius R]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "timing.h"
+#include "results.h"
+#include "perfcount.h"
+#include "matmul.h"
+
+// Configuration
+#define DEFAULT_RADIUS  2
+#define MAX_SIZES       16
+#define MAX_RADIUS      16
+#define REPEATS         3
+#define MIN_TIME_NS     2e8    // Repeat a kernel only while runs are shorter
+
+static const int default_sizes[] = {256, 512, 1024};
+
+typedef enum { K_NAIVE, K_IKJ, K_BLOCKED, K_PACKED, NUM_KERNELS } kernel_id_t;
+
+static const char *kernel_names[NUM_KERNELS] = {"naive", "ikj", "blocked", "packed"};
+
+typedef struct {
+    double gflops;
+    double l1_per_kflop;   // -1 without counters
+} run_t;
+
+static void run_kernel(kernel_id_t k, int n, const matrix_t *A, const matrix_t *B, matrix_t *C,
+                       const matmul_tiles_t *tiles) {
+    switch (k) {
+        case K_NAIVE:   matmul_naive(n, n, n, A->data, A->ld, B->data, B->ld, C->data, C->ld); break;
+        case K_IKJ:     matmul_ikj(n, n, n, A->data, A->ld, B->data, B->ld, C->data, C->ld); break;
+        case K_BLOCKED: matmul_blocked(n, n, n, A->data, A->ld, B->data, B->ld, C->data, C->ld, tiles); break;
+        default:        matmul_packed(n, n, n, A->data, A->ld, B->data, B->ld, C->data, C->ld, tiles); break;
+    }
+}
+
+static run_t time_kernel(kernel_id_t k, int n, const matrix_t *A, const matrix_t *B, matrix_t *C,
+                         const matmul_tiles_t *tiles, perf_counters_t *pc, int have_perf) {
+    run_t r = {0.0, -1.0};
+    const double flops = 2.0 * n * n * (double)n;
+    double best = 1e300;
+    long long misses[PERF_NUM_EVENTS];
+    for (int rep = 0; rep < REPEATS; rep++) {
+        if (have_perf) perf_start(pc);
+        const double start = get_time_ns();
+        run_kernel(k, n, A, B, C, tiles);
+        const double elapsed = get_time_ns() - start;
+        if (have_perf) perf_stop(pc, misses);
+        if (elapsed < best) {
+            best = elapsed;
+            if (have_perf && misses[PERF_L1D_MISS] >= 0) r.l1_per_kflop = misses[PERF_L1D_MISS] * 1e3 / flops;
+        }
+        if (elapsed > MIN_TIME_NS) break;
+    }
+    r.gflops = flops / best;
+    return r;
+}
+
+static int parse_sizes(const char *s, int *sizes) {
+    int count = 0;
+    while (*s && count < MAX_SIZES) {
+        sizes[count++] = (int)strtol(s, (char **)&s, 10);
+        if (*s == ',') s++;
+    }
+    return count;
+}
+
+static double max_diff(const matrix_t *X, const matrix_t *Y, int n) {
+    double worst = 0.0;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++) {
+            const double d = fabs(*matrix_at(X, i, j) - *matrix_at(Y, i, j));
+            if (d > worst) worst = d;
+        }
+    return worst;
+}
+
+int main(int argc, char *argv[]) {
+    int sizes[MAX_SIZES];
+    int num_sizes = (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    int radius = DEFAULT_RADIUS;
+    memcpy(sizes, default_sizes, sizeof(default_sizes));
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--sizes") == 0)       num_sizes = parse_sizes(val, sizes);
+        else if (strcmp(opt, "--radius") == 0) radius = atoi(val);
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (num_sizes < 1 || radius < 0 || radius > MAX_RADIUS) {
+        fprintf(stderr, "Need at least one size and a radius in [0, %d]\n", MAX_RADIUS);
+        return 1;
+    }
+    for (int s = 0; s < num_sizes; s++) {
+        if (sizes[s] - radius < 1) {
+            fprintf(stderr, "Size %d is too small for radius %d\n", sizes[s], radius);
+            return 1;
+        }
+    }
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    matmul_cache_level_t l1, l2;
+    matmul_cache_geometry(1, &l1);
+    matmul_cache_geometry(2, &l2);
+    perf_counters_t pc;
+    const int have_perf = perf_open(&pc) == 0;
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Padded Leading Dimensions\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  L1D:                 %ld KB, %d-way, %d-byte lines, %ld sets\n", l1.size / 1024, l1.ways,
+           l1.line, l1.sets);
+    printf("  L2:                  %ld KB, %d-way, %d-byte lines, %ld sets\n", l2.size / 1024, l2.ways,
+           l2.line, l2.sets);
+    printf("  Sizes:               N0 - %d .. N0 + %d for N0 =", radius, radius);
+    for (int s = 0; s < num_sizes; s++) printf(" %d", sizes[s]);
+    printf("\n");
+    printf("  Tiles:               mc=%d kc=%d nc=%d nr=%d\n", tiles.mc, tiles.kc, tiles.nc, tiles.nr);
+    printf("  Cache counters:      %s\n\n", have_perf ? "perf_event (L1D read misses)" : "unavailable");
+
+    printf("%6s %6s  %-8s %11s %11s %8s %12s %12s %10s\n", "N", "ld", "Kernel", "ld=N", "padded",
+           "Gain", "L1D/kFLOP", "L1D/kFLOP", "Check");
+    printf("%6s %6s  %-8s %11s %11s %8s %12s %12s %10s\n", "", "padded", "", "GFLOP/s", "GFLOP/s",
+           "", "ld=N", "padded", "");
+    printf("-----------------------------------------------------------------------------------------------\n");
+
+    int mismatch = 0;
+    for (int s = 0; s < num_sizes; s++) {
+        double plain_g[2 * MAX_RADIUS + 1][NUM_KERNELS], padded_g[2 * MAX_RADIUS + 1][NUM_KERNELS];
+        for (int n = sizes[s] - radius; n <= sizes[s] + radius; n++) {
+            const int ld = matmul_padded_ld(n, n);
+            matrix_t A, B, C, Ap, Bp, Cp;
+            if (matrix_alloc(&A, n, n, MATRIX_ROW_MAJOR, n) != 0 ||
+                matrix_alloc(&B, n, n, MATRIX_ROW_MAJOR, n) != 0 ||
+                matrix_alloc(&C, n, n, MATRIX_ROW_MAJOR, n) != 0 ||
+                matrix_alloc(&Ap, n, n, MATRIX_ROW_MAJOR, ld) != 0 ||
+                matrix_alloc(&Bp, n, n, MATRIX_ROW_MAJOR, ld) != 0 ||
+                matrix_alloc(&Cp, n, n, MATRIX_ROW_MAJOR, ld) != 0) {
+                fprintf(stderr, "Failed to allocate N=%d\n", n);
+                return 1;
+            }
+            matrix_fill_random(&A, 1u);
+            matrix_fill_random(&B, 2u);
+            matrix_convert(&Ap, &A);
+            matrix_convert(&Bp, &B);
+
+            for (int k = 0; k < NUM_KERNELS; k++) {
+                const run_t plain = time_kernel((kernel_id_t)k, n, &A, &B, &C, &tiles, &pc, have_perf);
+                const run_t padded = time_kernel((kernel_id_t)k, n, &Ap, &Bp, &Cp, &tiles, &pc, have_perf);
+                const int same = max_diff(&C, &Cp, n) == 0.0;
+                if (!same) mismatch = 1;
+                plain_g[n - sizes[s] + radius][k] = plain.gflops;
+                padded_g[n - sizes[s] + radius][k] = padded.gflops;
+
+                char m_plain[16] = "n/a", m_padded[16] = "n/a";
+                if (plain.l1_per_kflop >= 0) snprintf(m_plain, sizeof(m_plain), "%.2f", plain.l1_per_kflop);
+                if (padded.l1_per_kflop >= 0) snprintf(m_padded, sizeof(m_padded), "%.2f", padded.l1_per_kflop);
+                printf("%6d %6d  %-8s %11.2f %11.2f %+7.0f%% %12s %12s %10s\n", n, ld, kernel_names[k],
+                       plain.gflops, padded.gflops, 100.0 * (padded.gflops / plain.gflops - 1.0),
+                       m_plain, m_padded, same ? "identical" : "DIFFERS");
+                fflush(stdout);
+
+                char param[32];
+                snprintf(param, sizeof(param), "N=%d ld=%d", n, n);
+                results_record("exercise4_padding", kernel_names[k], param, "gflops", plain.gflops, "GFLOP/s");
+                snprintf(param, sizeof(param), "N=%d ld=%d", n, ld);
+                results_record("exercise4_padding", kernel_names[k], param, "gflops", padded.gflops, "GFLOP/s");
+            }
+            matrix_free(&A); matrix_free(&B); matrix_free(&C);
+            matrix_free(&Ap); matrix_free(&Bp); matrix_free(&Cp);
+        }
+        // The cliff: N0 against the mean of its neighbours
+        for (int k = 0; k < NUM_KERNELS && radius > 0; k++) {
+            double plain_nb = 0.0, padded_nb = 0.0;
+            for (int o = 0; o <= 2 * radius; o++) {
+                if (o == radius) continue;
+                plain_nb += plain_g[o][k] / (2 * radius);
+                padded_nb += padded_g[o][k] / (2 * radius);
+            }
+            printf("  N=%d %-8s vs neighbours: ld=N %+5.0f%%, padded %+5.0f%%\n", sizes[s], kernel_names[k],
+                   100.0 * (plain_g[radius][k] / plain_nb - 1.0),
+                   100.0 * (padded_g[radius][k] / padded_nb - 1.0));
+        }
+        printf("-----------------------------------------------------------------------------------------------\n");
+    }
+    printf("Check: padded products %s the ld = N ones (same summation order)\n",
+           mismatch ? "DIFFER from" : "are bit-identical to");
+
+    if (have_perf) perf_close(&pc);
+    return mismatch;
+}
@@ -0,0 +1,363 @@
+/*
+ * Exercise 4: Thread Placement Explorer
+ *
+ * The same thread count can measure very different machines: two threads
+ * on SMT siblings share one core's FMA units and L1/L2, two threads on one
+ * L3 share its bandwidth, two threads on two sockets get two memory
+ * controllers. This runs the parallel kernels of the exercises under every
+ * placement policy of common/topology.h (none = the scheduler decides,
+ * compact, scatter, one-per-core, one-per-l3) at 1, 2, 4, ... threads:
+ *   - the bandwidth-bound exercise3 stages init_b, compute_addition and
+ *     reduction, one pool task per chunk (GB/s of compulsory traffic)
+ *   - the compute-bound exercise4 matmul_parallel() (GFLOP/s)
+ * and reports each against the unpinned run at the same thread count. The
+ * vectors are allocated per run and first written by the pinned workers,
+ * so their pages follow the placement like exercise3_numa's first-touch.
+ * Expect scatter / one-per-l3 to win the streaming stages (more L3 slices
+ * and memory controllers) and compact to lose GEMM throughput as soon as
+ * it doubles up on SMT siblings.
+ *
+ * Results are also written as CSV for plot_exercise4_placement() in
+ * analysis.py.
+ *
+ * Usage: ./exercise4_placement [--threads P] [--vector N] [--n N] [--csv FILE]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "timing.h"
+#include "results.h"
+#include "threadpool.h"
+#include "topology.h"
+#include "matmul.h"
+
+// Configuration
+#define DEFAULT_VECTOR    (1L << 24)  // exercise3 elements (128 MB per array)
+#define DEFAULT_N         1024
+#define B_VALUE           2.0
+#define REPEATS           3
+#define CHUNKS_PER_THREAD 4
+#define MAX_POINTS        16
+#define MAX_CHUNKS        4096
+#define CHECK_TOLERANCE   1e-9   // Relative; the chunking changes the summation order
+
+typedef enum {
+    K_INIT_B, K_ADDITION, K_REDUCE,   // exercise3, GB/s
+    K_GEMM,                           // exercise4, GFLOP/s
+    NUM_KERNELS
+} kernel_id_t;
+
+static const struct {
+    const char *name, *unit, *metric;
+    double bytes_per_elem;            // Compulsory traffic of the stages
+} kernel_info[NUM_KERNELS] = {
+    {"init_b",           "GB/s",    "bandwidth", 8.0},
+    {"compute_addition", "GB/s",    "bandwidth", 24.0},
+    {"reduction",        "GB/s",    "bandwidth", 8.0},
+    {"matmul parallel",  "GFLOP/s", "gflops",    0.0},
+};
+
+typedef struct {
+    topology_policy_t policy;
+    int threads;
+    char cpus[48];                    // Placed CPUs, for the table
+    double value[NUM_KERNELS];
+} placement_point_t;
+
+typedef struct {
+    double *a, *b, *c;
+    long n;
+    int chunks;
+    double partial[MAX_CHUNKS];
+} vectors_t;
+
+static double *alloc_doubles(long count) {
+    return aligned_alloc(64, (sizeof(double) * count + 63) / 64 * 64);
+}
+
+// ============================================================================
+// exercise3 stages, one task per chunk
+// ============================================================================
+
+static void chunk_range(const vectors_t *v, int chunk, long *begin, long *end) {
+    *begin = v->n * chunk / v->chunks;
+    *end = v->n * (chunk + 1) / v->chunks;
+}
+
+static void fill_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    for (long i = begin; i < end; i++) {
+        v->a[i] = 1.0 + i * 1e-9;
+        v->c[i] = 0.0;
+    }
+}
+
+static void init_b_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    double *restrict b = v->b;
+    for (long i = begin; i < end; i++) b[i] = B_VALUE;
+}
+
+static void add_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    double *restrict c = v->c;
+    const double *restrict a = v->a, *restrict b = v->b;
+    for (long i = begin; i < end; i++) c[i] = a[i] + b[i];
+}
+
+static void reduce_task(void *arg, int chunk, int worker) {
+    vectors_t *v = arg;
+    long begin, end;
+    (void)worker;
+    chunk_range(v, chunk, &begin, &end);
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    long i = begin;
+    for (; i + 4 <= end; i += 4) {
+        s0 += v->c[i]; s1 += v->c[i + 1]; s2 += v->c[i + 2]; s3 += v->c[i + 3];
+    }
+    for (; i < end; i++) s0 += v->c[i];
+    v->partial[chunk] = (s0 + s1) + (s2 + s3);
+}
+
+// Best-of-REPEATS nanoseconds of one stage
+static double time_stage(threadpool_t *pool, vectors_t *v, tp_task_fn fn) {
+    double best = 1e300;
+    for (int r = 0; r < REPEATS; r++) {
+        double start = get_time_ns();
+        threadpool_run(pool, v->chunks, fn, v);
+        double elapsed = get_time_ns() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// ============================================================================
+// One (policy, thread count) point
+// ============================================================================
+
+static int run_point(placement_point_t *pt, long n, int mn, const double *A, const double *B,
+                     double *C, const matmul_tiles_t *tiles, double *check) {
+    int cpus[TOPOLOGY_MAX_CPUS];
+    const int placed = topology_place(pt->policy, pt->threads, cpus);
+    if (pt->policy == TOPOLOGY_NONE) snprintf(pt->cpus, sizeof(pt->cpus), "any");
+    else {
+        size_t o = 0;
+        pt->cpus[0] = '\0';
+        for (int i = 0; i < placed && o < sizeof(pt->cpus); i++)
+            o += snprintf(pt->cpus + o, sizeof(pt->cpus) - o, "%s%d", i ? "," : "", cpus[i]);
+        if (o >= sizeof(pt->cpus)) strcpy(pt->cpus + sizeof(pt->cpus) - 4, "...");
+    }
+
+    threadpool_t *pool = threadpool_create_placed(pt->threads, pt->policy);
+    vectors_t *v = calloc(1, sizeof(vectors_t));
+    if (!pool || !v) {
+        threadpool_destroy(pool);
+        free(v);
+        return -1;
+    }
+    v->n = n;
+    v->chunks = pt->threads * CHUNKS_PER_THREAD;
+    if (v->chunks > MAX_CHUNKS) v->chunks = MAX_CHUNKS;
+    v->a = alloc_doubles(n);
+    v->b = alloc_doubles(n);
+    v->c = alloc_doubles(n);
+    if (!v->a || !v->b || !v->c) {
+        free(v->a); free(v->b); free(v->c); free(v);
+        threadpool_destroy(pool);
+        return -1;
+    }
+
+    // First touch by the placed workers, then the timed stages
+    threadpool_run(pool, v->chunks, fill_task, v);
+    pt->value[K_INIT_B] = time_stage(pool, v, init_b_task);
+    pt->value[K_ADDITION] = time_stage(pool, v, add_task);
+    pt->value[K_REDUCE] = time_stage(pool, v, reduce_task);
+    for (int k = K_INIT_B; k <= K_REDUCE; k++)
+        pt->value[k] = kernel_info[k].bytes_per_elem * n / pt->value[k];
+    double sum = 0.0;
+    for (int c = 0; c < v->chunks; c++) sum += v->partial[c];
+    *check = sum;
+
+    double best = 1e300;
+    for (int r = 0; r < REPEATS; r++) {
+        double start = get_time_ns();
+        matmul_parallel(mn, mn, mn, A, mn, 1, B, mn, 1, C, mn, tiles, pool);
+        double elapsed = get_time_ns() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    pt->value[K_GEMM] = 2.0 * mn * mn * (double)mn / best;
+
+    free(v->a); free(v->b); free(v->c); free(v);
+    threadpool_destroy(pool);
+    return 0;
+}
+
+static const placement_point_t *find_point(const placement_point_t *points, int count,
+                                           topology_policy_t policy, int threads) {
+    for (int i = 0; i < count; i++)
+        if (points[i].policy == policy && points[i].threads == threads) return &points[i];
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = threadpool_cpu_count();
+    long n = DEFAULT_VECTOR;
+    int mn = DEFAULT_N;
+    const char *csv_path = "placement.csv";
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--threads") == 0)     max_threads = atoi(val);
+        else if (strcmp(opt, "--vector") == 0) n = (long)strtod(val, NULL);
+        else if (strcmp(opt, "--n") == 0)      mn = atoi(val);
+        else if (strcmp(opt, "--csv") == 0)    csv_path = val;
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (max_threads < 1 || n < 1024 || mn < 1) {
+        fprintf(stderr, "Sizes and thread count must be positive (vector at least 1024)\n");
+        return 1;
+    }
+    if (max_threads > TOPOLOGY_MAX_CPUS) max_threads = TOPOLOGY_MAX_CPUS;
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    double *A = alloc_doubles((long)mn * mn);
+    double *B = alloc_doubles((long)mn * mn);
+    double *C = alloc_doubles((long)mn * mn);
+    if (!A || !B || !C) {
+        fprintf(stderr, "Failed to allocate N=%d\n", mn);
+        return 1;
+    }
+    for (long e = 0; e < (long)mn * mn; e++) {
+        A[e] = (double)(e % 7) - 3.0;
+        B[e] = (double)(e % 5) * 0.5;
+    }
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Thread Placement Explorer\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Topology:            ");
+    topology_describe(stdout);
+    printf("\n");
+    printf("  Max threads:         %d\n", max_threads);
+    printf("  exercise3 vectors:   %ld elements (%.0f MB per array)\n", n, n * 8.0 / 1048576.0);
+    printf("  exercise4 GEMM:      N=%d, %s\n", mn, matmul_packed_isa(NULL, NULL));
+    printf("  Policies:            none");
+    for (int pol = 0; pol < TOPOLOGY_NUM_POLICIES; pol++)
+        printf(", %s (<= %d)", topology_policy_name((topology_policy_t)pol),
+               topology_max_threads((topology_policy_t)pol));
+    printf("\n\n");
+
+    placement_point_t points[(TOPOLOGY_NUM_POLICIES + 1) * MAX_POINTS];
+    int count = 0, mismatch = 0;
+    double reference = 0.0;
+
+    printf("%-13s %7s %-16s %11s %11s %11s %11s\n", "Placement", "Threads", "CPUs",
+           "init_b GB/s", "add GB/s", "reduce GB/s", "GEMM GFLOP/s");
+    printf("-------------------------------------------------------------------------------------\n");
+    for (int pol = TOPOLOGY_NONE; pol < TOPOLOGY_NUM_POLICIES; pol++) {
+        int limit = topology_max_threads((topology_policy_t)pol);
+        if (pol == TOPOLOGY_NONE || limit > max_threads) limit = max_threads;
+        for (int p = 1, last = 0; !last && count < (int)(sizeof(points) / sizeof(points[0])); p *= 2) {
+            if (p >= limit) {
+                p = limit;
+                last = 1;
+            }
+            placement_point_t *pt = &points[count];
+            pt->policy = (topology_policy_t)pol;
+            pt->threads = p;
+            double check;
+            if (run_point(pt, n, mn, A, B, C, &tiles, &check) != 0) {
+                printf("%-13s %7d   FAILED (placement or allocation)\n",
+                       topology_policy_name(pt->policy), p);
+                continue;
+            }
+            if (count == 0) reference = check;
+            else if (fabs(check - reference) > CHECK_TOLERANCE * fabs(reference)) mismatch = 1;
+            count++;
+            printf("%-13s %7d %-16s %11.2f %11.2f %11.2f %11.2f\n", topology_policy_name(pt->policy),
+                   p, pt->cpus, pt->value[K_INIT_B], pt->value[K_ADDITION], pt->value[K_REDUCE],
+                   pt->value[K_GEMM]);
+            fflush(stdout);
+        }
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    printf("Reduction check: %.6e (%s across placements)\n\n", reference,
+           mismatch ? "DIFFERS" : "consistent");
+
+    // Gain (+) or loss (-) of every pinned run against the unpinned one
+    printf("Gain / loss vs unpinned at the same thread count:\n");
+    printf("%-13s %7s %11s %11s %11s %11s\n", "Placement", "Threads",
+           "init_b", "add", "reduce", "GEMM");
+    printf("-------------------------------------------------------------------\n");
+    for (int i = 0; i < count; i++) {
+        const placement_point_t *pt = &points[i];
+        const placement_point_t *base = find_point(points, count, TOPOLOGY_NONE, pt->threads);
+        if (pt->policy == TOPOLOGY_NONE || !base) continue;
+        printf("%-13s %7d", topology_policy_name(pt->policy), pt->threads);
+        for (int k = 0; k < NUM_KERNELS; k++)
+            printf(" %+10.1f%%", 100.0 * (pt->value[k] / base->value[k] - 1.0));
+        printf("\n");
+    }
+    printf("-------------------------------------------------------------------\n\n");
+
+    printf("Best placement per kernel:\n");
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        const placement_point_t *best = NULL;
+        for (int i = 0; i < count; i++)
+            if (!best || points[i].value[k] > best->value[k]) best = &points[i];
+        if (best)
+            printf("  %-18s %-13s P=%-4d %10.2f %s\n", kernel_info[k].name,
+                   topology_policy_name(best->policy), best->threads, best->value[k],
+                   kernel_info[k].unit);
+    }
+
+    FILE *f = fopen(csv_path, "w");
+    if (!f) {
+        fprintf(stderr, "Cannot write %s\n", csv_path);
+        return 1;
+    }
+    fprintf(f, "policy,threads,kernel,value,unit,gain\n");
+    for (int i = 0; i < count; i++) {
+        const placement_point_t *pt = &points[i];
+        const placement_point_t *base = find_point(points, count, TOPOLOGY_NONE, pt->threads);
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            const double gain = base ? pt->value[k] / base->value[k] - 1.0 : 0.0;
+            fprintf(f, "%s,%d,%s,%.4f,%s,%.4f\n", topology_policy_name(pt->policy), pt->threads,
+                    kernel_info[k].name, pt->value[k], kernel_info[k].unit, gain);
+            char param[64];
+            snprintf(param, sizeof(param), "%s P=%d", topology_policy_name(pt->policy), pt->threads);
+            results_record("exercise4_placement", kernel_info[k].name, param, kernel_info[k].metric,
+                           pt->value[k], kernel_info[k].unit);
+        }
+    }
+    fclose(f);
+    printf("\nCSV written to %s\n", csv_path);
+
+    free(A); free(B); free(C);
+    return 0;
+}
@@ -0,0 +1,325 @@
+/*
+ * Exercise 4: Roofline of the TP2 Kernels
+ *
+ * Amdahl fractions say how much of a program can run in parallel, not how
+ * fast each part could run. This measures the three roofs of one core on
+ * the host:
+ *   - peak FP throughput (matmul_peak_gflops(): dependent-free FMAs)
+ *   - DRAM bandwidth (STREAM triad over vectors of 4x the last-level
+ *     cache, 64 .. 128 MB each)
+ *   - LLC bandwidth (the same triad over half the last-level cache, at
+ *     most 16 MB: larger "LLCs" are usually a VM's report of host caches)
+ * and times the kernels of the exercises next to them: the exercise1 sums
+ * (U=1 and 8 accumulators), the four exercise3 stages and the exercise4
+ * matmul variants. Arithmetic intensity is flops / compulsory bytes, each
+ * operand moved once (matmul: A, B and C once, 2 N^3 / 24 N^2), so a
+ * kernel well under its roof loses to latency or cache misses, not to the
+ * machine. The roof of a kernel is min(peak, AI x bandwidth) with the LLC
+ * bandwidth when its working set fits the last-level cache; init_b does
+ * no flops and is rated against bandwidth alone.
+ *
+ * Results are written as CSV for plot_exercise4_roofline() in analysis.py.
+ *
+ * Usage: ./exercise4_roofline [--n N] [--naive-n N] [--vector N] [--csv FILE]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+#include "results.h"
+#include "matmul.h"
+
+// Configuration
+#define DEFAULT_N        1024
+#define DEFAULT_NAIVE_N  512      // The i-j-k kernel is timed on a smaller problem
+#define EX1_N            1000000  // Array size of exercise1.c
+#define MIN_VECTOR       (1L << 23)  // exercise3 elements, default 4x LLC within these bounds
+#define MAX_VECTOR       (1L << 24)
+#define MAX_LLC_SET      (16L << 20) // Bytes of the LLC triad at most
+#define MIN_REPEATS      3
+#define MIN_TIME_NS      3e8
+#define TRIAD_SCALAR     3.0
+
+typedef enum {
+    K_SUM_U1, K_SUM_ILP8,                        // exercise1
+    K_ADD_NOISE, K_INIT_B, K_ADDITION, K_REDUCE, // exercise3
+    K_NAIVE, K_IKJ, K_BLOCKED, K_PACKED,         // exercise4
+    NUM_KERNELS
+} kernel_id_t;
+
+static const struct {
+    const char *exercise, *name;
+} kernel_info[NUM_KERNELS] = {
+    {"exercise1", "sum U=1"},       {"exercise1", "sum U=8 (8 accum ILP)"},
+    {"exercise3", "add_noise"},     {"exercise3", "init_b"},
+    {"exercise3", "compute_addition"}, {"exercise3", "reduction"},
+    {"exercise4", "matmul naive"},  {"exercise4", "matmul ikj"},
+    {"exercise4", "matmul blocked"}, {"exercise4", "matmul packed"},
+};
+
+typedef struct {
+    long vector;                 // exercise3 length
+    int n, naive_n;              // exercise4 sizes
+    double *x;                   // exercise1 array
+    double *a, *b, *c;           // exercise3 vectors
+    double *A, *B, *C;           // exercise4 matrices
+    matmul_tiles_t tiles;
+} workload_t;
+
+typedef struct {
+    long size;                   // N of the problem
+    double flops, bytes, working_set;
+    double seconds;
+} measurement_t;
+
+static volatile double sink;
+
+// ============================================================================
+// Kernels (same loops as the exercises)
+// ============================================================================
+
+__attribute__((noinline))
+static double sum_unroll_1(const double *a, long n) {
+    double sum = 0.0;
+    for (long i = 0; i < n; i++) sum += a[i];
+    return sum;
+}
+
+__attribute__((noinline))
+static double sum_ilp_8(const double *a, int n) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0, s4 = 0.0, s5 = 0.0, s6 = 0.0, s7 = 0.0;
+    int i;
+    for (i = 0; i < n - 7; i += 8) {
+        s0 += a[i];     s1 += a[i + 1]; s2 += a[i + 2]; s3 += a[i + 3];
+        s4 += a[i + 4]; s5 += a[i + 5]; s6 += a[i + 6]; s7 += a[i + 7];
+    }
+    for (; i < n; i++) s0 += a[i];
+    return ((s0 + s1) + (s2 + s3)) + ((s4 + s5) + (s6 + s7));
+}
+
+__attribute__((noinline))
+static void add_noise(double *a, long n) {
+    a[0] = 1.0;
+    for (long i = 1; i < n; i++) a[i] = a[i - 1] * 1.0000001;
+}
+
+__attribute__((noinline))
+static void init_b(double *b, long n) {
+    for (long i = 0; i < n; i++) b[i] = 2.0;
+}
+
+__attribute__((noinline))
+static void compute_addition(const double *a, const double *b, double *c, long n) {
+    for (long i = 0; i < n; i++) c[i] = a[i] + b[i];
+}
+
+__attribute__((noinline))
+static void triad(double *a, const double *b, const double *c, long n) {
+    for (long i = 0; i < n; i++) a[i] = b[i] + TRIAD_SCALAR * c[i];
+}
+
+// Flops, compulsory bytes and working set of one call
+static measurement_t kernel_cost(kernel_id_t id, const workload_t *w) {
+    const double v = (double)w->vector;
+    const double n = (id == K_NAIVE) ? w->naive_n : w->n;
+    measurement_t m = {0};
+    m.size = (id <= K_SUM_ILP8) ? EX1_N : (id <= K_REDUCE) ? w->vector : (long)n;
+    switch (id) {
+        case K_SUM_U1:
+        case K_SUM_ILP8:  m.flops = EX1_N;  m.bytes = 8.0 * EX1_N; break;
+        case K_ADD_NOISE: m.flops = v - 1;  m.bytes = 8.0 * v;     break;
+        case K_INIT_B:    m.flops = 0.0;    m.bytes = 8.0 * v;     break;
+        case K_ADDITION:  m.flops = v;      m.bytes = 24.0 * v;    break;
+        case K_REDUCE:    m.flops = v;      m.bytes = 8.0 * v;     break;
+        default:          m.flops = 2.0 * n * n * n; m.bytes = 24.0 * n * n; break;
+    }
+    m.working_set = m.bytes;
+    return m;
+}
+
+static void run_kernel(kernel_id_t id, workload_t *w) {
+    const int n = w->n, nn = w->naive_n;
+    switch (id) {
+        case K_SUM_U1:    sink += sum_unroll_1(w->x, EX1_N); break;
+        case K_SUM_ILP8:  sink += sum_ilp_8(w->x, EX1_N); break;
+        case K_ADD_NOISE: add_noise(w->a, w->vector); break;
+        case K_INIT_B:    init_b(w->b, w->vector); break;
+        case K_ADDITION:  compute_addition(w->a, w->b, w->c, w->vector); break;
+        case K_REDUCE:    sink += sum_unroll_1(w->c, w->vector); break;
+        case K_NAIVE:     matmul_naive(nn, nn, nn, w->A, nn, w->B, nn, w->C, nn); break;
+        case K_IKJ:       matmul_ikj(n, n, n, w->A, n, w->B, n, w->C, n); break;
+        case K_BLOCKED:   matmul_blocked(n, n, n, w->A, n, w->B, n, w->C, n, &w->tiles); break;
+        case K_PACKED:    matmul_packed(n, n, n, w->A, n, w->B, n, w->C, n, &w->tiles); break;
+        default: break;
+    }
+}
+
+// Best-of-repeats wall time in seconds
+static double time_kernel(kernel_id_t id, workload_t *w) {
+    double best = 1e30, spent = 0.0;
+    for (int r = 0; r < MIN_REPEATS || spent < MIN_TIME_NS; r++) {
+        double start = get_time_ns();
+        run_kernel(id, w);
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best / 1e9;
+}
+
+// Triad bandwidth in bytes/s over three arrays of n elements
+static double triad_bandwidth(double *a, double *b, double *c, long n) {
+    for (long i = 0; i < n; i++) { a[i] = 0.0; b[i] = 1.0; c[i] = 0.5; }
+    double best = 1e30, spent = 0.0;
+    for (int r = 0; r < MIN_REPEATS || spent < MIN_TIME_NS; r++) {
+        double start = get_time_ns();
+        triad(a, b, c, n);
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    sink += a[n / 2];
+    return 24.0 * n / (best / 1e9);
+}
+
+static double *alloc_doubles(long count) {
+    return aligned_alloc(64, ((count * sizeof(double) + 63) / 64) * 64);
+}
+
+int main(int argc, char *argv[]) {
+    int n = DEFAULT_N, naive_n = DEFAULT_NAIVE_N;
+    long vector = 0;
+    const char *csv_path = "roofline.csv";
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--n") == 0)            n = atoi(val);
+        else if (strcmp(opt, "--naive-n") == 0) naive_n = atoi(val);
+        else if (strcmp(opt, "--vector") == 0)  vector = atol(val);
+        else if (strcmp(opt, "--csv") == 0)     csv_path = val;
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (n < 1 || naive_n < 1 || naive_n > n || vector < 0) {
+        fprintf(stderr, "Sizes must be positive, with naive-n <= n\n");
+        return 1;
+    }
+
+    init_timing();
+    long l1, l2, l3;
+    matmul_cache_sizes(&l1, &l2, &l3);
+    const long llc = l3 > 0 ? l3 : l2;
+    if (vector == 0) {
+        vector = 4 * llc / (long)sizeof(double);
+        if (vector < MIN_VECTOR) vector = MIN_VECTOR;
+        if (vector > MAX_VECTOR) vector = MAX_VECTOR;
+    }
+
+    workload_t w = {.vector = vector, .n = n, .naive_n = naive_n};
+    matmul_default_tiles(&w.tiles);
+    const long nn = (long)n * n;
+    w.x = alloc_doubles(EX1_N);
+    w.a = alloc_doubles(vector); w.b = alloc_doubles(vector); w.c = alloc_doubles(vector);
+    w.A = alloc_doubles(nn); w.B = alloc_doubles(nn); w.C = alloc_doubles(nn);
+    if (!w.x || !w.a || !w.b || !w.c || !w.A || !w.B || !w.C) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return 1;
+    }
+    for (int i = 0; i < EX1_N; i++) w.x[i] = (double)(i % 100) / 100.0;
+    for (long i = 0; i < nn; i++) {
+        w.A[i] = (double)(i % 11) / 11.0 - 0.5;
+        w.B[i] = (double)(i % 5) / 5.0 - 0.5;
+    }
+
+    // Roofs
+    const double peak = matmul_peak_gflops();
+    const double dram_bw = triad_bandwidth(w.a, w.b, w.c, vector);
+    const long llc_set = llc / 2 < MAX_LLC_SET ? llc / 2 : MAX_LLC_SET;
+    const long llc_n = llc_set / 3 / (long)sizeof(double);
+    const double llc_bw = triad_bandwidth(w.a, w.b, w.c, llc_n);
+    add_noise(w.a, vector);
+    init_b(w.b, vector);
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Roofline of the TP2 Kernels (one core)\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Caches:              L1 %ld KB, L2 %ld KB, LLC %ld KB\n", l1 >> 10, l2 >> 10, llc >> 10);
+    printf("  Problems:            exercise1 N=%d, exercise3 N=%ld, exercise4 N=%d (naive %d)\n",
+           EX1_N, vector, n, naive_n);
+    printf("\nRoofs (measured):\n");
+    printf("  Peak FP:             %8.2f GFLOP/s (%s FMA)\n", peak, matmul_packed_isa(NULL, NULL));
+    printf("  DRAM bandwidth:      %8.2f GB/s (triad, %ld MB)\n", dram_bw / 1e9,
+           24 * vector >> 20);
+    printf("  LLC bandwidth:       %8.2f GB/s (triad, %ld KB)\n", llc_bw / 1e9,
+           24 * llc_n >> 10);
+    printf("  Ridge point:         %8.2f flop/byte (DRAM), %.2f (LLC)\n\n",
+           peak * 1e9 / dram_bw, peak * 1e9 / llc_bw);
+
+    printf("%-10s %-22s %9s %10s %9s %10s %-8s %8s %9s\n", "Exercise", "Kernel", "AI", "GFLOP/s",
+           "GB/s", "Roof", "Bound", "Of roof", "Headroom");
+    printf("----------------------------------------------------------------------------------------------------------\n");
+
+    FILE *f = fopen(csv_path, "w");
+    if (!f) {
+        fprintf(stderr, "Cannot write %s\n", csv_path);
+        return 1;
+    }
+    fprintf(f, "type,exercise,name,intensity,gflops,gbs,roof,bound,fraction\n");
+    fprintf(f, "roof,,peak,,%.4f,,,,\n", peak);
+    fprintf(f, "roof,,dram,,,%.4f,,,\n", dram_bw / 1e9);
+    fprintf(f, "roof,,llc,,,%.4f,,,\n", llc_bw / 1e9);
+
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        measurement_t m = kernel_cost((kernel_id_t)k, &w);
+        m.seconds = time_kernel((kernel_id_t)k, &w);
+        const int in_llc = m.working_set <= 2 * llc_set;   // Fits the (capped) LLC
+        const double bw = in_llc ? llc_bw : dram_bw;
+        const double gflops = m.flops / m.seconds / 1e9, gbs = m.bytes / m.seconds / 1e9;
+        const double ai = m.flops / m.bytes;
+
+        // Applicable roof, in GFLOP/s (in GB/s for a kernel without flops)
+        double roof, achieved;
+        const char *bound;
+        if (m.flops == 0.0) {
+            roof = bw / 1e9; achieved = gbs; bound = in_llc ? "LLC" : "DRAM";
+        } else if (ai * bw / 1e9 < peak) {
+            roof = ai * bw / 1e9; achieved = gflops; bound = in_llc ? "LLC" : "DRAM";
+        } else {
+            roof = peak; achieved = gflops; bound = "compute";
+        }
+        const double fraction = achieved / roof;
+
+        printf("%-10s %-22s %9.4f %10.3f %9.2f %10.2f %-8s %7.1f%% %8.1f%%\n",
+               kernel_info[k].exercise, kernel_info[k].name, ai, gflops, gbs, roof, bound,
+               100.0 * fraction, 100.0 * (1.0 - fraction));
+        fflush(stdout);
+        fprintf(f, "kernel,%s,%s,%.6f,%.4f,%.4f,%.4f,%s,%.4f\n", kernel_info[k].exercise,
+                kernel_info[k].name, ai, gflops, gbs, roof, bound, fraction);
+        char param[32];
+        snprintf(param, sizeof(param), "N=%ld", m.size);
+        if (m.flops == 0.0) results_record("exercise4_roofline", kernel_info[k].name, param, "bandwidth", gbs, "GB/s");
+        else results_record("exercise4_roofline", kernel_info[k].name, param, "gflops", gflops, "GFLOP/s");
+    }
+    fclose(f);
+
+    printf("----------------------------------------------------------------------------------------------------------\n");
+    printf("AI = flops / compulsory bytes. Roof = min(peak, AI x bandwidth) in GFLOP/s\n");
+    printf("(GB/s for init_b); Headroom = share of the roof the kernel leaves unused.\n");
+    printf("Above 100%%: read-only streams outrun the triad that sets the memory roofs.\n");
+    printf("\nCSV written to %s\n", csv_path);
+
+    free(w.x); free(w.a); free(w.b); free(w.c); free(w.A); free(w.B); free(w.C);
+    return 0;
+}
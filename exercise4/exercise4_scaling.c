@@ -0,0 +1,310 @@
+/*
+ * Exercise 4: Measured Strong and Weak Scaling of the Parallel GEMM
+ *
+ * results.txt derives a 369,004x Amdahl limit from Callgrind instruction
+ * counts; this benchmark measures what matmul_parallel() actually does on
+ * 1 .. P cores:
+ *   strong  fixed N x N x N problem, speedup T(1) / T(p)
+ *   weak    N grows as N0 * p^(1/3) so the flops per core stay constant,
+ *           efficiency = (GFLOP/s at p) / (p * GFLOP/s at 1)
+ *   skinny  fixed m x n x k with small m, n and long k, which only scales
+ *           through the k-split (3D) decomposition
+ * Results are also written as CSV for plot_exercise4_scaling() in
+ * analysis.py.
+ *
+ * Operands are initialized in parallel through common/numa.h (--numa,
+ * first-touch by default) so that on a multi-socket machine A, B and C are
+ * spread over the nodes instead of all sitting behind the memory
+ * controller of the thread that happened to write them; --numa serial
+ * restores single-threaded initialization.
+ *
+ * --placement pins every pool by a common/topology.h policy (unpinned by
+ * default); the thread counts stop at what the policy can place.
+ *
+ * Usage: ./exercise4_scaling [--threads P] [--n N] [--weak-n N0]
+ *                            [--skinny m,n,k] [--csv FILE]
+ *                            [--numa serial|first-touch|interleave|bind]
+ *                            [--placement none|compact|scatter|one-per-core|one-per-l3]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "timing.h"
+#include "threadpool.h"
+#include "numa.h"
+#include "matmul.h"
+
+// Configuration
+#define DEFAULT_STRONG_N 2048
+#define DEFAULT_WEAK_N   1024
+#define REPEATS          3
+#define MAX_POINTS       64
+#define INIT_CHUNKS      4     // Initialization chunks per thread
+
+typedef struct {
+    const char *experiment;
+    int threads, m, n, k;
+    double seconds, gflops, speedup, efficiency;
+    long stolen;
+} scaling_point_t;
+
+// Operand placement: policy and the pool that performs the initialization
+static numa_policy_t init_policy = NUMA_FIRST_TOUCH;
+static threadpool_t *init_pool;
+
+// Worker placement of every pool
+static topology_policy_t placement = TOPOLOGY_NONE;
+
+// Element i depends only on (seed, i), so any chunking fills the same values
+static void fill_random(void *arg, void *buf, long begin, long end) {
+    const unsigned long seed = *(const unsigned *)arg;
+    double *X = buf;
+    for (long i = begin; i < end; i++) {
+        unsigned long h = (seed << 32 | (unsigned long)i) * 0x9e3779b97f4a7c15ul;
+        h ^= h >> 29;
+        h *= 0xbf58476d1ce4e5b9ul;
+        h ^= h >> 32;
+        X[i] = (double)(h >> 11) / 9007199254740992.0 - 0.5;
+    }
+}
+
+static void fill_zero(void *arg, void *buf, long begin, long end) {
+    double *X = buf;
+    (void)arg;
+    for (long i = begin; i < end; i++) X[i] = 0.0;
+}
+
+// seed 0: zero-filled output matrix
+static double *alloc_matrix(int rows, int cols, unsigned seed) {
+    return numa_alloc_init((long)rows * cols + 8, sizeof(double),
+                           threadpool_size(init_pool) * INIT_CHUNKS, init_policy, init_pool,
+                           seed ? fill_random : fill_zero, &seed, NULL);
+}
+
+static void free_matrix(double *X, int rows, int cols) {
+    numa_free(X, (long)rows * cols + 8, sizeof(double));
+}
+
+// Best-of-REPEATS seconds for one matmul_parallel() call on p threads
+static double time_parallel(int p, int m, int n, int k, const double *A, const double *B,
+                            double *C, const matmul_tiles_t *t, long *stolen) {
+    threadpool_t *pool = threadpool_create_placed(p, placement);
+    double best = 1e30;
+    for (int r = 0; r < REPEATS; r++) {
+        double start = get_time_ns();
+        matmul_parallel(m, n, k, A, k, 1, B, n, 1, C, n, t, pool);
+        double elapsed = (get_time_ns() - start) / 1e9;
+        if (elapsed < best) best = elapsed;
+    }
+    tp_stats_t st;
+    threadpool_stats(pool, &st);
+    *stolen = st.stolen;
+    threadpool_destroy(pool);
+    return best;
+}
+
+// 1, 2, 4, ... and max_threads itself
+static int thread_counts(int max_threads, int *out) {
+    int count = 0;
+    for (int p = 1; p < max_threads; p *= 2) out[count++] = p;
+    out[count++] = max_threads;
+    return count;
+}
+
+static void print_header(const char *title) {
+    printf("\n%s\n", title);
+    printf("%8s %18s %10s %10s %10s %11s %8s\n",
+           "Threads", "Shape (m x n x k)", "Time (s)", "GFLOP/s", "Speedup", "Efficiency", "Stolen");
+    printf("------------------------------------------------------------------------------\n");
+}
+
+static void print_point(const scaling_point_t *pt) {
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%dx%dx%d", pt->m, pt->n, pt->k);
+    printf("%8d %18s %10.3f %10.2f %9.2fx %10.1f%% %8ld\n", pt->threads, shape,
+           pt->seconds, pt->gflops, pt->speedup, 100.0 * pt->efficiency, pt->stolen);
+}
+
+// Strong scaling of a fixed m x n x k problem
+static int run_strong(const char *name, int m, int n, int k, const int *ps, int np,
+                      const matmul_tiles_t *t, scaling_point_t *out) {
+    double *A = alloc_matrix(m, k, 1u), *B = alloc_matrix(k, n, 2u);
+    double *C = alloc_matrix(m, n, 0u);
+    double *Ref = aligned_alloc(64, sizeof(double) * (long)m * n);
+    if (!A || !B || !C || !Ref) {
+        fprintf(stderr, "Failed to allocate %dx%dx%d problem\n", m, n, k);
+        exit(1);
+    }
+    matmul_packed(m, n, k, A, k, B, n, Ref, n, t);
+
+    const double flops = 2.0 * m * n * (double)k;
+    double t1 = 0.0, max_diff = 0.0;
+    for (int i = 0; i < np; i++) {
+        scaling_point_t *pt = &out[i];
+        pt->experiment = name;
+        pt->threads = ps[i];
+        pt->m = m; pt->n = n; pt->k = k;
+        pt->seconds = time_parallel(ps[i], m, n, k, A, B, C, t, &pt->stolen);
+        if (i == 0) t1 = pt->seconds;
+        pt->gflops = flops / pt->seconds / 1e9;
+        pt->speedup = t1 / pt->seconds;
+        pt->efficiency = pt->speedup / ps[i];
+        print_point(pt);
+
+        for (long e = 0; e < (long)m * n; e++) {
+            double d = fabs(C[e] - Ref[e]) / (fabs(Ref[e]) + 1.0);
+            if (d > max_diff) max_diff = d;
+        }
+    }
+    printf("  max relative difference vs single-threaded packed kernel: %.2e\n", max_diff);
+    free_matrix(A, m, k); free_matrix(B, k, n); free_matrix(C, m, n);
+    free(Ref);
+    return np;
+}
+
+// Weak scaling: N(p) = N0 * p^(1/3), rounded to a multiple of 16
+static int run_weak(int n0, const int *ps, int np, const matmul_tiles_t *t,
+                    scaling_point_t *out) {
+    double rate1 = 0.0;
+    int verified = 0;
+    for (int i = 0; i < np; i++) {
+        const int n = ((int)lround(n0 * cbrt((double)ps[i])) + 15) / 16 * 16;
+        double *A = alloc_matrix(n, n, 1u), *B = alloc_matrix(n, n, 2u);
+        double *C = alloc_matrix(n, n, 0u);
+        if (!A || !B || !C) {
+            fprintf(stderr, "Failed to allocate N=%d\n", n);
+            exit(1);
+        }
+        scaling_point_t *pt = &out[i];
+        pt->experiment = "weak";
+        pt->threads = ps[i];
+        pt->m = pt->n = pt->k = n;
+        pt->seconds = time_parallel(ps[i], n, n, n, A, B, C, t, &pt->stolen);
+        pt->gflops = 2.0 * n * n * (double)n / pt->seconds / 1e9;
+        if (i == 0) rate1 = pt->gflops;
+        // Scaled speedup: work done at p relative to one core's rate
+        pt->speedup = pt->gflops / rate1;
+        pt->efficiency = pt->speedup / ps[i];
+        print_point(pt);
+        // No reference at these sizes: Freivalds' O(N^2) check instead
+        matmul_verify_t check;
+        const int ok = matmul_verify(n, n, n, A, n, 1, B, n, 1, C, n, MATMUL_VERIFY_VECTORS,
+                                     (unsigned)ps[i], NULL, &check);
+        if (ok != 1) {
+            printf("  P=%d check ", ps[i]);
+            if (ok < 0) printf("skipped (out of memory)\n");
+            else matmul_verify_print(stdout, &check);
+        }
+        verified += ok == 1;
+        free_matrix(A, n, n); free_matrix(B, n, n); free_matrix(C, n, n);
+    }
+    printf("  Freivalds check: %d of %d products passed\n", verified, np);
+    return np;
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = threadpool_cpu_count();
+    int strong_n = DEFAULT_STRONG_N, weak_n = DEFAULT_WEAK_N;
+    int sm = 256, sn = 256, sk = 65536;
+    const char *csv_path = "scaling.csv";
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--threads") == 0)     max_threads = atoi(val);
+        else if (strcmp(opt, "--n") == 0)      strong_n = atoi(val);
+        else if (strcmp(opt, "--weak-n") == 0) weak_n = atoi(val);
+        else if (strcmp(opt, "--csv") == 0)    csv_path = val;
+        else if (strcmp(opt, "--numa") == 0) {
+            if (numa_parse_policy(val, &init_policy) != 0) {
+                fprintf(stderr, "Unknown NUMA policy '%s'\n", val);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &placement) != 0) {
+                fprintf(stderr, "Unknown placement policy '%s'\n", val);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "--skinny") == 0) {
+            if (sscanf(val, "%d,%d,%d", &sm, &sn, &sk) != 3) {
+                fprintf(stderr, "--skinny expects m,n,k\n");
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (max_threads < 1 || strong_n < 1 || weak_n < 1 || sm < 1 || sn < 1 || sk < 1) {
+        fprintf(stderr, "Sizes and thread count must be positive\n");
+        return 1;
+    }
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    const int requested_threads = max_threads;
+    if (max_threads > topology_max_threads(placement)) max_threads = topology_max_threads(placement);
+    init_pool = threadpool_create_placed(max_threads, placement);
+    if (!init_pool) {
+        fprintf(stderr, "Failed to create the thread pool\n");
+        return 1;
+    }
+
+    int ps[MAX_POINTS];
+    const int np = thread_counts(max_threads, ps);
+    scaling_point_t points[3 * MAX_POINTS];
+    int count = 0;
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Measured Scaling of the Parallel GEMM\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Online CPUs:         %d\n", threadpool_cpu_count());
+    printf("  Max threads:         %d%s\n", max_threads,
+           max_threads < requested_threads ? " (limited by the placement)" : "");
+    printf("  Placement:           %s (", topology_policy_name(placement));
+    topology_describe(stdout);
+    printf(")\n");
+    printf("  Micro-kernel:        %s\n", matmul_packed_isa(NULL, NULL));
+    printf("  Tiles:               mc=%d kc=%d nc=%d\n", tiles.mc, tiles.kc, tiles.nc);
+    printf("  Operand placement:   %s over %d NUMA node(s)\n", numa_policy_name(init_policy),
+           numa_num_nodes());
+
+    print_header("Strong scaling (fixed problem)");
+    count += run_strong("strong", strong_n, strong_n, strong_n, ps, np, &tiles, points + count);
+
+    print_header("Weak scaling (N = N0 * p^(1/3), constant flops per core)");
+    count += run_weak(weak_n, ps, np, &tiles, points + count);
+
+    print_header("Skinny strong scaling (k-split decomposition)");
+    count += run_strong("skinny", sm, sn, sk, ps, np, &tiles, points + count);
+
+    FILE *f = fopen(csv_path, "w");
+    if (!f) {
+        fprintf(stderr, "Cannot write %s\n", csv_path);
+        return 1;
+    }
+    fprintf(f, "experiment,threads,m,n,k,seconds,gflops,speedup,efficiency\n");
+    for (int i = 0; i < count; i++) {
+        const scaling_point_t *pt = &points[i];
+        fprintf(f, "%s,%d,%d,%d,%d,%.6f,%.3f,%.4f,%.4f\n", pt->experiment, pt->threads,
+                pt->m, pt->n, pt->k, pt->seconds, pt->gflops, pt->speedup, pt->efficiency);
+    }
+    fclose(f);
+    printf("\nCSV written to %s\n", csv_path);
+
+    threadpool_destroy(init_pool);
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * Exercise 4: Rectangular and Batched Shape Sweep
+ *
+ * Runs every matmul_gemm() algorithm on runtime-sized matrix_t operands
+ * over a list of M x K x N shapes (square, tall-skinny, short-wide,
+ * long-k, rank-k update and batched small products) in row-major,
+ * column-major and mixed layouts. A batch count > 1 multiplies that many
+ * independent matrices one call at a time.
+ *
+ * Usage: ./exercise4_shapes [--shapes "m,k,n[,batch];..."]
+ *                           [--layout row|col|mixed|all] [--threads P]
+ *                           [--placement none|compact|scatter|one-per-core|one-per-l3]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "timing.h"
+#include "threadpool.h"
+#include "matmul.h"
+
+// Configuration
+#define MAX_SHAPES      32
+#define MIN_TIME_NS     3e8
+#define NAIVE_MAX_FLOPS 2e9     // Skip the i-j-k kernel above this
+
+typedef struct {
+    int m, k, n, batch;
+} shape_t;
+
+static const char *default_shapes =
+    "1024,1024,1024;"    // square
+    "65536,64,64;"       // tall-skinny A
+    "64,64,65536;"       // short-wide B
+    "64,65536,64;"       // long k (inner-product like)
+    "4096,32,4096;"      // rank-32 update
+    "32,32,32,4096";     // batch of small products
+
+typedef struct {
+    const char *name;
+    matrix_layout_t a, b, c;
+} layout_combo_t;
+
+static const layout_combo_t combos[] = {
+    {"row", MATRIX_ROW_MAJOR, MATRIX_ROW_MAJOR, MATRIX_ROW_MAJOR},
+    {"col", MATRIX_COL_MAJOR, MATRIX_COL_MAJOR, MATRIX_COL_MAJOR},
+    {"mixed", MATRIX_ROW_MAJOR, MATRIX_COL_MAJOR, MATRIX_COL_MAJOR},
+};
+
+#define NUM_COMBOS ((int)(sizeof(combos) / sizeof(combos[0])))
+
+static int parse_shapes(const char *s, shape_t *out) {
+    int count = 0;
+    while (*s && count < MAX_SHAPES) {
+        shape_t sh = {0, 0, 0, 1};
+        int used = 0;
+        int got = sscanf(s, "%d,%d,%d%n,%d%n", &sh.m, &sh.k, &sh.n, &used, &sh.batch, &used);
+        if (got < 3 || sh.m < 1 || sh.k < 1 || sh.n < 1 || sh.batch < 1) return -1;
+        out[count++] = sh;
+        s += used;
+        if (*s == ';') s++;
+    }
+    return count;
+}
+
+// Batched operands: batch independent matrices of one shape and layout
+typedef struct {
+    matrix_t *A, *B, *C, *Ref;
+    int batch;
+} operands_t;
+
+static int alloc_operands(operands_t *op, const shape_t *sh, const layout_combo_t *lc) {
+    op->batch = sh->batch;
+    op->A = calloc(sh->batch, sizeof(matrix_t));
+    op->B = calloc(sh->batch, sizeof(matrix_t));
+    op->C = calloc(sh->batch, sizeof(matrix_t));
+    op->Ref = calloc(sh->batch, sizeof(matrix_t));
+    if (!op->A || !op->B || !op->C || !op->Ref) return -1;
+    for (int b = 0; b < sh->batch; b++) {
+        if (matrix_alloc(&op->A[b], sh->m, sh->k, lc->a, 0) ||
+            matrix_alloc(&op->B[b], sh->k, sh->n, lc->b, 0) ||
+            matrix_alloc(&op->C[b], sh->m, sh->n, lc->c, 0) ||
+            matrix_alloc(&op->Ref[b], sh->m, sh->n, lc->c, 0))
+            return -1;
+        matrix_fill_random(&op->A[b], 1u + 2u * b);
+        matrix_fill_random(&op->B[b], 2u + 2u * b);
+    }
+    return 0;
+}
+
+static void free_operands(operands_t *op) {
+    for (int b = 0; b < op->batch; b++) {
+        if (op->A) matrix_free(&op->A[b]);
+        if (op->B) matrix_free(&op->B[b]);
+        if (op->C) matrix_free(&op->C[b]);
+        if (op->Ref) matrix_free(&op->Ref[b]);
+    }
+    free(op->A); free(op->B); free(op->C); free(op->Ref);
+}
+
+// Seconds per full batch (best of repeated runs), or -1 if unsupported
+static double time_algo(matmul_algo_t algo, operands_t *op, matrix_t *dst,
+                        const matmul_tiles_t *t, threadpool_t *pool) {
+    double best = 1e30, spent = 0.0;
+    for (int r = 0; r < 2 || spent < MIN_TIME_NS; r++) {
+        double start = get_time_ns();
+        for (int b = 0; b < op->batch; b++) {
+            if (matmul_gemm(algo, &op->A[b], &op->B[b], &dst[b], t, pool) != 0) return -1.0;
+        }
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best / 1e9;
+}
+
+// max |C - Ref| / (k max|A| max|B|) over the batch
+static double batch_error(const operands_t *op) {
+    double err = 0.0;
+    for (int b = 0; b < op->batch; b++) {
+        const matrix_t *A = &op->A[b], *B = &op->B[b];
+        double ma = 0.0, mb = 0.0, d = 0.0;
+        for (int i = 0; i < A->rows; i++)
+            for (int j = 0; j < A->cols; j++) ma = fmax(ma, fabs(*matrix_at(A, i, j)));
+        for (int i = 0; i < B->rows; i++)
+            for (int j = 0; j < B->cols; j++) mb = fmax(mb, fabs(*matrix_at(B, i, j)));
+        for (int i = 0; i < op->C[b].rows; i++)
+            for (int j = 0; j < op->C[b].cols; j++)
+                d = fmax(d, fabs(*matrix_at(&op->C[b], i, j) - *matrix_at(&op->Ref[b], i, j)));
+        err = fmax(err, d / (A->cols * ma * mb));
+    }
+    return err;
+}
+
+int main(int argc, char *argv[]) {
+    const char *shape_spec = default_shapes;
+    const char *layout = "all";
+    int threads = threadpool_cpu_count();
+    topology_policy_t placement = TOPOLOGY_NONE;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--shapes") == 0)       shape_spec = val;
+        else if (strcmp(opt, "--layout") == 0)  layout = val;
+        else if (strcmp(opt, "--threads") == 0) threads = atoi(val);
+        else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &placement) != 0) {
+                fprintf(stderr, "Unknown placement policy '%s'\n", val);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+
+    shape_t shapes[MAX_SHAPES];
+    const int num_shapes = parse_shapes(shape_spec, shapes);
+    if (num_shapes <= 0) {
+        fprintf(stderr, "Invalid --shapes (expected \"m,k,n[,batch];...\")\n");
+        return 1;
+    }
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    threadpool_t *pool = threadpool_create_placed(threads, placement);
+    if (!pool) {
+        fprintf(stderr, "Placement %s cannot place %d threads\n", topology_policy_name(placement), threads);
+        return 1;
+    }
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Rectangular / Batched Shape Sweep\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Threads (parallel):  %d\n", threadpool_size(pool));
+    printf("  Placement:           %s\n", topology_policy_name(placement));
+    printf("  Micro-kernel:        %s\n", matmul_packed_isa(NULL, NULL));
+    printf("  Layouts (A/B/C):     row = row/row/row, col = col/col/col, mixed = row/col/col\n\n");
+
+    printf("%-22s %-6s", "Shape (MxKxN x batch)", "Layout");
+    for (int a = 0; a < MATMUL_NUM_ALGOS; a++) printf(" %10s", matmul_algo_name((matmul_algo_t)a));
+    printf(" %11s %6s\n", "Rel. error", "Check");
+    printf("%-22s %-6s", "", "");
+    for (int a = 0; a < MATMUL_NUM_ALGOS; a++) printf(" %10s", "GFLOP/s");
+    printf("\n");
+    printf("--------------------------------------------------------------------------------------------------------------\n");
+
+    for (int s = 0; s < num_shapes; s++) {
+        const shape_t *sh = &shapes[s];
+        const double flops = 2.0 * sh->m * (double)sh->k * sh->n * sh->batch;
+
+        for (int c = 0; c < NUM_COMBOS; c++) {
+            const layout_combo_t *lc = &combos[c];
+            if (strcmp(layout, "all") != 0 && strcmp(layout, lc->name) != 0) continue;
+
+            operands_t op = {0};
+            if (alloc_operands(&op, sh, lc) != 0) {
+                fprintf(stderr, "Failed to allocate %dx%dx%d x %d\n", sh->m, sh->k, sh->n, sh->batch);
+                free_operands(&op);
+                continue;
+            }
+
+            // Reference: the naive kernel when affordable, else the packed one
+            const int have_naive = flops <= NAIVE_MAX_FLOPS;
+            double secs[MATMUL_NUM_ALGOS];
+            for (int a = 0; a < MATMUL_NUM_ALGOS; a++) secs[a] = -1.0;
+            if (have_naive) secs[MATMUL_NAIVE] = time_algo(MATMUL_NAIVE, &op, op.Ref, &tiles, pool);
+            else            time_algo(MATMUL_PACKED, &op, op.Ref, &tiles, pool);
+
+            double err = 0.0;
+            for (int a = MATMUL_BLOCKED; a < MATMUL_NUM_ALGOS; a++) {
+                secs[a] = time_algo((matmul_algo_t)a, &op, op.C, &tiles, pool);
+                if (secs[a] > 0.0) err = fmax(err, batch_error(&op));
+            }
+
+            char label[48];
+            if (sh->batch > 1) snprintf(label, sizeof(label), "%dx%dx%d x %d", sh->m, sh->k, sh->n, sh->batch);
+            else               snprintf(label, sizeof(label), "%dx%dx%d", sh->m, sh->k, sh->n);
+            printf("%-22s %-6s", label, lc->name);
+            for (int a = 0; a < MATMUL_NUM_ALGOS; a++) {
+                if (secs[a] > 0.0) printf(" %10.2f", flops / secs[a] / 1e9);
+                else               printf(" %10s", a == MATMUL_NAIVE ? "skipped" : "n/a");
+            }
+            printf(" %11.2e %6s\n", err, err <= 2.0 * sh->k * DBL_EPSILON ? "OK" : "FAIL");
+            fflush(stdout);
+
+            free_operands(&op);
+        }
+    }
+    printf("--------------------------------------------------------------------------------------------------------------\n");
+    printf("n/a: blocked and strassen need row-major A and B. Reference is the naive kernel,\n");
+    printf("or the packed kernel when naive is skipped (> %.0e flops).\n", NAIVE_MAX_FLOPS);
+
+    threadpool_destroy(pool);
+    return 0;
+}
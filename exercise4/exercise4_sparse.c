@@ -0,0 +1,353 @@
+/*
+ * Exercise 4: Sparse vs Dense GEMM Density Sweep
+ *
+ * A (m x k) with a given fraction of nonzeros times a dense B (k x n).
+ * The dense kernels (blocked and packed on one thread, parallel on the
+ * pool) cost the same at every density and are timed once; CSR and BSR
+ * SpMM are timed per density on one thread and on the pool. The sweep
+ * ends with the crossover: the density at which the best sparse format
+ * stops beating the dense kernel, log-interpolated between the sampled
+ * densities. A second table repeats the sweep for SpMV (n = 1) against a
+ * dense matrix-vector product.
+ *
+ * --pattern random scatters single nonzeros; --pattern blocks places
+ * whole aligned block x block groups, the structure BSR is built for.
+ *
+ * Usage: ./exercise4_sparse [--m M] [--k K] [--n N] [--densities d1,d2,...]
+ *                           [--block B] [--pattern random|blocks] [--threads P]
+ *                           [--placement none|compact|scatter|one-per-core|one-per-l3]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "timing.h"
+#include "threadpool.h"
+#include "matmul.h"
+#include "sparse.h"
+
+// Configuration
+#define DEFAULT_M     2048
+#define DEFAULT_K     2048
+#define DEFAULT_N     256
+#define DEFAULT_BLOCK 4
+#define MAX_DENSITIES 32
+#define MIN_REPEATS   3
+#define MIN_TIME_NS   2e8
+
+static const double default_densities[] = {0.001, 0.002, 0.005, 0.01, 0.02, 0.05,
+                                           0.1, 0.2, 0.3, 0.5, 0.7, 1.0};
+
+typedef enum {
+    KERNEL_CSR,
+    KERNEL_BSR,
+    KERNEL_CSR_POOL,
+    KERNEL_BSR_POOL,
+    NUM_SPARSE
+} sparse_kernel_t;
+
+typedef struct {
+    sparse_kernel_t kernel;
+    const sparse_csr_t *csr;
+    const sparse_bsr_t *bsr;
+    int n;                       // 0: SpMV
+    const double *B;
+    double *C;
+    threadpool_t *pool;
+} sparse_run_t;
+
+static void run_sparse(const sparse_run_t *r) {
+    threadpool_t *pool = (r->kernel == KERNEL_CSR_POOL || r->kernel == KERNEL_BSR_POOL) ? r->pool : NULL;
+    const int csr = (r->kernel == KERNEL_CSR || r->kernel == KERNEL_CSR_POOL);
+    if (r->n == 0) {
+        if (csr) sparse_csr_spmv(r->csr, r->B, r->C, pool);
+        else     sparse_bsr_spmv(r->bsr, r->B, r->C, pool);
+    } else {
+        if (csr) sparse_csr_spmm(r->csr, r->n, r->B, r->n, r->C, r->n, pool);
+        else     sparse_bsr_spmm(r->bsr, r->n, r->B, r->n, r->C, r->n, pool);
+    }
+}
+
+static double time_sparse(const sparse_run_t *r) {
+    double best = 1e30, spent = 0.0;
+    for (int rep = 0; rep < MIN_REPEATS || spent < MIN_TIME_NS; rep++) {
+        double start = get_time_ns();
+        run_sparse(r);
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best / 1e9;
+}
+
+static double time_dense(matmul_algo_t algo, const matrix_t *A, const matrix_t *B, matrix_t *C,
+                         const matmul_tiles_t *t, threadpool_t *pool) {
+    double best = 1e30, spent = 0.0;
+    for (int rep = 0; rep < MIN_REPEATS || spent < MIN_TIME_NS; rep++) {
+        double start = get_time_ns();
+        matmul_gemm(algo, A, B, C, t, pool);
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best / 1e9;
+}
+
+// Four partial sums so the dot product is not bound by the add latency
+static void dense_matvec(const matrix_t *A, const double *x, double *y) {
+    for (int i = 0; i < A->rows; i++) {
+        const double *a = A->data + (long)i * A->ld;
+        double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+        int j = 0;
+        for (; j + 4 <= A->cols; j += 4) {
+            s0 += a[j] * x[j];
+            s1 += a[j + 1] * x[j + 1];
+            s2 += a[j + 2] * x[j + 2];
+            s3 += a[j + 3] * x[j + 3];
+        }
+        for (; j < A->cols; j++) s0 += a[j] * x[j];
+        y[i] = (s0 + s1) + (s2 + s3);
+    }
+}
+
+static double time_matvec(const matrix_t *A, const double *x, double *y) {
+    double best = 1e30, spent = 0.0;
+    for (int rep = 0; rep < MIN_REPEATS || spent < MIN_TIME_NS; rep++) {
+        double start = get_time_ns();
+        dense_matvec(A, x, y);
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best / 1e9;
+}
+
+// Zero A, then place nonzeros with probability d per element, or per
+// aligned block x block group for the blocks pattern
+static void fill_sparse(matrix_t *A, double d, int block, int blocks, unsigned seed) {
+    const int g = blocks ? block : 1;
+    matrix_fill_zero(A);
+    for (int I = 0; I < A->rows; I += g) {
+        for (int J = 0; J < A->cols; J += g) {
+            seed = seed * 1103515245u + 12345u;
+            if ((seed >> 8 & 0xffffff) >= d * 16777216.0) continue;
+            for (int i = I; i < I + g && i < A->rows; i++) {
+                for (int j = J; j < J + g && j < A->cols; j++) {
+                    seed = seed * 1103515245u + 12345u;
+                    const double v = (double)(seed >> 8 & 0xffffff) / 16777216.0 - 0.5;
+                    A->data[(long)i * A->ld + j] = v != 0.0 ? v : 0.25;
+                }
+            }
+        }
+    }
+}
+
+static double max_abs(const double *x, long count) {
+    double m = 0.0;
+    for (long i = 0; i < count; i++) m = fmax(m, fabs(x[i]));
+    return m;
+}
+
+static double max_diff(const double *x, const double *y, long count) {
+    double m = 0.0;
+    for (long i = 0; i < count; i++) m = fmax(m, fabs(x[i] - y[i]));
+    return m;
+}
+
+// Density where dense / sparse time crosses 1, log-interpolated between
+// the last sampled density where sparse wins and the first where it
+// loses; 0 if sparse loses everywhere, -1 if it never loses
+static double crossover(const double *dens, const double *ratio, int count) {
+    for (int d = 0; d < count; d++) {
+        if (ratio[d] >= 1.0) continue;
+        if (d == 0) return 0.0;
+        const double t = log(ratio[d - 1]) / (log(ratio[d - 1]) - log(ratio[d]));
+        return exp(log(dens[d - 1]) + t * (log(dens[d]) - log(dens[d - 1])));
+    }
+    return -1.0;
+}
+
+static void print_crossover(const char *what, double c, const double *dens, int count) {
+    printf("  %-34s", what);
+    if (c == 0.0)       printf("below %.4g (dense wins at every sampled density)\n", dens[0]);
+    else if (c < 0.0)   printf("above %.4g (sparse wins at every sampled density)\n", dens[count - 1]);
+    else                printf("%.4g  (%.2f%% nonzeros)\n", c, 100.0 * c);
+}
+
+static int parse_densities(const char *s, double *dens) {
+    int count = 0;
+    while (*s && count < MAX_DENSITIES) {
+        dens[count++] = strtod(s, (char **)&s);
+        if (*s == ',') s++;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    int m = DEFAULT_M, k = DEFAULT_K, n = DEFAULT_N, block = DEFAULT_BLOCK, blocks = 0;
+    int threads = threadpool_cpu_count();
+    topology_policy_t placement = TOPOLOGY_NONE;
+    double dens[MAX_DENSITIES];
+    int num_dens = (int)(sizeof(default_densities) / sizeof(default_densities[0]));
+    memcpy(dens, default_densities, sizeof(default_densities));
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--m") == 0)              m = atoi(val);
+        else if (strcmp(opt, "--k") == 0)         k = atoi(val);
+        else if (strcmp(opt, "--n") == 0)         n = atoi(val);
+        else if (strcmp(opt, "--densities") == 0) num_dens = parse_densities(val, dens);
+        else if (strcmp(opt, "--block") == 0)     block = atoi(val);
+        else if (strcmp(opt, "--pattern") == 0)   blocks = strcmp(val, "blocks") == 0;
+        else if (strcmp(opt, "--threads") == 0)   threads = atoi(val);
+        else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &placement) != 0) {
+                fprintf(stderr, "Unknown placement policy '%s'\n", val);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (m < 1 || k < 1 || n < 1 || block < 1 || block > SPARSE_MAX_BLOCK || num_dens < 1) {
+        fprintf(stderr, "Sizes must be positive and the block at most %d\n", SPARSE_MAX_BLOCK);
+        return 1;
+    }
+    for (int d = 1; d < num_dens; d++) {
+        if (dens[d] <= dens[d - 1]) {
+            fprintf(stderr, "Densities must be increasing\n");
+            return 1;
+        }
+    }
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    threadpool_t *pool = threadpool_create_placed(threads, placement);
+    if (!pool) {
+        fprintf(stderr, "Placement %s cannot place %d threads\n", topology_policy_name(placement), threads);
+        return 1;
+    }
+
+    matrix_t A, B, C, Ref;
+    const long mn = (long)m * n;
+    double *x = malloc(sizeof(double) * k), *y = malloc(sizeof(double) * m);
+    double *yref = malloc(sizeof(double) * m);
+    if (matrix_alloc(&A, m, k, MATRIX_ROW_MAJOR, 0) || matrix_alloc(&B, k, n, MATRIX_ROW_MAJOR, 0) ||
+        matrix_alloc(&C, m, n, MATRIX_ROW_MAJOR, 0) || matrix_alloc(&Ref, m, n, MATRIX_ROW_MAJOR, 0) ||
+        !x || !y || !yref) {
+        fprintf(stderr, "Failed to allocate %d x %d x %d\n", m, k, n);
+        return 1;
+    }
+    matrix_fill_random(&B, 2u);
+    for (int j = 0; j < k; j++) x[j] = B.data[j];
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Sparse (CSR / BSR) vs Dense GEMM\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Shape (M x K x N):   %d x %d x %d\n", m, k, n);
+    printf("  Pattern:             %s\n", blocks ? "aligned blocks" : "random entries");
+    printf("  BSR block:           %d x %d\n", block, block);
+    printf("  Threads (pool):      %d\n", threadpool_size(pool));
+    printf("  Placement:           %s\n", topology_policy_name(placement));
+    printf("  Sparse kernels:      %s\n\n", sparse_isa());
+
+    // Dense cost does not depend on the values, so time it once
+    fill_sparse(&A, 0.5, block, blocks, 1u);
+    const double t_blocked = time_dense(MATMUL_BLOCKED, &A, &B, &C, &tiles, pool);
+    const double t_packed = time_dense(MATMUL_PACKED, &A, &B, &C, &tiles, pool);
+    const double t_parallel = time_dense(MATMUL_PARALLEL, &A, &B, &C, &tiles, pool);
+    const double t_matvec = time_matvec(&A, x, y);
+    const double flops = 2.0 * m * (double)k * n;
+    printf("Dense SpMM baselines: blocked %.2f ms (%.1f GFLOP/s), packed %.2f ms, parallel %.2f ms\n",
+           t_blocked * 1e3, flops / t_blocked / 1e9, t_packed * 1e3, t_parallel * 1e3);
+    printf("Dense matvec baseline: %.3f ms\n\n", t_matvec * 1e3);
+
+    printf("SpMM C = A * B\n");
+    printf("%9s %9s %8s %10s %10s %10s %10s %10s %10s %10s %6s\n", "Density", "nnz (%)", "BSR fill",
+           "CSR (ms)", "BSR (ms)", "CSR pool", "BSR pool", "vs blocked", "vs packed", "vs parall.",
+           "Check");
+    printf("-----------------------------------------------------------------------------------------------------------\n");
+
+    double ratio_1t[MAX_DENSITIES], ratio_packed[MAX_DENSITIES], ratio_pool[MAX_DENSITIES];
+    double spmv[MAX_DENSITIES][NUM_SPARSE], spmv_err[MAX_DENSITIES];
+    for (int d = 0; d < num_dens; d++) {
+        fill_sparse(&A, dens[d], block, blocks, 1u);
+        sparse_csr_t csr;
+        sparse_bsr_t bsr;
+        if (sparse_csr_from_dense(&csr, &A) || sparse_bsr_from_dense(&bsr, &A, block)) {
+            fprintf(stderr, "Failed to convert density %g\n", dens[d]);
+            return 1;
+        }
+        matmul_gemm(MATMUL_PACKED, &A, &B, &Ref, &tiles, pool);
+        dense_matvec(&A, x, yref);
+        const double scale = k * fmax(max_abs(A.data, (long)m * k), DBL_MIN) * max_abs(B.data, (long)k * n);
+
+        double t[NUM_SPARSE], err = 0.0, verr = 0.0;
+        for (int s = 0; s < NUM_SPARSE; s++) {
+            sparse_run_t r = {(sparse_kernel_t)s, &csr, &bsr, n, B.data, C.data, pool};
+            memset(C.data, 0, sizeof(double) * mn);
+            t[s] = time_sparse(&r);
+            err = fmax(err, max_diff(C.data, Ref.data, mn) / scale);
+
+            sparse_run_t v = {(sparse_kernel_t)s, &csr, &bsr, 0, x, y, pool};
+            spmv[d][s] = time_sparse(&v);
+            verr = fmax(verr, max_diff(y, yref, m) / scale);
+        }
+        spmv_err[d] = verr;
+        ratio_1t[d] = t_blocked / fmin(t[KERNEL_CSR], t[KERNEL_BSR]);
+        ratio_packed[d] = t_packed / fmin(t[KERNEL_CSR], t[KERNEL_BSR]);
+        ratio_pool[d] = t_parallel / fmin(t[KERNEL_CSR_POOL], t[KERNEL_BSR_POOL]);
+
+        printf("%9.4g %9.3f %8.2f %10.3f %10.3f %10.3f %10.3f %9.2fx %9.2fx %9.2fx %6s\n", dens[d],
+               100.0 * csr.nnz / ((double)m * k),
+               csr.nnz ? (double)bsr.nnzb * block * block / csr.nnz : 0.0,
+               t[KERNEL_CSR] * 1e3, t[KERNEL_BSR] * 1e3, t[KERNEL_CSR_POOL] * 1e3,
+               t[KERNEL_BSR_POOL] * 1e3, ratio_1t[d], ratio_packed[d], ratio_pool[d],
+               err <= 2.0 * k * DBL_EPSILON ? "OK" : "FAIL");
+        fflush(stdout);
+        sparse_csr_free(&csr);
+        sparse_bsr_free(&bsr);
+    }
+    printf("-----------------------------------------------------------------------------------------------------------\n");
+    printf("vs blocked / packed: single-thread dense time / best single-thread sparse time;\n");
+    printf("vs parall.: parallel dense time / best pool sparse time. BSR fill = stored / nonzero entries.\n\n");
+
+    printf("SpMV y = A * x\n");
+    printf("%9s %10s %10s %10s %10s %10s %6s\n", "Density", "CSR (us)", "BSR (us)", "CSR pool",
+           "BSR pool", "vs dense", "Check");
+    printf("---------------------------------------------------------------------\n");
+    double ratio_mv[MAX_DENSITIES];
+    for (int d = 0; d < num_dens; d++) {
+        ratio_mv[d] = t_matvec / fmin(spmv[d][KERNEL_CSR], spmv[d][KERNEL_BSR]);
+        printf("%9.4g %10.2f %10.2f %10.2f %10.2f %9.2fx %6s\n", dens[d], spmv[d][0] * 1e6,
+               spmv[d][1] * 1e6, spmv[d][2] * 1e6, spmv[d][3] * 1e6, ratio_mv[d],
+               spmv_err[d] <= 2.0 * k * DBL_EPSILON ? "OK" : "FAIL");
+    }
+    printf("---------------------------------------------------------------------\n");
+    printf("vs dense: dense matvec time / best single-thread sparse time.\n\n");
+
+    printf("Crossover density (sparse stops winning):\n");
+    print_crossover("SpMM, 1 thread vs blocked:", crossover(dens, ratio_1t, num_dens), dens, num_dens);
+    print_crossover("SpMM, 1 thread vs packed:", crossover(dens, ratio_packed, num_dens), dens, num_dens);
+    print_crossover("SpMM, pool vs parallel dense:", crossover(dens, ratio_pool, num_dens), dens, num_dens);
+    print_crossover("SpMV vs dense matvec:", crossover(dens, ratio_mv, num_dens), dens, num_dens);
+
+    free(x); free(y); free(yref);
+    matrix_free(&A); matrix_free(&B); matrix_free(&C); matrix_free(&Ref);
+    threadpool_destroy(pool);
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * Exercise 4: Recursive and Strassen-Winograd GEMM for Large N
+ *
+ * Compares the classical packed GEMM (parallel, same thread pool) against
+ * the cache-oblivious recursive kernel and Strassen-Winograd at several
+ * cutovers. Rates are GFLOP/s-equivalent, i.e. 2*N^3 / time whatever the
+ * algorithm actually executes, so a Strassen rate above the classical one
+ * means the reduced flop count paid for the extra additions and memory
+ * traffic. Errors are measured against the classical product.
+ *
+ * Usage: ./exercise4_strassen [--sizes 1024,2048,...] [--cutover 256,512,...]
+ *                             [--threads P]
+ *                             [--placement none|compact|scatter|one-per-core|one-per-l3]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "timing.h"
+#include "threadpool.h"
+#include "matmul.h"
+
+// Configuration
+#define MAX_LIST     16
+#define MIN_REPEATS  2       // Timed runs per mode at least ...
+#define MIN_TIME_NS  1e9     // ... and until this much time was spent
+
+static const int default_sizes[] = {1024, 2048, 4096};
+static const int default_cutovers[] = {128, 256, 512, 1024};
+
+typedef enum { MODE_CLASSICAL, MODE_RECURSIVE, MODE_STRASSEN } gemm_mode_t;
+
+static const char *mode_names[] = {"classical", "recursive", "strassen"};
+
+// Full 53-bit mantissas (matrix_random_next): with short dyadic inputs
+// every product is exact and both algorithms would report zero error
+static double *alloc_matrix(int n, unsigned long long seed) {
+    double *X = aligned_alloc(64, sizeof(double) * (long)n * n);
+    if (!X) return NULL;
+    for (long i = 0; i < (long)n * n; i++) X[i] = matrix_random_next(&seed);
+    return X;
+}
+
+static void run_mode(gemm_mode_t mode, int n, const double *A, const double *B, double *C,
+                     const matmul_tiles_t *t, threadpool_t *pool) {
+    switch (mode) {
+        case MODE_CLASSICAL: matmul_parallel(n, n, n, A, n, 1, B, n, 1, C, n, t, pool); break;
+        case MODE_RECURSIVE: matmul_recursive(n, n, n, A, n, 1, B, n, 1, C, n); break;
+        case MODE_STRASSEN:  matmul_strassen(n, n, n, A, n, B, n, C, n, t, pool); break;
+    }
+}
+
+// Best-of-repeats wall time in seconds
+static double time_mode(gemm_mode_t mode, int n, const double *A, const double *B, double *C,
+                        const matmul_tiles_t *t, threadpool_t *pool) {
+    double best = 1e30, spent = 0.0;
+    for (int r = 0; r < MIN_REPEATS || spent < MIN_TIME_NS; r++) {
+        double start = get_time_ns();
+        run_mode(mode, n, A, B, C, t, pool);
+        double elapsed = get_time_ns() - start;
+        spent += elapsed;
+        if (elapsed < best) best = elapsed;
+    }
+    return best / 1e9;
+}
+
+// max |C - Ref| / (n * max|A| * max|B|), as in exercise4_bench.c
+static double rel_error(int n, const double *C, const double *Ref, double scale) {
+    double err = 0.0;
+    for (long i = 0; i < (long)n * n; i++) {
+        double d = fabs(C[i] - Ref[i]);
+        if (d > err) err = d;
+    }
+    return err / (n * scale);
+}
+
+static int parse_list(const char *s, int *out) {
+    int count = 0;
+    while (*s && count < MAX_LIST) {
+        out[count++] = (int)strtol(s, (char **)&s, 10);
+        if (*s == ',') s++;
+    }
+    return count;
+}
+
+static void print_row(int n, gemm_mode_t mode, int cutover, double secs, double classical_secs,
+                      double err) {
+    char cut[16] = "-";
+    if (mode == MODE_STRASSEN) snprintf(cut, sizeof(cut), "%d", cutover);
+    printf("%6d %-10s %8s %10.3f %12.2f %9.2fx %11.2e\n", n, mode_names[mode], cut, secs,
+           2.0 * n * n * (double)n / secs / 1e9, classical_secs / secs, err);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    int sizes[MAX_LIST], cutovers[MAX_LIST];
+    int num_sizes = (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    int num_cutovers = (int)(sizeof(default_cutovers) / sizeof(default_cutovers[0]));
+    memcpy(sizes, default_sizes, sizeof(default_sizes));
+    memcpy(cutovers, default_cutovers, sizeof(default_cutovers));
+    int threads = threadpool_cpu_count();
+    topology_policy_t placement = TOPOLOGY_NONE;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--sizes") == 0)        num_sizes = parse_list(val, sizes);
+        else if (strcmp(opt, "--cutover") == 0) num_cutovers = parse_list(val, cutovers);
+        else if (strcmp(opt, "--threads") == 0) threads = atoi(val);
+        else if (strcmp(opt, "--placement") == 0) {
+            if (topology_parse_policy(val, &placement) != 0) {
+                fprintf(stderr, "Unknown placement policy '%s'\n", val);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+    threadpool_t *pool = threadpool_create_placed(threads, placement);
+    if (!pool) {
+        fprintf(stderr, "Placement %s cannot place %d threads\n", topology_policy_name(placement), threads);
+        return 1;
+    }
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Recursive and Strassen-Winograd GEMM\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Threads:             %d (classical and strassen)\n", threadpool_size(pool));
+    printf("  Placement:           %s\n", topology_policy_name(placement));
+    printf("  Micro-kernel:        %s\n", matmul_packed_isa(NULL, NULL));
+    printf("  Tiles:               mc=%d kc=%d nc=%d\n\n", tiles.mc, tiles.kc, tiles.nc);
+
+    printf("%6s %-10s %8s %10s %12s %10s %11s\n",
+           "N", "Mode", "Cutover", "Time (s)", "GFLOP/s-eq", "vs class.", "Rel. error");
+    printf("-----------------------------------------------------------------------------\n");
+
+    for (int s = 0; s < num_sizes; s++) {
+        const int n = sizes[s];
+        if (n < 1) continue;
+        double *A = alloc_matrix(n, 1u), *B = alloc_matrix(n, 2u);
+        double *C = aligned_alloc(64, sizeof(double) * (long)n * n);
+        double *Ref = aligned_alloc(64, sizeof(double) * (long)n * n);
+        if (!A || !B || !C || !Ref) {
+            fprintf(stderr, "Failed to allocate N=%d\n", n);
+            free(A); free(B); free(C); free(Ref);
+            continue;
+        }
+        double ma = 0.0, mb = 0.0;
+        for (long i = 0; i < (long)n * n; i++) {
+            ma = fmax(ma, fabs(A[i]));
+            mb = fmax(mb, fabs(B[i]));
+        }
+
+        const double classical = time_mode(MODE_CLASSICAL, n, A, B, Ref, &tiles, pool);
+        print_row(n, MODE_CLASSICAL, 0, classical, classical, 0.0);
+
+        double secs = time_mode(MODE_RECURSIVE, n, A, B, C, &tiles, pool);
+        print_row(n, MODE_RECURSIVE, 0, secs, classical, rel_error(n, C, Ref, ma * mb));
+
+        for (int c = 0; c < num_cutovers; c++) {
+            tiles.strassen_cutover = cutovers[c];
+            secs = time_mode(MODE_STRASSEN, n, A, B, C, &tiles, pool);
+            print_row(n, MODE_STRASSEN, cutovers[c], secs, classical,
+                      rel_error(n, C, Ref, ma * mb));
+        }
+        printf("\n");
+        free(A); free(B); free(C); free(Ref);
+    }
+    printf("-----------------------------------------------------------------------------\n");
+    printf("GFLOP/s-eq = 2*N^3 / time. Classical error bound is ~2*N*eps (%.1e at N=%d);\n",
+           2.0 * sizes[num_sizes - 1] * DBL_EPSILON, sizes[num_sizes - 1]);
+    printf("Strassen-Winograd loses a few more bits per recursion level.\n");
+
+    threadpool_destroy(pool);
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Exercise 4: Distributed SUMMA Benchmark
+ *
+ * Runs matmul_summa() on P local worker processes (near-square pr x pc
+ * grid) with panel broadcasts through shared memory, with and without
+ * lookahead, and reports for every run:
+ *   - SUMMA time (slowest rank, fork / scatter / gather excluded) and the
+ *     wall time of the whole call, GFLOP/s and speedup over the first P
+ *   - per rank: local GEMM time vs time spent sending and receiving
+ *     panels, and the bytes moved
+ * Gustafson's scaled speedup treats the parallel part as free of
+ * overhead; the send / recv columns are the part it leaves out, and they
+ * grow with P while the per-rank compute shrinks.
+ *
+ * Usage: ./exercise4_summa [--n N] [--procs 1,2,4,...] [--panel W]
+ *                          [--lookahead 0,1,...]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "timing.h"
+#include "threadpool.h"
+#include "matmul.h"
+
+// Configuration
+#define DEFAULT_N   2048
+#define MAX_LIST    16
+#define MAX_PROCS   256
+#define MIN_REPEATS 2
+
+static const int default_procs[] = {1, 2, 4, 8};
+static const int default_lookahead[] = {0, 1};
+
+typedef struct {
+    double wall, summa;                 // Seconds
+    matmul_summa_rank_t ranks[MAX_PROCS];
+} summa_result_t;
+
+static int parse_list(const char *s, int *out) {
+    int count = 0;
+    while (*s && count < MAX_LIST) {
+        out[count++] = (int)strtol(s, (char **)&s, 10);
+        if (*s == ',') s++;
+    }
+    return count;
+}
+
+// Best of MIN_REPEATS runs by SUMMA time (slowest rank)
+static int run_summa(int n, const double *A, const double *B, double *C,
+                     const matmul_summa_grid_t *g, const matmul_tiles_t *t, summa_result_t *res) {
+    static matmul_summa_rank_t ranks[MAX_PROCS];
+    const int P = g->pr * g->pc;
+    res->summa = 1e30;
+    for (int r = 0; r < MIN_REPEATS; r++) {
+        double start = get_time_ns();
+        if (matmul_summa(n, n, n, A, n, B, n, C, n, g, t, ranks) != 0) return -1;
+        const double wall = (get_time_ns() - start) / 1e9;
+        double slowest = 0.0;
+        for (int p = 0; p < P; p++) slowest = fmax(slowest, ranks[p].total);
+        if (slowest < res->summa) {
+            res->summa = slowest;
+            res->wall = wall;
+            memcpy(res->ranks, ranks, sizeof(matmul_summa_rank_t) * P);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int n = DEFAULT_N, panel = 0;
+    int procs[MAX_LIST], lookahead[MAX_LIST];
+    int num_procs = (int)(sizeof(default_procs) / sizeof(default_procs[0]));
+    int num_la = (int)(sizeof(default_lookahead) / sizeof(default_lookahead[0]));
+    memcpy(procs, default_procs, sizeof(default_procs));
+    memcpy(lookahead, default_lookahead, sizeof(default_lookahead));
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--n") == 0)              n = atoi(val);
+        else if (strcmp(opt, "--procs") == 0)     num_procs = parse_list(val, procs);
+        else if (strcmp(opt, "--panel") == 0)     panel = atoi(val);
+        else if (strcmp(opt, "--lookahead") == 0) num_la = parse_list(val, lookahead);
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (n < 1 || panel < 0) {
+        fprintf(stderr, "N must be positive\n");
+        return 1;
+    }
+
+    init_timing();
+    matmul_tiles_t tiles;
+    matmul_default_tiles(&tiles);
+
+    const long nn = (long)n * n;
+    double *A = aligned_alloc(64, sizeof(double) * nn), *B = aligned_alloc(64, sizeof(double) * nn);
+    double *C = aligned_alloc(64, sizeof(double) * nn), *Ref = aligned_alloc(64, sizeof(double) * nn);
+    if (!A || !B || !C || !Ref) {
+        fprintf(stderr, "Failed to allocate N=%d\n", n);
+        return 1;
+    }
+    unsigned seed = 12345u;
+    for (long e = 0; e < nn; e++) {
+        seed = seed * 1103515245u + 12345u;
+        A[e] = (double)(seed >> 8 & 0xffffff) / 16777216.0 - 0.5;
+        seed = seed * 1103515245u + 12345u;
+        B[e] = (double)(seed >> 8 & 0xffffff) / 16777216.0 - 0.5;
+    }
+    matmul_packed(n, n, n, A, n, B, n, Ref, n, &tiles);
+    const double flops = 2.0 * n * n * (double)n;
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Distributed SUMMA over Shared Memory\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Matrix size:         %d x %d\n", n, n);
+    printf("  Online CPUs:         %d\n", threadpool_cpu_count());
+    printf("  Micro-kernel:        %s (one thread per rank)\n", matmul_packed_isa(NULL, NULL));
+    printf("  Transport:           shared-memory panel rings, one per process row / column\n\n");
+
+    double base[MAX_LIST];
+    for (int l = 0; l < num_la; l++) base[l] = 0.0;
+
+    for (int p = 0; p < num_procs; p++) {
+        if (procs[p] < 1 || procs[p] > MAX_PROCS) continue;
+        for (int l = 0; l < num_la; l++) {
+            matmul_summa_grid_t g;
+            matmul_summa_default_grid(&g, procs[p]);
+            if (panel > 0) g.panel = panel;
+            g.lookahead = lookahead[l] < 0 ? 0 : lookahead[l];
+            const int P = g.pr * g.pc;
+
+            summa_result_t res;
+            if (run_summa(n, A, B, C, &g, &tiles, &res) != 0) {
+                printf("P=%d lookahead %d: failed\n\n", P, g.lookahead);
+                continue;
+            }
+            if (base[l] == 0.0) base[l] = res.summa;
+            double err = 0.0;
+            for (long e = 0; e < nn; e++) err = fmax(err, fabs(C[e] - Ref[e]));
+            err /= n * 0.25;
+
+            double compute = 0.0, comm = 0.0;
+            for (int r = 0; r < P; r++) {
+                compute += res.ranks[r].compute;
+                comm += res.ranks[r].send + res.ranks[r].recv;
+            }
+            printf("P = %d (%d x %d grid), panel %d, lookahead %d: SUMMA %.3f s, wall %.3f s, "
+                   "%.2f GFLOP/s, speedup %.2fx, comm %.1f%%, %s\n",
+                   P, g.pr, g.pc, g.panel, g.lookahead, res.summa, res.wall, flops / res.summa / 1e9,
+                   base[l] / res.summa, 100.0 * comm / (compute + comm),
+                   err <= 2.0 * n * DBL_EPSILON ? "OK" : "FAIL");
+            printf("  %5s %7s %11s %10s %10s %10s %7s %9s %9s\n", "Rank", "(i,j)", "Compute(ms)",
+                   "Send (ms)", "Recv (ms)", "Total (ms)", "Comm %", "Sent MB", "Recv MB");
+            for (int r = 0; r < P; r++) {
+                const matmul_summa_rank_t *st = &res.ranks[r];
+                char pos[16];
+                snprintf(pos, sizeof(pos), "(%d,%d)", st->row, st->col);
+                printf("  %5d %7s %11.2f %10.2f %10.2f %10.2f %6.1f%% %9.2f %9.2f\n", r, pos,
+                       st->compute * 1e3, st->send * 1e3, st->recv * 1e3, st->total * 1e3,
+                       st->total > 0.0 ? 100.0 * (st->send + st->recv) / st->total : 0.0,
+                       st->bytes_sent / 1048576.0, st->bytes_recv / 1048576.0);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    printf("SUMMA time is the slowest rank between the start barrier and its last panel;\n");
+    printf("wall adds fork, scatter and gather. Speedup is relative to the first P in\n");
+    printf("--procs (P = 1 by default), per lookahead. Comm = send + recv, waiting included.\n");
+
+    free(A); free(B); free(C); free(Ref);
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Exercise 4: Kernel Auto-Tuner
+ *
+ * The tiles in results.md fit one laptop. This searches, on the host it
+ * runs on and within a time budget:
+ *   - mc / kc / nc of the packed GEMM and nr of the blocked GEMM
+ *     (matmul_tune_tiles(): pruned coordinate search, see matmul_tune.c)
+ *   - the accumulator count of the reduction kernel tuning_sum(), on an
+ *     L2-resident vector where the add latency, not memory, is the limit
+ * and stores the winners in the tuning cache (common/tuning.h) under this
+ * host's CPU model and cache sizes. matmul_default_tiles() and
+ * exercise3_numa read them back at startup, so every benchmark on a
+ * machine with the same key runs tuned without a rebuild.
+ *
+ * Usage: ./exercise4_tune [--n N] [--budget SECONDS] [--file PATH]
+ *                         [--dry-run 1]
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+#include "tuning.h"
+#include "matmul.h"
+
+// Configuration
+#define DEFAULT_N        768
+#define DEFAULT_BUDGET   60.0
+#define SUM_BYTES_OF_L2  4        // Reduction vector = L2 / SUM_BYTES_OF_L2
+#define SUM_REPEATS      200
+
+static const int accumulator_candidates[] = {1, 2, 4, 8, 16};
+
+// Best seconds of one n x n x n product with tiles t
+static double time_gemm(int n, const double *A, const double *B, double *C,
+                        const matmul_tiles_t *t, int blocked) {
+    double best = 1e30, total = 0.0;
+    for (int r = 0; r < 3 || total < 0.2; r++) {
+        double start = get_time_ns();
+        if (blocked) matmul_blocked(n, n, n, A, n, B, n, C, n, t);
+        else matmul_packed(n, n, n, A, n, B, n, C, n, t);
+        const double elapsed = (get_time_ns() - start) / 1e9;
+        if (elapsed < best) best = elapsed;
+        total += elapsed;
+    }
+    return best;
+}
+
+// Accumulator count with the highest in-cache reduction rate
+static int tune_reduction(long n, double *best_gbs) {
+    double *x = malloc(sizeof(double) * n);
+    if (!x) return 1;
+    for (long i = 0; i < n; i++) x[i] = 1.0 + (double)(i % 7) * 0.125;
+
+    int best = 1;
+    *best_gbs = 0.0;
+    volatile double sink = 0.0;
+    printf("%-14s %12s\n", "Accumulators", "GB/s");
+    for (int c = 0; c < (int)(sizeof(accumulator_candidates) / sizeof(int)); c++) {
+        const int acc = accumulator_candidates[c];
+        double fastest = 1e30;
+        for (int r = 0; r < SUM_REPEATS; r++) {
+            double start = get_time_ns();
+            sink += tuning_sum(x, n, acc);
+            const double elapsed = get_time_ns() - start;
+            if (elapsed < fastest) fastest = elapsed;
+        }
+        const double gbs = n * sizeof(double) / fastest;
+        printf("%-14d %12.2f\n", acc, gbs);
+        if (gbs > *best_gbs) {
+            *best_gbs = gbs;
+            best = acc;
+        }
+    }
+    (void)sink;
+    free(x);
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    int n = DEFAULT_N, dry_run = 0;
+    double budget = DEFAULT_BUDGET;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *opt = argv[i], *val = argv[++i];
+        if (strcmp(opt, "--n") == 0)            n = atoi(val);
+        else if (strcmp(opt, "--budget") == 0)  budget = atof(val);
+        else if (strcmp(opt, "--file") == 0)    setenv("TP2_TUNING_FILE", val, 1);
+        else if (strcmp(opt, "--dry-run") == 0) dry_run = atoi(val);
+        else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if (n < 16 || budget <= 0.0) {
+        fprintf(stderr, "N must be at least 16 and the budget positive\n");
+        return 1;
+    }
+
+    init_timing();
+    char host[TUNING_MAX_KEY];
+    tuning_host_key(host, sizeof(host));
+    const char *path = tuning_file_path();
+    long l1, l2, l3;
+    matmul_cache_sizes(&l1, &l2, &l3);
+
+    matmul_tiles_t start, stored;
+    matmul_cache_tiles(&start);
+    stored = start;
+    const int have = matmul_load_tuned_tiles(&stored);
+
+    printf("=============================================================\n");
+    printf("Exercise 4: Kernel Auto-Tuner\n");
+    printf("=============================================================\n\n");
+    printf("Configuration:\n");
+    printf("  Host key:            %s\n", host);
+    printf("  Tuning file:         %s%s\n", path ? path : "(disabled)", dry_run ? " (dry run)" : "");
+    printf("  Problem:             %d x %d x %d, budget %.0f s\n", n, n, n, budget);
+    printf("  Micro-kernel:        %s\n", matmul_packed_isa(NULL, NULL));
+    printf("  Cache-derived tiles: mc=%d kc=%d nc=%d nr=%d\n", start.mc, start.kc, start.nc, start.nr);
+    if (have)
+        printf("  Stored tiles:        mc=%d kc=%d nc=%d nr=%d (%d tuned)\n",
+               stored.mc, stored.kc, stored.nc, stored.nr, have);
+    printf("\nGEMM search (configurations in the order they were timed):\n");
+
+    double t0 = get_time_ns();
+    matmul_tiles_t tuned = start;
+    const int timed = matmul_tune_tiles(&tuned, n, budget, stdout);
+    const double spent = (get_time_ns() - t0) / 1e9;
+    if (timed == 0) {
+        fprintf(stderr, "Failed to allocate the N=%d tuning problem\n", n);
+        return 1;
+    }
+
+    // Re-time the start point and the winner side by side
+    const long nn = (long)n * n;
+    double *A = malloc(sizeof(double) * nn), *B = malloc(sizeof(double) * nn);
+    double *C = malloc(sizeof(double) * nn);
+    if (!A || !B || !C) {
+        fprintf(stderr, "Failed to allocate N=%d\n", n);
+        return 1;
+    }
+    for (long i = 0; i < nn; i++) {
+        A[i] = (double)(i % 11) / 11.0 - 0.5;
+        B[i] = (double)(i % 5) / 5.0 - 0.5;
+    }
+    const double flops = 2.0 * n * n * (double)n;
+    const double packed0 = time_gemm(n, A, B, C, &start, 0), packed1 = time_gemm(n, A, B, C, &tuned, 0);
+    const double blocked0 = time_gemm(n, A, B, C, &start, 1), blocked1 = time_gemm(n, A, B, C, &tuned, 1);
+    free(A); free(B); free(C);
+
+    printf("\n%d configurations timed in %.1f s\n", timed, spent);
+    printf("  Tuned tiles:         mc=%d kc=%d nc=%d nr=%d\n", tuned.mc, tuned.kc, tuned.nc, tuned.nr);
+    printf("  Packed:              %.2f -> %.2f GFLOP/s (%.2fx)\n",
+           flops / packed0 / 1e9, flops / packed1 / 1e9, packed0 / packed1);
+    printf("  Blocked:             %.2f -> %.2f GFLOP/s (%.2fx)\n\n",
+           flops / blocked0 / 1e9, flops / blocked1 / 1e9, blocked0 / blocked1);
+
+    printf("Reduction search (%ld KB vector, L2 resident):\n", l2 / SUM_BYTES_OF_L2 / 1024);
+    double sum_gbs = 0.0;
+    const int accumulators = tune_reduction(l2 / SUM_BYTES_OF_L2 / (long)sizeof(double), &sum_gbs);
+    printf("  Best:                %d accumulators, %.2f GB/s\n\n", accumulators, sum_gbs);
+
+    if (dry_run || !path) {
+        printf("Nothing stored.\n");
+        return 0;
+    }
+    const int ok = tuning_store("matmul.mc", tuned.mc) == 0 && tuning_store("matmul.kc", tuned.kc) == 0 &&
+                   tuning_store("matmul.nc", tuned.nc) == 0 && tuning_store("matmul.nr", tuned.nr) == 0 &&
+                   tuning_store("reduce.accumulators", accumulators) == 0;
+    if (!ok) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        return 1;
+    }
+    printf("Stored in %s; matmul_default_tiles() and exercise3_numa pick them up\n", path);
+    printf("on every host with the key above (TP2_TUNING_FILE=none to ignore).\n");
+    return 0;
+}
@@ -0,0 +1,349 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - scalar kernels
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "tuning.h"
+#include "matmul.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// Fallback cache sizes when sysconf() cannot report them
+#define DEFAULT_L1_BYTES (32 * 1024)
+#define DEFAULT_L2_BYTES (512 * 1024)
+#define DEFAULT_L3_BYTES (8 * 1024 * 1024)
+
+// Data cache sizes in bytes as reported by sysconf() (glibc), else defaults
+void matmul_cache_sizes(long *l1, long *l2, long *l3) {
+    *l1 = DEFAULT_L1_BYTES;
+    *l2 = DEFAULT_L2_BYTES;
+    *l3 = DEFAULT_L3_BYTES;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    long v;
+    if ((v = sysconf(_SC_LEVEL1_DCACHE_SIZE)) > 0) *l1 = v;
+    if ((v = sysconf(_SC_LEVEL2_CACHE_SIZE)) > 0) *l2 = v;
+    if ((v = sysconf(_SC_LEVEL3_CACHE_SIZE)) > 0) *l3 = v;
+#endif
+}
+
+// Associativity and line size when sysconf() cannot report them
+#define DEFAULT_L1_WAYS  8
+#define DEFAULT_L2_WAYS  16
+#define DEFAULT_LINE     64
+
+void matmul_cache_geometry(int level, matmul_cache_level_t *c) {
+    long l1, l2, l3;
+    matmul_cache_sizes(&l1, &l2, &l3);
+    c->size = (level == 1) ? l1 : l2;
+    c->ways = (level == 1) ? DEFAULT_L1_WAYS : DEFAULT_L2_WAYS;
+    c->line = DEFAULT_LINE;
+#ifdef _SC_LEVEL1_DCACHE_ASSOC
+    long v;
+    if ((v = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_ASSOC : _SC_LEVEL2_CACHE_ASSOC)) > 0) c->ways = (int)v;
+    if ((v = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_LINESIZE : _SC_LEVEL2_CACHE_LINESIZE)) > 0)
+        c->line = (int)v;
+#endif
+    c->sets = c->size / ((long)c->ways * c->line);
+    if (c->sets < 1) c->sets = 1;
+}
+
+static long gcd(long a, long b) {
+    while (b) {
+        const long r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// Most lines a column walk over `rows` rows, `stride` bytes apart, puts
+// in one set. Row r starts at byte (r * stride) mod (sets * line) of the
+// set-index range; those offsets are multiples of g = gcd(stride,
+// sets * line), so the walk cycles through sets * line / max(g, line)
+// distinct sets.
+static long lines_per_set(const matmul_cache_level_t *c, long stride, long rows) {
+    const long span = c->sets * c->line;
+    const long capacity = c->size / c->line;
+    long g = gcd(stride % span, span);
+    if (g < c->line) g = c->line;
+    const long distinct = span / g;
+    if (rows > capacity) rows = capacity;
+    return (rows + distinct - 1) / distinct;
+}
+
+int matmul_padded_ld(int inner, int rows) {
+    matmul_cache_level_t levels[2];
+    matmul_cache_geometry(1, &levels[0]);
+    matmul_cache_geometry(2, &levels[1]);
+    const int base = (inner + 7) & ~7;
+    // Any ld whose row is an odd number of lines spreads the walk over
+    // every set, so the search ends within a few steps
+    for (int ld = base; ld < base + 1024; ld += 8) {
+        const long stride = (long)ld * sizeof(double);
+        if (lines_per_set(&levels[0], stride, rows) <= levels[0].ways &&
+            lines_per_set(&levels[1], stride, rows) <= levels[1].ways)
+            return ld;
+    }
+    return base;
+}
+
+// Round down to a multiple of 8 elements (one 64-byte cache line), min 8
+static int round_tile(long v) {
+    v &= ~7L;
+    return v < 8 ? 8 : (int)v;
+}
+
+void matmul_cache_tiles(matmul_tiles_t *t) {
+    long l1, l2, l3;
+    matmul_cache_sizes(&l1, &l2, &l3);
+
+    // Budget a fraction of each level for the operand that should live
+    // there, leaving room for the streaming operands and for the other
+    // hardware thread sharing the cache.
+    t->kc = 256;
+    t->nr = round_tile(l1 / 4 / (5 * (long)sizeof(double)));
+    t->mc = round_tile(l2 / 2 / (t->kc * (long)sizeof(double)));
+    t->nc = round_tile(MIN(l3 / 2, 16L * 1024 * 1024) / (t->kc * (long)sizeof(double)));
+    t->strassen_cutover = 512;
+}
+
+int matmul_load_tuned_tiles(matmul_tiles_t *t) {
+    const char *params[] = {"matmul.mc", "matmul.kc", "matmul.nc", "matmul.nr"};
+    int *fields[] = {&t->mc, &t->kc, &t->nc, &t->nr};
+    int found = 0;
+    for (int i = 0; i < 4; i++) {
+        int v;
+        if (tuning_get(params[i], &v) == 0 && v >= 8) {
+            *fields[i] = v;
+            found++;
+        }
+    }
+    return found;
+}
+
+void matmul_default_tiles(matmul_tiles_t *t) {
+    matmul_cache_tiles(t);
+    matmul_load_tuned_tiles(t);
+}
+
+// ============================================================================
+// Unblocked kernels
+// ============================================================================
+
+__attribute__((noinline))
+void matmul_naive(int m, int n, int k,
+                  const double *A, int lda, const double *B, int ldb,
+                  double *C, int ldc) {
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            double sum = 0.0;
+            for (int p = 0; p < k; p++) {
+                sum += A[(long)i * lda + p] * B[(long)p * ldb + j];
+            }
+            C[(long)i * ldc + j] = sum;
+        }
+    }
+}
+
+__attribute__((noinline))
+void matmul_ikj(int m, int n, int k,
+                const double *A, int lda, const double *B, int ldb,
+                double *C, int ldc) {
+    for (int i = 0; i < m; i++) {
+        double *c = C + (long)i * ldc;
+        memset(c, 0, n * sizeof(double));
+        for (int p = 0; p < k; p++) {
+            const double a = A[(long)i * lda + p];
+            const double *b = B + (long)p * ldb;
+            for (int j = 0; j < n; j++) {
+                c[j] += a * b[j];
+            }
+        }
+    }
+}
+
+// ============================================================================
+// Cache-blocked kernel
+// ============================================================================
+
+// C[mb x nb] += A[mb x kb] * B[kb x nb] on one L2 block: iterate over
+// L1-sized column strips of B, i-k-j inside the strip. Four rows of C are
+// updated per pass so each B element loaded from L1 feeds four FMAs.
+static void block_kernel(int mb, int nb, int kb, int nr,
+                         const double *A, int lda, const double *B, int ldb,
+                         double *C, int ldc) {
+    for (int jr = 0; jr < nb; jr += nr) {
+        const int nn = MIN(nr, nb - jr);
+        int i = 0;
+        for (; i + 3 < mb; i += 4) {
+            double *restrict c0 = C + (long)i * ldc + jr;
+            double *restrict c1 = c0 + ldc;
+            double *restrict c2 = c1 + ldc;
+            double *restrict c3 = c2 + ldc;
+            const double *a0 = A + (long)i * lda;
+            for (int p = 0; p < kb; p++) {
+                const double a0p = a0[p];
+                const double a1p = a0[p + lda];
+                const double a2p = a0[p + 2L * lda];
+                const double a3p = a0[p + 3L * lda];
+                const double *restrict b = B + (long)p * ldb + jr;
+                for (int j = 0; j < nn; j++) {
+                    c0[j] += a0p * b[j];
+                    c1[j] += a1p * b[j];
+                    c2[j] += a2p * b[j];
+                    c3[j] += a3p * b[j];
+                }
+            }
+        }
+        // Remainder rows
+        for (; i < mb; i++) {
+            double *restrict c = C + (long)i * ldc + jr;
+            const double *a = A + (long)i * lda;
+            for (int p = 0; p < kb; p++) {
+                const double aip = a[p];
+                const double *restrict b = B + (long)p * ldb + jr;
+                for (int j = 0; j < nn; j++) {
+                    c[j] += aip * b[j];
+                }
+            }
+        }
+    }
+}
+
+__attribute__((noinline))
+void matmul_blocked(int m, int n, int k,
+                    const double *A, int lda, const double *B, int ldb,
+                    double *C, int ldc, const matmul_tiles_t *t) {
+    for (int i = 0; i < m; i++) {
+        memset(C + (long)i * ldc, 0, n * sizeof(double));
+    }
+
+    // L3: kc x nc panel of B
+    for (int jc = 0; jc < n; jc += t->nc) {
+        const int nb = MIN(t->nc, n - jc);
+        for (int pc = 0; pc < k; pc += t->kc) {
+            const int kb = MIN(t->kc, k - pc);
+            // L2: mc x kc block of A
+            for (int ic = 0; ic < m; ic += t->mc) {
+                const int mb = MIN(t->mc, m - ic);
+                block_kernel(mb, nb, kb, t->nr,
+                             A + (long)ic * lda + pc, lda,
+                             B + (long)pc * ldb + jc, ldb,
+                             C + (long)ic * ldc + jc, ldc);
+            }
+        }
+    }
+}
+
+// ============================================================================
+// matrix_t entry point
+// ============================================================================
+
+static const char *algo_names[MATMUL_NUM_ALGOS] = {
+    "naive", "blocked", "packed", "parallel", "recursive", "strassen"
+};
+
+const char *matmul_algo_name(matmul_algo_t algo) {
+    return (algo >= 0 && algo < MATMUL_NUM_ALGOS) ? algo_names[algo] : "?";
+}
+
+void matmul_naive_strided(int m, int n, int k,
+                          const double *A, long rsa, long csa,
+                          const double *B, long rsb, long csb,
+                          double *C, int ldc) {
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            double sum = 0.0;
+            for (int p = 0; p < k; p++) {
+                sum += A[i * rsa + p * csa] * B[p * rsb + j * csb];
+            }
+            C[(long)i * ldc + j] = sum;
+        }
+    }
+}
+
+// i-j-k reference through matrix_at(), for any layout
+static void naive_at(const matrix_t *A, const matrix_t *B, matrix_t *C) {
+    for (int i = 0; i < C->rows; i++) {
+        for (int j = 0; j < C->cols; j++) {
+            double sum = 0.0;
+            for (int p = 0; p < A->cols; p++) {
+                sum += *matrix_at(A, i, p) * *matrix_at(B, p, j);
+            }
+            *matrix_at(C, i, j) = sum;
+        }
+    }
+}
+
+int matmul_gemm(matmul_algo_t algo, const matrix_t *A, const matrix_t *B, matrix_t *C,
+                const matmul_tiles_t *t, struct threadpool *pool) {
+    if (A->cols != B->rows || C->rows != A->rows || C->cols != B->cols) return -1;
+
+    if (matrix_is_tiled(A) || matrix_is_tiled(B) || matrix_is_tiled(C)) {
+        switch (algo) {
+            case MATMUL_NAIVE:
+                naive_at(A, B, C);
+                return 0;
+            case MATMUL_PACKED:
+                return matmul_tiled(A, B, C, NULL);
+            case MATMUL_PARALLEL:
+                return pool ? matmul_tiled(A, B, C, pool) : -1;
+            default:
+                return -1;
+        }
+    }
+
+    // Column-major C: C^T = B^T * A^T, and C^T is a row-major view
+    if (C->layout == MATRIX_COL_MAJOR) {
+        matrix_t At = matrix_transpose_view(A);
+        matrix_t Bt = matrix_transpose_view(B);
+        matrix_t Ct = matrix_transpose_view(C);
+        return matmul_gemm(algo, &Bt, &At, &Ct, t, pool);
+    }
+
+    const int m = C->rows, n = C->cols, k = A->cols;
+    const long rsa = matrix_rs(A), csa = matrix_cs(A);
+    const long rsb = matrix_rs(B), csb = matrix_cs(B);
+
+    switch (algo) {
+        case MATMUL_NAIVE:
+            matmul_naive_strided(m, n, k, A->data, rsa, csa, B->data, rsb, csb, C->data, C->ld);
+            return 0;
+        case MATMUL_BLOCKED:
+            if (A->layout != MATRIX_ROW_MAJOR || B->layout != MATRIX_ROW_MAJOR) return -1;
+            matmul_blocked(m, n, k, A->data, A->ld, B->data, B->ld, C->data, C->ld, t);
+            return 0;
+        case MATMUL_PACKED: {
+            matmul_tiles_t fit = *t;
+            matmul_pack_buf_t buf;
+            fit.mc = MIN(t->mc, m);
+            fit.nc = MIN(t->nc, n);
+            fit.kc = MIN(t->kc, k);
+            if (matmul_pack_buf_alloc(&buf, &fit) != 0) return -1;
+            matrix_fill_zero(C);
+            matmul_packed_acc(m, n, k, A->data, rsa, csa, B->data, rsb, csb,
+                              C->data, C->ld, &buf);
+            matmul_pack_buf_free(&buf);
+            return 0;
+        }
+        case MATMUL_PARALLEL:
+            if (!pool) return -1;
+            matmul_parallel(m, n, k, A->data, rsa, csa, B->data, rsb, csb,
+                            C->data, C->ld, t, pool);
+            return 0;
+        case MATMUL_RECURSIVE:
+            matmul_recursive(m, n, k, A->data, rsa, csa, B->data, rsb, csb, C->data, C->ld);
+            return 0;
+        case MATMUL_STRASSEN:
+            if (A->layout != MATRIX_ROW_MAJOR || B->layout != MATRIX_ROW_MAJOR) return -1;
+            matmul_strassen(m, n, k, A->data, A->ld, B->data, B->ld, C->data, C->ld, t, pool);
+            return 0;
+        default:
+            return -1;
+    }
+}
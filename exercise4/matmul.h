@@ -0,0 +1,341 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine
+ *
+ * C = A * B with A of size m x k, B of size k x n and C of size m x n.
+ * matmul_gemm() is the entry point for matrix_t operands of any shape and
+ * layout; the kernels below it take raw row-major pointers with leading
+ * dimensions (lda, ldb, ldc), or (row, column) element strides where they
+ * also serve column-major and transposed operands.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef MATMUL_H
+#define MATMUL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "matrix.h"
+
+struct threadpool;
+
+// Cache tile sizes for the blocked kernel (in elements)
+//   nc: columns of B per L3 block   (kc x nc panel of B stays in L3)
+//   kc: depth of a k panel          (mc x kc block of A stays in L2)
+//   mc: rows of A per L2 block
+//   nr: columns per L1 strip        (4 x nr strip of C + a row of B stay in L1)
+// strassen_cutover is not a tile: Strassen-Winograd stops recursing once a
+// dimension is at most this size and hands the product to the packed kernel.
+typedef struct {
+    int mc;
+    int kc;
+    int nc;
+    int nr;
+    int strassen_cutover;
+} matmul_tiles_t;
+
+// Data cache sizes in bytes (sysconf, else typical defaults)
+void matmul_cache_sizes(long *l1, long *l2, long *l3);
+
+// Geometry of one data cache level (1 or 2); sysconf, else typical values
+typedef struct {
+    long size;       // Bytes
+    int ways;        // Associativity
+    int line;        // Line size in bytes
+    long sets;       // size / (ways * line)
+} matmul_cache_level_t;
+
+void matmul_cache_geometry(int level, matmul_cache_level_t *c);
+
+// Leading dimension for `inner` doubles per row such that a column walk
+// over `rows` rows does not crowd into a few cache sets. With ld = 512
+// every row is 4 KB apart and maps to the same L1 set, so a walk down a
+// column keeps at most `ways` of its lines in L1 however small it is.
+// Returns the smallest ld >= inner, a multiple of 8 (rows stay 64-byte
+// aligned), for which the walk puts no more lines in any L1 / L2 set than
+// the level's associativity (counting only as many rows as fit in the
+// level). Non-power-of-two sizes mostly get ld = inner rounded up to 8.
+int matmul_padded_ld(int inner, int rows);
+
+// Tile sizes derived from the cache sizes reported by the host
+void matmul_cache_tiles(matmul_tiles_t *t);
+
+// matmul_cache_tiles() overridden by any tuned values stored for this host
+// in the tuning cache (common/tuning.h, written by exercise4_tune)
+void matmul_default_tiles(matmul_tiles_t *t);
+
+// Apply the tuned tile sizes stored for this host to t; returns how many
+// of mc / kc / nc / nr were found
+int matmul_load_tuned_tiles(matmul_tiles_t *t);
+
+// Pruned coordinate search over mc, kc, nc (timing matmul_packed on an
+// n x n x n product) and then nr (matmul_blocked), starting from *t and
+// stopping once budget seconds are spent. Candidates whose blocks overflow
+// the cache level they are meant for are never timed, and a candidate is
+// dropped after one run when it is clearly slower than the best so far.
+// *t receives the winner; returns the number of configurations timed.
+// log (may be NULL) receives one line per timed configuration.
+int matmul_tune_tiles(matmul_tiles_t *t, int n, double budget, FILE *log);
+
+// Reference i-j-k triple loop (exercise4.c): B is walked column-wise
+void matmul_naive(int m, int n, int k,
+                  const double *A, int lda, const double *B, int ldb,
+                  double *C, int ldc);
+
+// matmul_naive() with A and B addressed through element strides (C
+// row-major). Needs no workspace: the engines' last resort when out of memory.
+void matmul_naive_strided(int m, int n, int k,
+                          const double *A, long rsa, long csa,
+                          const double *B, long rsb, long csb,
+                          double *C, int ldc);
+
+// Loop interchange i-k-j: unit-stride inner loop over B and C rows
+void matmul_ikj(int m, int n, int k,
+                const double *A, int lda, const double *B, int ldb,
+                double *C, int ldc);
+
+// Multi-level cache-blocked kernel (L3 / L2 / L1 tiles, i-k-j inner order)
+void matmul_blocked(int m, int n, int k,
+                    const double *A, int lda, const double *B, int ldb,
+                    double *C, int ldc, const matmul_tiles_t *t);
+
+// Packed-panel GEMM with a register-blocked SIMD micro-kernel
+// (matmul_packed.c). Tiles are rounded to the micro-kernel shape. When the
+// packing buffers cannot be allocated it computes C with matmul_blocked().
+void matmul_packed(int m, int n, int k,
+                   const double *A, int lda, const double *B, int ldb,
+                   double *C, int ldc, const matmul_tiles_t *t);
+
+// Packing workspace for one thread: an mc x kc block of A and a kc x nc
+// panel of B, tile sizes rounded up to the micro-kernel shape
+typedef struct {
+    double *Ap, *Bp;
+    int mc, kc, nc;
+} matmul_pack_buf_t;
+
+int matmul_pack_buf_alloc(matmul_pack_buf_t *buf, const matmul_tiles_t *t);
+void matmul_pack_buf_free(matmul_pack_buf_t *buf);
+
+// C += A * B with the packed kernel, using the caller's workspace
+void matmul_packed_acc(int m, int n, int k,
+                       const double *A, long rsa, long csa,
+                       const double *B, long rsb, long csb,
+                       double *C, int ldc, const matmul_pack_buf_t *buf);
+
+// Name of the micro-kernel picked by runtime ISA dispatch, and its
+// MR x NR register tile (either pointer may be NULL)
+const char *matmul_packed_isa(int *mr, int *nr);
+
+// Measured single-core double-precision FMA throughput of that ISA
+double matmul_peak_gflops(void);
+
+// Multithreaded packed GEMM (matmul_parallel.c). C is split into 2D
+// tiles, and additionally along k when there are too few tiles to keep
+// every worker busy (skinny shapes); tiles run on a work-stealing pool
+// with per-thread packing buffers. Out of memory, it drops the k split,
+// then runs serially.
+void matmul_parallel(int m, int n, int k,
+                     const double *A, long rsa, long csa,
+                     const double *B, long rsb, long csb,
+                     double *C, int ldc, const matmul_tiles_t *t,
+                     struct threadpool *pool);
+
+// Cache-oblivious divide-and-conquer GEMM (matmul_recursive.c): halves the
+// largest dimension down to a fixed leaf, so no tile sizes are involved.
+// Without memory for the leaf buffer it runs matmul_naive_strided().
+void matmul_recursive(int m, int n, int k,
+                      const double *A, long rsa, long csa,
+                      const double *B, long rsb, long csb,
+                      double *C, int ldc);
+
+// Strassen-Winograd (matmul_recursive.c): 7 products per level down to
+// t->strassen_cutover, then the packed kernel. The seven top-level products
+// run on pool when it has more than one worker (pool may be NULL). A level
+// whose scratch cannot be allocated runs the packed kernel instead, and
+// without per-worker leaf buffers the whole product is matmul_packed().
+void matmul_strassen(int m, int n, int k,
+                     const double *A, int lda, const double *B, int ldb,
+                     double *C, int ldc, const matmul_tiles_t *t,
+                     struct threadpool *pool);
+
+// GEMM on block-major / Morton operands (matmul_tiled.c), one packed
+// product per (C tile, k tile) on in-tile strides. Row- and column-major
+// A and B may be mixed in; C must not be column-major and all tiled
+// operands must share one tile edge. pool may be NULL. Returns 0 or -1.
+int matmul_tiled(const matrix_t *A, const matrix_t *B, matrix_t *C,
+                 struct threadpool *pool);
+
+// ============================================================================
+// Batched small matrices (matmul_batched.c)
+// ============================================================================
+
+// Matrices per interleaved block: one 512-bit vector of doubles
+#define MATMUL_BATCH_LANES 8
+
+typedef enum {
+    MATMUL_BATCH_AOS,          // count row-major n x n matrices back to back
+    MATMUL_BATCH_INTERLEAVED   // element (i, j) of LANES consecutive matrices
+                               // adjacent: [(b / LANES) * n*n + i*n + j] * LANES + b % LANES
+} matmul_batch_layout_t;
+
+// Doubles needed to store count n x n matrices (interleaved: padded to
+// a whole number of lane blocks)
+long matmul_batch_elems(int n, int count, matmul_batch_layout_t layout);
+
+// AoS <-> interleaved; padding lanes are zeroed
+void matmul_batch_interleave(int n, int count, const double *aos, double *lanes);
+void matmul_batch_deinterleave(int n, int count, const double *lanes, double *aos);
+
+// 1 if n has a compile-time specialized kernel (2-6, 8, 12, 16, 24, 32)
+int matmul_batch_specialized(int n);
+
+// C[b] = A[b] * B[b] for count n x n matrices in the given layout, split
+// over pool when it has more than one worker (pool may be NULL)
+void matmul_batched(int n, int count, const double *A, const double *B, double *C,
+                    matmul_batch_layout_t layout, struct threadpool *pool);
+
+// ============================================================================
+// Reduced precision (matmul_lowp.c)
+// ============================================================================
+
+// bfloat16: the upper half of an IEEE float (8-bit exponent, 8-bit mantissa)
+typedef uint16_t matmul_bf16_t;
+
+matmul_bf16_t matmul_to_bf16(float x);   // Round to nearest even
+float matmul_from_bf16(matmul_bf16_t x);
+
+typedef enum {
+    MATMUL_LOWP_F32,    // float in, float accumulation
+    MATMUL_LOWP_BF16,   // bf16 in, float accumulation
+    MATMUL_LOWP_I8,     // int8 in, int32 accumulation
+    MATMUL_LOWP_NUM_TYPES
+} matmul_lowp_type_t;
+
+// Kernel picked for a type: avx512-bf16 / avx512-vnni when the CPU has
+// them, AVX-512F otherwise, else the portable C kernels
+const char *matmul_lowp_isa(matmul_lowp_type_t type);
+
+// Packing workspace of the reduced-precision kernels (any type, any size)
+typedef struct {
+    uint32_t *Ap, *Bp;
+} matmul_lowp_buf_t;
+
+int matmul_lowp_buf_alloc(matmul_lowp_buf_t *buf);
+void matmul_lowp_buf_free(matmul_lowp_buf_t *buf);
+
+// Row-major C = A * B; the int8 path is exact for k <= 65536. buf is the
+// caller's workspace, or NULL to allocate one per call. Returns 0, or -1
+// when out of memory (C is then left untouched).
+int matmul_f32(int m, int n, int k, const float *A, int lda, const float *B, int ldb,
+               float *C, int ldc, const matmul_lowp_buf_t *buf);
+int matmul_bf16(int m, int n, int k, const matmul_bf16_t *A, int lda,
+                const matmul_bf16_t *B, int ldb, float *C, int ldc, const matmul_lowp_buf_t *buf);
+int matmul_i8(int m, int n, int k, const int8_t *A, int lda, const int8_t *B, int ldb,
+              int32_t *C, int ldc, const matmul_lowp_buf_t *buf);
+
+// ============================================================================
+// Distributed SUMMA (matmul_summa.c)
+// ============================================================================
+
+// pr x pc process grid; k is broadcast in panels of at most `panel`
+// columns, `lookahead` panels ahead of the one being multiplied
+typedef struct {
+    int pr, pc;
+    int panel;
+    int lookahead;
+} matmul_summa_grid_t;
+
+// Wall-clock split (seconds) and traffic of one rank in a SUMMA run
+typedef struct {
+    int row, col;        // Position in the process grid
+    double compute;      // Local GEMM on the panels
+    double send;         // Waiting for free slots, copying panels in
+    double recv;         // Waiting for panels, copying them out
+    double total;
+    long bytes_sent, bytes_recv;
+} matmul_summa_rank_t;
+
+// Near-square grid for procs ranks (pr <= pc), 256-wide panels, lookahead 1
+void matmul_summa_default_grid(matmul_summa_grid_t *g, int procs);
+
+// Row-major C = A * B on pr * pc forked worker processes exchanging panels
+// through shared memory. stats (may be NULL) receives pr * pc entries in
+// rank order (rank = row * pc + col). Returns 0 on success, -1 on invalid
+// arguments, resource failure or without fork().
+int matmul_summa(int m, int n, int k, const double *A, int lda, const double *B, int ldb,
+                 double *C, int ldc, const matmul_summa_grid_t *g, const matmul_tiles_t *t,
+                 matmul_summa_rank_t *stats);
+
+// ============================================================================
+// Result verification (matmul_verify.c)
+// ============================================================================
+
+#define MATMUL_VERIFY_VECTORS     4    // Random vectors per check by default
+#define MATMUL_VERIFY_MAX_VECTORS 16
+#define MATMUL_VERIFY_TILE        64   // Tile edge failures are reported in
+
+// Outcome of matmul_verify(). Rows and columns are 0-based; tile (ti, tj)
+// covers rows ti*tile .. and columns tj*tile ..
+typedef struct {
+    int passed;
+    int vectors;
+    double worst;            // Largest residual / bound (<= 1 when passed)
+    int bad_rows, bad_cols;
+    int first_row, first_col;   // -1 when none
+    int tile;
+    long bad_tiles;          // Tiles holding a wrong element
+    int worst_ti, worst_tj;  // Tile with the most wrong elements
+    long worst_count;
+    long rechecked;          // Elements recomputed as dot products (0: the
+                             // tiles are bad-row x bad-column candidates)
+    long bad_elems;
+} matmul_verify_t;
+
+// Freivalds' check of a computed C = A * B in O((m + n) k + m n) work:
+// A (B R) against C R for `vectors` random vectors R (entries of either
+// sign, magnitude in [0.5, 1], from seed). Each row's residual is held to
+// the rounding bound of a classical GEMM plus that of the check itself,
+// gamma(2k + n) (|A| |B| |R|)_i + gamma(n) (|C| |R|)_i, so a correct
+// product always passes and any element off by more than that bound fails
+// with probability 1. On failure the same test on r^T A B vs r^T C finds
+// the bad columns, and bad-row x bad-column elements are recomputed (up to
+// m + n of them) to name the wrong tiles. Passes run on pool when given
+// (may be NULL). Returns 1 if C passed, 0 if not, -1 on invalid arguments
+// or allocation failure.
+int matmul_verify(int m, int n, int k, const double *A, long rsa, long csa,
+                  const double *B, long rsb, long csb, const double *C, int ldc,
+                  int vectors, unsigned seed, struct threadpool *pool, matmul_verify_t *v);
+
+// One line: "passed (4 vectors, worst 3.1e-04 of bound)" or the failure
+// location
+void matmul_verify_print(FILE *f, const matmul_verify_t *v);
+
+// ============================================================================
+// matrix_t entry point
+// ============================================================================
+
+typedef enum {
+    MATMUL_NAIVE,      // i-j-k reference, any layout
+    MATMUL_BLOCKED,    // cache-blocked, row-major A and B only
+    MATMUL_PACKED,     // packed SIMD, any layout
+    MATMUL_PARALLEL,   // packed SIMD on a thread pool, any layout
+    MATMUL_RECURSIVE,  // cache-oblivious recursion, any layout
+    MATMUL_STRASSEN,   // Strassen-Winograd, row-major A and B only
+    MATMUL_NUM_ALGOS
+} matmul_algo_t;
+
+const char *matmul_algo_name(matmul_algo_t algo);
+
+// C = A * B. A column-major C is computed as C^T = B^T * A^T on transposed
+// views, so every algorithm writes a row-major result. If any operand is
+// block-major or Morton, naive walks matrix_at() and packed / parallel go
+// through matmul_tiled(); the other algorithms return -1. pool is used by
+// MATMUL_PARALLEL (required) and MATMUL_STRASSEN (optional). Returns 0 on
+// success, -1 if the shapes do not conform or the algorithm does not
+// support the operand layouts.
+int matmul_gemm(matmul_algo_t algo, const matrix_t *A, const matrix_t *B, matrix_t *C,
+                const matmul_tiles_t *t, struct threadpool *pool);
+
+#endif // MATMUL_H
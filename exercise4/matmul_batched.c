@@ -0,0 +1,295 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - batched small matrices
+ *
+ * Millions of n x n products with n = 2 .. 32. Per-call overhead and loop
+ * control dominate the generic kernels at these sizes, so common sizes get
+ * kernels generated with n as a compile-time constant (BATCH_AOS_*, BATCH_LANES):
+ * every loop has a fixed trip count, is fully unrolled and the running
+ * row / element of C stays in registers. Other sizes use the same loops
+ * with a runtime n. Each kernel is built for the generic, AVX2 and AVX-512
+ * targets and chosen with the same ISA as the packed micro-kernel.
+ *
+ * Two batch layouts:
+ *   AoS          matrices stored one after the other, row-major
+ *   interleaved  MATMUL_BATCH_LANES matrices share each element slot, so
+ *                one SIMD vector holds the same (i, j) of consecutive
+ *                matrices and a lane never talks to its neighbours; this
+ *                vectorizes for any n, odd sizes included
+ * The batch is split into chunks that run on the work-stealing pool.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "matmul.h"
+#include "threadpool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86 1
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define CEIL_DIV(a, b) (((a) + (b) - 1) / (b))
+
+#define L MATMUL_BATCH_LANES
+#define TASK_BYTES (256 * 1024)   // A + B + C traffic per pool task
+
+typedef void (*batch_fn)(const double *restrict A, const double *restrict B,
+                         double *restrict C);
+typedef void (*batch_generic_fn)(int n, const double *restrict A, const double *restrict B,
+                                 double *restrict C);
+
+// ============================================================================
+// Kernels
+// ============================================================================
+
+// One AoS product, i-k-j order with row i of C held in registers. For
+// power-of-two n the row is a single GCC/Clang vector (n = 8 is one zmm),
+// which stops the compiler from vectorizing across i instead.
+#define BATCH_AOS_VEC(N, ISA, TARGET)                                          \
+typedef double row_##ISA##_##N __attribute__((vector_size(N * sizeof(double)))); \
+TARGET static void aos_##ISA##_##N(const double *restrict A,                   \
+                                   const double *restrict B,                   \
+                                   double *restrict C) {                       \
+    row_##ISA##_##N b[N];                                                      \
+    memcpy(b, B, sizeof(b));                                                   \
+    for (int i = 0; i < N; i++) {                                              \
+        row_##ISA##_##N c = A[i * N] * b[0];                                   \
+        for (int p = 1; p < N; p++) c += A[i * N + p] * b[p];                  \
+        memcpy(C + i * N, &c, sizeof(c));                                      \
+    }                                                                          \
+}
+
+#define BATCH_AOS_LOOP(N, ISA, TARGET)                                         \
+TARGET static void aos_##ISA##_##N(const double *restrict A,                   \
+                                   const double *restrict B,                   \
+                                   double *restrict C) {                       \
+    for (int i = 0; i < N; i++) {                                              \
+        double c[N] = {0};                                                     \
+        for (int p = 0; p < N; p++) {                                          \
+            const double a = A[i * N + p];                                     \
+            for (int j = 0; j < N; j++) c[j] += a * B[p * N + j];              \
+        }                                                                      \
+        for (int j = 0; j < N; j++) C[i * N + j] = c[j];                       \
+    }                                                                          \
+}
+
+// One interleaved product block: 4 C elements x L lanes at a time, so each
+// A(i, p) vector load feeds four FMAs
+#define BATCH_LANES(N, ISA, TARGET)                                            \
+TARGET static void lanes_##ISA##_##N(const double *restrict A,                 \
+                                     const double *restrict B,                 \
+                                     double *restrict C) {                     \
+    for (int i = 0; i < N; i++) {                                              \
+        int j = 0;                                                             \
+        for (; j + 4 <= N; j += 4) {                                           \
+            double c[4][L] = {{0}};                                            \
+            for (int p = 0; p < N; p++) {                                      \
+                const double *a = A + (i * N + p) * L;                         \
+                const double *b = B + (p * N + j) * L;                         \
+                for (int jj = 0; jj < 4; jj++)                                 \
+                    for (int l = 0; l < L; l++) c[jj][l] += a[l] * b[jj * L + l]; \
+            }                                                                  \
+            for (int jj = 0; jj < 4; jj++)                                     \
+                for (int l = 0; l < L; l++) C[(i * N + j + jj) * L + l] = c[jj][l]; \
+        }                                                                      \
+        for (; j < N; j++) {                                                   \
+            double c[L] = {0};                                                 \
+            for (int p = 0; p < N; p++)                                        \
+                for (int l = 0; l < L; l++)                                    \
+                    c[l] += A[(i * N + p) * L + l] * B[(p * N + j) * L + l];   \
+            for (int l = 0; l < L; l++) C[(i * N + j) * L + l] = c[l];         \
+        }                                                                      \
+    }                                                                          \
+}
+
+// Runtime-n fallbacks, accumulating straight into C
+#define BATCH_GENERIC_KERNELS(ISA, TARGET)                                     \
+TARGET static void aos_##ISA##_any(int n, const double *restrict A,            \
+                                   const double *restrict B,                   \
+                                   double *restrict C) {                       \
+    for (int i = 0; i < n; i++) {                                              \
+        double *c = C + i * n;                                                 \
+        for (int j = 0; j < n; j++) c[j] = 0.0;                                \
+        for (int p = 0; p < n; p++) {                                          \
+            const double a = A[i * n + p];                                     \
+            for (int j = 0; j < n; j++) c[j] += a * B[p * n + j];              \
+        }                                                                      \
+    }                                                                          \
+}                                                                              \
+TARGET static void lanes_##ISA##_any(int n, const double *restrict A,          \
+                                     const double *restrict B,                 \
+                                     double *restrict C) {                     \
+    for (int i = 0; i < n; i++) {                                              \
+        for (int j = 0; j < n; j++) {                                          \
+            double c[L] = {0};                                                 \
+            for (int p = 0; p < n; p++)                                        \
+                for (int l = 0; l < L; l++)                                    \
+                    c[l] += A[(i * n + p) * L + l] * B[(p * n + j) * L + l];   \
+            for (int l = 0; l < L; l++) C[(i * n + j) * L + l] = c[l];         \
+        }                                                                      \
+    }                                                                          \
+}
+
+// Specialized sizes (listed in matmul.h next to matmul_batch_specialized)
+#define BATCH_ALL_KERNELS(ISA, TARGET)                                         \
+    BATCH_AOS_VEC(2, ISA, TARGET)   BATCH_AOS_LOOP(3, ISA, TARGET)             \
+    BATCH_AOS_VEC(4, ISA, TARGET)   BATCH_AOS_LOOP(5, ISA, TARGET)             \
+    BATCH_AOS_LOOP(6, ISA, TARGET)  BATCH_AOS_VEC(8, ISA, TARGET)              \
+    BATCH_AOS_LOOP(12, ISA, TARGET) BATCH_AOS_VEC(16, ISA, TARGET)             \
+    BATCH_AOS_LOOP(24, ISA, TARGET) BATCH_AOS_LOOP(32, ISA, TARGET)            \
+    BATCH_LANES(2, ISA, TARGET)  BATCH_LANES(3, ISA, TARGET)                   \
+    BATCH_LANES(4, ISA, TARGET)  BATCH_LANES(5, ISA, TARGET)                   \
+    BATCH_LANES(6, ISA, TARGET)  BATCH_LANES(8, ISA, TARGET)                   \
+    BATCH_LANES(12, ISA, TARGET) BATCH_LANES(16, ISA, TARGET)                  \
+    BATCH_LANES(24, ISA, TARGET) BATCH_LANES(32, ISA, TARGET)                  \
+    BATCH_GENERIC_KERNELS(ISA, TARGET)
+
+#define BATCH_FIXED_ENTRY(ISA, N) {N, aos_##ISA##_##N, lanes_##ISA##_##N}
+
+#define BATCH_KERNEL_SET(ISA) {                                                \
+    #ISA, aos_##ISA##_any, lanes_##ISA##_any, {                                \
+        BATCH_FIXED_ENTRY(ISA, 2),  BATCH_FIXED_ENTRY(ISA, 3),                 \
+        BATCH_FIXED_ENTRY(ISA, 4),  BATCH_FIXED_ENTRY(ISA, 5),                 \
+        BATCH_FIXED_ENTRY(ISA, 6),  BATCH_FIXED_ENTRY(ISA, 8),                 \
+        BATCH_FIXED_ENTRY(ISA, 12), BATCH_FIXED_ENTRY(ISA, 16),                \
+        BATCH_FIXED_ENTRY(ISA, 24), BATCH_FIXED_ENTRY(ISA, 32),                \
+    }                                                                          \
+}
+
+#define NUM_FIXED 10
+
+typedef struct {
+    const char *name;            // Matches matmul_packed_isa()
+    batch_generic_fn aos_any, lanes_any;
+    struct {
+        int n;
+        batch_fn aos, lanes;
+    } fixed[NUM_FIXED];
+} batch_kernel_set_t;
+
+BATCH_ALL_KERNELS(generic, )
+#ifdef BATCH_X86
+BATCH_ALL_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+BATCH_ALL_KERNELS(avx512, __attribute__((target("avx512f"))))
+#endif
+
+static const batch_kernel_set_t kernel_sets[] = {
+#ifdef BATCH_X86
+    BATCH_KERNEL_SET(avx512),
+    BATCH_KERNEL_SET(avx2),
+#endif
+    BATCH_KERNEL_SET(generic),
+};
+
+#define NUM_SETS ((int)(sizeof(kernel_sets) / sizeof(kernel_sets[0])))
+
+// Same ISA as the packed micro-kernel, so MATMUL_ISA caps both
+static const batch_kernel_set_t *select_kernels(void) {
+    static const batch_kernel_set_t *selected = NULL;
+    if (selected) return selected;
+    const char *isa = matmul_packed_isa(NULL, NULL);
+    selected = &kernel_sets[NUM_SETS - 1];
+    for (int i = 0; i < NUM_SETS; i++) {
+        if (strcmp(kernel_sets[i].name, isa) == 0) selected = &kernel_sets[i];
+    }
+    return selected;
+}
+
+static int find_fixed(int n) {
+    for (int f = 0; f < NUM_FIXED; f++)
+        if (kernel_sets[0].fixed[f].n == n) return f;
+    return -1;
+}
+
+int matmul_batch_specialized(int n) {
+    return find_fixed(n) >= 0;
+}
+
+// ============================================================================
+// Layout helpers
+// ============================================================================
+
+long matmul_batch_elems(int n, int count, matmul_batch_layout_t layout) {
+    const long units = (layout == MATMUL_BATCH_INTERLEAVED) ? (long)CEIL_DIV(count, L) * L : count;
+    return units * n * n;
+}
+
+void matmul_batch_interleave(int n, int count, const double *aos, double *lanes) {
+    const long nn = (long)n * n;
+    for (int b0 = 0; b0 < count; b0 += L) {
+        double *dst = lanes + (long)b0 * nn;
+        const int lanes_used = MIN(L, count - b0);
+        for (long e = 0; e < nn; e++) {
+            for (int l = 0; l < lanes_used; l++) dst[e * L + l] = aos[(b0 + l) * nn + e];
+            for (int l = lanes_used; l < L; l++) dst[e * L + l] = 0.0;
+        }
+    }
+}
+
+void matmul_batch_deinterleave(int n, int count, const double *lanes, double *aos) {
+    const long nn = (long)n * n;
+    for (int b0 = 0; b0 < count; b0 += L) {
+        const double *src = lanes + (long)b0 * nn;
+        const int lanes_used = MIN(L, count - b0);
+        for (long e = 0; e < nn; e++) {
+            for (int l = 0; l < lanes_used; l++) aos[(b0 + l) * nn + e] = src[e * L + l];
+        }
+    }
+}
+
+// ============================================================================
+// Batched driver
+// ============================================================================
+
+typedef struct {
+    int n, units, per_task;    // units: matrices (AoS) or lane blocks
+    long stride;               // doubles per unit
+    const double *A, *B;
+    double *C;
+    batch_fn fixed;            // NULL: runtime-n kernel
+    batch_generic_fn any;
+} batch_job_t;
+
+static void batch_task(void *arg, int task, int worker) {
+    batch_job_t *job = arg;
+    (void)worker;
+    const int u0 = task * job->per_task;
+    const int u1 = MIN(u0 + job->per_task, job->units);
+    for (int u = u0; u < u1; u++) {
+        const long off = u * job->stride;
+        if (job->fixed) job->fixed(job->A + off, job->B + off, job->C + off);
+        else            job->any(job->n, job->A + off, job->B + off, job->C + off);
+    }
+}
+
+void matmul_batched(int n, int count, const double *A, const double *B, double *C,
+                    matmul_batch_layout_t layout, struct threadpool *pool) {
+    if (n < 1 || count < 1) return;
+    const batch_kernel_set_t *ks = select_kernels();
+    const int f = find_fixed(n);
+    const int interleaved = (layout == MATMUL_BATCH_INTERLEAVED);
+    batch_job_t job;
+    job.n = n;
+    job.units = interleaved ? CEIL_DIV(count, L) : count;
+    job.stride = (long)n * n * (interleaved ? L : 1);
+    job.A = A;
+    job.B = B;
+    job.C = C;
+    job.fixed = (f < 0) ? NULL : interleaved ? ks->fixed[f].lanes : ks->fixed[f].aos;
+    job.any = interleaved ? ks->lanes_any : ks->aos_any;
+
+    const long unit_bytes = 3 * job.stride * (long)sizeof(double);
+    job.per_task = (int)(TASK_BYTES / unit_bytes);
+    if (job.per_task < 1) job.per_task = 1;
+    const int tasks = CEIL_DIV(job.units, job.per_task);
+
+    if (pool && threadpool_size(pool) > 1 && tasks > 1) {
+        threadpool_run(pool, tasks, batch_task, &job);
+    } else {
+        for (int t = 0; t < tasks; t++) batch_task(&job, t, 0);
+    }
+}
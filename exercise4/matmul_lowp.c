@@ -0,0 +1,479 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - reduced precision
+ *
+ * float32, bf16 (fp32 accumulation) and int8 (int32 accumulation) GEMM.
+ * All three share one packed format: k is cut into groups of G elements
+ * (G = 1, 2, 4) so that every packed word is 32 bits. A micro-kernel
+ * broadcasts one word of A per row and multiplies it with a 32-column
+ * row of packed B words, which is exactly the operand shape of
+ *   f32   VFMADD231PS  (one product per lane)
+ *   bf16  VDPBF16PS    (AVX512_BF16, pair of products per fp32 lane)
+ *   int8  VPDPBUSD     (AVX512_VNNI, four u8 x s8 products per int32 lane)
+ * VPDPBUSD wants unsigned A, so A is packed as a + 128 (a ^ 0x80) and
+ * 128 * sum_p B[p][j] is subtracted from C at the end.
+ *
+ * Without the native instructions bf16 is widened to fp32 in registers
+ * (AVX-512F), and every type has a portable C kernel on the same format.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "matmul.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOWP_X86 1
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define CEIL_DIV(a, b) (((a) + (b) - 1) / (b))
+
+#define MR 8        // Rows of C per micro-kernel
+#define NR 32       // Columns of C per micro-kernel (two 16-lane vectors)
+#define KG 256      // k groups per packed panel
+#define NC 1024     // Columns of B per packed panel
+
+// C[MR x NR] += Ap (kg words per row, row-interleaved) * Bp (kg x NR words);
+// c is float or int32 depending on the kernel
+typedef void (*lowp_kernel_fn)(int kg, const uint32_t *restrict a,
+                               const uint32_t *restrict b, void *restrict c, long ldc);
+
+typedef struct {
+    const char *name;
+    lowp_kernel_fn kernel;
+} lowp_kernel_t;
+
+// ============================================================================
+// bf16 conversion
+// ============================================================================
+
+matmul_bf16_t matmul_to_bf16(float x) {
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    if ((u & 0x7fffffffu) > 0x7f800000u) return (matmul_bf16_t)(u >> 16 | 0x40);  // Quiet NaN
+    u += 0x7fffu + (u >> 16 & 1);  // Round to nearest even
+    return (matmul_bf16_t)(u >> 16);
+}
+
+float matmul_from_bf16(matmul_bf16_t x) {
+    uint32_t u = (uint32_t)x << 16;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline float word_lo_f32(uint32_t w) {
+    uint32_t u = w << 16;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline float word_hi_f32(uint32_t w) {
+    uint32_t u = w & 0xffff0000u;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// ============================================================================
+// Portable kernels
+// ============================================================================
+
+static void lowp_f32_generic(int kg, const uint32_t *restrict a, const uint32_t *restrict b,
+                             void *restrict cv, long ldc) {
+    float acc[MR][NR] = {{0}};
+    for (int g = 0; g < kg; g++) {
+        float af[MR], bf[NR];
+        memcpy(af, a + g * MR, sizeof(af));
+        memcpy(bf, b + g * NR, sizeof(bf));
+        for (int r = 0; r < MR; r++)
+            for (int j = 0; j < NR; j++) acc[r][j] += af[r] * bf[j];
+    }
+    float *c = cv;
+    for (int r = 0; r < MR; r++)
+        for (int j = 0; j < NR; j++) c[r * ldc + j] += acc[r][j];
+}
+
+static void lowp_bf16_generic(int kg, const uint32_t *restrict a, const uint32_t *restrict b,
+                              void *restrict cv, long ldc) {
+    float acc[MR][NR] = {{0}};
+    for (int g = 0; g < kg; g++) {
+        float b_lo[NR], b_hi[NR];
+        for (int j = 0; j < NR; j++) {
+            b_lo[j] = word_lo_f32(b[g * NR + j]);
+            b_hi[j] = word_hi_f32(b[g * NR + j]);
+        }
+        for (int r = 0; r < MR; r++) {
+            const float lo = word_lo_f32(a[g * MR + r]), hi = word_hi_f32(a[g * MR + r]);
+            for (int j = 0; j < NR; j++) acc[r][j] += lo * b_lo[j] + hi * b_hi[j];
+        }
+    }
+    float *c = cv;
+    for (int r = 0; r < MR; r++)
+        for (int j = 0; j < NR; j++) c[r * ldc + j] += acc[r][j];
+}
+
+static void lowp_i8_generic(int kg, const uint32_t *restrict a, const uint32_t *restrict b,
+                            void *restrict cv, long ldc) {
+    int32_t acc[MR][NR] = {{0}};
+    for (int g = 0; g < kg; g++) {
+        const int8_t *bq = (const int8_t *)(b + g * NR);
+        for (int r = 0; r < MR; r++) {
+            const uint8_t *aq = (const uint8_t *)(a + g * MR + r);
+            for (int j = 0; j < NR; j++) {
+                acc[r][j] += aq[0] * bq[4 * j] + aq[1] * bq[4 * j + 1] +
+                             aq[2] * bq[4 * j + 2] + aq[3] * bq[4 * j + 3];
+            }
+        }
+    }
+    int32_t *c = cv;
+    for (int r = 0; r < MR; r++)
+        for (int j = 0; j < NR; j++) c[r * ldc + j] += acc[r][j];
+}
+
+// ============================================================================
+// AVX-512 kernels
+// ============================================================================
+
+#ifdef LOWP_X86
+#define STORE_PS(c, ldc, acc) do {                                             \
+        for (int r = 0; r < MR; r++) {                                         \
+            float *cr = (float *)(c) + r * (ldc);                              \
+            _mm512_storeu_ps(cr,      _mm512_add_ps(_mm512_loadu_ps(cr),      acc[r][0])); \
+            _mm512_storeu_ps(cr + 16, _mm512_add_ps(_mm512_loadu_ps(cr + 16), acc[r][1])); \
+        }                                                                      \
+    } while (0)
+
+__attribute__((target("avx512f")))
+static void lowp_f32_avx512(int kg, const uint32_t *restrict a, const uint32_t *restrict b,
+                            void *restrict c, long ldc) {
+    __m512 acc[MR][2];
+    for (int r = 0; r < MR; r++) acc[r][0] = acc[r][1] = _mm512_setzero_ps();
+    const float *af = (const float *)a, *bf = (const float *)b;
+    for (int g = 0; g < kg; g++) {
+        const __m512 b0 = _mm512_load_ps(bf), b1 = _mm512_load_ps(bf + 16);
+#pragma GCC unroll 8
+        for (int r = 0; r < MR; r++) {
+            const __m512 ar = _mm512_set1_ps(af[r]);
+            acc[r][0] = _mm512_fmadd_ps(ar, b0, acc[r][0]);
+            acc[r][1] = _mm512_fmadd_ps(ar, b1, acc[r][1]);
+        }
+        af += MR;
+        bf += NR;
+    }
+    STORE_PS(c, ldc, acc);
+}
+
+__attribute__((target("avx512f,avx512bf16")))
+static void lowp_bf16_avx512bf16(int kg, const uint32_t *restrict a, const uint32_t *restrict b,
+                                 void *restrict c, long ldc) {
+    __m512 acc[MR][2];
+    for (int r = 0; r < MR; r++) acc[r][0] = acc[r][1] = _mm512_setzero_ps();
+    for (int g = 0; g < kg; g++) {
+        const __m512bh b0 = (__m512bh)_mm512_load_si512(b);
+        const __m512bh b1 = (__m512bh)_mm512_load_si512(b + 16);
+#pragma GCC unroll 8
+        for (int r = 0; r < MR; r++) {
+            const __m512bh ar = (__m512bh)_mm512_set1_epi32((int)a[r]);
+            acc[r][0] = _mm512_dpbf16_ps(acc[r][0], ar, b0);
+            acc[r][1] = _mm512_dpbf16_ps(acc[r][1], ar, b1);
+        }
+        a += MR;
+        b += NR;
+    }
+    STORE_PS(c, ldc, acc);
+}
+
+// bf16 pairs widened to fp32 in registers: the low half of each word
+// shifted up, the high half masked
+__attribute__((target("avx512f")))
+static void lowp_bf16_avx512(int kg, const uint32_t *restrict a, const uint32_t *restrict b,
+                             void *restrict c, long ldc) {
+    __m512 acc[MR][2];
+    for (int r = 0; r < MR; r++) acc[r][0] = acc[r][1] = _mm512_setzero_ps();
+    const __m512i hi_mask = _mm512_set1_epi32((int)0xffff0000u);
+    for (int g = 0; g < kg; g++) {
+        const __m512i w0 = _mm512_load_si512(b), w1 = _mm512_load_si512(b + 16);
+        const __m512 b0_lo = _mm512_castsi512_ps(_mm512_slli_epi32(w0, 16));
+        const __m512 b0_hi = _mm512_castsi512_ps(_mm512_and_si512(w0, hi_mask));
+        const __m512 b1_lo = _mm512_castsi512_ps(_mm512_slli_epi32(w1, 16));
+        const __m512 b1_hi = _mm512_castsi512_ps(_mm512_and_si512(w1, hi_mask));
+#pragma GCC unroll 8
+        for (int r = 0; r < MR; r++) {
+            const __m512 lo = _mm512_set1_ps(word_lo_f32(a[r]));
+            const __m512 hi = _mm512_set1_ps(word_hi_f32(a[r]));
+            acc[r][0] = _mm512_fmadd_ps(hi, b0_hi, _mm512_fmadd_ps(lo, b0_lo, acc[r][0]));
+            acc[r][1] = _mm512_fmadd_ps(hi, b1_hi, _mm512_fmadd_ps(lo, b1_lo, acc[r][1]));
+        }
+        a += MR;
+        b += NR;
+    }
+    STORE_PS(c, ldc, acc);
+}
+
+__attribute__((target("avx512f,avx512vnni")))
+static void lowp_i8_avx512vnni(int kg, const uint32_t *restrict a, const uint32_t *restrict b,
+                               void *restrict c, long ldc) {
+    __m512i acc[MR][2];
+    for (int r = 0; r < MR; r++) acc[r][0] = acc[r][1] = _mm512_setzero_si512();
+    for (int g = 0; g < kg; g++) {
+        const __m512i b0 = _mm512_load_si512(b), b1 = _mm512_load_si512(b + 16);
+#pragma GCC unroll 8
+        for (int r = 0; r < MR; r++) {
+            const __m512i ar = _mm512_set1_epi32((int)a[r]);
+            acc[r][0] = _mm512_dpbusd_epi32(acc[r][0], ar, b0);
+            acc[r][1] = _mm512_dpbusd_epi32(acc[r][1], ar, b1);
+        }
+        a += MR;
+        b += NR;
+    }
+    for (int r = 0; r < MR; r++) {
+        int32_t *cr = (int32_t *)c + r * ldc;
+        _mm512_storeu_si512(cr, _mm512_add_epi32(_mm512_loadu_si512(cr), acc[r][0]));
+        _mm512_storeu_si512(cr + 16, _mm512_add_epi32(_mm512_loadu_si512(cr + 16), acc[r][1]));
+    }
+}
+#undef STORE_PS
+#endif // LOWP_X86
+
+// ============================================================================
+// Kernel selection
+// ============================================================================
+
+// The AVX-512 tiers follow the packed double kernel, so MATMUL_ISA below
+// avx512 selects the portable kernels here as well
+static const lowp_kernel_t *select_kernel(matmul_lowp_type_t type) {
+    static const lowp_kernel_t generic[MATMUL_LOWP_NUM_TYPES] = {
+        {"generic", lowp_f32_generic},
+        {"generic", lowp_bf16_generic},
+        {"generic", lowp_i8_generic},
+    };
+#ifdef LOWP_X86
+    static const lowp_kernel_t f32_avx512 = {"avx512f", lowp_f32_avx512};
+    static const lowp_kernel_t bf16_native = {"avx512-bf16", lowp_bf16_avx512bf16};
+    static const lowp_kernel_t bf16_avx512 = {"avx512f-widen", lowp_bf16_avx512};
+    static const lowp_kernel_t i8_native = {"avx512-vnni", lowp_i8_avx512vnni};
+
+    if (strcmp(matmul_packed_isa(NULL, NULL), "avx512") == 0) {
+        switch (type) {
+            case MATMUL_LOWP_F32:
+                return &f32_avx512;
+            case MATMUL_LOWP_BF16:
+                return __builtin_cpu_supports("avx512bf16") ? &bf16_native : &bf16_avx512;
+            case MATMUL_LOWP_I8:
+                if (__builtin_cpu_supports("avx512vnni")) return &i8_native;
+                break;
+            default:
+                break;
+        }
+    }
+#endif
+    return &generic[type];
+}
+
+const char *matmul_lowp_isa(matmul_lowp_type_t type) {
+    if (type < 0 || type >= MATMUL_LOWP_NUM_TYPES) return "?";
+    return select_kernel(type)->name;
+}
+
+// ============================================================================
+// Packing and blocked driver
+// ============================================================================
+
+typedef struct {
+    int group;        // k elements per 32-bit word
+    int elem;         // Bytes per element
+    int flip_a;       // XOR A bytes with 0x80 (int8: a + 128 as u8)
+} lowp_format_t;
+
+static const lowp_format_t formats[MATMUL_LOWP_NUM_TYPES] = {
+    {1, 4, 0},   // f32
+    {2, 2, 0},   // bf16
+    {4, 1, 1},   // int8
+};
+
+// Word of G consecutive elements of X starting at element offset, with
+// only the first avail of them present (the rest are zero)
+static inline uint32_t load_word(const unsigned char *x, int elem, int avail, int flip) {
+    uint32_t w = 0;
+    memcpy(&w, x, (size_t)elem * avail);
+    if (flip) {
+        // Padding bytes stay zero so they contribute nothing
+        const uint32_t mask = avail >= 4 ? 0xffffffffu : (1u << (8 * avail)) - 1u;
+        w ^= 0x80808080u & mask;
+    }
+    return w;
+}
+
+// MR rows x kg groups of A -> row-interleaved words (zero padded)
+static void pack_a(const lowp_format_t *f, int rows, int p0, int k, int kg,
+                   const unsigned char *A, long lda_bytes, uint32_t *Ap) {
+    const uint32_t flip = f->flip_a ? 0x80808080u : 0u;
+    for (int g = 0; g < kg; g++, Ap += MR) {
+        const int p = p0 + g * f->group;
+        const int avail = MIN(f->group, k - p);
+        const unsigned char *a = A + (long)p * f->elem;
+        int r = 0;
+        if (avail == f->group) {
+            // Full word: G consecutive elements are one 32-bit load
+            for (; r < rows; r++) {
+                uint32_t w;
+                memcpy(&w, a + r * lda_bytes, sizeof(w));
+                Ap[r] = w ^ flip;
+            }
+        } else if (avail > 0) {
+            for (; r < rows; r++) Ap[r] = load_word(a + r * lda_bytes, f->elem, avail, f->flip_a);
+        }
+        for (; r < MR; r++) Ap[r] = 0;
+    }
+}
+
+// kg groups x nb columns of B -> strips of NR columns, one word per
+// (group, column) holding G consecutive rows of that column
+static void pack_b(const lowp_format_t *f, int nb, int p0, int k, int kg,
+                   const unsigned char *B, long ldb_bytes, uint32_t *Bp) {
+    for (int j0 = 0; j0 < nb; j0 += NR) {
+        for (int g = 0; g < kg; g++) {
+            const int p = p0 + g * f->group;
+            for (int j = 0; j < NR; j++) {
+                uint32_t w = 0;
+                if (j0 + j < nb) {
+                    for (int e = 0; e < f->group && p + e < k; e++) {
+                        uint32_t v = 0;
+                        memcpy(&v, B + (long)(p + e) * ldb_bytes + (long)(j0 + j) * f->elem, f->elem);
+                        w |= v << (8 * f->elem * e);
+                    }
+                }
+                *Bp++ = w;
+            }
+        }
+    }
+}
+
+// pack_b() for one element per word (f32): each strip row is a plain copy
+// of a row of B. Kept apart so the general pack_b() stays as compiled.
+static void pack_b_words(int nb, int p0, int kg, const unsigned char *B, long ldb_bytes,
+                         uint32_t *Bp) {
+    for (int j0 = 0; j0 < nb; j0 += NR) {
+        const int cols = MIN(NR, nb - j0);
+        for (int g = 0; g < kg; g++, Bp += NR) {
+            memcpy(Bp, B + (long)(p0 + g) * ldb_bytes + (long)j0 * 4, (size_t)cols * 4);
+            if (cols < NR) memset(Bp + cols, 0, (size_t)(NR - cols) * 4);
+        }
+    }
+}
+
+int matmul_lowp_buf_alloc(matmul_lowp_buf_t *buf) {
+    buf->Ap = aligned_alloc(64, sizeof(uint32_t) * MR * KG);
+    buf->Bp = aligned_alloc(64, sizeof(uint32_t) * KG * NC);
+    if (!buf->Ap || !buf->Bp) {
+        matmul_lowp_buf_free(buf);
+        return -1;
+    }
+    return 0;
+}
+
+void matmul_lowp_buf_free(matmul_lowp_buf_t *buf) {
+    free(buf->Ap);
+    free(buf->Bp);
+    buf->Ap = buf->Bp = NULL;
+}
+
+static int lowp_gemm(matmul_lowp_type_t type, int m, int n, int k,
+                     const void *A, int lda, const void *B, int ldb, void *C, int ldc,
+                     const matmul_lowp_buf_t *caller_buf) {
+    const lowp_format_t *f = &formats[type];
+    const lowp_kernel_fn kernel = select_kernel(type)->kernel;
+    const int kg_total = CEIL_DIV(k, f->group);
+    const long lda_b = (long)lda * f->elem, ldb_b = (long)ldb * f->elem;
+    if (m <= 0 || n <= 0) return 0;
+
+    // Every allocation happens before C is written: a failure leaves it as it was
+    matmul_lowp_buf_t own = {NULL, NULL};
+    const matmul_lowp_buf_t *buf = caller_buf;
+    if (!buf) {
+        if (matmul_lowp_buf_alloc(&own) != 0) return -1;
+        buf = &own;
+    }
+    int32_t *colsum = NULL;
+    if (f->flip_a && !(colsum = calloc(n, sizeof(int32_t)))) {
+        matmul_lowp_buf_free(&own);
+        return -1;
+    }
+    uint32_t *Ap = buf->Ap, *Bp = buf->Bp;
+
+    // C elements are 4 bytes (float or int32) and all-zero bits is 0 in both
+    for (int i = 0; i < m; i++) memset((char *)C + (long)i * ldc * 4, 0, (size_t)n * 4);
+
+    for (int jc = 0; jc < n; jc += NC) {
+        const int nb = MIN(NC, n - jc);
+        for (int gc = 0; gc < kg_total; gc += KG) {
+            const int kg = MIN(KG, kg_total - gc);
+            const int p0 = gc * f->group;
+            const unsigned char *b = (const unsigned char *)B + (long)jc * f->elem;
+            if (f->group == 1) pack_b_words(nb, p0, kg, b, ldb_b, Bp);
+            else pack_b(f, nb, p0, k, kg, b, ldb_b, Bp);
+            for (int ir = 0; ir < m; ir += MR) {
+                const int rows = MIN(MR, m - ir);
+                pack_a(f, rows, p0, k, kg, (const unsigned char *)A + ir * lda_b, lda_b, Ap);
+                for (int jr = 0; jr < nb; jr += NR) {
+                    const int cols = MIN(NR, nb - jr);
+                    char *c = (char *)C + ((long)ir * ldc + jc + jr) * 4;
+                    const uint32_t *bp = Bp + (long)jr * kg;
+                    if (rows == MR && cols == NR) {
+                        kernel(kg, Ap, bp, c, ldc);
+                        continue;
+                    }
+                    // Partial tile: compute the full MR x NR tile aside
+                    union { float f[MR * NR]; int32_t i[MR * NR]; } edge;
+                    memset(&edge, 0, sizeof(edge));
+                    kernel(kg, Ap, bp, &edge, NR);
+                    for (int i = 0; i < rows; i++) {
+                        for (int j = 0; j < cols; j++) {
+                            if (type == MATMUL_LOWP_I8) {
+                                ((int32_t *)c)[i * ldc + j] += edge.i[i * NR + j];
+                            } else {
+                                ((float *)c)[i * ldc + j] += edge.f[i * NR + j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (f->flip_a) {
+        // Undo the +128 on A: C[i][j] -= 128 * sum_p B[p][j]
+        const int8_t *Bq = B;
+        for (int p = 0; p < k; p++)
+            for (int j = 0; j < n; j++) colsum[j] += Bq[(long)p * ldb + j];
+        for (int i = 0; i < m; i++) {
+            int32_t *ci = (int32_t *)C + (long)i * ldc;
+            for (int j = 0; j < n; j++) ci[j] -= 128 * colsum[j];
+        }
+    }
+
+    free(colsum);
+    matmul_lowp_buf_free(&own);
+    return 0;
+}
+
+int matmul_f32(int m, int n, int k, const float *A, int lda, const float *B, int ldb,
+               float *C, int ldc, const matmul_lowp_buf_t *buf) {
+    return lowp_gemm(MATMUL_LOWP_F32, m, n, k, A, lda, B, ldb, C, ldc, buf);
+}
+
+int matmul_bf16(int m, int n, int k, const matmul_bf16_t *A, int lda,
+                const matmul_bf16_t *B, int ldb, float *C, int ldc, const matmul_lowp_buf_t *buf) {
+    return lowp_gemm(MATMUL_LOWP_BF16, m, n, k, A, lda, B, ldb, C, ldc, buf);
+}
+
+int matmul_i8(int m, int n, int k, const int8_t *A, int lda, const int8_t *B, int ldb,
+              int32_t *C, int ldc, const matmul_lowp_buf_t *buf) {
+    return lowp_gemm(MATMUL_LOWP_I8, m, n, k, A, lda, B, ldb, C, ldc, buf);
+}
@@ -0,0 +1,384 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - packed SIMD kernel
+ *
+ * GotoBLAS/BLIS-style GEMM: a kc x nc panel of B and an mc x kc block of
+ * A are copied ("packed") into contiguous micro-panels, and a register
+ * blocked micro-kernel computes an MR x NR tile of C entirely in vector
+ * registers, streaming one packed column of A and one packed row of B per
+ * k step.
+ *
+ * Micro-kernels (selected once at runtime from the CPU features):
+ *   avx512  12 x 16   24 zmm accumulators
+ *   avx2     6 x 8    12 ymm accumulators (FMA3)
+ *   generic  4 x 8    plain C, left to the auto-vectorizer
+ * The MATMUL_ISA environment variable (generic|avx2|avx512) forces a
+ * lower ISA for comparison.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "matmul.h"
+#include "timing.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATMUL_X86 1
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define ROUND_UP(x, m) (((x) + (m) - 1) / (m) * (m))
+
+#define MAX_MR 12
+#define MAX_NR 16
+
+// C[MR x NR] += Ap (kc x MR, column per k) * Bp (kc x NR, row per k)
+typedef void (*ukernel_t)(int kc, const double *restrict a, const double *restrict b,
+                          double *restrict c, long ldc);
+
+typedef struct {
+    const char *name;
+    int mr, nr;
+    ukernel_t kernel;
+    double (*peak)(void);   // FMA-throughput microbenchmark, GFLOP/s
+} ukernel_info_t;
+
+// ============================================================================
+// Micro-kernels
+// ============================================================================
+
+static void ukr_generic_4x8(int kc, const double *restrict a, const double *restrict b,
+                            double *restrict c, long ldc) {
+    double acc[4][8] = {{0}};
+    for (int p = 0; p < kc; p++) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 8; j++) {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += 4;
+        b += 8;
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 8; j++) {
+            c[i * ldc + j] += acc[i][j];
+        }
+    }
+}
+
+// Independent accumulation chains so throughput, not latency, is measured
+#define PEAK_ITERS 20000000L
+
+static double peak_generic(void) {
+    double acc[16] = {0};
+    const double x = 1.0000001, y = 0.9999999;
+    double start = get_time_ns();
+    for (long it = 0; it < PEAK_ITERS; it++) {
+        for (int j = 0; j < 16; j++) acc[j] = acc[j] * x + y;
+    }
+    double t = get_time_ns() - start;
+    volatile double sink = 0.0;
+    for (int j = 0; j < 16; j++) sink += acc[j];
+    return 2.0 * 16 * PEAK_ITERS / t;
+}
+
+#ifdef MATMUL_X86
+__attribute__((target("avx2,fma")))
+static void ukr_avx2_6x8(int kc, const double *restrict a, const double *restrict b,
+                         double *restrict c, long ldc) {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+    for (int p = 0; p < kc; p++) {
+        const __m256d b0 = _mm256_load_pd(b);
+        const __m256d b1 = _mm256_load_pd(b + 4);
+        __m256d ai;
+        ai = _mm256_broadcast_sd(a + 0);
+        c00 = _mm256_fmadd_pd(ai, b0, c00); c01 = _mm256_fmadd_pd(ai, b1, c01);
+        ai = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_fmadd_pd(ai, b0, c10); c11 = _mm256_fmadd_pd(ai, b1, c11);
+        ai = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_fmadd_pd(ai, b0, c20); c21 = _mm256_fmadd_pd(ai, b1, c21);
+        ai = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_fmadd_pd(ai, b0, c30); c31 = _mm256_fmadd_pd(ai, b1, c31);
+        ai = _mm256_broadcast_sd(a + 4);
+        c40 = _mm256_fmadd_pd(ai, b0, c40); c41 = _mm256_fmadd_pd(ai, b1, c41);
+        ai = _mm256_broadcast_sd(a + 5);
+        c50 = _mm256_fmadd_pd(ai, b0, c50); c51 = _mm256_fmadd_pd(ai, b1, c51);
+        a += 6;
+        b += 8;
+    }
+
+#define STORE_ROW(i, lo, hi) do { \
+        double *ci = c + (i) * ldc; \
+        _mm256_storeu_pd(ci,     _mm256_add_pd(_mm256_loadu_pd(ci),     lo)); \
+        _mm256_storeu_pd(ci + 4, _mm256_add_pd(_mm256_loadu_pd(ci + 4), hi)); \
+    } while (0)
+    STORE_ROW(0, c00, c01); STORE_ROW(1, c10, c11); STORE_ROW(2, c20, c21);
+    STORE_ROW(3, c30, c31); STORE_ROW(4, c40, c41); STORE_ROW(5, c50, c51);
+#undef STORE_ROW
+}
+
+__attribute__((target("avx2,fma")))
+static double peak_avx2(void) {
+    __m256d acc[12];
+    for (int j = 0; j < 12; j++) acc[j] = _mm256_setzero_pd();
+    const __m256d x = _mm256_set1_pd(1.0000001), y = _mm256_set1_pd(0.9999999);
+    double start = get_time_ns();
+    for (long it = 0; it < PEAK_ITERS; it++) {
+        for (int j = 0; j < 12; j++) acc[j] = _mm256_fmadd_pd(acc[j], x, y);
+    }
+    double t = get_time_ns() - start;
+    volatile double sink = 0.0;
+    for (int j = 0; j < 12; j++) sink += _mm256_cvtsd_f64(acc[j]);
+    return 2.0 * 4 * 12 * PEAK_ITERS / t;
+}
+
+__attribute__((target("avx512f")))
+static void ukr_avx512_12x16(int kc, const double *restrict a, const double *restrict b,
+                             double *restrict c, long ldc) {
+    __m512d acc[12][2];
+    for (int i = 0; i < 12; i++) {
+        acc[i][0] = _mm512_setzero_pd();
+        acc[i][1] = _mm512_setzero_pd();
+    }
+
+    for (int p = 0; p < kc; p++) {
+        const __m512d b0 = _mm512_load_pd(b);
+        const __m512d b1 = _mm512_load_pd(b + 8);
+#pragma GCC unroll 12
+        for (int i = 0; i < 12; i++) {
+            const __m512d ai = _mm512_set1_pd(a[i]);
+            acc[i][0] = _mm512_fmadd_pd(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_pd(ai, b1, acc[i][1]);
+        }
+        a += 12;
+        b += 16;
+    }
+
+#pragma GCC unroll 12
+    for (int i = 0; i < 12; i++) {
+        double *ci = c + i * ldc;
+        _mm512_storeu_pd(ci,     _mm512_add_pd(_mm512_loadu_pd(ci),     acc[i][0]));
+        _mm512_storeu_pd(ci + 8, _mm512_add_pd(_mm512_loadu_pd(ci + 8), acc[i][1]));
+    }
+}
+
+__attribute__((target("avx512f")))
+static double peak_avx512(void) {
+    __m512d acc[24];
+    for (int j = 0; j < 24; j++) acc[j] = _mm512_setzero_pd();
+    const __m512d x = _mm512_set1_pd(1.0000001), y = _mm512_set1_pd(0.9999999);
+    double start = get_time_ns();
+    for (long it = 0; it < PEAK_ITERS; it++) {
+#pragma GCC unroll 24
+        for (int j = 0; j < 24; j++) acc[j] = _mm512_fmadd_pd(acc[j], x, y);
+    }
+    double t = get_time_ns() - start;
+    volatile double sink = 0.0;
+    for (int j = 0; j < 24; j++) sink += _mm512_reduce_add_pd(acc[j]);
+    return 2.0 * 8 * 24 * PEAK_ITERS / t;
+}
+#endif // MATMUL_X86
+
+static const ukernel_info_t ukernels[] = {
+#ifdef MATMUL_X86
+    {"avx512", 12, 16, ukr_avx512_12x16, peak_avx512},
+    {"avx2",    6,  8, ukr_avx2_6x8,     peak_avx2},
+#endif
+    {"generic", 4,  8, ukr_generic_4x8,  peak_generic},
+};
+
+#define NUM_UKERNELS ((int)(sizeof(ukernels) / sizeof(ukernels[0])))
+
+static int isa_supported(const char *name) {
+#ifdef MATMUL_X86
+    if (strcmp(name, "avx512") == 0) return __builtin_cpu_supports("avx512f");
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    return strcmp(name, "generic") == 0;
+}
+
+// Best supported micro-kernel, no higher than MATMUL_ISA if set
+static const ukernel_info_t *select_ukernel(void) {
+    static const ukernel_info_t *selected = NULL;
+    if (selected) return selected;
+
+    const char *cap = getenv("MATMUL_ISA");
+    int allowed = (cap == NULL);
+    for (int i = 0; i < NUM_UKERNELS; i++) {
+        if (!allowed && strcmp(cap, ukernels[i].name) == 0) allowed = 1;
+        if (allowed && isa_supported(ukernels[i].name)) {
+            selected = &ukernels[i];
+            return selected;
+        }
+    }
+    selected = &ukernels[NUM_UKERNELS - 1];
+    return selected;
+}
+
+const char *matmul_packed_isa(int *mr, int *nr) {
+    const ukernel_info_t *uk = select_ukernel();
+    if (mr) *mr = uk->mr;
+    if (nr) *nr = uk->nr;
+    return uk->name;
+}
+
+double matmul_peak_gflops(void) {
+    return select_ukernel()->peak();
+}
+
+// ============================================================================
+// Packing
+// ============================================================================
+
+// Operands are addressed through (row, column) strides, so row-major,
+// column-major and transposed views all pack into the same panel format.
+
+// mb x kb block of A -> ceil(mb/MR) micro-panels, each kb x MR (zero padded)
+static void pack_a(int mb, int kb, const double *A, long rs, long cs, double *Ap, int mr) {
+    for (int ir = 0; ir < mb; ir += mr) {
+        const int rows = MIN(mr, mb - ir);
+        if (cs == 1) {
+            // Row-major: read each row of the panel contiguously
+            for (int i = 0; i < rows; i++) {
+                const double *a = A + (ir + i) * rs;
+                for (int p = 0; p < kb; p++) Ap[(long)p * mr + i] = a[p];
+            }
+            for (int i = rows; i < mr; i++)
+                for (int p = 0; p < kb; p++) Ap[(long)p * mr + i] = 0.0;
+            Ap += (long)kb * mr;
+        } else {
+            for (int p = 0; p < kb; p++) {
+                const double *a = A + ir * rs + p * cs;
+                int i = 0;
+                for (; i < rows; i++) Ap[i] = a[i * rs];
+                for (; i < mr; i++)   Ap[i] = 0.0;
+                Ap += mr;
+            }
+        }
+    }
+}
+
+// kb x nb panel of B -> ceil(nb/NR) micro-panels, each kb x NR (zero padded)
+static void pack_b(int kb, int nb, const double *B, long rs, long cs, double *Bp, int nr) {
+    for (int jr = 0; jr < nb; jr += nr) {
+        const int cols = MIN(nr, nb - jr);
+        for (int p = 0; p < kb; p++) {
+            const double *b = B + p * rs + jr * cs;
+            int j = 0;
+            if (cs == 1) {
+                for (; j < cols; j++) Bp[j] = b[j];
+            } else {
+                for (; j < cols; j++) Bp[j] = b[j * cs];
+            }
+            for (; j < nr; j++)   Bp[j] = 0.0;
+            Bp += nr;
+        }
+    }
+}
+
+// ============================================================================
+// Macro-kernel and driver
+// ============================================================================
+
+// C[mb x nb] += packed A block * packed B panel
+static void macro_kernel(const ukernel_info_t *uk, int mb, int nb, int kb,
+                         const double *Ap, const double *Bp, double *C, int ldc) {
+    const int mr = uk->mr, nr = uk->nr;
+    double edge[MAX_MR * MAX_NR] __attribute__((aligned(64)));
+
+    for (int jr = 0; jr < nb; jr += nr) {
+        const int cols = MIN(nr, nb - jr);
+        const double *bp = Bp + (long)jr * kb;
+        for (int ir = 0; ir < mb; ir += mr) {
+            const int rows = MIN(mr, mb - ir);
+            const double *ap = Ap + (long)ir * kb;
+            double *c = C + (long)ir * ldc + jr;
+            if (rows == mr && cols == nr) {
+                uk->kernel(kb, ap, bp, c, ldc);
+            } else {
+                // Partial tile: compute the full MR x NR tile aside
+                memset(edge, 0, sizeof(double) * mr * nr);
+                uk->kernel(kb, ap, bp, edge, nr);
+                for (int i = 0; i < rows; i++)
+                    for (int j = 0; j < cols; j++)
+                        c[(long)i * ldc + j] += edge[i * nr + j];
+            }
+        }
+    }
+}
+
+int matmul_pack_buf_alloc(matmul_pack_buf_t *buf, const matmul_tiles_t *t) {
+    const ukernel_info_t *uk = select_ukernel();
+    buf->mc = ROUND_UP(t->mc, uk->mr);
+    buf->nc = ROUND_UP(t->nc, uk->nr);
+    buf->kc = t->kc;
+    buf->Ap = aligned_alloc(64, ROUND_UP(sizeof(double) * buf->mc * buf->kc, 64));
+    buf->Bp = aligned_alloc(64, ROUND_UP(sizeof(double) * buf->kc * buf->nc, 64));
+    if (!buf->Ap || !buf->Bp) {
+        matmul_pack_buf_free(buf);
+        return -1;
+    }
+    return 0;
+}
+
+void matmul_pack_buf_free(matmul_pack_buf_t *buf) {
+    free(buf->Ap);
+    free(buf->Bp);
+    buf->Ap = buf->Bp = NULL;
+}
+
+void matmul_packed_acc(int m, int n, int k,
+                       const double *A, long rsa, long csa,
+                       const double *B, long rsb, long csb,
+                       double *C, int ldc, const matmul_pack_buf_t *buf) {
+    const ukernel_info_t *uk = select_ukernel();
+    const int mc = buf->mc, nc = buf->nc, kc = buf->kc;
+
+    for (int jc = 0; jc < n; jc += nc) {
+        const int nb = MIN(nc, n - jc);
+        for (int pc = 0; pc < k; pc += kc) {
+            const int kb = MIN(kc, k - pc);
+            pack_b(kb, nb, B + pc * rsb + jc * csb, rsb, csb, buf->Bp, uk->nr);
+            for (int ic = 0; ic < m; ic += mc) {
+                const int mb = MIN(mc, m - ic);
+                pack_a(mb, kb, A + ic * rsa + pc * csa, rsa, csa, buf->Ap, uk->mr);
+                macro_kernel(uk, mb, nb, kb, buf->Ap, buf->Bp, C + (long)ic * ldc + jc, ldc);
+            }
+        }
+    }
+}
+
+__attribute__((noinline))
+void matmul_packed(int m, int n, int k,
+                   const double *A, int lda, const double *B, int ldb,
+                   double *C, int ldc, const matmul_tiles_t *t) {
+    // Do not allocate more than the problem needs
+    matmul_tiles_t fit = *t;
+    fit.mc = MIN(t->mc, m);
+    fit.nc = MIN(t->nc, n);
+    fit.kc = MIN(t->kc, k);
+
+    matmul_pack_buf_t buf;
+    if (matmul_pack_buf_alloc(&buf, &fit) != 0) {
+        // No room to pack: the cache-blocked kernel needs no workspace
+        matmul_blocked(m, n, k, A, lda, B, ldb, C, ldc, t);
+        return;
+    }
+
+    for (int i = 0; i < m; i++) {
+        memset(C + (long)i * ldc, 0, n * sizeof(double));
+    }
+    matmul_packed_acc(m, n, k, A, lda, 1, B, ldb, 1, C, ldc, &buf);
+
+    matmul_pack_buf_free(&buf);
+}
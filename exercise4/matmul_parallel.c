@@ -0,0 +1,162 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - multithreaded GEMM
+ *
+ * C is cut into 2D tiles (tm x tn). When the shape has too few tiles to
+ * feed every worker (small m and n, long k), k is split as well and each
+ * k-slice accumulates into its own copy of C, summed in a final parallel
+ * reduction pass (3D decomposition). Tiles are tasks of the work-stealing
+ * pool; each worker packs into its own buffers, so tasks never share
+ * scratch space.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "matmul.h"
+#include "threadpool.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define CEIL_DIV(a, b) (((a) + (b) - 1) / (b))
+#define ROUND_UP(x, m) (CEIL_DIV(x, m) * (m))
+
+#define TASKS_PER_WORKER 4   // Enough slack for stealing to balance load
+#define MIN_TILE         64  // Below this packing overhead dominates
+#define REDUCE_ROWS      16  // Rows of C per k-split reduction task
+
+typedef struct {
+    int m, n, k;
+    const double *A; long rsa, csa;
+    const double *B; long rsb, csb;
+    double *C; int ldc;
+
+    int tm, tn, tk;          // Tile extents
+    int tiles_n, splits_k;
+    double *partial;         // (splits_k - 1) extra m x n slices of C
+    matmul_pack_buf_t *bufs; // One packing workspace per worker
+} par_gemm_t;
+
+static void gemm_tile_task(void *arg, int task, int worker) {
+    par_gemm_t *g = arg;
+    const int tile = task / g->splits_k, s = task % g->splits_k;
+    const int i0 = (tile / g->tiles_n) * g->tm;
+    const int j0 = (tile % g->tiles_n) * g->tn;
+    const int k0 = s * g->tk;
+    const int mb = MIN(g->tm, g->m - i0);
+    const int nb = MIN(g->tn, g->n - j0);
+    const int kb = MIN(g->tk, g->k - k0);
+
+    double *dst;
+    int ld;
+    if (s == 0) {
+        dst = g->C + (long)i0 * g->ldc + j0;
+        ld = g->ldc;
+    } else {
+        dst = g->partial + (long)(s - 1) * g->m * g->n + (long)i0 * g->n + j0;
+        ld = g->n;
+    }
+    // Zeroing here also first-touches the tile on the worker computing it
+    for (int i = 0; i < mb; i++) memset(dst + (long)i * ld, 0, nb * sizeof(double));
+    if (kb <= 0) return;
+
+    matmul_packed_acc(mb, nb, kb,
+                      g->A + i0 * g->rsa + k0 * g->csa, g->rsa, g->csa,
+                      g->B + k0 * g->rsb + j0 * g->csb, g->rsb, g->csb,
+                      dst, ld, &g->bufs[worker]);
+}
+
+static void reduce_task(void *arg, int task, int worker) {
+    par_gemm_t *g = arg;
+    (void)worker;
+    const int i0 = task * REDUCE_ROWS;
+    const int i1 = MIN(i0 + REDUCE_ROWS, g->m);
+    for (int s = 1; s < g->splits_k; s++) {
+        const double *P = g->partial + (long)(s - 1) * g->m * g->n;
+        for (int i = i0; i < i1; i++) {
+            double *c = g->C + (long)i * g->ldc;
+            const double *p = P + (long)i * g->n;
+            for (int j = 0; j < g->n; j++) c[j] += p[j];
+        }
+    }
+}
+
+// Shrink 2D tiles until there are enough tasks, then split k if needed
+static void choose_decomposition(par_gemm_t *g, const matmul_tiles_t *t, int workers) {
+    const int target = workers * TASKS_PER_WORKER;
+    int tm = MIN(t->mc, g->m), tn = MIN(t->nc, g->n);
+
+    while ((long)CEIL_DIV(g->m, tm) * CEIL_DIV(g->n, tn) < target) {
+        if (tn >= tm && tn > MIN_TILE)      tn = ROUND_UP(CEIL_DIV(tn, 2), 16);
+        else if (tm > MIN_TILE)             tm = ROUND_UP(CEIL_DIV(tm, 2), 16);
+        else break;
+    }
+    g->tm = tm;
+    g->tn = tn;
+    g->tiles_n = CEIL_DIV(g->n, tn);
+
+    const long tiles = (long)CEIL_DIV(g->m, tm) * g->tiles_n;
+    g->splits_k = 1;
+    g->tk = g->k;
+    if (workers > 1 && tiles < workers) {
+        // Each k-slice must still be at least one kc panel deep
+        int splits = (int)CEIL_DIV(target, tiles);
+        splits = MIN(splits, g->k / t->kc);
+        if (splits > 1) {
+            g->tk = ROUND_UP(CEIL_DIV(g->k, splits), t->kc);
+            g->splits_k = CEIL_DIV(g->k, g->tk);
+        }
+    }
+}
+
+void matmul_parallel(int m, int n, int k,
+                     const double *A, long rsa, long csa,
+                     const double *B, long rsb, long csb,
+                     double *C, int ldc, const matmul_tiles_t *t,
+                     threadpool_t *pool) {
+    const int P = threadpool_size(pool);
+    par_gemm_t g = {m, n, k, A, rsa, csa, B, rsb, csb, C, ldc,
+                    0, 0, 0, 0, 1, NULL, NULL};
+    choose_decomposition(&g, t, P);
+
+    matmul_tiles_t fit = *t;
+    fit.mc = MIN(t->mc, g.tm);
+    fit.nc = MIN(t->nc, g.tn);
+    fit.kc = MIN(t->kc, g.tk);
+
+    if (g.splits_k > 1) {
+        g.partial = malloc(sizeof(double) * (g.splits_k - 1) * (long)m * n);
+        if (!g.partial) {
+            // No room for the k-slices: 2D tiles only
+            g.splits_k = 1;
+            g.tk = k;
+        }
+    }
+    g.bufs = calloc(P, sizeof(matmul_pack_buf_t));
+    int ok = g.bufs != NULL;
+    for (int w = 0; ok && w < P; w++) ok = matmul_pack_buf_alloc(&g.bufs[w], &fit) == 0;
+
+    if (ok) {
+        const int tiles = CEIL_DIV(m, g.tm) * g.tiles_n;
+        threadpool_run(pool, tiles * g.splits_k, gemm_tile_task, &g);
+        if (g.splits_k > 1)
+            threadpool_run(pool, CEIL_DIV(m, REDUCE_ROWS), reduce_task, &g);
+    }
+
+    for (int w = 0; g.bufs && w < P; w++) matmul_pack_buf_free(&g.bufs[w]);
+    free(g.bufs);
+    free(g.partial);
+    if (ok) return;
+
+    // Not enough memory for every worker's buffers: one buffer, serially,
+    // or the strided reference when even that fails
+    matmul_pack_buf_t buf;
+    if (matmul_pack_buf_alloc(&buf, &fit) != 0) {
+        matmul_naive_strided(m, n, k, A, rsa, csa, B, rsb, csb, C, ldc);
+        return;
+    }
+    for (int i = 0; i < m; i++) memset(C + (long)i * ldc, 0, n * sizeof(double));
+    matmul_packed_acc(m, n, k, A, rsa, csa, B, rsb, csb, C, ldc, &buf);
+    matmul_pack_buf_free(&buf);
+}
@@ -0,0 +1,258 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - recursive algorithms
+ *
+ * Cache-oblivious GEMM
+ *   Halve the largest of m, n, k until the sub-problem is at most
+ *   RECURSIVE_LEAF in every dimension, then run the packed micro-kernel.
+ *   Every level of the memory hierarchy eventually holds a whole
+ *   sub-problem, without any cache-size parameter.
+ *
+ * Strassen-Winograd
+ *   7 half-size products and 15 additions per level instead of 8 products
+ *   (O(n^2.81) flops), recursing until a dimension drops below the cutover
+ *   and then switching to the packed kernel. Odd dimensions are peeled: the
+ *   even part goes through Strassen and the last row / column / k-slice is
+ *   fixed up with a thin classical product. The seven top-level products
+ *   run concurrently on the thread pool.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "matmul.h"
+#include "threadpool.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define RECURSIVE_LEAF 256
+
+// ============================================================================
+// Cache-oblivious recursion
+// ============================================================================
+
+// C (row-major) += A * B, A and B addressed through strides
+static void recursive_acc(int m, int n, int k,
+                          const double *A, long rsa, long csa,
+                          const double *B, long rsb, long csb,
+                          double *C, int ldc, const matmul_pack_buf_t *buf) {
+    if (m <= RECURSIVE_LEAF && n <= RECURSIVE_LEAF && k <= RECURSIVE_LEAF) {
+        matmul_packed_acc(m, n, k, A, rsa, csa, B, rsb, csb, C, ldc, buf);
+        return;
+    }
+    if (m >= n && m >= k) {
+        const int h = m / 2;
+        recursive_acc(h, n, k, A, rsa, csa, B, rsb, csb, C, ldc, buf);
+        recursive_acc(m - h, n, k, A + h * rsa, rsa, csa, B, rsb, csb,
+                      C + (long)h * ldc, ldc, buf);
+    } else if (n >= k) {
+        const int h = n / 2;
+        recursive_acc(m, h, k, A, rsa, csa, B, rsb, csb, C, ldc, buf);
+        recursive_acc(m, n - h, k, A, rsa, csa, B + h * csb, rsb, csb, C + h, ldc, buf);
+    } else {
+        const int h = k / 2;
+        recursive_acc(m, n, h, A, rsa, csa, B, rsb, csb, C, ldc, buf);
+        recursive_acc(m, n, k - h, A + h * csa, rsa, csa, B + h * rsb, rsb, csb, C, ldc, buf);
+    }
+}
+
+void matmul_recursive(int m, int n, int k,
+                      const double *A, long rsa, long csa,
+                      const double *B, long rsb, long csb,
+                      double *C, int ldc) {
+    // The leaf kernel's buffers are sized by the leaf, not by the cache
+    matmul_tiles_t leaf = {RECURSIVE_LEAF, RECURSIVE_LEAF, RECURSIVE_LEAF, RECURSIVE_LEAF, 0};
+    matmul_pack_buf_t buf;
+    if (matmul_pack_buf_alloc(&buf, &leaf) != 0) {
+        matmul_naive_strided(m, n, k, A, rsa, csa, B, rsb, csb, C, ldc);
+        return;
+    }
+
+    for (int i = 0; i < m; i++) memset(C + (long)i * ldc, 0, n * sizeof(double));
+    recursive_acc(m, n, k, A, rsa, csa, B, rsb, csb, C, ldc, &buf);
+
+    matmul_pack_buf_free(&buf);
+}
+
+// ============================================================================
+// Strassen-Winograd
+// ============================================================================
+
+// Row-major dense operand: element (i, j) at p[i * ld + j]
+typedef struct {
+    double *p;
+    int ld;
+} dmat_t;
+
+static dmat_t sub(dmat_t X, int i, int j) {
+    dmat_t S = {X.p + (long)i * X.ld + j, X.ld};
+    return S;
+}
+
+static double *tmp_alloc(int rows, int cols) {
+    size_t bytes = sizeof(double) * (size_t)rows * cols;
+    return aligned_alloc(64, (bytes + 63) / 64 * 64);
+}
+
+// Z = X + sign * Y  (rows x cols)
+static void add(int rows, int cols, dmat_t X, dmat_t Y, double sign, dmat_t Z) {
+    for (int i = 0; i < rows; i++) {
+        const double *x = X.p + (long)i * X.ld, *y = Y.p + (long)i * Y.ld;
+        double *z = Z.p + (long)i * Z.ld;
+        for (int j = 0; j < cols; j++) z[j] = x[j] + sign * y[j];
+    }
+}
+
+// Z += X
+static void acc(int rows, int cols, dmat_t X, dmat_t Z) {
+    for (int i = 0; i < rows; i++) {
+        const double *x = X.p + (long)i * X.ld;
+        double *z = Z.p + (long)i * Z.ld;
+        for (int j = 0; j < cols; j++) z[j] += x[j];
+    }
+}
+
+static void classical(int m, int n, int k, dmat_t A, dmat_t B, dmat_t C,
+                      const matmul_pack_buf_t *buf) {
+    for (int i = 0; i < m; i++) memset(C.p + (long)i * C.ld, 0, n * sizeof(double));
+    matmul_packed_acc(m, n, k, A.p, A.ld, 1, B.p, B.ld, 1, C.p, C.ld, buf);
+}
+
+// State of one Strassen-Winograd level: operands split into quadrants,
+// the S/T sums and the seven products M1..M7
+typedef struct {
+    int h_m, h_n, h_k;
+    dmat_t A11, A12, A21, A22, B11, B12, B21, B22;
+    dmat_t S[4], T[4], M[7];
+    int cutover;
+    const matmul_pack_buf_t *bufs;   // Indexed by worker
+} winograd_level_t;
+
+static void strassen_rec(int m, int n, int k, dmat_t A, dmat_t B, dmat_t C,
+                         int cutover, const matmul_pack_buf_t *bufs, int worker,
+                         threadpool_t *pool);
+
+// Product i of the level: M1 = A11 B11, M2 = A12 B21, M3 = S4 B22,
+// M4 = A22 T4, M5 = S1 T1, M6 = S2 T2, M7 = S3 T3
+static void winograd_product(winograd_level_t *w, int i, int worker) {
+    const dmat_t lhs[7] = {w->A11, w->A12, w->S[3], w->A22, w->S[0], w->S[1], w->S[2]};
+    const dmat_t rhs[7] = {w->B11, w->B21, w->B22, w->T[3], w->T[0], w->T[1], w->T[2]};
+    strassen_rec(w->h_m, w->h_n, w->h_k, lhs[i], rhs[i], w->M[i],
+                 w->cutover, w->bufs, worker, NULL);
+}
+
+static void winograd_task(void *arg, int task, int worker) {
+    winograd_product(arg, task, worker);
+}
+
+static void strassen_rec(int m, int n, int k, dmat_t A, dmat_t B, dmat_t C,
+                         int cutover, const matmul_pack_buf_t *bufs, int worker,
+                         threadpool_t *pool) {
+    if (m < 2 || n < 2 || k < 2 || MIN(MIN(m, n), k) <= cutover) {
+        classical(m, n, k, A, B, C, &bufs[worker]);
+        return;
+    }
+
+    // Strassen on the even part, then peel the odd row / column / k-slice
+    const int me = m & ~1, ne = n & ~1, ke = k & ~1;
+    winograd_level_t w;
+    w.h_m = me / 2; w.h_n = ne / 2; w.h_k = ke / 2;
+    w.cutover = cutover;
+    w.bufs = bufs;
+    w.A11 = A;                     w.A12 = sub(A, 0, w.h_k);
+    w.A21 = sub(A, w.h_m, 0);      w.A22 = sub(A, w.h_m, w.h_k);
+    w.B11 = B;                     w.B12 = sub(B, 0, w.h_n);
+    w.B21 = sub(B, w.h_k, 0);      w.B22 = sub(B, w.h_k, w.h_n);
+
+    double *mem[15];
+    for (int i = 0; i < 4; i++) {
+        mem[i] = tmp_alloc(w.h_m, w.h_k);
+        w.S[i].p = mem[i]; w.S[i].ld = w.h_k;
+        mem[4 + i] = tmp_alloc(w.h_k, w.h_n);
+        w.T[i].p = mem[4 + i]; w.T[i].ld = w.h_n;
+    }
+    for (int i = 0; i < 7; i++) {
+        mem[8 + i] = tmp_alloc(w.h_m, w.h_n);
+        w.M[i].p = mem[8 + i]; w.M[i].ld = w.h_n;
+    }
+    for (int i = 0; i < 15; i++) {
+        if (mem[i]) continue;
+        // Out of scratch: this level (and everything below it) runs classically
+        for (int j = 0; j < 15; j++) free(mem[j]);
+        classical(m, n, k, A, B, C, &bufs[worker]);
+        return;
+    }
+
+    // S1 = A21 + A22, S2 = S1 - A11, S3 = A11 - A21, S4 = A12 - S2
+    add(w.h_m, w.h_k, w.A21, w.A22, 1.0, w.S[0]);
+    add(w.h_m, w.h_k, w.S[0], w.A11, -1.0, w.S[1]);
+    add(w.h_m, w.h_k, w.A11, w.A21, -1.0, w.S[2]);
+    add(w.h_m, w.h_k, w.A12, w.S[1], -1.0, w.S[3]);
+    // T1 = B12 - B11, T2 = B22 - T1, T3 = B22 - B12, T4 = T2 - B21
+    add(w.h_k, w.h_n, w.B12, w.B11, -1.0, w.T[0]);
+    add(w.h_k, w.h_n, w.B22, w.T[0], -1.0, w.T[1]);
+    add(w.h_k, w.h_n, w.B22, w.B12, -1.0, w.T[2]);
+    add(w.h_k, w.h_n, w.T[1], w.B21, -1.0, w.T[3]);
+
+    if (pool && threadpool_size(pool) > 1) {
+        threadpool_run(pool, 7, winograd_task, &w);
+    } else {
+        for (int i = 0; i < 7; i++) winograd_product(&w, i, worker);
+    }
+
+    // C11 = M1 + M2
+    // U2 = M1 + M6, U3 = U2 + M7, U4 = U2 + M5
+    // C12 = U4 + M3, C21 = U3 - M4, C22 = U3 + M5
+    const dmat_t C11 = C, C12 = sub(C, 0, w.h_n), C21 = sub(C, w.h_m, 0);
+    const dmat_t C22 = sub(C, w.h_m, w.h_n);
+    add(w.h_m, w.h_n, w.M[0], w.M[1], 1.0, C11);
+    add(w.h_m, w.h_n, w.M[0], w.M[5], 1.0, w.M[0]);    // M1 <- U2
+    add(w.h_m, w.h_n, w.M[0], w.M[6], 1.0, C21);       // C21 <- U3
+    add(w.h_m, w.h_n, w.M[0], w.M[4], 1.0, C12);       // C12 <- U4
+    acc(w.h_m, w.h_n, w.M[2], C12);                    // C12 = U4 + M3
+    add(w.h_m, w.h_n, C21, w.M[4], 1.0, C22);          // C22 = U3 + M5
+    add(w.h_m, w.h_n, C21, w.M[3], -1.0, C21);         // C21 = U3 - M4
+
+    for (int i = 0; i < 15; i++) free(mem[i]);
+
+    // Peeling: last k-slice, last column, last row
+    const matmul_pack_buf_t *buf = &bufs[worker];
+    if (ke < k)
+        matmul_packed_acc(me, ne, 1, A.p + ke, A.ld, 1, B.p + (long)ke * B.ld, B.ld, 1,
+                          C.p, C.ld, buf);
+    if (ne < n)
+        classical(m, 1, k, A, sub(B, 0, ne), sub(C, 0, ne), buf);
+    if (me < m)
+        classical(1, ne, k, sub(A, me, 0), B, sub(C, me, 0), buf);
+}
+
+void matmul_strassen(int m, int n, int k,
+                     const double *A, int lda, const double *B, int ldb,
+                     double *C, int ldc, const matmul_tiles_t *t,
+                     threadpool_t *pool) {
+    const int P = pool ? threadpool_size(pool) : 1;
+    const int cutover = MAX(t->strassen_cutover, 16);
+
+    // Leaf products are at most ~cutover..2*cutover in each dimension
+    matmul_tiles_t fit = *t;
+    fit.mc = MIN(t->mc, m);
+    fit.nc = MIN(t->nc, n);
+    fit.kc = MIN(t->kc, k);
+
+    matmul_pack_buf_t *bufs = calloc(P, sizeof(matmul_pack_buf_t));
+    int ok = bufs != NULL;
+    for (int w = 0; ok && w < P; w++) ok = matmul_pack_buf_alloc(&bufs[w], &fit) == 0;
+
+    if (ok) {
+        dmat_t dA = {(double *)A, lda}, dB = {(double *)B, ldb}, dC = {C, ldc};
+        strassen_rec(m, n, k, dA, dB, dC, cutover, bufs, 0, pool);
+    }
+
+    for (int w = 0; bufs && w < P; w++) matmul_pack_buf_free(&bufs[w]);
+    free(bufs);
+    // No leaf buffers for every worker: the serial packed kernel instead
+    if (!ok) matmul_packed(m, n, k, A, lda, B, ldb, C, ldc, t);
+}
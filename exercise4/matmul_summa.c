@@ -0,0 +1,384 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - distributed SUMMA
+ *
+ * C = A * B on P = pr x pc forked worker processes arranged as a 2D grid.
+ * Rank (i, j) owns block (i, j) of A, B and C in private memory, as it
+ * would on a cluster node. The k dimension is cut into panels; for each
+ * panel the rank column owning that slice of A broadcasts it along its
+ * process row, the rank row owning that slice of B broadcasts it along its
+ * process column, and every rank adds A_panel * B_panel to its C block
+ * (van de Geijn & Watts, SUMMA).
+ *
+ * Messages travel through a shared mapping (MAP_SHARED | MAP_ANONYMOUS,
+ * inherited across fork): each process row / column has a ring of panel
+ * slots. A send waits for its slot to be drained by every reader, copies
+ * the panel in and publishes the step number; a receive waits for that
+ * step and copies the panel out into private memory. With lookahead L
+ * a rank sends the panel for step s + L before it receives step s, so
+ * the broadcast of later panels overlaps the local GEMM of the current
+ * one; L = 0 sends each panel just in time.
+ *
+ * Waiting spins briefly and then yields, so ranks that oversubscribe the
+ * cores still make progress. POSIX only.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "matmul.h"
+#include "timing.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#define SUMMA_POSIX 1
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define CACHE_LINE 64
+#define SPIN_LIMIT 1000        // Busy polls before a waiting rank yields
+#define DEFAULT_PANEL 256
+
+// One slot of a broadcast ring: posted holds step + 1 of the panel in the
+// slot, reads counts the receives completed over the slot's lifetime
+typedef struct {
+    long posted;
+    long reads;
+    char pad[CACHE_LINE - 2 * sizeof(long)];
+} summa_slot_t;
+
+// Layout of the shared mapping
+typedef struct {
+    int ranks, nbuf;
+    long a_slot_elems, b_slot_elems;      // Doubles per A / B panel slot
+    summa_slot_t *a_ctl, *b_ctl;          // [pr][nbuf], [pc][nbuf]
+    double *a_data, *b_data;
+    matmul_summa_rank_t *stats;           // [P]
+    double *C;                            // m x n, gathered result
+    int *failed;                          // Set by a rank that could not start
+    int *arrived;                         // Start barrier
+    size_t bytes;
+    void *base;
+} summa_shared_t;
+
+typedef struct {
+    int m, n, k;
+    int pr, pc;
+    int *row_off, *col_off;               // Splits of m over pr and n over pc
+    int *ka_off, *kb_off;                 // Splits of k over pc (A) and pr (B)
+    int steps;
+    int *step_off;                        // steps + 1 panel boundaries
+} summa_plan_t;
+
+void matmul_summa_default_grid(matmul_summa_grid_t *g, int procs) {
+    int r = 1;
+    for (int d = 1; d * d <= procs; d++)
+        if (procs % d == 0) r = d;
+    g->pr = r;
+    g->pc = procs / r;
+    g->panel = DEFAULT_PANEL;
+    g->lookahead = 1;
+}
+
+// ============================================================================
+// Plan: block splits and the k panels
+// ============================================================================
+
+static int *split(int total, int parts) {
+    int *off = malloc(sizeof(int) * (parts + 1));
+    if (!off) return NULL;
+    for (int p = 0; p <= parts; p++) off[p] = (int)((long)total * p / parts);
+    return off;
+}
+
+// Owner of position x in a split into parts
+static int owner(const int *off, int parts, int x) {
+    int p = 0;
+    while (p + 1 < parts && off[p + 1] <= x) p++;
+    return p;
+}
+
+static void plan_free(summa_plan_t *pl) {
+    free(pl->row_off); free(pl->col_off);
+    free(pl->ka_off); free(pl->kb_off);
+    free(pl->step_off);
+}
+
+// Panels are at most `panel` wide and never straddle an A or B block
+// boundary, so each has one owning rank column (A) and rank row (B)
+static int plan_init(summa_plan_t *pl, int m, int n, int k, int pr, int pc, int panel) {
+    memset(pl, 0, sizeof(*pl));
+    pl->m = m; pl->n = n; pl->k = k;
+    pl->pr = pr; pl->pc = pc;
+    pl->row_off = split(m, pr);
+    pl->col_off = split(n, pc);
+    pl->ka_off = split(k, pc);
+    pl->kb_off = split(k, pr);
+    pl->step_off = malloc(sizeof(int) * (k / panel + pr + pc + 2));
+    if (!pl->row_off || !pl->col_off || !pl->ka_off || !pl->kb_off || !pl->step_off) {
+        plan_free(pl);
+        return -1;
+    }
+    int s = 0;
+    for (int p = 0; p < k; ) {
+        pl->step_off[s++] = p;
+        int next = MIN(k, (p / panel + 1) * panel);
+        next = MIN(next, pl->ka_off[owner(pl->ka_off, pc, p) + 1]);
+        next = MIN(next, pl->kb_off[owner(pl->kb_off, pr, p) + 1]);
+        p = next;
+    }
+    pl->step_off[s] = k;
+    pl->steps = s;
+    return 0;
+}
+
+#ifdef SUMMA_POSIX
+// ============================================================================
+// Shared mapping and message passing
+// ============================================================================
+
+static void *carve(char **cursor, size_t bytes) {
+    void *p = *cursor;
+    *cursor += (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    return p;
+}
+
+static int shared_init(summa_shared_t *sh, const summa_plan_t *pl, int panel, int lookahead) {
+    int max_rows = 0, max_cols = 0;
+    for (int i = 0; i < pl->pr; i++) max_rows = MAX(max_rows, pl->row_off[i + 1] - pl->row_off[i]);
+    for (int j = 0; j < pl->pc; j++) max_cols = MAX(max_cols, pl->col_off[j + 1] - pl->col_off[j]);
+    sh->ranks = pl->pr * pl->pc;
+    sh->nbuf = lookahead + 2;
+    sh->a_slot_elems = (long)max_rows * panel;
+    sh->b_slot_elems = (long)panel * max_cols;
+
+    const size_t ctl = sizeof(summa_slot_t) * sh->nbuf;
+    const size_t sizes[] = {
+        ctl * pl->pr, ctl * pl->pc,
+        sizeof(double) * sh->a_slot_elems * sh->nbuf * pl->pr,
+        sizeof(double) * sh->b_slot_elems * sh->nbuf * pl->pc,
+        sizeof(matmul_summa_rank_t) * sh->ranks,
+        sizeof(double) * pl->m * pl->n,
+        sizeof(int), sizeof(int)
+    };
+    sh->bytes = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        sh->bytes += (sizes[i] + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+    sh->base = mmap(NULL, sh->bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh->base == MAP_FAILED) return -1;
+    char *cursor = sh->base;    // Fresh anonymous pages are zero
+    sh->a_ctl = carve(&cursor, sizes[0]);
+    sh->b_ctl = carve(&cursor, sizes[1]);
+    sh->a_data = carve(&cursor, sizes[2]);
+    sh->b_data = carve(&cursor, sizes[3]);
+    sh->stats = carve(&cursor, sizes[4]);
+    sh->C = carve(&cursor, sizes[5]);
+    sh->failed = carve(&cursor, sizes[6]);
+    sh->arrived = carve(&cursor, sizes[7]);
+    return 0;
+}
+
+static void wait_until_at_least(const long *x, long value) {
+    for (int spin = 0; __atomic_load_n(x, __ATOMIC_ACQUIRE) < value; ) {
+        if (spin < SPIN_LIMIT) spin++;
+        else sched_yield();
+    }
+}
+
+// Broadcast channel: the ring of one process row (A) or column (B)
+typedef struct {
+    summa_slot_t *ctl;
+    double *data;
+    long slot_elems;
+    int nbuf, readers;
+} summa_chan_t;
+
+// Copy a rows x cols panel (leading dimension ld) into the slot of step s
+static void chan_send(const summa_chan_t *ch, int s, const double *src, int ld,
+                      int rows, int cols) {
+    summa_slot_t *slot = &ch->ctl[s % ch->nbuf];
+    // Every reader of the slot's previous step has copied it out
+    wait_until_at_least(&slot->reads, (long)(s / ch->nbuf) * ch->readers);
+    double *dst = ch->data + (long)(s % ch->nbuf) * ch->slot_elems;
+    for (int r = 0; r < rows; r++) memcpy(dst + (long)r * cols, src + (long)r * ld, sizeof(double) * cols);
+    __atomic_store_n(&slot->posted, (long)s + 1, __ATOMIC_RELEASE);
+}
+
+static void chan_recv(const summa_chan_t *ch, int s, double *dst, long elems) {
+    summa_slot_t *slot = &ch->ctl[s % ch->nbuf];
+    wait_until_at_least(&slot->posted, (long)s + 1);
+    memcpy(dst, ch->data + (long)(s % ch->nbuf) * ch->slot_elems, sizeof(double) * elems);
+    __atomic_add_fetch(&slot->reads, 1, __ATOMIC_ACQ_REL);
+}
+
+// ============================================================================
+// Worker
+// ============================================================================
+
+typedef struct {
+    const summa_plan_t *pl;
+    summa_shared_t *sh;
+    const double *A, *B;      // Global inputs (read before the timed region)
+    int lda, ldb, panel, lookahead;
+    const matmul_tiles_t *t;
+} summa_job_t;
+
+static int worker(const summa_job_t *job, int rank) {
+    const summa_plan_t *pl = job->pl;
+    summa_shared_t *sh = job->sh;
+    const int i = rank / pl->pc, j = rank % pl->pc;
+    const int r0 = pl->row_off[i], rows = pl->row_off[i + 1] - r0;
+    const int c0 = pl->col_off[j], cols = pl->col_off[j + 1] - c0;
+    const int ka0 = pl->ka_off[j], kas = pl->ka_off[j + 1] - ka0;   // A block: rows x kas
+    const int kb0 = pl->kb_off[i], kbs = pl->kb_off[i + 1] - kb0;   // B block: kbs x cols
+    matmul_summa_rank_t *st = &sh->stats[rank];
+    memset(st, 0, sizeof(*st));
+    st->row = i;
+    st->col = j;
+
+    // Scatter: the local blocks are private copies
+    double *Al = malloc(sizeof(double) * MAX(1L, (long)rows * kas));
+    double *Bl = malloc(sizeof(double) * MAX(1L, (long)kbs * cols));
+    double *Cl = calloc(MAX(1L, (long)rows * cols), sizeof(double));
+    double *Ar = malloc(sizeof(double) * MAX(1L, (long)rows * job->panel));
+    double *Br = malloc(sizeof(double) * MAX(1L, (long)job->panel * cols));
+    matmul_pack_buf_t buf = {NULL, NULL, 0, 0, 0};
+    const int ok = Al && Bl && Cl && Ar && Br && matmul_pack_buf_alloc(&buf, job->t) == 0;
+    if (!ok) __atomic_store_n(sh->failed, 1, __ATOMIC_RELEASE);
+    for (int r = 0; ok && r < rows; r++)
+        memcpy(Al + (long)r * kas, job->A + (long)(r0 + r) * job->lda + ka0, sizeof(double) * kas);
+    for (int p = 0; ok && p < kbs; p++)
+        memcpy(Bl + (long)p * cols, job->B + (long)(kb0 + p) * job->ldb + c0, sizeof(double) * cols);
+
+    const summa_chan_t row_chan = {sh->a_ctl + (long)i * sh->nbuf,
+                                   sh->a_data + (long)i * sh->nbuf * sh->a_slot_elems,
+                                   sh->a_slot_elems, sh->nbuf, pl->pc - 1};
+    const summa_chan_t col_chan = {sh->b_ctl + (long)j * sh->nbuf,
+                                   sh->b_data + (long)j * sh->nbuf * sh->b_slot_elems,
+                                   sh->b_slot_elems, sh->nbuf, pl->pr - 1};
+
+    // Start together so per-rank times are comparable; if any rank is
+    // short of memory nobody starts, since its panels would never arrive
+    __atomic_add_fetch(sh->arrived, 1, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(sh->arrived, __ATOMIC_ACQUIRE) < sh->ranks) sched_yield();
+    if (__atomic_load_n(sh->failed, __ATOMIC_ACQUIRE)) {
+        matmul_pack_buf_free(&buf);
+        free(Al); free(Bl); free(Cl); free(Ar); free(Br);
+        return -1;
+    }
+    const double start = get_time_ns();
+
+    int sent = 0;     // Steps [0, sent) have been offered to the channels
+    for (int s = 0; s < pl->steps; s++) {
+        // Send this rank's slices of the panels up to step s + lookahead
+        double t0 = get_time_ns();
+        for (; sent < pl->steps && sent <= s + job->lookahead; sent++) {
+            const int p0 = pl->step_off[sent], w = pl->step_off[sent + 1] - p0;
+            if (pl->pc > 1 && owner(pl->ka_off, pl->pc, p0) == j) {
+                chan_send(&row_chan, sent, Al + (p0 - ka0), kas, rows, w);
+                st->bytes_sent += sizeof(double) * (long)rows * w;
+            }
+            if (pl->pr > 1 && owner(pl->kb_off, pl->pr, p0) == i) {
+                chan_send(&col_chan, sent, Bl + (long)(p0 - kb0) * cols, cols, w, cols);
+                st->bytes_sent += sizeof(double) * (long)w * cols;
+            }
+        }
+        double t1 = get_time_ns();
+        st->send += (t1 - t0) / 1e9;
+
+        // Receive step s, or use the local block when this rank owns it
+        const int p0 = pl->step_off[s], w = pl->step_off[s + 1] - p0;
+        const double *Ap = Al + (p0 - ka0);
+        long rsa = kas;
+        if (owner(pl->ka_off, pl->pc, p0) != j) {
+            chan_recv(&row_chan, s, Ar, (long)rows * w);
+            st->bytes_recv += sizeof(double) * (long)rows * w;
+            Ap = Ar;
+            rsa = w;
+        }
+        const double *Bp = Bl + (long)(p0 - kb0) * cols;
+        if (owner(pl->kb_off, pl->pr, p0) != i) {
+            chan_recv(&col_chan, s, Br, (long)w * cols);
+            st->bytes_recv += sizeof(double) * (long)w * cols;
+            Bp = Br;
+        }
+        double t2 = get_time_ns();
+        st->recv += (t2 - t1) / 1e9;
+
+        if (rows > 0 && cols > 0) matmul_packed_acc(rows, cols, w, Ap, rsa, 1, Bp, cols, 1, Cl, cols, &buf);
+        st->compute += (get_time_ns() - t2) / 1e9;
+    }
+    st->total = (get_time_ns() - start) / 1e9;
+
+    // Gather
+    for (int r = 0; r < rows; r++)
+        memcpy(sh->C + (long)(r0 + r) * pl->n + c0, Cl + (long)r * cols, sizeof(double) * cols);
+
+    matmul_pack_buf_free(&buf);
+    free(Al); free(Bl); free(Cl); free(Ar); free(Br);
+    return 0;
+}
+#endif // SUMMA_POSIX
+
+// ============================================================================
+// Entry point
+// ============================================================================
+
+int matmul_summa(int m, int n, int k, const double *A, int lda, const double *B, int ldb,
+                 double *C, int ldc, const matmul_summa_grid_t *g, const matmul_tiles_t *t,
+                 matmul_summa_rank_t *stats) {
+#ifdef SUMMA_POSIX
+    if (m < 1 || n < 1 || k < 1 || g->pr < 1 || g->pc < 1 || g->panel < 1 || g->lookahead < 0)
+        return -1;
+    summa_plan_t pl;
+    summa_shared_t sh;
+    if (plan_init(&pl, m, n, k, g->pr, g->pc, g->panel) != 0) return -1;
+    if (shared_init(&sh, &pl, g->panel, g->lookahead) != 0) {
+        plan_free(&pl);
+        return -1;
+    }
+
+    summa_job_t job = {&pl, &sh, A, B, lda, ldb, g->panel, g->lookahead, t};
+    const int ranks = g->pr * g->pc;
+    pid_t *pids = malloc(sizeof(pid_t) * ranks);
+    int rc = pids ? 0 : -1;
+    int started = 0;
+    for (; rc == 0 && started < ranks; started++) {
+        pids[started] = fork();
+        if (pids[started] < 0) {
+            rc = -1;
+            break;
+        }
+        if (pids[started] == 0) _exit(worker(&job, started) == 0 ? 0 : 1);
+    }
+    if (rc != 0) {
+        // Ranks that did start are stuck at the barrier
+        for (int r = 0; r < started; r++) kill(pids[r], SIGKILL);
+    }
+    for (int r = 0; r < started; r++) {
+        int status = 0;
+        if (waitpid(pids[r], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) rc = -1;
+    }
+
+    if (rc == 0) {
+        for (int i = 0; i < m; i++) memcpy(C + (long)i * ldc, sh.C + (long)i * n, sizeof(double) * n);
+        if (stats) memcpy(stats, sh.stats, sizeof(matmul_summa_rank_t) * ranks);
+    }
+    free(pids);
+    munmap(sh.base, sh.bytes);
+    plan_free(&pl);
+    return rc;
+#else
+    (void)m; (void)n; (void)k; (void)A; (void)lda; (void)B; (void)ldb;
+    (void)C; (void)ldc; (void)g; (void)t; (void)stats;
+    return -1;
+#endif
+}
@@ -0,0 +1,86 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - tiled storage layouts
+ *
+ * GEMM directly on block-major and Morton operands. C is walked one
+ * storage tile at a time and every (C tile, k tile) pair is a packed
+ * product on in-tile strides, so no operand is ever converted. Row- and
+ * column-major operands can be mixed in: their global strides work at any
+ * tile offset. C tiles are the tasks of the work-stealing pool when one is
+ * given.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "matmul.h"
+#include "threadpool.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define CEIL_DIV(a, b) (((a) + (b) - 1) / (b))
+
+typedef struct {
+    const matrix_t *A, *B;
+    matrix_t *C;
+    int T, tiles_n;
+    matmul_pack_buf_t *bufs;   // One packing workspace per worker
+} tiled_gemm_t;
+
+static void tile_task(void *arg, int task, int worker) {
+    tiled_gemm_t *g = arg;
+    const int m = g->C->rows, n = g->C->cols, k = g->A->cols, T = g->T;
+    const int i0 = (task / g->tiles_n) * T, j0 = (task % g->tiles_n) * T;
+    const int mb = MIN(T, m - i0), nb = MIN(T, n - j0);
+
+    double *c = matrix_at(g->C, i0, j0);
+    const int ldc = (int)matrix_rs(g->C);
+    for (int i = 0; i < mb; i++) memset(c + (long)i * ldc, 0, nb * sizeof(double));
+
+    for (int k0 = 0; k0 < k; k0 += T) {
+        matmul_packed_acc(mb, nb, MIN(T, k - k0),
+                          matrix_at(g->A, i0, k0), matrix_rs(g->A), matrix_cs(g->A),
+                          matrix_at(g->B, k0, j0), matrix_rs(g->B), matrix_cs(g->B),
+                          c, ldc, &g->bufs[worker]);
+    }
+}
+
+int matmul_tiled(const matrix_t *A, const matrix_t *B, matrix_t *C,
+                 struct threadpool *pool) {
+    if (C->layout == MATRIX_COL_MAJOR) return -1;
+
+    // Step by the storage tile; every tiled operand must share it
+    const matrix_t *ops[3] = {C, A, B};
+    int T = 0;
+    for (int i = 0; i < 3; i++) {
+        if (!matrix_is_tiled(ops[i])) continue;
+        if (T && ops[i]->ld != T) return -1;
+        T = ops[i]->ld;
+    }
+    if (!T) T = MATRIX_DEFAULT_TILE;
+
+    const int P = pool ? threadpool_size(pool) : 1;
+    tiled_gemm_t g = {A, B, C, T, CEIL_DIV(C->cols, T), NULL};
+    matmul_tiles_t fit = {T, T, T, T, 0};
+    int rc = -1;
+
+    g.bufs = calloc(P, sizeof(matmul_pack_buf_t));
+    if (!g.bufs) return -1;
+    for (int w = 0; w < P; w++) {
+        if (matmul_pack_buf_alloc(&g.bufs[w], &fit) != 0) goto out;
+    }
+
+    const int tasks = CEIL_DIV(C->rows, T) * g.tiles_n;
+    if (pool) {
+        threadpool_run(pool, tasks, tile_task, &g);
+    } else {
+        for (int task = 0; task < tasks; task++) tile_task(&g, task, 0);
+    }
+    rc = 0;
+
+out:
+    for (int w = 0; w < P; w++) matmul_pack_buf_free(&g.bufs[w]);
+    free(g.bufs);
+    return rc;
+}
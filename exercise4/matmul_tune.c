@@ -0,0 +1,176 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - tile size auto-tuner
+ *
+ * The analytic tiles of matmul_cache_tiles() assume an idealized cache;
+ * associativity, prefetchers, TLB reach and the SMT sibling move the real
+ * optimum. matmul_tune_tiles() measures instead: a coordinate search that
+ * varies one tile at a time around the current best and keeps a change
+ * only if it is faster, repeating until a full pass changes nothing or the
+ * time budget runs out. Two prunings keep it cheap:
+ *   - capacity: an A block (mc x kc) larger than L2 or a B panel
+ *     (kc x nc) larger than L3 is never timed, nor is a tile larger than
+ *     the problem (it behaves like the tile of the problem size)
+ *   - early abandon: a candidate whose first run is ABANDON_RATIO slower
+ *     than the best so far is not repeated
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timing.h"
+#include "matmul.h"
+
+#define TUNE_REPEATS  3
+#define TUNE_MIN_TIME 0.05    // Seconds of runs per configuration at least
+#define ABANDON_RATIO 1.25
+#define MAX_TRIED     512
+
+static const int kc_candidates[] = {64, 96, 128, 192, 256, 320, 384, 512};
+static const int mc_candidates[] = {32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024};
+static const int nc_candidates[] = {256, 512, 1024, 2048, 4096, 8192, 16384};
+static const int nr_candidates[] = {16, 32, 64, 128, 256, 512};
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+typedef struct {
+    matmul_tiles_t t;
+    int blocked;
+    double seconds;
+} tried_t;
+
+typedef struct {
+    int n;
+    const double *A, *B;
+    double *C;
+    long l1, l2, l3;
+    double deadline;    // get_time_ns() value at which the budget is spent
+    tried_t tried[MAX_TRIED];
+    int count;
+    FILE *log;
+} tune_state_t;
+
+static int same_tiles(const matmul_tiles_t *a, const matmul_tiles_t *b, int blocked) {
+    return a->mc == b->mc && a->kc == b->kc && a->nc == b->nc && (!blocked || a->nr == b->nr);
+}
+
+// Capacity pruning (see the file comment)
+static int worth_timing(const tune_state_t *s, const matmul_tiles_t *t, int blocked) {
+    const long d = (long)sizeof(double);
+    if ((long)t->mc * t->kc * d > s->l2) return 0;
+    if ((long)t->kc * t->nc * d > s->l3) return 0;
+    if (blocked && 5L * t->nr * d > s->l1) return 0;
+    return 1;
+}
+
+// Largest useful value of a tile: the first candidate covering the problem
+static int clamp_candidate(const int *cand, int count, int v, int n) {
+    for (int i = 0; i < count && cand[i] < v; i++)
+        if (cand[i] >= n) return -1;
+    return v;
+}
+
+// Fastest of TUNE_REPEATS runs (and TUNE_MIN_TIME), or the abandoned first run
+static double time_config(tune_state_t *s, const matmul_tiles_t *t, int blocked, double best) {
+    for (int i = 0; i < s->count; i++)
+        if (s->tried[i].blocked == blocked && same_tiles(&s->tried[i].t, t, blocked))
+            return s->tried[i].seconds;
+
+    const int n = s->n;
+    double fastest = 1e30, total = 0.0;
+    int runs = 0, abandoned = 0;
+    while (runs < TUNE_REPEATS || total < TUNE_MIN_TIME) {
+        double start = get_time_ns();
+        if (blocked) matmul_blocked(n, n, n, s->A, n, s->B, n, s->C, n, t);
+        else matmul_packed(n, n, n, s->A, n, s->B, n, s->C, n, t);
+        const double elapsed = (get_time_ns() - start) / 1e9;
+        if (elapsed < fastest) fastest = elapsed;
+        total += elapsed;
+        runs++;
+        if (fastest > ABANDON_RATIO * best) {
+            abandoned = 1;
+            break;
+        }
+    }
+    if (s->count < MAX_TRIED) {
+        s->tried[s->count].t = *t;
+        s->tried[s->count].blocked = blocked;
+        s->tried[s->count].seconds = fastest;
+        s->count++;
+    }
+    if (s->log) {
+        const double gflops = 2.0 * n * n * (double)n / fastest / 1e9;
+        if (blocked) fprintf(s->log, "  blocked  mc=%-5d kc=%-5d nc=%-6d nr=%-4d %8.2f GFLOP/s%s\n",
+                             t->mc, t->kc, t->nc, t->nr, gflops, abandoned ? "  (abandoned)" : "");
+        else fprintf(s->log, "  packed   mc=%-5d kc=%-5d nc=%-6d         %8.2f GFLOP/s%s\n",
+                     t->mc, t->kc, t->nc, gflops, abandoned ? "  (abandoned)" : "");
+        fflush(s->log);
+    }
+    return fastest;
+}
+
+// Vary one field over its candidates; returns 1 if *cur improved
+static int search_field(tune_state_t *s, matmul_tiles_t *cur, double *best, int *field_of_cur,
+                        const int *cand, int count, int blocked) {
+    const long offset = (char *)field_of_cur - (char *)cur;
+    int improved = 0;
+    for (int i = 0; i < count; i++) {
+        if (get_time_ns() >= s->deadline) break;
+        matmul_tiles_t trial = *cur;
+        int *field = (int *)((char *)&trial + offset);
+        if (*field == cand[i] || clamp_candidate(cand, count, cand[i], s->n) < 0) continue;
+        *field = cand[i];
+        if (!worth_timing(s, &trial, blocked)) continue;
+        const double sec = time_config(s, &trial, blocked, *best);
+        if (sec < *best) {
+            *best = sec;
+            *cur = trial;
+            improved = 1;
+        }
+    }
+    return improved;
+}
+
+int matmul_tune_tiles(matmul_tiles_t *t, int n, double budget, FILE *log) {
+    tune_state_t *s = calloc(1, sizeof(tune_state_t));
+    const long nn = (long)n * n;
+    double *A = malloc(sizeof(double) * nn), *B = malloc(sizeof(double) * nn);
+    double *C = malloc(sizeof(double) * nn);
+    if (!s || !A || !B || !C) {
+        free(s); free(A); free(B); free(C);
+        return 0;
+    }
+    for (long i = 0; i < nn; i++) {
+        A[i] = (double)(i % 17) / 17.0 - 0.5;
+        B[i] = (double)(i % 13) / 13.0 - 0.5;
+    }
+    s->n = n;
+    s->A = A; s->B = B; s->C = C;
+    s->log = log;
+    matmul_cache_sizes(&s->l1, &s->l2, &s->l3);
+    s->deadline = get_time_ns() + budget * 1e9;
+
+    // Packed kernel: mc / kc / nc, kc first (it sizes both blocks)
+    matmul_tiles_t cur = *t;
+    double best = time_config(s, &cur, 0, 1e30);
+    for (int pass = 0; pass < 3 && get_time_ns() < s->deadline; pass++) {
+        int changed = 0;
+        changed |= search_field(s, &cur, &best, &cur.kc, kc_candidates, COUNT(kc_candidates), 0);
+        changed |= search_field(s, &cur, &best, &cur.mc, mc_candidates, COUNT(mc_candidates), 0);
+        changed |= search_field(s, &cur, &best, &cur.nc, nc_candidates, COUNT(nc_candidates), 0);
+        if (!changed) break;
+    }
+
+    // Blocked kernel: nr under the packed winner's mc / kc / nc
+    if (get_time_ns() < s->deadline) {
+        best = time_config(s, &cur, 1, 1e30);
+        search_field(s, &cur, &best, &cur.nr, nr_candidates, COUNT(nr_candidates), 1);
+    }
+
+    *t = cur;
+    const int timed = s->count;
+    free(s); free(A); free(B); free(C);
+    return timed;
+}
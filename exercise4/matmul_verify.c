@@ -0,0 +1,309 @@
+/*
+ * Exercise 4: Matrix Multiplication Engine - result verification
+ *
+ * Freivalds' randomized check: C = A * B implies C R = A (B R) for any
+ * vectors R, and the right-hand side costs O(k n + m k) instead of the
+ * O(m n k) of recomputing C. Each matrix is streamed once (B, then A and
+ * C row by row), every vector being applied to a row while it is in
+ * cache, and the same pass accumulates the |A| |B| 1 and |C| 1 magnitudes
+ * the rounding bound needs; |R| <= 1 lets one set of magnitudes serve
+ * every vector.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "matmul.h"
+#include "threadpool.h"
+
+#define CEIL_DIV(a, b) (((a) + (b) - 1) / (b))
+
+#define ROWS_PER_TASK 64
+#define GROUP         2    // Vectors handled per pass over a row
+
+typedef struct {
+    int m, n, k, vectors;
+    int ld;                  // vectors rounded up to whole groups
+    const double *A; long rsa, csa;
+    const double *B; long rsb, csb;
+    const double *C; int ldc;
+    const double *R;         // n x ld, zero past the vectors
+    double *BR;              // k x ld
+    double *absB;            // k: |B| 1
+    double *ratio;           // m: worst residual / bound of each row
+    double gamma_ab, gamma_c;
+} verify_job_t;
+
+// gamma(n) = n u / (1 - n u), the classical bound on n-term dot products
+static double gamma_n(double n) {
+    const double u = DBL_EPSILON / 2.0;
+    return n * u / (1.0 - n * u);
+}
+
+static unsigned long long splitmix64(unsigned long long *state) {
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Random sign, magnitude in [0.5, 1]: a single wrong element always moves
+// the product by at least half its error
+static void fill_vectors(double *R, long count, unsigned long long seed) {
+    unsigned long long state = seed;
+    for (long i = 0; i < count; i++) {
+        const unsigned long long x = splitmix64(&state);
+        const double mag = 0.5 + 0.5 * (double)(x >> 11) / 9007199254740992.0;
+        R[i] = (x & 1) ? -mag : mag;
+    }
+}
+
+static void run_tasks(struct threadpool *pool, int count, tp_task_fn fn, void *arg) {
+    if (pool && threadpool_size(pool) > 1) {
+        threadpool_run(pool, count, fn, arg);
+        return;
+    }
+    for (int t = 0; t < count; t++) fn(arg, t, 0);
+}
+
+typedef double group_t __attribute__((vector_size(GROUP * sizeof(double))));
+
+static inline group_t load_group(const double *p) {
+    group_t g;
+    memcpy(&g, p, sizeof(g));
+    return g;
+}
+
+// out[g] = sum_j x_j R[j * ld + g] for one group of GROUP vectors (one SSE
+// register), x_j = x[j * stride], and, when abs_out is set, *abs_out =
+// sum_j |x_j| w_j (w_j = 1 when w is NULL). Four accumulators of each hide
+// the add latency.
+static void times_group(const double *x, long stride, int len, const double *R, int ld,
+                        const double *w, double *out, double *abs_out) {
+    group_t acc0 = {0}, acc1 = {0}, acc2 = {0}, acc3 = {0};
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    int j = 0;
+    for (; j + 3 < len; j += 4) {
+        const double x0 = x[j * stride], x1 = x[(j + 1) * stride];
+        const double x2 = x[(j + 2) * stride], x3 = x[(j + 3) * stride];
+        const double *r = R + (long)j * ld;
+        acc0 += x0 * load_group(r);
+        acc1 += x1 * load_group(r + ld);
+        acc2 += x2 * load_group(r + 2 * ld);
+        acc3 += x3 * load_group(r + 3 * ld);
+        if (abs_out) {
+            s0 += fabs(x0) * (w ? w[j] : 1.0);
+            s1 += fabs(x1) * (w ? w[j + 1] : 1.0);
+            s2 += fabs(x2) * (w ? w[j + 2] : 1.0);
+            s3 += fabs(x3) * (w ? w[j + 3] : 1.0);
+        }
+    }
+    for (; j < len; j++) {
+        acc0 += x[j * stride] * load_group(R + (long)j * ld);
+        if (abs_out) s0 += fabs(x[j * stride]) * (w ? w[j] : 1.0);
+    }
+    acc0 += acc1 + (acc2 + acc3);
+    memcpy(out, &acc0, sizeof(acc0));
+    if (abs_out) *abs_out = (s0 + s1) + (s2 + s3);
+}
+
+// out[v] = sum_j x_j R[j][v] over all (padded) vectors, a group at a time
+// while the row is in cache, and *abs_out = sum_j |x_j| w_j
+static void row_times_vectors(const double *x, long stride, int len, const double *R, int ld,
+                              const double *w, double *out, double *abs_out) {
+    for (int g = 0; g < ld; g += GROUP)
+        times_group(x, stride, len, R + g, ld, w, out + g, g == 0 ? abs_out : NULL);
+}
+
+// BR = B R and |B| 1 for a block of rows of B
+static void b_pass_task(void *arg, int task, int worker) {
+    verify_job_t *job = arg;
+    const int l1 = task * ROWS_PER_TASK;
+    const int l2 = l1 + ROWS_PER_TASK < job->k ? l1 + ROWS_PER_TASK : job->k;
+    (void)worker;
+    for (int l = l1; l < l2; l++)
+        row_times_vectors(job->B + l * job->rsb, job->csb, job->n, job->R, job->ld, NULL,
+                          job->BR + (long)l * job->ld, &job->absB[l]);
+}
+
+// A (B R) against C R, row by row, with each row's rounding bound
+static void ac_pass_task(void *arg, int task, int worker) {
+    verify_job_t *job = arg;
+    const int V = job->vectors, i1 = task * ROWS_PER_TASK;
+    const int i2 = i1 + ROWS_PER_TASK < job->m ? i1 + ROWS_PER_TASK : job->m;
+    (void)worker;
+    for (int i = i1; i < i2; i++) {
+        double abr[MATMUL_VERIFY_MAX_VECTORS], cr[MATMUL_VERIFY_MAX_VECTORS], abs_ab, abs_c;
+        row_times_vectors(job->A + i * job->rsa, job->csa, job->k, job->BR, job->ld, job->absB,
+                          abr, &abs_ab);
+        row_times_vectors(job->C + (long)i * job->ldc, 1, job->n, job->R, job->ld, NULL, cr, &abs_c);
+        const double bound = job->gamma_ab * abs_ab + job->gamma_c * abs_c;
+        double worst = 0.0;
+        for (int v = 0; v < V; v++) {
+            const double res = fabs(abr[v] - cr[v]);
+            double ratio = bound > 0.0 ? res / bound : (res > 0.0 ? INFINITY : 0.0);
+            if (isnan(ratio)) ratio = INFINITY;
+            if (ratio > worst) worst = ratio;
+        }
+        job->ratio[i] = worst;
+    }
+}
+
+// r^T A B against r^T C: flags the columns holding a wrong element
+static int find_bad_columns(const verify_job_t *job, unsigned long long seed, char *bad_col) {
+    const int m = job->m, n = job->n, k = job->k;
+    double *r = malloc(m * sizeof(double));
+    double *rA = calloc(k, sizeof(double)), *absA = calloc(k, sizeof(double));
+    double *rAB = calloc(n, sizeof(double)), *absAB = calloc(n, sizeof(double));
+    double *rC = calloc(n, sizeof(double)), *absC = calloc(n, sizeof(double));
+    int count = -1;
+    if (!r || !rA || !absA || !rAB || !absAB || !rC || !absC) goto done;
+    fill_vectors(r, m, seed);
+    for (int i = 0; i < m; i++) {
+        const double *a = job->A + i * job->rsa;
+        const double *c = job->C + (long)i * job->ldc;
+        for (int l = 0; l < k; l++) {
+            rA[l] += r[i] * a[l * job->csa];
+            absA[l] += fabs(a[l * job->csa]);
+        }
+        for (int j = 0; j < n; j++) {
+            rC[j] += r[i] * c[j];
+            absC[j] += fabs(c[j]);
+        }
+    }
+    for (int l = 0; l < k; l++) {
+        const double *b = job->B + l * job->rsb;
+        for (int j = 0; j < n; j++) {
+            rAB[j] += rA[l] * b[j * job->csb];
+            absAB[j] += absA[l] * fabs(b[j * job->csb]);
+        }
+    }
+    const double g_ab = gamma_n(2.0 * k + m + 1), g_c = gamma_n(m);
+    count = 0;
+    for (int j = 0; j < n; j++) {
+        const double res = fabs(rAB[j] - rC[j]);
+        bad_col[j] = !(res <= g_ab * absAB[j] + g_c * absC[j]);
+        count += bad_col[j];
+    }
+done:
+    free(r); free(rA); free(absA); free(rAB); free(absAB); free(rC); free(absC);
+    return count;
+}
+
+// Count wrong elements per tile: recomputed when there are at most m + n
+// candidates, otherwise every bad-row x bad-column element is a suspect
+static int localize(const verify_job_t *job, const char *bad_row, const char *bad_col,
+                    matmul_verify_t *v) {
+    const int T = v->tile;
+    const int tiles_m = CEIL_DIV(job->m, T), tiles_n = CEIL_DIV(job->n, T);
+    long *count = calloc((long)tiles_m * tiles_n, sizeof(long));
+    if (!count) return -1;
+    const int recheck = (long)v->bad_rows * v->bad_cols <= (long)job->m + job->n;
+    const double g = gamma_n(2.0 * job->k + 1);
+    v->rechecked = 0;
+    v->bad_elems = 0;
+    for (int i = 0; i < job->m; i++) {
+        if (!bad_row[i]) continue;
+        const double *a = job->A + i * job->rsa;
+        for (int j = 0; j < job->n; j++) {
+            if (!bad_col[j]) continue;
+            int wrong = 1;
+            if (recheck) {
+                double dot = 0.0, abs_dot = 0.0;
+                for (int l = 0; l < job->k; l++) {
+                    const double p = a[l * job->csa] * job->B[l * job->rsb + j * job->csb];
+                    dot += p;
+                    abs_dot += fabs(p);
+                }
+                wrong = !(fabs(job->C[(long)i * job->ldc + j] - dot) <= g * abs_dot);
+                v->rechecked++;
+            }
+            if (!wrong) continue;
+            v->bad_elems++;
+            count[(long)(i / T) * tiles_n + j / T]++;
+        }
+    }
+    v->bad_tiles = 0;
+    v->worst_count = 0;
+    for (long t = 0; t < (long)tiles_m * tiles_n; t++) {
+        if (count[t] == 0) continue;
+        v->bad_tiles++;
+        if (count[t] > v->worst_count) {
+            v->worst_count = count[t];
+            v->worst_ti = (int)(t / tiles_n);
+            v->worst_tj = (int)(t % tiles_n);
+        }
+    }
+    free(count);
+    return 0;
+}
+
+int matmul_verify(int m, int n, int k, const double *A, long rsa, long csa,
+                  const double *B, long rsb, long csb, const double *C, int ldc,
+                  int vectors, unsigned seed, struct threadpool *pool, matmul_verify_t *v) {
+    memset(v, 0, sizeof(*v));
+    v->first_row = v->first_col = v->worst_ti = v->worst_tj = -1;
+    v->tile = MATMUL_VERIFY_TILE;
+    if (m < 1 || n < 1 || k < 1 || vectors < 1 || vectors > MATMUL_VERIFY_MAX_VECTORS) return -1;
+    v->vectors = vectors;
+
+    const int ld = CEIL_DIV(vectors, GROUP) * GROUP;
+    verify_job_t job = {m, n, k, vectors, ld, A, rsa, csa, B, rsb, csb, C, ldc,
+                        NULL, NULL, NULL, NULL, gamma_n(2.0 * k + n + 1), gamma_n(n)};
+    double *R = malloc((long)n * ld * sizeof(double));
+    job.BR = malloc((long)k * ld * sizeof(double));
+    job.absB = malloc(k * sizeof(double));
+    job.ratio = malloc(m * sizeof(double));
+    char *bad_row = calloc(m, 1), *bad_col = calloc(n, 1);
+    int result = -1;
+    if (!R || !job.BR || !job.absB || !job.ratio || !bad_row || !bad_col) goto done;
+    fill_vectors(R, (long)n * ld, seed);
+    for (long j = 0; j < n; j++)
+        for (int v = vectors; v < ld; v++) R[j * ld + v] = 0.0;
+    job.R = R;
+
+    run_tasks(pool, CEIL_DIV(k, ROWS_PER_TASK), b_pass_task, &job);
+    run_tasks(pool, CEIL_DIV(m, ROWS_PER_TASK), ac_pass_task, &job);
+
+    for (int i = 0; i < m; i++) {
+        if (job.ratio[i] > v->worst) v->worst = job.ratio[i];
+        if (job.ratio[i] <= 1.0) continue;
+        bad_row[i] = 1;
+        if (v->bad_rows++ == 0) v->first_row = i;
+    }
+    v->passed = v->bad_rows == 0;
+    if (!v->passed) {
+        v->bad_cols = find_bad_columns(&job, seed ^ 0x5bd1e995ULL, bad_col);
+        if (v->bad_cols < 0) goto done;
+        for (int j = 0; j < n && v->first_col < 0; j++)
+            if (bad_col[j]) v->first_col = j;
+        if (localize(&job, bad_row, bad_col, v) != 0) goto done;
+    }
+    result = v->passed;
+done:
+    free(R); free(job.BR); free(job.absB); free(job.ratio);
+    free(bad_row); free(bad_col);
+    return result;
+}
+
+void matmul_verify_print(FILE *f, const matmul_verify_t *v) {
+    if (v->passed) {
+        fprintf(f, "passed (%d vectors, worst residual %.1e of the bound)\n", v->vectors, v->worst);
+        return;
+    }
+    fprintf(f, "FAILED: %d row(s) from %d, %d column(s) from %d", v->bad_rows, v->first_row,
+            v->bad_cols, v->first_col);
+    if (v->bad_tiles > 0) {
+        const int T = v->tile;
+        fprintf(f, "; %ld %s element(s) in %ld %dx%d tile(s), most in rows %d-%d, columns %d-%d",
+                v->bad_elems, v->rechecked ? "wrong" : "suspect", v->bad_tiles, T, T,
+                v->worst_ti * T, v->worst_ti * T + T - 1, v->worst_tj * T, v->worst_tj * T + T - 1);
+    }
+    fprintf(f, "\n");
+}
@@ -0,0 +1,191 @@
+/*
+ * Exercise 4: Runtime-Sized Matrix Type
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "matrix.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATRIX_X86
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define CONVERT_BLOCK 8      // Conversion unit; never straddles a tile
+
+long matrix_storage(const matrix_t *M) {
+    if (matrix_is_tiled(M)) {
+        // Tile indices grow with both coordinates, so the last tile is
+        // the highest one (Morton leaves holes for non-square grids)
+        const int T = M->ld;
+        const int tr = (M->rows + T - 1) / T, tc = (M->cols + T - 1) / T;
+        return (matrix_tile_index(M, tr - 1, tc - 1) + 1) * T * T;
+    }
+    return (long)M->ld * (M->layout == MATRIX_ROW_MAJOR ? M->rows : M->cols);
+}
+
+int matrix_alloc(matrix_t *M, int rows, int cols, matrix_layout_t layout, int ld) {
+    if (rows <= 0 || cols <= 0 || layout < 0 || layout >= MATRIX_NUM_LAYOUTS) return -1;
+    M->rows = rows;
+    M->cols = cols;
+    M->layout = layout;
+    M->owns_data = 1;
+
+    if (layout == MATRIX_TILED || layout == MATRIX_MORTON) {
+        if (ld == 0) ld = MATRIX_DEFAULT_TILE;
+        if (ld % CONVERT_BLOCK != 0) return -1;
+    } else {
+        const int inner = (layout == MATRIX_ROW_MAJOR) ? cols : rows;
+        if (ld == 0) ld = inner;
+        if (ld < inner) return -1;
+    }
+    M->ld = ld;
+
+    // aligned_alloc needs a size that is a multiple of the alignment
+    size_t bytes = sizeof(double) * (size_t)matrix_storage(M);
+    bytes = (bytes + 63) / 64 * 64;
+
+    M->data = aligned_alloc(64, bytes);
+    if (!M->data) return -1;
+    if (matrix_is_tiled(M)) memset(M->data, 0, bytes);
+    return 0;
+}
+
+void matrix_free(matrix_t *M) {
+    if (M->owns_data) free(M->data);
+    M->data = NULL;
+    M->owns_data = 0;
+}
+
+matrix_t matrix_view(const matrix_t *M, int i, int j, int rows, int cols) {
+    matrix_t V = *M;
+    V.data = matrix_at(M, i, j);
+    V.rows = rows;
+    V.cols = cols;
+    V.owns_data = 0;
+    return V;
+}
+
+matrix_t matrix_transpose_view(const matrix_t *M) {
+    matrix_t T = *M;
+    T.rows = M->cols;
+    T.cols = M->rows;
+    T.layout = (M->layout == MATRIX_ROW_MAJOR) ? MATRIX_COL_MAJOR : MATRIX_ROW_MAJOR;
+    T.owns_data = 0;
+    return T;
+}
+
+void matrix_fill_random(matrix_t *M, unsigned seed) {
+    unsigned long long state = seed;
+    for (int i = 0; i < M->rows; i++)
+        for (int j = 0; j < M->cols; j++) *matrix_at(M, i, j) = matrix_random_next(&state);
+}
+
+void matrix_fill_zero(matrix_t *M) {
+    if (matrix_is_tiled(M)) {
+        memset(M->data, 0, sizeof(double) * matrix_storage(M));
+        return;
+    }
+    const int outer = (M->layout == MATRIX_ROW_MAJOR) ? M->rows : M->cols;
+    const int inner = (M->layout == MATRIX_ROW_MAJOR) ? M->cols : M->rows;
+    for (int o = 0; o < outer; o++) {
+        memset(M->data + (long)o * M->ld, 0, sizeof(double) * inner);
+    }
+}
+
+// ============================================================================
+// Layout conversion
+// ============================================================================
+
+// Full 8 x 8 block, same orientation: d[r * dld + c] = s[r * sld + c]
+static void copy8x8(const double *restrict s, long sld, double *restrict d, long dld) {
+    for (int r = 0; r < 8; r++) {
+        for (int c = 0; c < 8; c++) d[r * dld + c] = s[r * sld + c];
+    }
+}
+
+static void transpose8x8_scalar(const double *restrict s, long sld,
+                                double *restrict d, long dld) {
+    for (int r = 0; r < 8; r++) {
+        for (int c = 0; c < 8; c++) d[c * dld + r] = s[r * sld + c];
+    }
+}
+
+#ifdef MATRIX_X86
+// Four 4 x 4 in-register transposes: unpack pairs, then swap 128-bit lanes
+__attribute__((target("avx2")))
+static void transpose8x8_avx2(const double *restrict s, long sld,
+                              double *restrict d, long dld) {
+    for (int bi = 0; bi < 8; bi += 4) {
+        for (int bj = 0; bj < 8; bj += 4) {
+            const double *sp = s + bi * sld + bj;
+            __m256d r0 = _mm256_loadu_pd(sp);
+            __m256d r1 = _mm256_loadu_pd(sp + sld);
+            __m256d r2 = _mm256_loadu_pd(sp + 2 * sld);
+            __m256d r3 = _mm256_loadu_pd(sp + 3 * sld);
+            __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+            __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+            __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+            __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+            double *dp = d + bj * dld + bi;
+            _mm256_storeu_pd(dp, _mm256_permute2f128_pd(t0, t2, 0x20));
+            _mm256_storeu_pd(dp + dld, _mm256_permute2f128_pd(t1, t3, 0x20));
+            _mm256_storeu_pd(dp + 2 * dld, _mm256_permute2f128_pd(t0, t2, 0x31));
+            _mm256_storeu_pd(dp + 3 * dld, _mm256_permute2f128_pd(t1, t3, 0x31));
+        }
+    }
+}
+#endif
+
+typedef void (*transpose_fn)(const double *restrict, long, double *restrict, long);
+
+static transpose_fn select_transpose(void) {
+#ifdef MATRIX_X86
+    if (__builtin_cpu_supports("avx2")) return transpose8x8_avx2;
+#endif
+    return transpose8x8_scalar;
+}
+
+int matrix_convert(matrix_t *dst, const matrix_t *src) {
+    if (dst->rows != src->rows || dst->cols != src->cols) return -1;
+    const transpose_fn transpose = select_transpose();
+    const int m = src->rows, n = src->cols;
+    const long srs = matrix_rs(src), scs = matrix_cs(src);
+    const long drs = matrix_rs(dst), dcs = matrix_cs(dst);
+
+    // Blocks are 8-aligned and tiles are multiples of 8, so the in-tile
+    // strides hold across a whole block
+    for (int i0 = 0; i0 < m; i0 += CONVERT_BLOCK) {
+        const int mb = MIN(CONVERT_BLOCK, m - i0);
+        for (int j0 = 0; j0 < n; j0 += CONVERT_BLOCK) {
+            const int nb = MIN(CONVERT_BLOCK, n - j0);
+            const double *s = matrix_at(src, i0, j0);
+            double *d = matrix_at(dst, i0, j0);
+
+            if (mb < CONVERT_BLOCK || nb < CONVERT_BLOCK) {
+                for (int i = 0; i < mb; i++)
+                    for (int j = 0; j < nb; j++) d[i * drs + j * dcs] = s[i * srs + j * scs];
+            } else if (scs == 1 && dcs == 1) {
+                copy8x8(s, srs, d, drs);
+            } else if (srs == 1 && drs == 1) {
+                copy8x8(s, scs, d, dcs);         // Both column-major
+            } else if (scs == 1) {
+                transpose(s, srs, d, dcs);       // Rows of src -> columns of dst
+            } else {
+                transpose(s, scs, d, drs);       // Columns of src -> rows of dst
+            }
+        }
+    }
+    return 0;
+}
+
+const char *matrix_layout_name(matrix_layout_t layout) {
+    static const char *names[MATRIX_NUM_LAYOUTS] = {"row", "col", "tiled", "morton"};
+    return (layout >= 0 && layout < MATRIX_NUM_LAYOUTS) ? names[layout] : "?";
+}
@@ -0,0 +1,114 @@
+/*
+ * Exercise 4: Runtime-Sized Matrix Type
+ *
+ * Heap-allocated rows x cols double matrix in row- or column-major order
+ * with an explicit leading dimension (ld >= cols for row-major, ld >= rows
+ * for column-major), so sub-matrices and padded storage are views on the
+ * same buffer. Element (i, j) lives at data[i * rs + j * cs], where the
+ * row/column strides (rs, cs) are (ld, 1) or (1, ld).
+ *
+ * The two tiled layouts store T x T row-major tiles contiguously, with
+ * ld holding the tile edge T (a multiple of 8). Block-major puts the tiles
+ * in row-major tile order; Morton puts them in Z-order (tile row and
+ * column bits interleaved), so any aligned 2^j x 2^j group of tiles is
+ * one contiguous range. Edge tiles are padded to T x T. Within a tile,
+ * (rs, cs) = (T, 1); views and transposes exist for row/column-major only.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef MATRIX_H
+#define MATRIX_H
+
+typedef enum {
+    MATRIX_ROW_MAJOR,
+    MATRIX_COL_MAJOR,
+    MATRIX_TILED,            // Block-major: tiles in row-major tile order
+    MATRIX_MORTON,           // Tiles in Z-order
+    MATRIX_NUM_LAYOUTS
+} matrix_layout_t;
+
+#define MATRIX_DEFAULT_TILE 128
+
+typedef struct {
+    int rows, cols;
+    int ld;                  // Elements between consecutive rows (columns),
+                             // or the tile edge for the tiled layouts
+    matrix_layout_t layout;
+    double *data;
+    int owns_data;           // 0 for views
+} matrix_t;
+
+// Allocate a 64-byte aligned matrix; ld = 0 means tightly packed (or
+// MATRIX_DEFAULT_TILE for the tiled layouts, whose padding is zeroed).
+// Returns 0 on success, -1 on invalid arguments or allocation failure.
+int matrix_alloc(matrix_t *M, int rows, int cols, matrix_layout_t layout, int ld);
+void matrix_free(matrix_t *M);
+
+static inline int matrix_is_tiled(const matrix_t *M) {
+    return M->layout == MATRIX_TILED || M->layout == MATRIX_MORTON;
+}
+
+// Row/column strides; for the tiled layouts only valid inside one tile
+static inline long matrix_rs(const matrix_t *M) {
+    return M->layout == MATRIX_COL_MAJOR ? 1 : M->ld;
+}
+
+static inline long matrix_cs(const matrix_t *M) {
+    return M->layout == MATRIX_COL_MAJOR ? M->ld : 1;
+}
+
+// Spread the low 32 bits of x to the even bit positions
+static inline unsigned long long matrix_morton_spread(unsigned x) {
+    unsigned long long v = x;
+    v = (v | v << 16) & 0x0000ffff0000ffffULL;
+    v = (v | v << 8) & 0x00ff00ff00ff00ffULL;
+    v = (v | v << 4) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | v << 2) & 0x3333333333333333ULL;
+    v = (v | v << 1) & 0x5555555555555555ULL;
+    return v;
+}
+
+// Index of tile (ti, tj) in storage order
+static inline long matrix_tile_index(const matrix_t *M, int ti, int tj) {
+    if (M->layout == MATRIX_MORTON)
+        return (long)(matrix_morton_spread(ti) << 1 | matrix_morton_spread(tj));
+    return (long)ti * ((M->cols + M->ld - 1) / M->ld) + tj;
+}
+
+static inline double *matrix_at(const matrix_t *M, int i, int j) {
+    if (!matrix_is_tiled(M)) return M->data + i * matrix_rs(M) + j * matrix_cs(M);
+    const int T = M->ld;
+    return M->data + matrix_tile_index(M, i / T, j / T) * T * T + (i % T) * T + j % T;
+}
+
+// Number of doubles backing M (including tile padding)
+long matrix_storage(const matrix_t *M);
+
+// rows x cols window starting at (i, j), sharing storage with M
+matrix_t matrix_view(const matrix_t *M, int i, int j, int rows, int cols);
+
+// M^T without copying: swap the extents and flip the layout
+matrix_t matrix_transpose_view(const matrix_t *M);
+
+// Next value of a 64-bit LCG stream, uniform in [-0.5, 0.5) with a full
+// 53-bit mantissa: with short dyadic inputs every product and partial sum
+// is exact and no error check could catch a wrong summation order
+static inline double matrix_random_next(unsigned long long *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double)(*state >> 11) / 9007199254740992.0 - 0.5;
+}
+
+// matrix_random_next() values in row order, reproducible from seed
+void matrix_fill_random(matrix_t *M, unsigned seed);
+void matrix_fill_zero(matrix_t *M);
+
+// Copy src into dst of the same shape, converting between any two
+// layouts (8 x 8 blocks, SIMD transposes when the orientation flips).
+// Returns -1 if the shapes differ.
+int matrix_convert(matrix_t *dst, const matrix_t *src);
+
+const char *matrix_layout_name(matrix_layout_t layout);
+
+#endif // MATRIX_H
@@ -0,0 +1,509 @@
+/*
+ * Exercise 4: Sparse Matrices (CSR / BSR) - conversion and kernels
+ *
+ * SpMM walks one row (block row) of A at a time and keeps a 32-column
+ * panel of the C row(s) in registers while it streams the matching rows
+ * of B, so every stored nonzero costs one broadcast and four vector FMAs.
+ * CSR SpMV gathers x with VGATHERDPD (AVX2 / AVX-512); BSR SpMV needs no
+ * gather, each block column is a contiguous vector times one x entry.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sparse.h"
+#include "matmul.h"
+#include "threadpool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPARSE_X86 1
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define CEIL_DIV(a, b) (((a) + (b) - 1) / (b))
+
+#define PANEL 32                // Columns of C held in registers by SpMM
+#define TASKS_PER_THREAD 4
+#define MAX_TASKS 1024
+
+typedef double panel_vec __attribute__((vector_size(8 * sizeof(double))));
+
+// ============================================================================
+// Conversion
+// ============================================================================
+
+// Row i of A: a pointer into A for row-major storage, else copied to buf
+static const double *dense_row(const matrix_t *A, int i, double *buf) {
+    if (A->layout == MATRIX_ROW_MAJOR) return A->data + (long)i * A->ld;
+    for (int j = 0; j < A->cols; j++) buf[j] = *matrix_at(A, i, j);
+    return buf;
+}
+
+void sparse_csr_free(sparse_csr_t *S) {
+    free(S->row_ptr);
+    free(S->col_idx);
+    free(S->val);
+    memset(S, 0, sizeof(*S));
+}
+
+void sparse_bsr_free(sparse_bsr_t *S) {
+    free(S->row_ptr);
+    free(S->col_idx);
+    free(S->val);
+    memset(S, 0, sizeof(*S));
+}
+
+int sparse_csr_from_dense(sparse_csr_t *S, const matrix_t *A) {
+    memset(S, 0, sizeof(*S));
+    if (A->rows < 1 || A->cols < 1) return -1;
+    double *buf = malloc(sizeof(double) * A->cols);
+    S->row_ptr = malloc(sizeof(long) * (A->rows + 1));
+    if (!buf || !S->row_ptr) goto fail;
+    S->rows = A->rows;
+    S->cols = A->cols;
+
+    S->row_ptr[0] = 0;
+    for (int i = 0; i < A->rows; i++) {
+        const double *row = dense_row(A, i, buf);
+        long count = 0;
+        for (int j = 0; j < A->cols; j++) count += row[j] != 0.0;
+        S->row_ptr[i + 1] = S->row_ptr[i] + count;
+    }
+    S->nnz = S->row_ptr[A->rows];
+    S->col_idx = malloc(sizeof(int) * (S->nnz + 1));
+    S->val = malloc(sizeof(double) * (S->nnz + 1));
+    if (!S->col_idx || !S->val) goto fail;
+
+    for (int i = 0; i < A->rows; i++) {
+        const double *row = dense_row(A, i, buf);
+        long p = S->row_ptr[i];
+        for (int j = 0; j < A->cols; j++) {
+            if (row[j] != 0.0) {
+                S->col_idx[p] = j;
+                S->val[p++] = row[j];
+            }
+        }
+    }
+    free(buf);
+    return 0;
+
+fail:
+    free(buf);
+    sparse_csr_free(S);
+    return -1;
+}
+
+// Copy block row I of A into rows (b x cols, zero-padded past A->rows)
+static void load_block_row(const matrix_t *A, int I, int b, double *rows, double *buf) {
+    for (int r = 0; r < b; r++) {
+        const int i = I * b + r;
+        if (i < A->rows) memcpy(rows + (long)r * A->cols, dense_row(A, i, buf), sizeof(double) * A->cols);
+        else             memset(rows + (long)r * A->cols, 0, sizeof(double) * A->cols);
+    }
+}
+
+static int block_nonzero(const double *rows, int cols, int b, int J) {
+    const int cb = MIN(b, cols - J * b);
+    for (int r = 0; r < b; r++)
+        for (int c = 0; c < cb; c++)
+            if (rows[(long)r * cols + J * b + c] != 0.0) return 1;
+    return 0;
+}
+
+int sparse_bsr_from_dense(sparse_bsr_t *S, const matrix_t *A, int block) {
+    memset(S, 0, sizeof(*S));
+    if (A->rows < 1 || A->cols < 1 || block < 1 || block > SPARSE_MAX_BLOCK) return -1;
+    const int b = block, cols = A->cols;
+    S->rows = A->rows;
+    S->cols = cols;
+    S->block = b;
+    S->brows = CEIL_DIV(A->rows, b);
+    S->bcols = CEIL_DIV(cols, b);
+
+    double *buf = malloc(sizeof(double) * cols);
+    double *rows = malloc(sizeof(double) * b * cols);
+    S->row_ptr = malloc(sizeof(long) * (S->brows + 1));
+    if (!buf || !rows || !S->row_ptr) goto fail;
+
+    S->row_ptr[0] = 0;
+    for (int I = 0; I < S->brows; I++) {
+        load_block_row(A, I, b, rows, buf);
+        long count = 0;
+        for (int J = 0; J < S->bcols; J++) count += block_nonzero(rows, cols, b, J);
+        S->row_ptr[I + 1] = S->row_ptr[I] + count;
+    }
+    S->nnzb = S->row_ptr[S->brows];
+    const size_t val_bytes = sizeof(double) * (S->nnzb * b * b + 8);
+    S->col_idx = malloc(sizeof(int) * (S->nnzb + 1));
+    S->val = aligned_alloc(64, (val_bytes + 63) / 64 * 64);
+    if (!S->col_idx || !S->val) goto fail;
+
+    for (int I = 0; I < S->brows; I++) {
+        load_block_row(A, I, b, rows, buf);
+        long p = S->row_ptr[I];
+        for (int J = 0; J < S->bcols; J++) {
+            if (!block_nonzero(rows, cols, b, J)) continue;
+            double *blk = S->val + p * b * b;
+            for (int c = 0; c < b; c++) {
+                const int j = J * b + c;
+                for (int r = 0; r < b; r++) blk[c * b + r] = j < cols ? rows[(long)r * cols + j] : 0.0;
+            }
+            S->col_idx[p++] = J;
+        }
+    }
+    free(buf);
+    free(rows);
+    return 0;
+
+fail:
+    free(buf);
+    free(rows);
+    sparse_bsr_free(S);
+    return -1;
+}
+
+// ============================================================================
+// Kernels (rows / block rows [r0, r1))
+// ============================================================================
+
+static void csr_spmv_generic(const sparse_csr_t *A, const double *restrict x,
+                             double *restrict y, int r0, int r1) {
+    for (int i = r0; i < r1; i++) {
+        const long p1 = A->row_ptr[i + 1];
+        long p = A->row_ptr[i];
+        double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+        for (; p + 4 <= p1; p += 4) {
+            s0 += A->val[p] * x[A->col_idx[p]];
+            s1 += A->val[p + 1] * x[A->col_idx[p + 1]];
+            s2 += A->val[p + 2] * x[A->col_idx[p + 2]];
+            s3 += A->val[p + 3] * x[A->col_idx[p + 3]];
+        }
+        for (; p < p1; p++) s0 += A->val[p] * x[A->col_idx[p]];
+        y[i] = (s0 + s1) + (s2 + s3);
+    }
+}
+
+#ifdef SPARSE_X86
+__attribute__((target("avx2,fma")))
+static void csr_spmv_avx2(const sparse_csr_t *A, const double *restrict x,
+                          double *restrict y, int r0, int r1) {
+    for (int i = r0; i < r1; i++) {
+        const long p1 = A->row_ptr[i + 1];
+        long p = A->row_ptr[i];
+        __m256d acc = _mm256_setzero_pd();
+        for (; p + 4 <= p1; p += 4) {
+            const __m128i idx = _mm_loadu_si128((const __m128i *)(A->col_idx + p));
+            acc = _mm256_fmadd_pd(_mm256_loadu_pd(A->val + p), _mm256_i32gather_pd(x, idx, 8), acc);
+        }
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+        double sum = _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+        for (; p < p1; p++) sum += A->val[p] * x[A->col_idx[p]];
+        y[i] = sum;
+    }
+}
+
+__attribute__((target("avx512f")))
+static void csr_spmv_avx512(const sparse_csr_t *A, const double *restrict x,
+                            double *restrict y, int r0, int r1) {
+    for (int i = r0; i < r1; i++) {
+        const long p1 = A->row_ptr[i + 1];
+        long p = A->row_ptr[i];
+        __m512d acc = _mm512_setzero_pd();
+        for (; p + 8 <= p1; p += 8) {
+            const __m256i idx = _mm256_loadu_si256((const __m256i *)(A->col_idx + p));
+            acc = _mm512_fmadd_pd(_mm512_loadu_pd(A->val + p), _mm512_i32gather_pd(idx, x, 8), acc);
+        }
+        if (p < p1) {
+            const __mmask8 k = (__mmask8)((1u << (p1 - p)) - 1u);
+            const __m256i idx = _mm512_castsi512_si256(_mm512_maskz_loadu_epi32(k, A->col_idx + p));
+            const __m512d xv = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), k, idx, x, 8);
+            acc = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(k, A->val + p), xv, acc);
+        }
+        y[i] = _mm512_reduce_add_pd(acc);
+    }
+}
+#endif
+
+// The bodies below are force-inlined into one wrapper per ISA, so each
+// is compiled for that target; the block edge is a compile-time constant
+// for the common BSR sizes.
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
+// SpMM: for each row of C, PANEL columns at a time stay in four vectors
+// while the rows of B selected by the nonzeros stream past. The column
+// tail (n % PANEL) goes through a scalar panel of the same shape.
+ALWAYS_INLINE void csr_spmm_rows(const sparse_csr_t *A, int n, const double *restrict B,
+                                 int ldb, double *restrict C, int ldc, int r0, int r1) {
+    for (int i = r0; i < r1; i++) {
+        const long p0 = A->row_ptr[i], p1 = A->row_ptr[i + 1];
+        double *ci = C + (long)i * ldc;
+        int j0 = 0;
+        for (; j0 + PANEL <= n; j0 += PANEL) {
+            panel_vec c0 = {0}, c1 = {0}, c2 = {0}, c3 = {0}, b[4];
+            for (long p = p0; p < p1; p++) {
+                memcpy(b, B + (long)A->col_idx[p] * ldb + j0, sizeof(b));
+                const double v = A->val[p];
+                c0 += v * b[0]; c1 += v * b[1];
+                c2 += v * b[2]; c3 += v * b[3];
+            }
+            memcpy(ci + j0, &c0, sizeof(c0));
+            memcpy(ci + j0 + 8, &c1, sizeof(c1));
+            memcpy(ci + j0 + 16, &c2, sizeof(c2));
+            memcpy(ci + j0 + 24, &c3, sizeof(c3));
+        }
+        if (j0 < n) {
+            const int w = n - j0;
+            double acc[PANEL] = {0};
+            for (long p = p0; p < p1; p++) {
+                const double *b = B + (long)A->col_idx[p] * ldb + j0;
+                const double v = A->val[p];
+                for (int j = 0; j < w; j++) acc[j] += v * b[j];
+            }
+            memcpy(ci + j0, acc, sizeof(double) * w);
+        }
+    }
+}
+
+// BSR SpMM: the same panels for a group of rows of the block row (four
+// when bs is a multiple of 4), so each row of B a block touches is loaded
+// once per group and feeds up to 16 vector FMAs
+ALWAYS_INLINE void bsr_spmm_rows(const sparse_bsr_t *A, int n, const double *restrict B,
+                                 int ldb, double *restrict C, int ldc, int r0, int r1,
+                                 const int bs) {
+    const int rg = bs % 4 == 0 ? 4 : 1;
+    for (int I = r0; I < r1; I++) {
+        const long p0 = A->row_ptr[I], p1 = A->row_ptr[I + 1];
+        const int rb = MIN(bs, A->rows - I * bs);
+        for (int r = 0; r < rb; r += rg) {
+            const int rows = MIN(rg, rb - r);
+            double *ci = C + (long)(I * bs + r) * ldc;
+            int j0 = 0;
+            for (; j0 + PANEL <= n; j0 += PANEL) {
+                panel_vec acc[4][4] = {{{0}}}, b[4];
+                for (long p = p0; p < p1; p++) {
+                    const int col0 = A->col_idx[p] * bs;
+                    const int cb = MIN(bs, A->cols - col0);
+                    const double *blk = A->val + p * bs * bs + r;
+                    for (int c = 0; c < cb; c++) {
+                        memcpy(b, B + (long)(col0 + c) * ldb + j0, sizeof(b));
+                        for (int q = 0; q < rg; q++) {
+                            const double v = blk[c * bs + q];
+                            acc[q][0] += v * b[0]; acc[q][1] += v * b[1];
+                            acc[q][2] += v * b[2]; acc[q][3] += v * b[3];
+                        }
+                    }
+                }
+                for (int q = 0; q < rows; q++) memcpy(ci + (long)q * ldc + j0, acc[q], sizeof(acc[q]));
+            }
+            if (j0 < n) {
+                const int w = n - j0;
+                double acc[4][PANEL] = {{0}};
+                for (long p = p0; p < p1; p++) {
+                    const int col0 = A->col_idx[p] * bs;
+                    const int cb = MIN(bs, A->cols - col0);
+                    const double *blk = A->val + p * bs * bs + r;
+                    for (int c = 0; c < cb; c++) {
+                        const double *b = B + (long)(col0 + c) * ldb + j0;
+                        for (int q = 0; q < rg; q++) {
+                            const double v = blk[c * bs + q];
+                            for (int j = 0; j < w; j++) acc[q][j] += v * b[j];
+                        }
+                    }
+                }
+                for (int q = 0; q < rows; q++) memcpy(ci + (long)q * ldc + j0, acc[q], sizeof(double) * w);
+            }
+        }
+    }
+}
+
+// BSR SpMV: a block column is bs contiguous rows times one x entry
+ALWAYS_INLINE void bsr_spmv_rows(const sparse_bsr_t *A, const double *restrict x,
+                                 double *restrict y, int r0, int r1, const int bs) {
+    for (int I = r0; I < r1; I++) {
+        double acc[SPARSE_MAX_BLOCK] = {0};
+        for (long p = A->row_ptr[I]; p < A->row_ptr[I + 1]; p++) {
+            const int col0 = A->col_idx[p] * bs;
+            const double *blk = A->val + p * bs * bs;
+            if (col0 + bs <= A->cols) {
+                for (int c = 0; c < bs; c++)
+                    for (int r = 0; r < bs; r++) acc[r] += blk[c * bs + r] * x[col0 + c];
+            } else {
+                for (int c = 0; c < A->cols - col0; c++)
+                    for (int r = 0; r < bs; r++) acc[r] += blk[c * bs + r] * x[col0 + c];
+            }
+        }
+        const int rb = MIN(bs, A->rows - I * bs);
+        for (int r = 0; r < rb; r++) y[I * bs + r] = acc[r];
+    }
+}
+
+#define SPARSE_BLOCK_SWITCH(bs, CALL)                                          \
+    switch (bs) {                                                              \
+        case 2:  CALL(2); break;                                               \
+        case 4:  CALL(4); break;                                               \
+        case 8:  CALL(8); break;                                               \
+        default: CALL(bs); break;                                              \
+    }
+
+#define SPARSE_KERNELS(ISA, TARGET)                                            \
+TARGET static void csr_spmm_##ISA(const sparse_csr_t *A, int n, const double *B, \
+                                  int ldb, double *C, int ldc, int r0, int r1) { \
+    csr_spmm_rows(A, n, B, ldb, C, ldc, r0, r1);                               \
+}                                                                              \
+TARGET static void bsr_spmm_##ISA(const sparse_bsr_t *A, int n, const double *B, \
+                                  int ldb, double *C, int ldc, int r0, int r1) { \
+    const int bs = A->block;                                                   \
+    SPARSE_BLOCK_SWITCH(bs, BSR_SPMM_CALL)                                     \
+}                                                                              \
+TARGET static void bsr_spmv_##ISA(const sparse_bsr_t *A, const double *x,      \
+                                  double *y, int r0, int r1) {                 \
+    const int bs = A->block;                                                   \
+    SPARSE_BLOCK_SWITCH(bs, BSR_SPMV_CALL)                                     \
+}
+
+#define BSR_SPMM_CALL(B_) bsr_spmm_rows(A, n, B, ldb, C, ldc, r0, r1, B_)
+#define BSR_SPMV_CALL(B_) bsr_spmv_rows(A, x, y, r0, r1, B_)
+
+SPARSE_KERNELS(generic, )
+#ifdef SPARSE_X86
+SPARSE_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+SPARSE_KERNELS(avx512, __attribute__((target("avx512f"))))
+#endif
+
+// ============================================================================
+// Kernel selection
+// ============================================================================
+
+typedef struct {
+    const char *name;            // Matches matmul_packed_isa()
+    void (*csr_spmv)(const sparse_csr_t *, const double *, double *, int, int);
+    void (*bsr_spmv)(const sparse_bsr_t *, const double *, double *, int, int);
+    void (*csr_spmm)(const sparse_csr_t *, int, const double *, int, double *, int, int, int);
+    void (*bsr_spmm)(const sparse_bsr_t *, int, const double *, int, double *, int, int, int);
+} sparse_kernel_set_t;
+
+#define SPARSE_KERNEL_SET(ISA) \
+    {#ISA, csr_spmv_##ISA, bsr_spmv_##ISA, csr_spmm_##ISA, bsr_spmm_##ISA}
+
+static const sparse_kernel_set_t kernel_sets[] = {
+#ifdef SPARSE_X86
+    SPARSE_KERNEL_SET(avx512),
+    SPARSE_KERNEL_SET(avx2),
+#endif
+    SPARSE_KERNEL_SET(generic),
+};
+
+#define NUM_SETS ((int)(sizeof(kernel_sets) / sizeof(kernel_sets[0])))
+
+// Same ISA as the packed micro-kernel, so MATMUL_ISA caps both
+static const sparse_kernel_set_t *select_kernels(void) {
+    static const sparse_kernel_set_t *selected = NULL;
+    if (selected) return selected;
+    const char *isa = matmul_packed_isa(NULL, NULL);
+    selected = &kernel_sets[NUM_SETS - 1];
+    for (int i = 0; i < NUM_SETS; i++) {
+        if (strcmp(kernel_sets[i].name, isa) == 0) selected = &kernel_sets[i];
+    }
+    return selected;
+}
+
+const char *sparse_isa(void) {
+    return select_kernels()->name;
+}
+
+// ============================================================================
+// Parallel driver
+// ============================================================================
+
+typedef enum { OP_CSR_SPMV, OP_BSR_SPMV, OP_CSR_SPMM, OP_BSR_SPMM } sparse_op_t;
+
+typedef struct {
+    sparse_op_t op;
+    const sparse_kernel_set_t *ks;
+    const void *A;
+    int n, ldb, ldc;
+    const double *B;             // x for SpMV
+    double *C;                   // y for SpMV
+    int bounds[MAX_TASKS + 1];   // Row (block row) range of each task
+} sparse_job_t;
+
+static void run_range(const sparse_job_t *job, int r0, int r1) {
+    switch (job->op) {
+        case OP_CSR_SPMV: job->ks->csr_spmv(job->A, job->B, job->C, r0, r1); break;
+        case OP_BSR_SPMV: job->ks->bsr_spmv(job->A, job->B, job->C, r0, r1); break;
+        case OP_CSR_SPMM:
+            job->ks->csr_spmm(job->A, job->n, job->B, job->ldb, job->C, job->ldc, r0, r1);
+            break;
+        case OP_BSR_SPMM:
+            job->ks->bsr_spmm(job->A, job->n, job->B, job->ldb, job->C, job->ldc, r0, r1);
+            break;
+    }
+}
+
+static void sparse_task(void *arg, int task, int worker) {
+    const sparse_job_t *job = arg;
+    (void)worker;
+    run_range(job, job->bounds[task], job->bounds[task + 1]);
+}
+
+// Split rows [0, units) into tasks of equal weight, a row weighing its
+// stored entries plus one (empty rows still write their output)
+static int partition(const long *row_ptr, int units, int tasks, int *bounds) {
+    const long total = row_ptr[units] + units;
+    bounds[0] = 0;
+    for (int t = 1; t < tasks; t++) {
+        const long target = total * t / tasks;
+        int lo = bounds[t - 1], hi = units;
+        while (lo < hi) {
+            const int mid = lo + (hi - lo) / 2;
+            if (row_ptr[mid] + mid < target) lo = mid + 1;
+            else hi = mid;
+        }
+        bounds[t] = lo;
+    }
+    bounds[tasks] = units;
+    return tasks;
+}
+
+static void sparse_run(sparse_job_t *job, const long *row_ptr, int units,
+                       struct threadpool *pool) {
+    job->ks = select_kernels();
+    const int threads = pool ? threadpool_size(pool) : 1;
+    if (threads <= 1 || units < 2) {
+        run_range(job, 0, units);
+        return;
+    }
+    const int tasks = partition(row_ptr, units, MIN(MIN(threads * TASKS_PER_THREAD, units), MAX_TASKS),
+                                job->bounds);
+    threadpool_run(pool, tasks, sparse_task, job);
+}
+
+void sparse_csr_spmv(const sparse_csr_t *A, const double *x, double *y,
+                     struct threadpool *pool) {
+    sparse_job_t job = {.op = OP_CSR_SPMV, .A = A, .B = x, .C = y};
+    sparse_run(&job, A->row_ptr, A->rows, pool);
+}
+
+void sparse_bsr_spmv(const sparse_bsr_t *A, const double *x, double *y,
+                     struct threadpool *pool) {
+    sparse_job_t job = {.op = OP_BSR_SPMV, .A = A, .B = x, .C = y};
+    sparse_run(&job, A->row_ptr, A->brows, pool);
+}
+
+void sparse_csr_spmm(const sparse_csr_t *A, int n, const double *B, int ldb,
+                     double *C, int ldc, struct threadpool *pool) {
+    if (n < 1) return;
+    sparse_job_t job = {.op = OP_CSR_SPMM, .A = A, .n = n, .ldb = ldb, .ldc = ldc, .B = B, .C = C};
+    sparse_run(&job, A->row_ptr, A->rows, pool);
+}
+
+void sparse_bsr_spmm(const sparse_bsr_t *A, int n, const double *B, int ldb,
+                     double *C, int ldc, struct threadpool *pool) {
+    if (n < 1) return;
+    sparse_job_t job = {.op = OP_BSR_SPMM, .A = A, .n = n, .ldb = ldb, .ldc = ldc, .B = B, .C = C};
+    sparse_run(&job, A->row_ptr, A->brows, pool);
+}
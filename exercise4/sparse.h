@@ -0,0 +1,70 @@
+/*
+ * Exercise 4: Sparse Matrices (CSR / BSR)
+ *
+ * Compressed sparse row: the nonzeros of row i are val[row_ptr[i] ..
+ * row_ptr[i + 1]) with their columns in col_idx. Blocked CSR (BSR) is the
+ * same structure over b x b blocks: a block is stored whole (zeros
+ * included) as soon as one of its entries is nonzero, column-major inside
+ * the block, so one column of a block is a short contiguous SIMD vector.
+ * Edge blocks are padded with zeros.
+ *
+ * The kernels multiply a sparse A (rows x cols) with a dense vector or a
+ * dense row-major B (cols x n). Rows are split across the thread pool in
+ * chunks of equal nonzero count; SIMD runs across the columns of B (SpMM)
+ * or across the gathered x entries / block rows (SpMV), with the same
+ * runtime ISA as the packed GEMM.
+ *
+ * Author: TP2 Parallel Computing
+ * Date: 2024
+ */
+
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "matrix.h"
+
+struct threadpool;
+
+#define SPARSE_MAX_BLOCK 16
+
+typedef struct {
+    int rows, cols;
+    long nnz;
+    long *row_ptr;           // rows + 1 entries
+    int *col_idx;            // nnz entries
+    double *val;             // nnz entries
+} sparse_csr_t;
+
+typedef struct {
+    int rows, cols;
+    int block;               // Block edge b (1 .. SPARSE_MAX_BLOCK)
+    int brows, bcols;        // Block rows / columns, edges rounded up
+    long nnzb;               // Stored blocks
+    long *row_ptr;           // brows + 1 entries
+    int *col_idx;            // Block column of each stored block
+    double *val;             // nnzb * b * b entries, column-major per block
+} sparse_bsr_t;
+
+// Compress the nonzeros of A (any layout). Return 0 on success, -1 on
+// invalid arguments or allocation failure.
+int sparse_csr_from_dense(sparse_csr_t *S, const matrix_t *A);
+int sparse_bsr_from_dense(sparse_bsr_t *S, const matrix_t *A, int block);
+void sparse_csr_free(sparse_csr_t *S);
+void sparse_bsr_free(sparse_bsr_t *S);
+
+// y = A * x (x has cols entries, y has rows entries); pool may be NULL
+void sparse_csr_spmv(const sparse_csr_t *A, const double *x, double *y,
+                     struct threadpool *pool);
+void sparse_bsr_spmv(const sparse_bsr_t *A, const double *x, double *y,
+                     struct threadpool *pool);
+
+// C = A * B with B (cols x n) and C (rows x n) row-major; pool may be NULL
+void sparse_csr_spmm(const sparse_csr_t *A, int n, const double *B, int ldb,
+                     double *C, int ldc, struct threadpool *pool);
+void sparse_bsr_spmm(const sparse_bsr_t *A, int n, const double *B, int ldb,
+                     double *C, int ldc, struct threadpool *pool);
+
+// Kernel set picked by runtime dispatch (matches matmul_packed_isa())
+const char *sparse_isa(void);
+
+#endif // SPARSE_H
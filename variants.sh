@@ -0,0 +1,159 @@
+#!/bin/bash
+#
+# Build-variant matrix: every benchmark across
+#   compiler      gcc, clang (the ones installed)
+#   optimization  -O2, -O3, -Ofast
+#   target        generic, -march=native
+#   link          plain, LTO, PGO (instrumented build, training run,
+#                 rebuild with the profile)
+# run each variant once and collect the structured results (see
+# common/results.h) into variants.csv, one row per variant and kernel.
+# `python3 analysis.py variants` then ranks the variants per kernel.
+#
+# The matrix can be narrowed through the environment, e.g.
+#   COMPILERS=gcc OPTS="O2 O3" LINKS="plain lto" ./variants.sh
+#
+# Benchmarks: exercise1, exercise1_types, exercise2 and exercise2_manual,
+# exercise3 (phase-profiled at PHASE_N) and exercise4_bench (SIZES).
+# -Ofast implies -ffast-math: its sums are reassociated, so rank it only
+# for kernels where that is acceptable (exercise4_bench still checks its
+# error bound).
+#
+
+cd "$(dirname "$0")"
+
+COMPILERS=${COMPILERS:-"gcc clang"}
+OPTS=${OPTS:-"O2 O3 Ofast"}
+ARCHS=${ARCHS:-"generic native"}
+LINKS=${LINKS:-"plain lto pgo"}
+PHASE_N=${PHASE_N:-10000000}
+SIZES=${SIZES:-512}
+BUILD_DIR=${BUILD_DIR:-bench_build/variants}
+OUTPUT=${OUTPUT:-variants.csv}
+
+ENGINE_SRC=$(make -s -C exercise4 --eval='print-%: ; @echo $($*)' print-ENGINE_SRC)
+ENGINE_SRC=$(for f in $ENGINE_SRC; do printf 'exercise4/%s ' "$f"; done)
+
+echo "=============================================================="
+echo "Build-Variant Matrix"
+echo "=============================================================="
+echo ""
+echo "Compilers:  $COMPILERS"
+echo "Opt levels: $OPTS"
+echo "Targets:    $ARCHS"
+echo "Link modes: $LINKS"
+echo ""
+
+# build CC FLAGS DIR: compile every benchmark into DIR
+build() {
+    local cc=$1 flags=$2 dir=$3
+    mkdir -p "$dir"
+    $cc $flags -Icommon exercise1/exercise1.c -o "$dir/exercise1" &&
+    $cc $flags -Icommon exercise1/exercise1_types.c -o "$dir/exercise1_types" &&
+    $cc $flags exercise2/exercise2.c -o "$dir/exercise2" &&
+    $cc $flags exercise2/exercise2_manual.c -o "$dir/exercise2_manual" &&
+    $cc $flags -Icommon -DPHASE_PROFILE -DN="$PHASE_N" exercise3/exercise3.c -o "$dir/exercise3" &&
+    $cc $flags -Icommon exercise4/exercise4_bench.c $ENGINE_SRC -o "$dir/exercise4_bench" -lm -pthread
+}
+
+# run DIR RESULTS: run every benchmark once, structured results to RESULTS
+run() {
+    local dir=$1 results=$2
+    TP2_RESULTS=$results "$dir/exercise1" > /dev/null &&
+    TP2_RESULTS=$results "$dir/exercise1_types" > /dev/null &&
+    TP2_RESULTS=$results "$dir/exercise3" > /dev/null &&
+    TP2_RESULTS=$results "$dir/exercise4_bench" --sizes "$SIZES" --naive-max "$SIZES" > /dev/null || return 1
+
+    # exercise2 only prints "Time: X seconds"
+    for prog in exercise2 exercise2_manual; do
+        local t
+        t=$("$dir/$prog" | awk '/^Time:/ { print $2 }')
+        [ -n "$t" ] || return 1
+        [ -s "$results" ] || echo "benchmark,kernel,param,metric,value,unit" > "$results"
+        echo "$prog,loop,N=100000000,time,$t,s" >> "$results"
+    done
+}
+
+# PGO training and profile flags of one compiler
+pgo_generate() {
+    case $1 in
+        clang*) echo "-fprofile-instr-generate=$2/%p.profraw" ;;
+        *)      echo "-fprofile-generate -fprofile-dir=$2" ;;
+    esac
+}
+pgo_use() {
+    case $1 in
+        clang*) llvm-profdata merge -o "$2/default.profdata" "$2"/*.profraw &&
+                echo "-fprofile-instr-use=$2/default.profdata -Wno-profile-instr-unprofiled" ;;
+        *)      echo "-fprofile-use -fprofile-dir=$2 -fprofile-correction -Wno-missing-profile" ;;
+    esac
+}
+
+mkdir -p "$BUILD_DIR"
+echo "variant,compiler,opt,target,link,benchmark,kernel,param,metric,value,unit" > "$OUTPUT"
+built=0
+failed=0
+
+for cc in $COMPILERS; do
+    if ! command -v "$cc" > /dev/null 2>&1; then
+        echo "Skipping $cc: not installed"
+        continue
+    fi
+    version=$($cc --version | head -1 | tr ',' ' ')
+    for opt in $OPTS; do
+        for arch in $ARCHS; do
+            for link in $LINKS; do
+                variant="$cc-$opt-$arch-$link"
+                dir="$BUILD_DIR/$variant"
+                flags="-$opt"
+                [ "$arch" = "native" ] && flags="$flags -march=native"
+                case $link in
+                    lto) case $cc in clang*) flags="$flags -flto" ;; *) flags="$flags -flto=auto" ;; esac ;;
+                    pgo) ;;
+                    plain) ;;
+                    *) echo "Unknown link mode $link"; exit 1 ;;
+                esac
+                printf "%-34s " "$variant"
+                rm -rf "$dir" "$dir.log"
+                mkdir -p "$dir"
+                results="$dir/results.csv"
+
+                if [ "$link" = "pgo" ]; then
+                    profile="$PWD/$dir/profile"
+                    mkdir -p "$profile"
+                    if ! build "$cc" "$flags $(pgo_generate "$cc" "$profile")" "$dir" 2> "$dir.log" ||
+                       ! run "$dir" /dev/null 2>> "$dir.log"; then
+                        echo "FAILED (instrumented build, see $dir.log)"
+                        failed=$((failed + 1))
+                        continue
+                    fi
+                    use=$(pgo_use "$cc" "$profile" 2>> "$dir.log") || {
+                        echo "FAILED (profile merge, see $dir.log)"
+                        failed=$((failed + 1))
+                        continue
+                    }
+                    flags="$flags $use"
+                fi
+
+                if ! build "$cc" "$flags" "$dir" 2>> "$dir.log"; then
+                    echo "FAILED (build, see $dir.log)"
+                    failed=$((failed + 1))
+                    continue
+                fi
+                if ! run "$dir" "$PWD/$results" 2>> "$dir.log"; then
+                    echo "FAILED (run, see $dir.log)"
+                    failed=$((failed + 1))
+                    continue
+                fi
+                tail -n +2 "$results" | sed "s|^|$variant,$version,$opt,$arch,$link,|" >> "$OUTPUT"
+                built=$((built + 1))
+                echo "ok ($(( $(wc -l < "$results") - 1 )) results)"
+            done
+        done
+    done
+done
+
+echo ""
+echo "$built variant(s) measured, $failed failed; results in $OUTPUT"
+echo "Ranking: python3 analysis.py variants"
+[ "$built" -gt 0 ]